@@ -1,15 +1,49 @@
 #version 330 core
 #define normalise normalize
-const int NR_DIR_LIGHTS=3;
-const int NR_POINT_LIGHTS=30;
-const int NR_SPOT_LIGHTS=30;
+// Size of the directional light block, this must match graphics::maxDirLights()
+#define MAX_DIR_LIGHTS 3
+// Shininess is kept in the G-buffer as a fraction of this
+#define MAX_SHININESS 1024.0
+// Views per directional light, this must match shadows::getCascadeCount()
+#define SHADOW_CASCADES 4
+// Permutations define the exact amount of lights, otherwise every slot is read
+#ifndef EXACT_LIGHT_COUNTS
+	#define NR_DIR_LIGHTS MAX_DIR_LIGHTS
+#endif
 const float near=0.1;
 const float far=500.0;
 // I/O
+#ifdef DEFERRED
+// The G-buffer, see deferred::target
+layout(location=0)out vec4 FragCol;
+layout(location=1)out vec4 FragMaterial;
+#else
 out vec4 FragCol;
+#endif
+#ifdef DEFERRED_LIGHTING
+// Rebuilt from the G-buffer rather than passed in
+vec3 FragPos;
+vec3 Normal;
+uniform sampler2D u_gAlbedo;
+uniform sampler2D u_gMaterial;
+uniform sampler2D u_gDepth;
+uniform mat4 u_inverseCamera;
+#else
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+#endif
+#ifdef CHECKERBOARD_RESOLVE
+// This frame's half of the columns and the frame resolved before it, see checkerboard
+uniform sampler2D u_cbCurrent;
+uniform sampler2D u_cbDepth;
+uniform sampler2D u_cbHistory;
+// From this frame's clip space to the last frame's, neither with the column offset
+uniform mat4 u_cbReproject;
+// The columns drawn this frame, 0 for even and 1 for odd
+uniform int u_cbParity;
+uniform bool u_cbHistoryValid;
+#endif
 struct Material{
 	float shininess;
 	sampler2D texture_diffuse0;
@@ -24,108 +58,238 @@ struct LightDirectional{
 	LightColour colour;
 	vec4 direction;
 };
-struct LightPoint{
-	LightColour colour;
-	vec4 position;
-	float linear;
-	float quadratic;
-};
-struct LightSpot{
-	LightColour colour;
-	vec4 position;
-	vec4 direction;
-	float linear;
-	float quadratic;
-	float cutoff;
-	float blur;
-};
-uniform bool u_depthBuffer=false;
-uniform bool u_useTextures=false;
-uniform bool u_fullbright=false;
-uniform vec3 u_viewPos;
 uniform vec3 u_colour=vec3(1.0);
 uniform Material u_material;
-uniform LightDirectional[NR_DIR_LIGHTS] u_dirLights;
-uniform LightPoint[NR_POINT_LIGHTS] u_pointLights;
-uniform LightSpot[NR_SPOT_LIGHTS] u_spotLights;
+// Shared by every program, filled once per frame or when lights change
+layout(std140) uniform Camera{
+	mat4 u_camera;
+	vec3 u_viewPos;
+};
+layout(std140) uniform DirLights{
+	LightDirectional u_dirLights[MAX_DIR_LIGHTS];
+};
+// Which cluster a fragment is in, see graphics::updateClusters
+layout(std140) uniform Clusters{
+	vec4 u_depthPlane;
+	vec4 u_clusterScale;
+	uvec4 u_clusterGrid;
+};
+// Point and spot lights as four texels each, see graphics::clusterLight
+uniform samplerBuffer u_lights;
+// Where each cluster's list starts and how long it is
+uniform usamplerBuffer u_clusters;
+// Every cluster's list of lights, one after another
+uniform usamplerBuffer u_clusterLights;
+// Every shadow view as five texels, the matrix into the atlas and then its tile
+uniform samplerBuffer u_shadowViews;
+// Every light's shadow maps as tiles of one texture, see shadows
+uniform sampler2DShadow u_shadowAtlas;
 vec3 m_viewDir;
+vec3 m_diffuseTex=vec3(1.0);
+vec3 m_specularTex=vec3(1.0);
+float m_shininess;
 vec3 PhongShading(LightColour _colour,vec3 _lightDir,float _intensity){
-	// Textures
-	vec3 diffuseTex=vec3(1.0);
-	vec3 specularTex=vec3(1.0);
-	if(u_useTextures){
-		diffuseTex=texture(u_material.texture_diffuse0,TexCoords).rgb;
-		specularTex=texture(u_material.texture_specular0,TexCoords).rgb;
-	}
 	// Diffuse shading
 	float diff=max(dot(Normal,_lightDir),0.0);
 	// Specular shading
 	vec3 reflectDir=reflect(-_lightDir,Normal);
-	float spec=pow(max(dot(m_viewDir,reflectDir),0.0),u_material.shininess);
+	float spec=pow(max(dot(m_viewDir,reflectDir),0.0),m_shininess);
 	// Combine results
-	vec3 ambient=_colour.ambient*diffuseTex;
-	vec3 diffuse=_colour.diffuse*diffuseTex*diff*_intensity;
-	vec3 specular=_colour.specular*specularTex*spec*_intensity;
+	vec3 ambient=_colour.ambient*m_diffuseTex;
+	vec3 diffuse=_colour.diffuse*m_diffuseTex*diff*_intensity;
+	vec3 specular=_colour.specular*m_specularTex*spec*_intensity;
 	return ambient+diffuse+specular;
 }
 float CalculateAttentuation(float _dist,float _linear,float _quadratic){
 	return 1.0/(1.0+_linear*_dist+_quadratic*(_dist*_dist));
 }
+vec3 ShadowCoord(int _view){
+	int base=_view*5;
+	mat4 toAtlas=mat4(texelFetch(u_shadowViews,base),texelFetch(u_shadowViews,base+1),
+		texelFetch(u_shadowViews,base+2),texelFetch(u_shadowViews,base+3));
+	vec4 coord=toAtlas*vec4(FragPos,1.0);
+	return coord.xyz/coord.w;
+}
+bool InsideTile(int _view,vec3 _coord){
+	vec4 tile=texelFetch(u_shadowViews,_view*5+4);
+	return all(greaterThanEqual(_coord.xy,tile.xy))&&all(lessThanEqual(_coord.xy,tile.zw));
+}
+float SampleShadow(int _view,vec3 _coord){
+	// Past the far plane nothing was drawn that could cast a shadow
+	if(_coord.z>=1.0)
+		return 1.0;
+	// Kept to its own tile, the neighbours belong to other views
+	vec4 tile=texelFetch(u_shadowViews,_view*5+4);
+	return texture(u_shadowAtlas,vec3(clamp(_coord.xy,tile.xy,tile.zw),_coord.z));
+}
+float DirectionalShadow(int _first){
+	if(_first<0)
+		return 1.0;
+	// Cascades grow outwards, so the first one around the fragment is the sharpest
+	for(int i=0;i<SHADOW_CASCADES;++i){
+		vec3 coord=ShadowCoord(_first+i);
+		if(InsideTile(_first+i,coord))
+			return SampleShadow(_first+i,coord);
+	}
+	return 1.0;
+}
+int CubeFace(vec3 _dir){
+	vec3 size=abs(_dir);
+	if(size.x>=size.y&&size.x>=size.z)
+		return _dir.x>=0.0?0:1;
+	if(size.y>=size.z)
+		return _dir.y>=0.0?2:3;
+	return _dir.z>=0.0?4:5;
+}
 vec3 CalculateDirectionalLighting(LightDirectional _light){
 	vec3 lightDir=normalise(_light.direction.xyz);
-	return PhongShading(_light.colour,lightDir,1);
+	return PhongShading(_light.colour,lightDir,DirectionalShadow(int(_light.direction.w)));
 }
-vec3 CalculatePointLight(LightPoint _light){
-	// Skip over "dead" lights
-	if(length(_light.linear)==0)
-		return vec3(0);
-	// Point or spotlight
-	vec3 lightDiff=_light.position.xyz-FragPos;
+vec3 CalculateClusteredLight(int _index){
+	vec4 position=texelFetch(u_lights,_index*4);
+	vec4 colour=texelFetch(u_lights,_index*4+1);
+	vec4 direction=texelFetch(u_lights,_index*4+2);
+	vec4 cone=texelFetch(u_lights,_index*4+3);
+	vec3 lightDiff=position.xyz-FragPos;
 	vec3 lightDir=normalise(lightDiff);
 	// Light fading over distance
 	float lightDist=length(lightDiff);
-	float attenuation=CalculateAttentuation(lightDist,_light.linear,_light.quadratic);
-	return PhongShading(_light.colour,lightDir,1)*attenuation;
-}
-vec3 CalculateSpotLight(LightSpot _light){
-	// Skip over "dead" lights
-	if(length(_light.linear)==0)
-		return vec3(0);
-	// Point or spotlight
-	vec3 lightDiff=_light.position.xyz-FragPos;
-	vec3 lightDir=normalise(lightDiff);
-	// Light fading over distance
-	float lightDist=length(lightDiff);
-	float attenuation=CalculateAttentuation(lightDist,_light.linear,_light.quadratic);
-	// Soft edges
+	float attenuation=CalculateAttentuation(lightDist,colour.w,direction.w);
+	// Soft edges, only spotlights have them
 	float intensity=1;
-	float theta=dot(lightDir,normalise(_light.direction.xyz));
-	// l(1-c)+c scales light.blur from 0-1 to light.cutoff-1
-	float epsilon=(_light.blur*(1-_light.cutoff)+_light.cutoff)-_light.cutoff;
-	intensity=clamp((theta-_light.cutoff)/epsilon,0.0,1.0);
-	return PhongShading(_light.colour,lightDir,intensity)*attenuation;
+	if(position.w>0.5){
+		float theta=dot(lightDir,normalise(direction.xyz));
+		// l(1-c)+c scales blur from 0-1 to cutoff-1
+		float epsilon=(cone.y*(1-cone.x)+cone.x)-cone.x;
+		intensity=clamp((theta-cone.x)/epsilon,0.0,1.0);
+	}
+	// Point lights have a view per cube face, spot lights just the one
+	int shadowView=int(cone.z);
+	if(shadowView>=0){
+		if(position.w<0.5)
+			shadowView+=CubeFace(FragPos-position.xyz);
+		intensity*=SampleShadow(shadowView,ShadowCoord(shadowView));
+	}
+	return PhongShading(LightColour(vec3(0.0),colour.rgb,colour.rgb),lightDir,intensity)*attenuation;
+}
+uint ClusterIndex(){
+	// Slices are spaced exponentially, so the log of the depth is linear in them
+	float depth=max(dot(u_depthPlane,vec4(FragPos,1.0)),near);
+	vec3 cell=vec3(gl_FragCoord.xy*u_clusterScale.xy,log(depth)*u_clusterScale.z+u_clusterScale.w);
+	uvec3 clamped=uvec3(clamp(ivec3(cell),ivec3(0),ivec3(u_clusterGrid.xyz)-1));
+	return (clamped.z*u_clusterGrid.y+clamped.y)*u_clusterGrid.x+clamped.x;
+}
+vec2 OctEncode(vec3 _normal){
+	// Onto an octahedron, then the lower half is folded over the upper
+	_normal/=abs(_normal.x)+abs(_normal.y)+abs(_normal.z);
+	vec2 signs=vec2(_normal.x>=0.0?1.0:-1.0,_normal.y>=0.0?1.0:-1.0);
+	vec2 folded=_normal.z>=0.0?_normal.xy:(1.0-abs(_normal.yx))*signs;
+	return folded*0.5+0.5;
+}
+vec3 OctDecode(vec2 _encoded){
+	_encoded=_encoded*2.0-1.0;
+	vec3 normal=vec3(_encoded,1.0-abs(_encoded.x)-abs(_encoded.y));
+	// Unfolds the lower half, the upper half has nothing to undo
+	float fold=max(-normal.z,0.0);
+	normal.xy-=fold*vec2(normal.x>=0.0?1.0:-1.0,normal.y>=0.0?1.0:-1.0);
+	return normalise(normal);
 }
 float LineariseDepth(float pDepth){
 	float z=pDepth*2.0-1.0;	// Back to ndc
 	return (2.0*near*far)/(far+near-z*(far-near));
 }
 void main(){
-	if(u_depthBuffer){
-		//FragCol=vec4(vec3(gl_FragCoord.z),1.0);
-		FragCol=vec4(vec3(LineariseDepth(gl_FragCoord.z)/far),1.0);
-	}else if(u_fullbright){
-		FragCol=vec4(u_colour,1);
-	}else{
-		// Important vectors
-		m_viewDir=normalise(u_viewPos-FragPos);
-		vec3 result;
-		for(int i=0;i<NR_DIR_LIGHTS;++i)
-			result+=CalculateDirectionalLighting(u_dirLights[i]);
-		for(int i=0;i<NR_POINT_LIGHTS;++i)
-			result+=CalculatePointLight(u_pointLights[i]);
-		for(int i=0;i<NR_SPOT_LIGHTS;++i)
-			result+=CalculateSpotLight(u_spotLights[i]);
-		FragCol=vec4(result*u_colour,1);
+#if defined(CHECKERBOARD_RESOLVE)
+	ivec2 pixel=ivec2(gl_FragCoord.xy);
+	ivec2 drawnSize=textureSize(u_cbCurrent,0);
+	// Drawn this frame, so it is taken as it is
+	if((pixel.x&1)==u_cbParity){
+		FragCol=vec4(texelFetch(u_cbCurrent,ivec2(pixel.x>>1,pixel.y),0).rgb,1.0);
+		return;
+	}
+	// The drawn columns either side, clamped at the edges
+	ivec2 left=ivec2(clamp((pixel.x-1)>>1,0,drawnSize.x-1),pixel.y);
+	ivec2 right=ivec2(clamp((pixel.x+1)>>1,0,drawnSize.x-1),pixel.y);
+	vec3 leftCol=texelFetch(u_cbCurrent,left,0).rgb;
+	vec3 rightCol=texelFetch(u_cbCurrent,right,0).rgb;
+	vec3 result=(leftCol+rightCol)*0.5;
+	if(u_cbHistoryValid){
+		// The nearer side's depth, so an edge follows the surface in front of it
+		float depth=min(texelFetch(u_cbDepth,left,0).r,texelFetch(u_cbDepth,right,0).r);
+		vec2 ndc=gl_FragCoord.xy/vec2(textureSize(u_cbHistory,0))*2.0-1.0;
+		vec4 last=u_cbReproject*vec4(ndc,depth*2.0-1.0,1.0);
+		vec2 uv=last.xy/last.w*0.5+0.5;
+		if(last.w>0.0&&all(greaterThanEqual(uv,vec2(0.0)))&&all(lessThanEqual(uv,vec2(1.0)))){
+			// History outside what the drawn pixels around it span is from something that moved
+			vec3 low=min(leftCol,rightCol);
+			vec3 high=max(leftCol,rightCol);
+			for(int row=-1;row<=1;row+=2){
+				int y=clamp(pixel.y+row,0,drawnSize.y-1);
+				vec3 leftRow=texelFetch(u_cbCurrent,ivec2(left.x,y),0).rgb;
+				vec3 rightRow=texelFetch(u_cbCurrent,ivec2(right.x,y),0).rgb;
+				low=min(low,min(leftRow,rightRow));
+				high=max(high,max(leftRow,rightRow));
+			}
+			result=clamp(texture(u_cbHistory,uv).rgb,low,high);
+		}
+	}
+	FragCol=vec4(result,1.0);
+#elif defined(DEPTH_BUFFER)
+	//FragCol=vec4(vec3(gl_FragCoord.z),1.0);
+	FragCol=vec4(vec3(LineariseDepth(gl_FragCoord.z)/far),1.0);
+#elif defined(FULLBRIGHT) && !defined(DEFERRED)
+	FragCol=vec4(u_colour,1);
+#else
+#ifdef DEFERRED_LIGHTING
+	// The surface comes from the G-buffer, see deferred::target
+	ivec2 texel=ivec2(gl_FragCoord.xy);
+	float depth=texelFetch(u_gDepth,texel,0).r;
+	// Nothing was drawn here, so the screen keeps its clear colour
+	if(depth>=1.0)
+		discard;
+	vec4 albedo=texelFetch(u_gAlbedo,texel,0);
+	vec4 material=texelFetch(u_gMaterial,texel,0);
+	if(material.a<0.5){
+		FragCol=vec4(albedo.rgb,1);
+		return;
 	}
+	vec2 ndc=gl_FragCoord.xy/vec2(textureSize(u_gDepth,0))*2.0-1.0;
+	vec4 world=u_inverseCamera*vec4(ndc,depth*2.0-1.0,1.0);
+	FragPos=world.xyz/world.w;
+	Normal=OctDecode(material.xy);
+	m_diffuseTex=albedo.rgb;
+	m_specularTex=vec3(albedo.a);
+	m_shininess=material.z*MAX_SHININESS;
+#else
+	m_shininess=u_material.shininess;
+	// Textures, sampled once rather than once per light
+#ifdef USE_TEXTURES
+	m_diffuseTex=texture(u_material.texture_diffuse0,TexCoords).rgb;
+	m_specularTex=texture(u_material.texture_specular0,TexCoords).rgb;
+#endif
+#endif
+#if defined(DEFERRED)
+	// Only the surface is written, it is lit once per pixel by the lighting pass
+#ifdef FULLBRIGHT
+	FragCol=vec4(u_colour,0.0);
+	FragMaterial=vec4(0.0);
+#else
+	vec3 specular=m_specularTex*u_colour;
+	FragCol=vec4(m_diffuseTex*u_colour,(specular.r+specular.g+specular.b)/3.0);
+	FragMaterial=vec4(OctEncode(normalise(Normal)),m_shininess/MAX_SHININESS,1.0);
+#endif
+#else
+	// Important vectors
+	m_viewDir=normalise(u_viewPos-FragPos);
+	vec3 result=vec3(0.0);
+	for(int i=0;i<NR_DIR_LIGHTS;++i)
+		result+=CalculateDirectionalLighting(u_dirLights[i]);
+	// Only the lights that reach this fragment's cluster
+	uvec2 range=texelFetch(u_clusters,int(ClusterIndex())).xy;
+	for(uint i=0u;i<range.y;++i)
+		result+=CalculateClusteredLight(int(texelFetch(u_clusterLights,int(range.x+i)).r));
+	FragCol=vec4(result*u_colour,1);
+#endif
+#endif
 	return;
 }
@@ -2,20 +2,32 @@
 layout(location=0)in vec3 aPos;
 layout(location=1)in vec3 aNormal;
 layout(location=2)in vec2 aTexCoords;
+// Per instance, see renderer::getInstanceSize
+layout(location=3)in mat4 aModel;// Position, rotation, scale
+layout(location=7)in mat3 aTransposeInverseOfModel;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+// The depth prepass must land on exactly the same depth, see drawQueue::submit
+invariant gl_Position;
 
-uniform mat4 u_camera;// Projection*view
-uniform mat4 u_model;// Position, rotation, scale
-uniform mat3 u_transposeInverseOfModel;
+layout(std140) uniform Camera{
+	mat4 u_camera;// Projection*view
+	vec3 u_viewPos;
+};
 
 void main()
 {
-	vec4 vertModel=u_model*vec4(aPos,1.0);
+#if defined(DEFERRED_LIGHTING) || defined(CHECKERBOARD_RESOLVE)
+	// One triangle over the whole screen, its corners at (-1,-1), (3,-1) and (-1,3)
+	vec2 corner=vec2((gl_VertexID<<1)&2,gl_VertexID&2);
+	gl_Position=vec4(corner*2.0-1.0,0.0,1.0);
+#else
+	vec4 vertModel=aModel*vec4(aPos,1.0);
 	TexCoords=aTexCoords;
-	Normal=normalize(u_transposeInverseOfModel*aNormal);
+	Normal=normalize(aTransposeInverseOfModel*aNormal);
 	FragPos=vertModel.xyz; // Vertex position in world space
 	gl_Position=u_camera*vertModel;
+#endif
 }
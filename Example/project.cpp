@@ -21,6 +21,9 @@ using namespace srender;
 int main(int _argc, char *_args[])
 {
 	application::setFullscreen(false);
+	// Mouse look should lag as little as possible
+	application::setFramesInFlight(1U);
+	application::setLateInputSampling(true);
 	#ifdef _DEBUG
 		application::setDimensions(1030, 650);
 		application::setTitle("SRender Example (DEBUG)");
@@ -92,6 +95,12 @@ namespace project
 		createLights();
 		createScene();
 		//graphics::setRenderDepthBuffer(true);
+		graphics::setOcclusionQueries(true);
+		// Takes over from the queries where compute shaders are available
+		graphics::setGpuCulling(true);
+		graphics::setDepthPrepass(true);
+		// Holds 60 frames per second by drawing fewer pixels, down to half the window on each axis
+		graphics::setDynamicResolution(true);
 		input::addMouseCallback(mouseCallback);
 		input::addSrollCallback(scrollCallback);
 	}
@@ -134,12 +143,16 @@ namespace project
 		// Create the ground
 		m_ground = new entity();
 		model *groundModel = new model();
-		groundModel->addShader(new shader());
+		groundModel->addShader(shader::acquire());
 		vector<mesh::vertex> verts = mesh::generateVertices();
 		vector<uint32_t> inds = mesh::generateIndices();
-		mesh *square = new mesh(&verts, &inds);
+		// Large and simple, so it is cheap to hide whatever is beneath it
+		mesh *square = new mesh(&verts, &inds, false, true);
 		groundModel->addMesh(square);
 		groundModel->sentTint(colour(0.25f, 0.4f, 0.18f));
+		groundModel->setOccluder(true);
+		// Never moves, so its shadows are drawn once
+		groundModel->setStatic(true);
 		m_ground->addComponent(groundModel);
 		m_ground->setScale(vec3(50, 1, 50));
 
@@ -151,6 +164,7 @@ namespace project
 		));
 		m_backpack->translate(vec3(0.0f, 3.5f, 0.9f));
 		m_backpack->setScale(vec3(0.6f));
+		m_backpack->getComponentModel()->setStatic(true);
 
 		// Place 9 cubes behind
 		for (uint8_t i = 0; i < s_numCubes; ++i)
@@ -186,6 +200,7 @@ namespace project
 				colour(colour::hsvToRgb(vec3(0, 0.0f, 0.6f)))
 			));
 			lightRef = entityRef->getComponentLight();
+			lightRef->castShadows(true);
 			entityRef->setForward(vec3(0.0f, -1.0f, 0.0f));
 			graphics::setClearColour(
 				lightRef->getColour() * graphics::getAmbience()
@@ -202,6 +217,7 @@ namespace project
 				colour(colour::hsvToRgb(vec3(0, 0.6f, 0.8f)))
 			));
 			lightRef = entityRef->getComponentLight();
+			lightRef->castShadows(true);
 			entityRef->addComponent(new model(
 				"assets/models/cube/cube.obj",
 				"assets/shaders/default",
@@ -211,6 +227,8 @@ namespace project
 			entityRef->setScale(vec3(0.1f, 0.1f, 0.1f));
 			entityRef->getComponentModel()->sentTint(lightRef->getColour());
 			entityRef->getComponentModel()->fullbright(true);
+			// The marker sits around the light, it would shadow everything
+			entityRef->getComponentModel()->castShadows(false);
 			m_lights.push_back(entityRef);
 		}
 
@@ -223,6 +241,7 @@ namespace project
 				colour(colour::hsvToRgb(vec3(110, 0.3f, 1.0f)))
 			));
 			lightRef = entityRef->getComponentLight();
+			lightRef->castShadows(true);
 			entityRef->addComponent(new model(
 				"assets/models/cube/cube.obj",
 				"assets/shaders/default",
@@ -230,6 +249,7 @@ namespace project
 			));
 			entityRef->getComponentModel()->sentTint(lightRef->getColour());
 			entityRef->getComponentModel()->fullbright(true);
+			entityRef->getComponentModel()->castShadows(false);
 			entityRef->setPosition(vec3(2.0f, 6.0f, 6.0f));
 			entityRef->setForward(vec3(-0.3f, -0.4f, -1));
 			// FIXME needs to be called after setForward
@@ -251,6 +271,16 @@ namespace project
 		// Render triangles as dots
 		if (input::checkKeyState(input::key::key_f3, input::state::press))
 		{	graphics::setRenderMode(graphics::mode::point); }
+		// Light while drawing, or once per pixel afterwards
+		if (input::checkKeyState(input::key::key_f4, input::state::press))
+		{	graphics::setPipeline(graphics::pipeline::forward); }
+		if (input::checkKeyState(input::key::key_f5, input::state::press))
+		{	graphics::setPipeline(graphics::pipeline::deferred); }
+		// Shade half the pixels each frame, or all of them
+		if (input::checkKeyState(input::key::key_f6, input::state::press))
+		{	graphics::setCheckerboard(true); }
+		if (input::checkKeyState(input::key::key_f7, input::state::press))
+		{	graphics::setCheckerboard(false); }
 
 		// Spotlight cone
 		const float coneSpeed = valueModKeys(6.0f) * (float)application::getDeltaTime();
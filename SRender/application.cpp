@@ -1,7 +1,10 @@
+#include <algorithm>
 #include <chrono>
 //#include <thread>
 #include "application.hpp"
 #include "renderer.hpp"
+#include "shader.hpp"
+#include "shader_cache.hpp"
 #include "GLFW/glfw3.h"
 #include "glm/gtc/matrix_transform.hpp"
 #include "debug.hpp"
@@ -54,6 +57,10 @@ namespace application
 	callbackFunc l_fixedUpdateCallback = nullptr;
 	/** Called once per frame, after fixedUpdate but still before rendering */
 	callbackFunc l_lateUpdateCallback = nullptr;
+	/** How many frames may be queued on the GPU before the next one waits */
+	uint8_t l_framesInFlight = 2U;
+	/** Whether the mouse is read again just before drawing */
+	bool l_lateInputSampling = false;
 
 	constexpr double titleUpdateInterval() { return 0.5; }
 
@@ -218,6 +225,9 @@ namespace application
 			return false;
 		}
 
+		// Before anything compiles shaders
+		shaderCache::init(l_appLocation + "shadercache/");
+
 		if (!graphics::init((float)l_wWidth / (float)l_wHeight))
 		{
 			l_exitCode = exitCode::fail_Renderer;
@@ -241,6 +251,29 @@ namespace application
 		auto endTime = std::chrono::high_resolution_clock::now();
 		std::chrono::duration<double> elapsedTime = endTime - startTime;
 		debug::send("Initialised in " + to_string(elapsedTime.count()) + " seconds");
+		if (shaderCache::getEnabled())
+		{
+			shaderCache::stats cacheStats = shaderCache::getStats();
+			debug::send(
+				"Shader cache: "
+				+ to_string(cacheStats.hits)
+				+ " hits, "
+				+ to_string(cacheStats.misses)
+				+ " misses ("
+				+ to_string(cacheStats.rejected)
+				+ " rejected)"
+			);
+		}
+		#ifdef _VERBOSE
+			if (shader::pendingCount() > 0U)
+			{	debug::send(to_string(shader::pendingCount()) + " shaders still compiling in the background"); }
+			const renderer::geometryStats geometry = renderer::getGeometryStats();
+			debug::send(
+				"Geometry: " + to_string(geometry.bytesInUse) + " of " + to_string(geometry.bytesReserved)
+				+ " bytes in use over " + to_string(geometry.ranges) + " meshes, "
+				+ to_string((int)(geometry.fragmentation * 100.0f)) + "% fragmented"
+			);
+		#endif
 
 		return true;
 	}
@@ -255,6 +288,10 @@ namespace application
 		{
 			auto updateStart = std::chrono::high_resolution_clock::now();
 
+			// Waits for the GPU before sampling input, rather than queueing frames with stale input.
+			// The wait is counted in UT, so it shows when the GPU is the bottleneck
+			renderer::waitForFramesInFlight(l_framesInFlight);
+
 			// TODO: Look into extracting into a timekeeping class
 			l_prevTime = l_currentTime;
 			l_currentTime = glfwGetTime();
@@ -298,15 +335,20 @@ namespace application
 			}
 
 			auto frameStart = std::chrono::high_resolution_clock::now();
+			if (l_lateInputSampling)
+			{	input::sampleMouse(); }
 			graphics::draw();
 
 			// Check and call events and swap the buffers
 			glfwSwapBuffers(l_windowRef);
+			renderer::fenceFrame();
 
 			auto updateEnd = std::chrono::high_resolution_clock::now();
 
 			std::chrono::duration<double> updateTime = updateEnd - updateStart;
 			std::chrono::duration<double> frameTime = updateEnd - frameStart;
+			// The whole loop, including the wait for the GPU, is what the next frame's resolution is chosen by
+			resolution::setFrameTime(updateTime.count());
 
 			// Doing this allows me to updates fps as often as I want
 			if (l_frameTimer >= titleUpdateInterval())
@@ -331,6 +373,8 @@ namespace application
 					+ "/"
 					+ updateTimeMs
 				};
+				if (resolution::getEnabled())
+				{	title += " | Scale: " + to_string((int)(resolution::getScale() * 100.0f + 0.5f)) + "%"; }
 				glfwSetWindowTitle(l_windowRef, title.c_str());
 			}
 		}
@@ -340,6 +384,7 @@ namespace application
 	{
 		if (l_shutdownCallback)
 		{ l_shutdownCallback(); }
+		renderer::releaseFrameFences();
 		graphics::terminate();
 		glfwTerminate();
 	}
@@ -390,6 +435,12 @@ namespace application
 	void setLateUpdateCallback(callbackFunc _func) noexcept
 	{ l_lateUpdateCallback = _func; }
 
+	void setFramesInFlight(const uint8_t _frames) noexcept
+	{	l_framesInFlight = (uint8_t)std::clamp<uint32_t>(_frames, 1U, renderer::maxFramesInFlight()); }
+
+	void setLateInputSampling(const bool _enabled) noexcept
+	{	l_lateInputSampling = _enabled; }
+
 	double getTime() noexcept
 	{	return l_currentTime; }
 
@@ -26,6 +26,12 @@ namespace application
 	void setUpdateCallback(callbackFunc _func) noexcept;
 	void setFixedUpdateCallback(callbackFunc _func) noexcept;
 	void setLateUpdateCallback(callbackFunc _func) noexcept;
+	/** Caps how many frames the CPU can queue ahead of the GPU, clamped to 1-3.
+	 * @note Fewer frames cut input latency, more keep the GPU busy through CPU spikes.
+	 */
+	void setFramesInFlight(const uint8_t _frames) noexcept;
+	/** Reads the mouse again right before drawing, so the camera follows it up to the last moment. */
+	void setLateInputSampling(const bool _enabled) noexcept;
 
 	_NODISCARD double getTime() noexcept;
 	_NODISCARD double getDeltaTime() noexcept;
@@ -0,0 +1,422 @@
+#include <algorithm>
+#include <chrono>
+#include "bvh.hpp"
+#include "glm/geometric.hpp"
+
+using glm::vec3;
+
+namespace srender
+{
+inline float area(const vec3 &_min, const vec3 &_max) noexcept
+{
+	const vec3 size = _max - _min;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+//Static
+
+bvh::built bvh::build(std::vector<proxy> _proxies, std::vector<uint32_t> _ids) noexcept
+{
+	built out;
+	if (_ids.empty())
+	{	return out; }
+
+	out.nodes.reserve(_ids.size() * 2U - 1U);
+	out.root = buildNode(&out, &_proxies, &_ids, 0U, _ids.size(), invalid());
+	return out;
+}
+
+uint32_t bvh::buildNode(
+	built *_out,
+	std::vector<proxy> *_proxies,
+	std::vector<uint32_t> *_ids,
+	const size_t _begin,
+	const size_t _end,
+	const uint32_t _parent
+) noexcept
+{
+	// Parents always come before their children, adopt relies on it to refit in one pass
+	const uint32_t index = (uint32_t)_out->nodes.size();
+	_out->nodes.push_back(node());
+	_out->nodes[index].parent = _parent;
+
+	const std::vector<proxy> &proxies = *_proxies;
+	if (_end - _begin == 1U)
+	{
+		const uint32_t id = (*_ids)[_begin];
+		node &leaf = _out->nodes[index];
+		leaf.min = proxies[id].min;
+		leaf.max = proxies[id].max;
+		leaf.proxy = id;
+		return index;
+	}
+
+	vec3 centreMin = (proxies[(*_ids)[_begin]].min + proxies[(*_ids)[_begin]].max) * 0.5f;
+	vec3 centreMax = centreMin;
+	for (size_t i = _begin + 1U; i < _end; ++i)
+	{
+		const vec3 centre = (proxies[(*_ids)[i]].min + proxies[(*_ids)[i]].max) * 0.5f;
+		centreMin = glm::min(centreMin, centre);
+		centreMax = glm::max(centreMax, centre);
+	}
+	const vec3 extent = centreMax - centreMin;
+	const uint8_t axis = extent.x >= extent.y && extent.x >= extent.z ? 0U : (extent.y >= extent.z ? 1U : 2U);
+
+	// Half the boxes each side, so the depth stays logarithmic whatever the layout
+	const size_t middle = _begin + (_end - _begin) / 2U;
+	std::nth_element(
+		_ids->begin() + _begin,
+		_ids->begin() + middle,
+		_ids->begin() + _end,
+		[&proxies, axis](const uint32_t _a, const uint32_t _b)
+		{	return proxies[_a].min[axis] + proxies[_a].max[axis] < proxies[_b].min[axis] + proxies[_b].max[axis]; }
+	);
+
+	const uint32_t left = buildNode(_out, _proxies, _ids, _begin, middle, index);
+	const uint32_t right = buildNode(_out, _proxies, _ids, middle, _end, index);
+	node &cur = _out->nodes[index];
+	cur.left = left;
+	cur.right = right;
+	cur.min = glm::min(_out->nodes[left].min, _out->nodes[right].min);
+	cur.max = glm::max(_out->nodes[left].max, _out->nodes[right].max);
+	return index;
+}
+
+//Member
+
+bvh::~bvh()
+{
+	if (m_rebuild.valid())
+	{	m_rebuild.wait(); }
+}
+
+uint32_t bvh::allocateNode() noexcept
+{
+	if (!m_freeNodes.empty())
+	{
+		const uint32_t index = m_freeNodes.back();
+		m_freeNodes.pop_back();
+		m_nodes[index] = node();
+		return index;
+	}
+	m_nodes.push_back(node());
+	return (uint32_t)m_nodes.size() - 1U;
+}
+
+void bvh::refit(uint32_t _node) noexcept
+{
+	while (_node != invalid())
+	{
+		node &cur = m_nodes[_node];
+		const vec3 min = glm::min(m_nodes[cur.left].min, m_nodes[cur.right].min);
+		const vec3 max = glm::max(m_nodes[cur.left].max, m_nodes[cur.right].max);
+		// Nothing above can change either
+		if (min == cur.min && max == cur.max)
+		{	return; }
+
+		cur.min = min;
+		cur.max = max;
+		_node = cur.parent;
+	}
+}
+
+void bvh::insertLeaf(const uint32_t _leaf) noexcept
+{
+	if (m_root == invalid())
+	{
+		m_root = _leaf;
+		m_nodes[_leaf].parent = invalid();
+		return;
+	}
+
+	const vec3 leafMin = m_nodes[_leaf].min;
+	const vec3 leafMax = m_nodes[_leaf].max;
+	uint32_t sibling = m_root;
+	while (m_nodes[sibling].left != invalid())
+	{
+		// Down whichever side grows least from taking the leaf
+		const node &cur = m_nodes[sibling];
+		const node &left = m_nodes[cur.left];
+		const node &right = m_nodes[cur.right];
+		const float leftGrowth = area(glm::min(left.min, leafMin), glm::max(left.max, leafMax)) - area(left.min, left.max);
+		const float rightGrowth = area(glm::min(right.min, leafMin), glm::max(right.max, leafMax)) - area(right.min, right.max);
+		sibling = leftGrowth <= rightGrowth ? cur.left : cur.right;
+	}
+
+	const uint32_t parent = allocateNode();
+	const uint32_t grandparent = m_nodes[sibling].parent;
+	node &fresh = m_nodes[parent];
+	fresh.parent = grandparent;
+	fresh.left = sibling;
+	fresh.right = _leaf;
+	fresh.min = glm::min(m_nodes[sibling].min, leafMin);
+	fresh.max = glm::max(m_nodes[sibling].max, leafMax);
+	m_nodes[sibling].parent = parent;
+	m_nodes[_leaf].parent = parent;
+
+	if (grandparent == invalid())
+	{	m_root = parent; }
+	else
+	{
+		node &above = m_nodes[grandparent];
+		(above.left == sibling ? above.left : above.right) = parent;
+		refit(grandparent);
+	}
+}
+
+void bvh::removeLeaf(const uint32_t _leaf) noexcept
+{
+	if (_leaf == m_root)
+	{
+		m_root = invalid();
+		return;
+	}
+
+	// The parent goes too, the sibling takes its place
+	const uint32_t parent = m_nodes[_leaf].parent;
+	const uint32_t grandparent = m_nodes[parent].parent;
+	const uint32_t sibling = m_nodes[parent].left == _leaf ? m_nodes[parent].right : m_nodes[parent].left;
+	m_nodes[sibling].parent = grandparent;
+	if (grandparent == invalid())
+	{	m_root = sibling; }
+	else
+	{
+		node &above = m_nodes[grandparent];
+		(above.left == parent ? above.left : above.right) = sibling;
+		refit(grandparent);
+	}
+	m_freeNodes.push_back(parent);
+}
+
+float bvh::cost() const noexcept
+{
+	if (m_root == invalid() || m_nodes[m_root].left == invalid())
+	{	return 0.0f; }
+
+	float total = 0.0f;
+	std::vector<uint32_t> stack = { m_root };
+	while (!stack.empty())
+	{
+		const node &cur = m_nodes[stack.back()];
+		stack.pop_back();
+		if (cur.left == invalid())
+		{	continue; }
+
+		total += area(cur.min, cur.max);
+		stack.push_back(cur.left);
+		stack.push_back(cur.right);
+	}
+
+	const float rootArea = area(m_nodes[m_root].min, m_nodes[m_root].max);
+	return rootArea > 0.0f ? total / rootArea : 0.0f;
+}
+
+void bvh::adopt(built &&_tree) noexcept
+{
+	m_nodes = std::move(_tree.nodes);
+	m_freeNodes.clear();
+	m_root = _tree.root;
+
+	// Boxes kept moving while the tree was built, so the leaves take the latest and everything above is refit
+	for (size_t i = m_nodes.size(); i-- > 0U;)
+	{
+		node &cur = m_nodes[i];
+		if (cur.left == invalid())
+		{
+			proxy &owner = m_proxies[cur.proxy];
+			owner.node = (uint32_t)i;
+			cur.min = owner.min;
+			cur.max = owner.max;
+			continue;
+		}
+		cur.min = glm::min(m_nodes[cur.left].min, m_nodes[cur.right].min);
+		cur.max = glm::max(m_nodes[cur.left].max, m_nodes[cur.right].max);
+	}
+
+	m_builtCost = cost();
+	m_quality = 1.0f;
+	++m_rebuilds;
+}
+
+void bvh::startRebuild()
+{
+	std::vector<uint32_t> ids;
+	ids.reserve(m_leaves);
+	for (uint32_t i = 0; i < (uint32_t)m_proxies.size(); ++i)
+	{
+		if (m_proxies[i].node != invalid())
+		{	ids.push_back(i); }
+	}
+
+	m_structureChanged = false;
+	m_rebuild = std::async(std::launch::async, &bvh::build, m_proxies, std::move(ids));
+}
+
+uint32_t bvh::insert(const culling::bounds &_bounds, const uint32_t _item) noexcept
+{
+	uint32_t id;
+	if (!m_freeProxies.empty())
+	{
+		id = m_freeProxies.back();
+		m_freeProxies.pop_back();
+	}
+	else
+	{
+		m_proxies.push_back(proxy());
+		id = (uint32_t)m_proxies.size() - 1U;
+	}
+
+	const uint32_t leaf = allocateNode();
+	m_nodes[leaf].min = _bounds.min;
+	m_nodes[leaf].max = _bounds.max;
+	m_nodes[leaf].proxy = id;
+
+	proxy &cur = m_proxies[id];
+	cur.min = _bounds.min;
+	cur.max = _bounds.max;
+	cur.node = leaf;
+	cur.item = _item;
+
+	insertLeaf(leaf);
+	++m_leaves;
+	m_structureChanged = true;
+	return id;
+}
+
+void bvh::remove(const uint32_t _proxy) noexcept
+{
+	proxy &cur = m_proxies[_proxy];
+	removeLeaf(cur.node);
+	m_freeNodes.push_back(cur.node);
+	cur.node = invalid();
+	m_freeProxies.push_back(_proxy);
+	--m_leaves;
+	m_structureChanged = true;
+}
+
+void bvh::move(const uint32_t _proxy, const culling::bounds &_bounds) noexcept
+{
+	proxy &cur = m_proxies[_proxy];
+	cur.min = _bounds.min;
+	cur.max = _bounds.max;
+
+	node &leaf = m_nodes[cur.node];
+	leaf.min = _bounds.min;
+	leaf.max = _bounds.max;
+	refit(leaf.parent);
+}
+
+void bvh::setItem(const uint32_t _proxy, const uint32_t _item) noexcept
+{	m_proxies[_proxy].item = _item; }
+
+void bvh::maintain()
+{
+	if (m_rebuild.valid())
+	{
+		if (m_rebuild.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{	return; }
+
+		// A tree missing boxes added since it started is no use, the next check starts another
+		built tree = m_rebuild.get();
+		if (!m_structureChanged)
+		{	adopt(std::move(tree)); }
+		m_sinceCheck = 0U;
+		return;
+	}
+
+	if (++m_sinceCheck < qualityInterval)
+	{	return; }
+	m_sinceCheck = 0U;
+	if (m_leaves < 3U)
+	{	return; }
+
+	// Until the first build there is nothing to compare against, inserting one by one never gives a good tree
+	m_quality = m_builtCost > 0.0f ? cost() / m_builtCost : rebuildThreshold + 1.0f;
+	if (m_quality > rebuildThreshold)
+	{	startRebuild(); }
+}
+
+uint32_t bvh::cull(
+	const culling::frustum &_frustum,
+	std::vector<uint32_t> *_outInside,
+	std::vector<uint32_t> *_outPartial
+) const
+{
+	if (m_root == invalid())
+	{	return 0U; }
+
+	uint32_t tested = 0U;
+	std::vector<uint32_t> stack = { m_root };
+	std::vector<uint32_t> below;
+	while (!stack.empty())
+	{
+		const node &cur = m_nodes[stack.back()];
+		stack.pop_back();
+		++tested;
+
+		const culling::containment side = culling::classifyBox(_frustum, cur.min, cur.max);
+		if (side == culling::containment::outside)
+		{	continue; }
+
+		if (cur.left == invalid())
+		{
+			(side == culling::containment::inside ? _outInside : _outPartial)->push_back(m_proxies[cur.proxy].item);
+			continue;
+		}
+		if (side == culling::containment::intersecting)
+		{
+			stack.push_back(cur.left);
+			stack.push_back(cur.right);
+			continue;
+		}
+
+		// Inside, so every leaf below is too
+		below.push_back(cur.left);
+		below.push_back(cur.right);
+		while (!below.empty())
+		{
+			const node &inner = m_nodes[below.back()];
+			below.pop_back();
+			if (inner.left == invalid())
+			{	_outInside->push_back(m_proxies[inner.proxy].item); }
+			else
+			{
+				below.push_back(inner.left);
+				below.push_back(inner.right);
+			}
+		}
+	}
+	return tested;
+}
+
+/** Bounds for a box alone, the sphere is the one around its corners. */
+_NODISCARD inline culling::bounds boxBounds(const vec3 &_min, const vec3 &_max) noexcept
+{
+	culling::bounds out;
+	out.min = _min;
+	out.max = _max;
+	out.centre = (_min + _max) * 0.5f;
+	out.radius = glm::length(_max - _min) * 0.5f;
+	out.empty = false;
+	return out;
+}
+
+culling::bounds bvh::getBounds() const noexcept
+{
+	if (m_root == invalid())
+	{	return culling::bounds(); }
+	return boxBounds(m_nodes[m_root].min, m_nodes[m_root].max);
+}
+
+culling::bounds bvh::getProxyBounds(const uint32_t _proxy) const noexcept
+{	return boxBounds(m_proxies[_proxy].min, m_proxies[_proxy].max); }
+
+bvh::stats bvh::getStats() const noexcept
+{
+	stats out;
+	out.leaves = m_leaves;
+	out.rebuilds = m_rebuilds;
+	out.quality = m_quality;
+	return out;
+}
+}
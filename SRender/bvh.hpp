@@ -0,0 +1,132 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <future>
+#include "culling.hpp"
+
+#ifndef _NODISCARD
+#define _NODISCARD [[nodiscard]]
+#endif
+
+namespace srender
+{
+/** A bounding volume hierarchy over world space boxes, kept up to date as they move.
+ * Moving a box only refits the nodes above it. Once refits have made the tree much worse than
+ * when it was built, a new one is built on another thread from a copy of the boxes and swapped in.
+ * @note Each box carries an item, any value the owner wants back from a query.
+ */
+struct bvh
+{
+	_NODISCARD static constexpr uint32_t invalid() { return UINT32_MAX; }
+	/** How much worse than when built the tree may get before it is rebuilt. */
+	static constexpr float rebuildThreshold = 1.3f;
+	/** Measuring the quality walks the whole tree, so it is only done every so many frames. */
+	static constexpr uint32_t qualityInterval = 16U;
+
+	struct stats
+	{
+		uint32_t leaves = 0U;
+		uint32_t rebuilds = 0U;	// Trees built in the background and swapped in
+		float quality = 1.0f;	// Current cost over the cost when built, higher is worse
+	};
+
+private:
+	struct node
+	{
+		glm::vec3 min = glm::vec3(0.0f);
+		glm::vec3 max = glm::vec3(0.0f);
+		uint32_t parent = invalid();
+		uint32_t left = invalid();	// Both children are invalid for a leaf
+		uint32_t right = invalid();
+		uint32_t proxy = invalid();	// Only set for a leaf
+	};
+
+	/** What the owner holds on to, it stays the same when the tree is rebuilt. */
+	struct proxy
+	{
+		glm::vec3 min = glm::vec3(0.0f);
+		glm::vec3 max = glm::vec3(0.0f);
+		uint32_t node = invalid();
+		uint32_t item = 0U;
+	};
+
+	/** The result of a background build. */
+	struct built
+	{
+		std::vector<node> nodes;
+		uint32_t root = invalid();
+	};
+
+	std::vector<node> m_nodes = std::vector<node>();
+	std::vector<uint32_t> m_freeNodes = std::vector<uint32_t>();
+	std::vector<proxy> m_proxies = std::vector<proxy>();
+	std::vector<uint32_t> m_freeProxies = std::vector<uint32_t>();
+	uint32_t m_root = invalid();
+	uint32_t m_leaves = 0U;
+
+	float m_builtCost = 0.0f;	// The cost when the tree was last built, what quality is measured against
+	float m_quality = 1.0f;
+	uint32_t m_sinceCheck = 0U;	// Calls to maintain since the quality was last measured
+	uint32_t m_rebuilds = 0U;
+	std::future<built> m_rebuild;
+	/** Proxies were added or removed while a rebuild ran, so its result is already out of date. */
+	bool m_structureChanged = false;
+
+	/** Builds a tree top down, splitting each node at the median of its longest axis.
+	 * @note Runs on a worker thread, so it only touches its arguments.
+	 */
+	static built build(std::vector<proxy> _proxies, std::vector<uint32_t> _ids) noexcept;
+	static uint32_t buildNode(
+		built *_out,
+		std::vector<proxy> *_proxies,
+		std::vector<uint32_t> *_ids,
+		const size_t _begin,
+		const size_t _end,
+		const uint32_t _parent
+	) noexcept;
+
+	_NODISCARD uint32_t allocateNode() noexcept;
+	/** Recomputes the boxes from a node up, stopping once a box no longer changes. */
+	void refit(uint32_t _node) noexcept;
+	/** Places a leaf next to the sibling that grows least from it. */
+	void insertLeaf(const uint32_t _leaf) noexcept;
+	void removeLeaf(const uint32_t _leaf) noexcept;
+	/** Total surface area of the inner nodes relative to the root, how costly the tree is to walk. */
+	_NODISCARD float cost() const noexcept;
+	void adopt(built &&_tree) noexcept;
+	void startRebuild();
+
+public:
+	bvh() noexcept = default;
+	~bvh();
+
+	/** Adds a box to the tree.
+	 * @return [uint32_t] The proxy, used to move or remove the box later.
+	 */
+	_NODISCARD uint32_t insert(const culling::bounds &_bounds, const uint32_t _item) noexcept;
+	void remove(const uint32_t _proxy) noexcept;
+	/** Updates a box, refitting only the nodes above it. */
+	void move(const uint32_t _proxy, const culling::bounds &_bounds) noexcept;
+	/** Changes the item a box hands back, for when the owner's indices shift. */
+	void setItem(const uint32_t _proxy, const uint32_t _item) noexcept;
+	/** Swaps in a finished rebuild, and starts one if the tree has got too much worse. Call once a frame. */
+	void maintain();
+
+	/** Walks the tree, skipping every node outside the frustum along with all below it.
+	 * @param _outInside Items whose whole subtree was inside, no further test needed.
+	 * @param _outPartial Items whose leaf box crosses a plane, they may still be outside.
+	 * @return [uint32_t] Nodes tested.
+	 */
+	uint32_t cull(
+		const culling::frustum &_frustum,
+		std::vector<uint32_t> *_outInside,
+		std::vector<uint32_t> *_outPartial
+	) const;
+
+	/** The box around every box in the tree, empty if there are none. */
+	_NODISCARD culling::bounds getBounds() const noexcept;
+	/** The box a proxy was last inserted or moved with. */
+	_NODISCARD culling::bounds getProxyBounds(const uint32_t _proxy) const noexcept;
+	_NODISCARD stats getStats() const noexcept;
+};
+}
@@ -189,9 +189,9 @@ void camera::setFovV(float inFovV) noexcept
 mat4 camera::getWorldToCameraMatrix() const noexcept
 {	return m_projection * m_view; }
 
-constexpr glm::mat4 camera::getView() const noexcept
+glm::mat4 camera::getView() const noexcept
 {	return m_view; }
 
-constexpr glm::mat4 camera::getProjection() const noexcept
+glm::mat4 camera::getProjection() const noexcept
 {	return m_projection; }
 }
@@ -79,7 +79,7 @@ public:
 	void setFovV(float _fovV) noexcept;
 
 	_NODISCARD glm::mat4 getWorldToCameraMatrix() const noexcept;
-	_NODISCARD constexpr glm::mat4 getView() const noexcept;
-	_NODISCARD constexpr glm::mat4 getProjection() const noexcept;
+	_NODISCARD glm::mat4 getView() const noexcept;
+	_NODISCARD glm::mat4 getProjection() const noexcept;
 };
 }
@@ -0,0 +1,181 @@
+#include "checkerboard.hpp"
+#include "renderer.hpp"
+#include "shader.hpp"
+#include "debug.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+using glm::vec3;
+using glm::mat4;
+
+namespace srender
+{
+namespace checkerboard
+{
+	enum class input: uint8_t
+	{
+		current,
+		depth,
+		history,
+		count
+	};
+
+	/** The sampler of each input in the resolve program, in the order of input. */
+	constexpr shader::uniformId l_uInputs[(uint8_t)input::count] = {
+		shader::uniform("u_cbCurrent"),
+		shader::uniform("u_cbDepth"),
+		shader::uniform("u_cbHistory")
+	};
+	constexpr shader::uniformId l_uReproject = shader::uniform("u_cbReproject");
+	constexpr shader::uniformId l_uParity = shader::uniform("u_cbParity");
+	constexpr shader::uniformId l_uHistoryValid = shader::uniform("u_cbHistoryValid");
+
+	bool l_enabled = false;
+	/** Set between beginFrame and endFrame of a frame that is drawn at half width. */
+	bool l_active = false;
+	/** The half width target the scene is drawn into. */
+	uint32_t l_idColour = 0U, l_idDepth = 0U, l_idFBO = 0U;
+	/** Resolved frames at full width, one is written while the other is read. */
+	uint32_t l_idHistory[2] = {}, l_idHistoryFBO[2] = {};
+	uint8_t l_written = 0U;
+	/** Cleared whenever the last resolved frame is missing or no longer lines up. */
+	bool l_historyValid = false;
+	/** The full size, the target is half of it across rounded up. */
+	uint32_t l_width = 0U, l_height = 0U;
+	/** 0 draws the even columns, 1 the odd ones. */
+	uint8_t l_parity = 0U;
+	/** Where the scene was drawn before this frame took it over, the resolve writes there. */
+	uint32_t l_idOuter = 0U;
+	mat4 l_viewProjection = mat4(1.0f), l_lastViewProjection = mat4(1.0f);
+	shader *l_resolve = nullptr;
+
+	void deleteTargets() noexcept
+	{
+		if (l_idFBO)
+		{	renderer::deleteFramebuffer(l_idFBO); }
+		if (l_idColour)
+		{
+			const uint32_t textures[2] = { l_idColour, l_idDepth };
+			renderer::deleteTextures(textures, 2U);
+		}
+		for (uint8_t i = 0; i < 2U; ++i)
+		{
+			if (l_idHistoryFBO[i])
+			{	renderer::deleteFramebuffer(l_idHistoryFBO[i]); }
+			l_idHistoryFBO[i] = 0U;
+		}
+		if (l_idHistory[0])
+		{	renderer::deleteTextures(l_idHistory, 2U); }
+		l_idFBO = l_idColour = l_idDepth = 0U;
+		l_idHistory[0] = l_idHistory[1] = 0U;
+		l_width = l_height = 0U;
+		l_historyValid = false;
+	}
+
+	/** @return [bool] False if the driver cannot draw into any of the targets. */
+	bool resize(const uint32_t _width, const uint32_t _height) noexcept
+	{
+		deleteTargets();
+		const uint32_t drawnWidth = (_width + 1U) / 2U;
+		l_idColour = renderer::createTargetTexture(drawnWidth, _height, renderer::targetFormat::rgba8);
+		// Matches the screen's format, so the G-buffer's depth can still be blitted into it
+		l_idDepth = renderer::createDepthTexture(drawnWidth, _height);
+		l_idFBO = renderer::createFramebuffer(&l_idColour, 1U, l_idDepth);
+		bool complete = l_idFBO != 0U;
+		for (uint8_t i = 0; i < 2U; ++i)
+		{
+			l_idHistory[i] = renderer::createTargetTexture(_width, _height, renderer::targetFormat::rgba8);
+			l_idHistoryFBO[i] = renderer::createFramebuffer(&l_idHistory[i], 1U, 0U);
+			complete = complete && l_idHistoryFBO[i];
+		}
+		if (!complete)
+		{
+			deleteTargets();
+			return false;
+		}
+		l_width = _width;
+		l_height = _height;
+		return true;
+	}
+
+	void terminate() noexcept
+	{
+		deleteTargets();
+		shader::release(l_resolve);
+		l_resolve = nullptr;
+		l_active = false;
+	}
+
+	void setEnabled(const bool _state) noexcept
+	{	l_enabled = _state; }
+
+	bool getEnabled() noexcept
+	{	return l_enabled; }
+
+	mat4 beginFrame(const mat4 &_viewProjection, const bool _allowed) noexcept
+	{
+		l_active = false;
+		if (!l_enabled || !_allowed)
+		{
+			l_historyValid = false;
+			return _viewProjection;
+		}
+		if (!l_resolve)
+		{	l_resolve = shader::acquire(nullptr, "#define CHECKERBOARD_RESOLVE\n"); }
+		uint32_t width, height;
+		renderer::getViewportSize(&width, &height);
+		// Drawn whole until the resolve program compiles, and while minimised
+		if (!l_resolve->isLoaded() || width < 2U || height == 0U)
+		{
+			l_historyValid = false;
+			return _viewProjection;
+		}
+		if ((width != l_width || height != l_height) && !resize(width, height))
+		{
+			debug::send(
+				"The driver cannot draw into the checkerboard targets, shading every pixel",
+				debug::type::note, debug::impact::large, debug::stage::mid
+			);
+			l_enabled = false;
+			return _viewProjection;
+		}
+
+		l_idOuter = renderer::getSceneTarget();
+		renderer::setSceneTarget(l_idFBO, (width + 1U) / 2U, height);
+		l_parity ^= 1U;
+		l_viewProjection = _viewProjection;
+		l_active = true;
+		// Each drawn pixel covers two columns, half a column either way of its centre lands on one of them
+		const float offset = (1.0f - 2.0f * (float)l_parity) / (float)width;
+		return glm::translate(mat4(1.0f), vec3(offset, 0.0f, 0.0f)) * _viewProjection;
+	}
+
+	void endFrame() noexcept
+	{
+		if (!l_active)
+		{	return; }
+		l_active = false;
+
+		renderer::setSceneTarget(l_idOuter, l_width, l_height);
+		renderer::bindFramebuffer(l_idHistoryFBO[l_written]);
+		const uint32_t inputs[(uint8_t)input::count] = { l_idColour, l_idDepth, l_idHistory[l_written ^ 1U] };
+		for (uint8_t i = 0; i < (uint8_t)input::count; ++i)
+		{
+			renderer::setActiveTexture(getInputUnit(i));
+			renderer::bindTexture2D(inputs[i]);
+			l_resolve->setInt(l_uInputs[i], getInputUnit(i));
+		}
+		// Neither matrix has the column offset, the history was resolved back to whole pixels
+		l_resolve->setMat4(l_uReproject, l_lastViewProjection * glm::inverse(l_viewProjection));
+		l_resolve->setInt(l_uParity, (int32_t)l_parity);
+		l_resolve->setBool(l_uHistoryValid, l_historyValid);
+		l_resolve->use();
+		renderer::drawFullscreenTriangle();
+
+		// Kept for the next frame, so it is copied out rather than written to the scene directly
+		renderer::copyColourRect(l_idHistoryFBO[l_written], 0U, 0U, 0U, l_width, l_height);
+		l_lastViewProjection = l_viewProjection;
+		l_historyValid = true;
+		l_written ^= 1U;
+	}
+}
+}
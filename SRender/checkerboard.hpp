@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+#include "glm/mat4x4.hpp"
+
+#ifndef _NODISCARD
+#define _NODISCARD [[nodiscard]]
+#endif
+
+namespace srender
+{
+/** Interleaved rendering, each frame shades only every other column of pixels into a half width target,
+ * moving the projection by half a pixel so the next frame shades the columns in between.
+ * A resolve pass writes the full width frame from that target.
+ * The columns drawn this frame are copied as they are.
+ * Each other column is taken from the last frame, reprojected with the camera's depth and matrices and clamped to the colours around it.
+ * Where the last frame has nothing to offer, the two drawn columns either side are averaged.
+ * @note Only the camera moving is reprojected, anything moving on its own relies on the clamp and looks softer.
+ */
+namespace checkerboard
+{
+	/** The resolve pass reads this frame's colour, its depth and the last frame from here, the G-buffer's units,
+	 * which are free again once lighting is done.
+	 */
+	_NODISCARD constexpr uint8_t getInputUnit(const uint8_t _input) { return 8U + _input; }
+
+	void terminate() noexcept;
+	/** Halves the pixels shaded from the next frame, or shades all of them again. */
+	void setEnabled(const bool _state) noexcept;
+	_NODISCARD bool getEnabled() noexcept;
+
+	/** Draws into the half width target from here on, if enabled and the resolve program is ready.
+	 * @param _viewProjection The camera's projection * view matrix.
+	 * @param _allowed False to draw this frame whole, lines and points cannot be filled in from the columns beside them.
+	 * @return [glm::mat4] What to draw this frame with, _viewProjection moved to this frame's columns or as it is.
+	 */
+	_NODISCARD glm::mat4 beginFrame(const glm::mat4 &_viewProjection, const bool _allowed) noexcept;
+	/** Fills in the columns that were not drawn and writes the whole frame to where the scene was drawn before beginFrame. */
+	void endFrame() noexcept;
+}
+}
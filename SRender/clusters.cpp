@@ -0,0 +1,342 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+#include "clusters.hpp"
+#include "glm/geometric.hpp"
+#include "glm/matrix.hpp"
+
+// Every x64 target has SSE, elsewhere the compiler says when it is enabled
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#include <xmmintrin.h>
+	#define CLUSTERS_SSE
+#endif
+
+using glm::vec2;
+using glm::vec3;
+using glm::vec4;
+using glm::mat4;
+using std::vector;
+
+namespace srender
+{
+namespace clusters
+{
+	static_assert(getGridX() % 4U == 0U, "Rows are tested four clusters at a time");
+
+	/** The view space box and bounding sphere of every cluster, a component per array so four load at once. */
+	struct grid
+	{
+		float minX[getClusterCount()];
+		float minY[getClusterCount()];
+		float minZ[getClusterCount()];
+		float maxX[getClusterCount()];
+		float maxY[getClusterCount()];
+		float maxZ[getClusterCount()];
+		float centreX[getClusterCount()];
+		float centreY[getClusterCount()];
+		float centreZ[getClusterCount()];
+		float radius[getClusterCount()];
+	};
+
+	grid l_grid;
+	mat4 l_projection = mat4(0.0f);
+	float l_near = 0.0f, l_far = 0.0f;
+	vec2 l_sliceScale = vec2(0.0f);
+
+	/** Kept between frames so assigning does not allocate. */
+	vector<uint32_t> l_pairClusters = vector<uint32_t>();
+	vector<uint32_t> l_pairLights = vector<uint32_t>();
+	vector<uint32_t> l_table = vector<uint32_t>(getClusterCount() * 2U, 0U);
+	vector<uint32_t> l_indices = vector<uint32_t>();
+	stats l_stats;
+
+	_NODISCARD inline uint32_t clusterIndex(const uint32_t _x, const uint32_t _y, const uint32_t _z) noexcept
+	{	return (_z * getGridY() + _y) * getGridX() + _x; }
+
+	/** The slice holding a view space depth, clamped to the grid. */
+	_NODISCARD inline uint32_t sliceAt(const float _depth) noexcept
+	{
+		const float slice = std::floor(std::log(_depth) * l_sliceScale.x + l_sliceScale.y);
+		return (uint32_t)std::clamp(slice, 0.0f, (float)getGridZ() - 1.0f);
+	}
+
+	/** The depth where a slice starts, slices past the last one end at the far plane. */
+	_NODISCARD inline float sliceDepth(const uint32_t _slice) noexcept
+	{	return l_near * std::pow(l_far / l_near, (float)_slice / (float)getGridZ()); }
+
+	/** If a cone misses a sphere, Bart Wronski's test against the closest point of the cone to it.
+	 * @param _offset From the cone's tip to the sphere's centre.
+	 */
+	_NODISCARD inline bool coneMisses(
+		const vec3 &_offset,
+		const float _sphereRadius,
+		const volume &_cone,
+		const float _sinAngle
+	) noexcept
+	{
+		const float along = glm::dot(_offset, _cone.direction);
+		const float across = std::sqrt(std::max(glm::dot(_offset, _offset) - along * along, 0.0f));
+		const float closest = _cone.cosAngle * across - along * _sinAngle;
+		return closest > _sphereRadius || along > _sphereRadius + _cone.radius || along < -_sphereRadius;
+	}
+
+	float getRadius(const float _linear, const float _quadratic, const float _brightness) noexcept
+	{
+		// Solves 1 / (1 + linear * d + quadratic * d^2) = cutoff / brightness for d
+		const float constant = 1.0f - _brightness / getCutoff();
+		if (constant >= 0.0f)
+		{	return 0.0f; }
+		if (_quadratic > 0.0f)
+		{	return (-_linear + std::sqrt(_linear * _linear - 4.0f * _quadratic * constant)) / (2.0f * _quadratic); }
+		if (_linear > 0.0f)
+		{	return -constant / _linear; }
+		return FLT_MAX;
+	}
+
+	void setProjection(const mat4 &_projection, const float _near, const float _far) noexcept
+	{
+		if (_projection == l_projection && _near == l_near && _far == l_far)
+		{	return; }
+		l_projection = _projection;
+		l_near = _near;
+		l_far = _far;
+		l_sliceScale.x = (float)getGridZ() / std::log(_far / _near);
+		l_sliceScale.y = -std::log(_near) * l_sliceScale.x;
+
+		// Each tile's corners as rays from the eye, scaled to the depth of a slice's faces
+		const mat4 inverse = glm::inverse(_projection);
+		vec3 rays[getGridX() + 1U][getGridY() + 1U];
+		for (uint32_t x = 0; x <= getGridX(); ++x)
+		{
+			for (uint32_t y = 0; y <= getGridY(); ++y)
+			{
+				const vec4 ndc = vec4(
+					(float)x / (float)getGridX() * 2.0f - 1.0f,
+					(float)y / (float)getGridY() * 2.0f - 1.0f,
+					-1.0f,
+					1.0f
+				);
+				const vec4 point = inverse * ndc;
+				rays[x][y] = vec3(point) / -point.z;
+			}
+		}
+
+		for (uint32_t z = 0; z < getGridZ(); ++z)
+		{
+			const float depths[2] = { sliceDepth(z), sliceDepth(z + 1U) };
+			for (uint32_t y = 0; y < getGridY(); ++y)
+			{
+				for (uint32_t x = 0; x < getGridX(); ++x)
+				{
+					vec3 min = vec3(FLT_MAX), max = vec3(-FLT_MAX);
+					for (uint8_t corner = 0; corner < 8U; ++corner)
+					{
+						const vec3 point = rays[x + (corner & 1U)][y + ((corner >> 1U) & 1U)] * depths[corner >> 2U];
+						min = glm::min(min, point);
+						max = glm::max(max, point);
+					}
+
+					const uint32_t index = clusterIndex(x, y, z);
+					l_grid.minX[index] = min.x;
+					l_grid.minY[index] = min.y;
+					l_grid.minZ[index] = min.z;
+					l_grid.maxX[index] = max.x;
+					l_grid.maxY[index] = max.y;
+					l_grid.maxZ[index] = max.z;
+					const vec3 centre = (min + max) * 0.5f;
+					l_grid.centreX[index] = centre.x;
+					l_grid.centreY[index] = centre.y;
+					l_grid.centreZ[index] = centre.z;
+					l_grid.radius[index] = glm::length(max - centre);
+				}
+			}
+		}
+	}
+
+	/** Adds the light to each cluster of a row its sphere, and cone if it has one, reaches.
+	 * @param _first The first cluster of the row.
+	 * @param _begin,_end The columns to test, the rest of the row is known to be out of reach.
+	 */
+	void assignRow(
+		const uint32_t _first,
+		const uint32_t _begin,
+		const uint32_t _end,
+		const uint32_t _light,
+		const volume &_view,
+		const float _sinAngle
+	)
+	{
+		const bool cone = _view.cosAngle > -1.0f;
+		uint32_t x = _begin;
+		#ifdef CLUSTERS_SSE
+			const __m128 centreX = _mm_set1_ps(_view.position.x);
+			const __m128 centreY = _mm_set1_ps(_view.position.y);
+			const __m128 centreZ = _mm_set1_ps(_view.position.z);
+			const __m128 radiusSq = _mm_set1_ps(_view.radius * _view.radius);
+			const __m128 zero = _mm_setzero_ps();
+			for (x &= ~3U; x < _end; x += 4U)
+			{
+				// Distance from the centre to the nearest point of each box, per axis
+				const uint32_t index = _first + x;
+				__m128 dx = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&l_grid.minX[index]), centreX), zero);
+				dx = _mm_max_ps(dx, _mm_sub_ps(centreX, _mm_loadu_ps(&l_grid.maxX[index])));
+				__m128 dy = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&l_grid.minY[index]), centreY), zero);
+				dy = _mm_max_ps(dy, _mm_sub_ps(centreY, _mm_loadu_ps(&l_grid.maxY[index])));
+				__m128 dz = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&l_grid.minZ[index]), centreZ), zero);
+				dz = _mm_max_ps(dz, _mm_sub_ps(centreZ, _mm_loadu_ps(&l_grid.maxZ[index])));
+				const __m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+				const int mask = _mm_movemask_ps(_mm_cmple_ps(distanceSq, radiusSq));
+				for (uint32_t lane = 0; lane < 4U; ++lane)
+				{
+					// Lanes outside the columns asked for were only loaded to keep the registers whole
+					if (!((mask >> lane) & 1) || x + lane < _begin || x + lane >= _end)
+					{	continue; }
+					const uint32_t cluster = index + lane;
+					if (cone && coneMisses(
+						vec3(l_grid.centreX[cluster], l_grid.centreY[cluster], l_grid.centreZ[cluster]) - _view.position,
+						l_grid.radius[cluster], _view, _sinAngle))
+					{	continue; }
+					l_pairClusters.push_back(cluster);
+					l_pairLights.push_back(_light);
+				}
+			}
+		#else
+			for (; x < _end; ++x)
+			{
+				const uint32_t cluster = _first + x;
+				const vec3 min = vec3(l_grid.minX[cluster], l_grid.minY[cluster], l_grid.minZ[cluster]);
+				const vec3 max = vec3(l_grid.maxX[cluster], l_grid.maxY[cluster], l_grid.maxZ[cluster]);
+				const vec3 offset = glm::max(glm::max(min - _view.position, vec3(0.0f)), _view.position - max);
+				if (glm::dot(offset, offset) > _view.radius * _view.radius)
+				{	continue; }
+				if (cone && coneMisses(
+					vec3(l_grid.centreX[cluster], l_grid.centreY[cluster], l_grid.centreZ[cluster]) - _view.position,
+					l_grid.radius[cluster], _view, _sinAngle))
+				{	continue; }
+				l_pairClusters.push_back(cluster);
+				l_pairLights.push_back(_light);
+			}
+		#endif
+	}
+
+	void assign(
+		const mat4 &_view,
+		const volume *_lights,
+		const uint32_t _count,
+		const uint32_t _maxAssignments
+	)
+	{
+		l_stats = stats();
+		l_pairClusters.clear();
+		l_pairLights.clear();
+
+		for (uint32_t i = 0; i < _count; ++i)
+		{
+			const volume &light = _lights[i];
+			if (light.radius <= 0.0f)
+			{	continue; }
+
+			volume view = light;
+			view.position = vec3(_view * vec4(light.position, 1.0f));
+			view.direction = glm::normalize(vec3(_view * vec4(light.direction, 0.0f)));
+			// Past the far corners of the frustum any range is as good as endless, and stays finite to project
+			view.radius = std::min(light.radius, glm::length(view.position) + l_far * 4.0f);
+			const float depth = -view.position.z;
+			if (depth + view.radius < l_near || depth - view.radius > l_far)
+			{	continue; }
+			const float nearest = std::max(depth - view.radius, l_near);
+			const float furthest = std::min(depth + view.radius, l_far);
+
+			// The screen rectangle of the sphere's box, clipped to the depths it covers
+			vec2 ndcMin = vec2(-1.0f), ndcMax = vec2(1.0f);
+			bool behind = false;
+			vec2 projectedMin = vec2(FLT_MAX), projectedMax = vec2(-FLT_MAX);
+			for (uint8_t corner = 0; corner < 8U; ++corner)
+			{
+				const vec4 point = vec4(
+					view.position.x + (corner & 1U ? view.radius : -view.radius),
+					view.position.y + (corner & 2U ? view.radius : -view.radius),
+					-(corner & 4U ? furthest : nearest),
+					1.0f
+				);
+				const vec4 clip = l_projection * point;
+				if (clip.w <= 0.0f)
+				{
+					behind = true;
+					break;
+				}
+				const vec2 ndc = vec2(clip) / clip.w;
+				projectedMin = glm::min(projectedMin, ndc);
+				projectedMax = glm::max(projectedMax, ndc);
+			}
+			if (!behind)
+			{
+				ndcMin = glm::max(ndcMin, projectedMin);
+				ndcMax = glm::min(ndcMax, projectedMax);
+				if (ndcMin.x > ndcMax.x || ndcMin.y > ndcMax.y)
+				{	continue; }
+			}
+
+			const uint32_t beginX = (uint32_t)std::clamp((ndcMin.x * 0.5f + 0.5f) * getGridX(), 0.0f, getGridX() - 1.0f);
+			const uint32_t endX = (uint32_t)std::clamp((ndcMax.x * 0.5f + 0.5f) * getGridX(), 0.0f, getGridX() - 1.0f) + 1U;
+			const uint32_t beginY = (uint32_t)std::clamp((ndcMin.y * 0.5f + 0.5f) * getGridY(), 0.0f, getGridY() - 1.0f);
+			const uint32_t endY = (uint32_t)std::clamp((ndcMax.y * 0.5f + 0.5f) * getGridY(), 0.0f, getGridY() - 1.0f) + 1U;
+			const uint32_t endZ = sliceAt(furthest) + 1U;
+			const float sinAngle = std::sqrt(std::max(1.0f - light.cosAngle * light.cosAngle, 0.0f));
+
+			const size_t before = l_pairClusters.size();
+			for (uint32_t z = sliceAt(nearest); z < endZ; ++z)
+			{
+				for (uint32_t y = beginY; y < endY; ++y)
+				{	assignRow(clusterIndex(0U, y, z), beginX, endX, i, view, sinAngle); }
+			}
+			if (l_pairClusters.size() > before)
+			{	++l_stats.lights; }
+		}
+
+		// Counting sort by cluster, lights keep their order within each list
+		if (l_pairClusters.size() > _maxAssignments)
+		{
+			l_pairClusters.resize(_maxAssignments);
+			l_stats.truncated = true;
+		}
+		std::fill(l_table.begin(), l_table.end(), 0U);
+		for (const uint32_t cluster : l_pairClusters)
+		{	++l_table[cluster * 2U + 1U]; }
+		uint32_t offset = 0U;
+		for (uint32_t cluster = 0; cluster < getClusterCount(); ++cluster)
+		{
+			l_table[cluster * 2U] = offset;
+			offset += l_table[cluster * 2U + 1U];
+			l_stats.busiest = std::max(l_stats.busiest, l_table[cluster * 2U + 1U]);
+		}
+
+		l_indices.resize(l_pairClusters.size());
+		for (uint32_t cluster = 0; cluster < getClusterCount(); ++cluster)
+		{	l_table[cluster * 2U + 1U] = 0U; }
+		for (size_t i = 0; i < l_pairClusters.size(); ++i)
+		{
+			uint32_t *entry = &l_table[l_pairClusters[i] * 2U];
+			l_indices[entry[0] + entry[1]++] = l_pairLights[i];
+		}
+		l_stats.assignments = (uint32_t)l_indices.size();
+	}
+
+	const uint32_t *getTable() noexcept
+	{	return l_table.data(); }
+
+	const uint32_t *getIndices() noexcept
+	{	return l_indices.data(); }
+
+	uint32_t getIndexCount() noexcept
+	{	return (uint32_t)l_indices.size(); }
+
+	vec2 getSliceScale() noexcept
+	{	return l_sliceScale; }
+
+	stats getStats() noexcept
+	{	return l_stats; }
+}
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <stdint.h>
+#include "glm/vec2.hpp"
+#include "glm/vec3.hpp"
+#include "glm/mat4x4.hpp"
+
+#ifndef _NODISCARD
+#define _NODISCARD [[nodiscard]]
+#endif
+
+namespace srender
+{
+/** Clustered light assignment, entirely on the CPU.
+ * The view volume is cut into a grid of tiles across the screen and slices in depth,
+ * the slices growing exponentially so near clusters stay small. Each light is tested against
+ * only the clusters its range could reach, and every cluster ends up with a list of the lights that touch it.
+ * @note Assumes a perspective projection looking down -z.
+ */
+namespace clusters
+{
+	/** The size of the grid, the width is a multiple of the SIMD width so each row tests in whole registers. */
+	_NODISCARD constexpr uint32_t getGridX() { return 16U; }
+	_NODISCARD constexpr uint32_t getGridY() { return 9U; }
+	_NODISCARD constexpr uint32_t getGridZ() { return 24U; }
+	_NODISCARD constexpr uint32_t getClusterCount() { return getGridX() * getGridY() * getGridZ(); }
+	/** Light any dimmer than this is treated as none at all, a step of one in an 8 bit channel. */
+	_NODISCARD constexpr float getCutoff() { return 1.0f / 256.0f; }
+
+	/** Everywhere a point or spot light reaches, in world space. */
+	struct volume
+	{
+		glm::vec3 position = glm::vec3(0.0f);
+		float radius = 0.0f;
+		glm::vec3 direction = glm::vec3(0.0f, 0.0f, -1.0f);	// The way the cone opens, normalised
+		float cosAngle = -1.0f;	// Half the cone's angle, -1 for a point light
+	};
+
+	struct stats
+	{
+		uint32_t lights = 0U;	// Lights that reached at least one cluster
+		uint32_t assignments = 0U;	// Entries across every cluster's list
+		uint32_t busiest = 0U;	// The longest list of any cluster
+		bool truncated = false;	// More assignments than could be kept, the last lights lost some clusters
+	};
+
+	/** How far a light reaches before it falls under getCutoff.
+	 * @param _brightness The light's largest colour channel.
+	 * @return [float] The distance, FLT_MAX if the light never fades.
+	 */
+	_NODISCARD float getRadius(const float _linear, const float _quadratic, const float _brightness) noexcept;
+
+	/** Rebuilds the cluster boxes if the projection changed since the last call. */
+	void setProjection(const glm::mat4 &_projection, const float _near, const float _far) noexcept;
+	/** Fills every cluster's list for this frame.
+	 * @param _view World to view space.
+	 * @param _maxAssignments The most entries kept across all the lists.
+	 */
+	void assign(
+		const glm::mat4 &_view,
+		const volume *_lights,
+		const uint32_t _count,
+		const uint32_t _maxAssignments
+	);
+
+	/** Two words per cluster, where its list starts in getIndices and how long it is.
+	 * @note Clusters are ordered by x, then y, then slice.
+	 */
+	_NODISCARD const uint32_t *getTable() noexcept;
+	/** Every list one after another, each entry the index of a light as passed to assign. */
+	_NODISCARD const uint32_t *getIndices() noexcept;
+	_NODISCARD uint32_t getIndexCount() noexcept;
+	/** Turns a view space depth into a slice, as floor(log(depth) * x + y). */
+	_NODISCARD glm::vec2 getSliceScale() noexcept;
+	/** Counts from the last assign. */
+	_NODISCARD stats getStats() noexcept;
+}
+}
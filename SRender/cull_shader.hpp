@@ -0,0 +1,99 @@
+#pragma once
+
+// Every buffer is read as words, so each can start at any offset into the stream buffer
+#define CULL_COMPUTE "#version 430 core\n\
+layout(local_size_x=64)in;\
+layout(std430,binding=0)readonly buffer Instances{uint instances[];};\
+layout(std430,binding=1)buffer Commands{uint commands[];};\
+layout(std430,binding=2)readonly buffer Records{uint records[];};\
+layout(std430,binding=3)writeonly buffer Culled{uint culled[];};\
+uniform uint u_instanceBase;\
+uniform uint u_commandBase;\
+uniform uint u_recordBase;\
+uniform uint u_instanceCount;\
+uniform uint u_commandCount;\
+uniform vec4 u_planes[6];\
+uniform bool u_useHiZ;\
+uniform mat4 u_lastViewProj;\
+uniform sampler2D u_hiZ;\
+uniform ivec2 u_depthSize;\
+uniform int u_levels;\
+vec3 recordVec(uint _word){\
+return vec3(uintBitsToFloat(records[_word]),uintBitsToFloat(records[_word+1u]),uintBitsToFloat(records[_word+2u]));}\
+bool hidden(vec3 _min,vec3 _max){\
+vec2 ndcMin=vec2(1.0);\
+vec2 ndcMax=vec2(-1.0);\
+float nearest=1.0;\
+for(int i=0;i<8;++i){\
+vec4 clip=u_lastViewProj*vec4(mix(_min,_max,bvec3((i&1)!=0,(i&2)!=0,(i&4)!=0)),1.0);\
+if(clip.w<=0.0)return false;\
+vec3 ndc=clip.xyz/clip.w;\
+ndcMin=min(ndcMin,ndc.xy);\
+ndcMax=max(ndcMax,ndc.xy);\
+nearest=min(nearest,ndc.z);}\
+if(any(greaterThanEqual(ndcMin,vec2(1.0)))||any(lessThanEqual(ndcMax,vec2(-1.0))))return false;\
+ivec2 pixelMin=clamp(ivec2((ndcMin*0.5+0.5)*vec2(u_depthSize)),ivec2(0),u_depthSize-1);\
+ivec2 pixelMax=clamp(ivec2((ndcMax*0.5+0.5)*vec2(u_depthSize)),ivec2(0),u_depthSize-1);\
+int extent=max(pixelMax.x-pixelMin.x,pixelMax.y-pixelMin.y)+1;\
+int level=clamp(int(ceil(log2(float(extent))))-1,0,u_levels-1);\
+ivec2 texelMin=pixelMin>>(level+1);\
+ivec2 texelMax=pixelMax>>(level+1);\
+float furthest=0.0;\
+for(int y=texelMin.y;y<=texelMax.y;++y){\
+for(int x=texelMin.x;x<=texelMax.x;++x){\
+furthest=max(furthest,texelFetch(u_hiZ,ivec2(x,y),level).r);}}\
+return nearest*0.5+0.5>furthest;}\
+void main(){\
+uint id=gl_GlobalInvocationID.x;\
+if(id>=u_instanceCount)return;\
+uint low=0u;\
+uint high=u_commandCount-1u;\
+while(low<high){\
+uint middle=(low+high+1u)/2u;\
+if(records[u_recordBase+middle*8u+3u]<=id)low=middle;\
+else high=middle-1u;}\
+uint record=u_recordBase+low*8u;\
+uint source=u_instanceBase+id*25u;\
+if(records[record+7u]==0u){\
+vec3 localMin=recordVec(record);\
+vec3 localMax=recordVec(record+4u);\
+vec3 worldMin=vec3(uintBitsToFloat(instances[source+12u]),uintBitsToFloat(instances[source+13u]),uintBitsToFloat(instances[source+14u]));\
+vec3 worldMax=worldMin;\
+for(uint col=0u;col<3u;++col){\
+vec3 axis=vec3(uintBitsToFloat(instances[source+col*4u]),uintBitsToFloat(instances[source+col*4u+1u]),uintBitsToFloat(instances[source+col*4u+2u]));\
+vec3 a=axis*localMin[col];\
+vec3 b=axis*localMax[col];\
+worldMin+=min(a,b);\
+worldMax+=max(a,b);}\
+for(int p=0;p<6;++p){\
+vec3 front=mix(worldMin,worldMax,greaterThanEqual(u_planes[p].xyz,vec3(0.0)));\
+if(dot(u_planes[p].xyz,front)+u_planes[p].w<0.0)return;}\
+if(u_useHiZ&&hidden(worldMin,worldMax))return;}\
+uint slot=atomicAdd(commands[u_commandBase+low*5u+1u],1u);\
+uint target=(records[record+3u]+slot)*25u;\
+for(uint i=0u;i<25u;++i)culled[target+i]=instances[source+i];}"
+
+// Each texel keeps the furthest of the four below it, the last row or column of an odd level is read twice
+#define HIZ_COMPUTE "#version 430 core\n\
+layout(local_size_x=8,local_size_y=8)in;\
+layout(r32f,binding=0)writeonly uniform image2D u_target;\n\
+#ifdef FROM_DEPTH\n\
+uniform sampler2D u_source;\n\
+#else\n\
+layout(r32f,binding=1)readonly uniform image2D u_source;\n\
+#endif\n\
+uniform ivec2 u_sourceSize;\
+float load(ivec2 _texel){\
+_texel=min(_texel,u_sourceSize-1);\n\
+#ifdef FROM_DEPTH\n\
+return texelFetch(u_source,_texel,0).r;\n\
+#else\n\
+return imageLoad(u_source,_texel).r;\n\
+#endif\n\
+}\
+void main(){\
+ivec2 texel=ivec2(gl_GlobalInvocationID.xy);\
+if(any(greaterThanEqual(texel,imageSize(u_target))))return;\
+ivec2 below=texel*2;\
+float furthest=max(max(load(below),load(below+ivec2(1,0))),max(load(below+ivec2(0,1)),load(below+ivec2(1,1))));\
+imageStore(u_target,texel,vec4(furthest));}"
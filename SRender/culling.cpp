@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cmath>
+#include "culling.hpp"
+#include "glm/geometric.hpp"
+
+// Every x64 target has SSE, elsewhere the compiler says when it is enabled
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#include <xmmintrin.h>
+	#define CULLING_SSE
+#endif
+
+using glm::vec3;
+using glm::vec4;
+using glm::mat4;
+
+namespace srender
+{
+namespace culling
+{
+	bounds fromPoints(
+		const vec3 *_points,
+		const size_t _count,
+		const size_t _stride
+	) noexcept
+	{
+		bounds out;
+		if (_count == 0U)
+		{	return out; }
+
+		const uint8_t *bytes = (const uint8_t*)_points;
+		out.min = *_points;
+		out.max = *_points;
+		for (size_t i = 1; i < _count; ++i)
+		{
+			const vec3 &point = *(const vec3*)(bytes + i * _stride);
+			out.min = glm::min(out.min, point);
+			out.max = glm::max(out.max, point);
+		}
+
+		// Centred on the box, but only as big as the furthest point needs
+		out.centre = (out.min + out.max) * 0.5f;
+		float radiusSq = 0.0f;
+		for (size_t i = 0; i < _count; ++i)
+		{
+			const vec3 offset = *(const vec3*)(bytes + i * _stride) - out.centre;
+			radiusSq = std::max(radiusSq, glm::dot(offset, offset));
+		}
+		out.radius = std::sqrt(radiusSq);
+		out.empty = false;
+		return out;
+	}
+
+	bounds merge(const bounds &_a, const bounds &_b) noexcept
+	{
+		if (_a.empty)
+		{	return _b; }
+		if (_b.empty)
+		{	return _a; }
+
+		bounds out;
+		out.min = glm::min(_a.min, _b.min);
+		out.max = glm::max(_a.max, _b.max);
+		out.centre = (out.min + out.max) * 0.5f;
+		out.radius = std::max(
+			glm::length(_a.centre - out.centre) + _a.radius,
+			glm::length(_b.centre - out.centre) + _b.radius
+		);
+		out.empty = false;
+		return out;
+	}
+
+	bounds transform(const bounds &_bounds, const mat4 &_transform) noexcept
+	{
+		if (_bounds.empty)
+		{	return _bounds; }
+
+		// Arvo's method, each axis of the matrix adds its smallest and largest contribution
+		bounds out;
+		out.min = vec3(_transform[3]);
+		out.max = out.min;
+		for (uint8_t col = 0; col < 3U; ++col)
+		{
+			for (uint8_t row = 0; row < 3U; ++row)
+			{
+				const float a = _transform[col][row] * _bounds.min[col];
+				const float b = _transform[col][row] * _bounds.max[col];
+				out.min[row] += std::min(a, b);
+				out.max[row] += std::max(a, b);
+			}
+		}
+
+		const vec4 sphere = transformSphere(_bounds, _transform);
+		out.centre = vec3(sphere);
+		out.radius = sphere.w;
+		out.empty = false;
+		return out;
+	}
+
+	vec4 transformSphere(const bounds &_bounds, const mat4 &_transform) noexcept
+	{
+		const float scaleSq = std::max({
+			glm::dot(vec3(_transform[0]), vec3(_transform[0])),
+			glm::dot(vec3(_transform[1]), vec3(_transform[1])),
+			glm::dot(vec3(_transform[2]), vec3(_transform[2]))
+		});
+		return vec4(vec3(_transform * vec4(_bounds.centre, 1.0f)), _bounds.radius * std::sqrt(scaleSq));
+	}
+
+	frustum extractFrustum(const mat4 &_viewProjection) noexcept
+	{
+		// Rows of the matrix, glm stores it by column
+		vec4 rows[4];
+		for (uint8_t i = 0; i < 4U; ++i)
+		{	rows[i] = vec4(_viewProjection[0][i], _viewProjection[1][i], _viewProjection[2][i], _viewProjection[3][i]); }
+
+		frustum out;
+		out.planes[0] = rows[3] + rows[0];	// Left
+		out.planes[1] = rows[3] - rows[0];	// Right
+		out.planes[2] = rows[3] + rows[1];	// Bottom
+		out.planes[3] = rows[3] - rows[1];	// Top
+		out.planes[4] = rows[3] + rows[2];	// Near
+		out.planes[5] = rows[3] - rows[2];	// Far
+		// Normalised so the distance to a plane can be compared against a radius
+		for (vec4 &plane : out.planes)
+		{	plane /= glm::length(vec3(plane)); }
+		return out;
+	}
+
+	bool testSphere(const frustum &_frustum, const vec4 &_sphere) noexcept
+	{
+		for (const vec4 &plane : _frustum.planes)
+		{
+			if (glm::dot(vec3(plane), vec3(_sphere)) + plane.w < -_sphere.w)
+			{	return false; }
+		}
+		return true;
+	}
+
+	bool testBox(const frustum &_frustum, const bounds &_bounds) noexcept
+	{
+		for (const vec4 &plane : _frustum.planes)
+		{
+			// The corner most in front of the plane, if that is behind so is the whole box
+			const vec3 corner = vec3(
+				plane.x >= 0.0f ? _bounds.max.x : _bounds.min.x,
+				plane.y >= 0.0f ? _bounds.max.y : _bounds.min.y,
+				plane.z >= 0.0f ? _bounds.max.z : _bounds.min.z
+			);
+			if (glm::dot(vec3(plane), corner) + plane.w < 0.0f)
+			{	return false; }
+		}
+		return true;
+	}
+
+	containment classifyBox(const frustum &_frustum, const vec3 &_min, const vec3 &_max) noexcept
+	{
+		containment out = containment::inside;
+		for (const vec4 &plane : _frustum.planes)
+		{
+			const vec3 normal = vec3(plane);
+			const vec3 front = vec3(
+				plane.x >= 0.0f ? _max.x : _min.x,
+				plane.y >= 0.0f ? _max.y : _min.y,
+				plane.z >= 0.0f ? _max.z : _min.z
+			);
+			if (glm::dot(normal, front) + plane.w < 0.0f)
+			{	return containment::outside; }
+
+			// The opposite corner behind the plane means the box crosses it
+			const vec3 back = _min + _max - front;
+			if (glm::dot(normal, back) + plane.w < 0.0f)
+			{	out = containment::intersecting; }
+		}
+		return out;
+	}
+
+	void testSpheres(
+		const frustum &_frustum,
+		const vec4 *_spheres,
+		const uint32_t _count,
+		uint8_t *_outVisible
+	) noexcept
+	{
+		uint32_t i = 0;
+		#ifdef CULLING_SSE
+			for (; i + 4U <= _count; i += 4U)
+			{
+				// Transposed so each register holds one component of all four spheres
+				__m128 x = _mm_loadu_ps(&_spheres[i].x);
+				__m128 y = _mm_loadu_ps(&_spheres[i + 1U].x);
+				__m128 z = _mm_loadu_ps(&_spheres[i + 2U].x);
+				__m128 radius = _mm_loadu_ps(&_spheres[i + 3U].x);
+				_MM_TRANSPOSE4_PS(x, y, z, radius);
+				const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+
+				__m128 visible = _mm_setzero_ps();
+				for (uint8_t p = 0; p < 6U; ++p)
+				{
+					const vec4 &plane = _frustum.planes[p];
+					__m128 distance = _mm_mul_ps(x, _mm_set1_ps(plane.x));
+					distance = _mm_add_ps(distance, _mm_mul_ps(y, _mm_set1_ps(plane.y)));
+					distance = _mm_add_ps(distance, _mm_mul_ps(z, _mm_set1_ps(plane.z)));
+					distance = _mm_add_ps(distance, _mm_set1_ps(plane.w));
+					const __m128 inside = _mm_cmpge_ps(distance, negRadius);
+					visible = p == 0U ? inside : _mm_and_ps(visible, inside);
+				}
+
+				const int mask = _mm_movemask_ps(visible);
+				for (uint8_t j = 0; j < 4U; ++j)
+				{	_outVisible[i + j] = (uint8_t)((mask >> j) & 1); }
+			}
+		#endif
+		// The remainder, or everything without SSE
+		for (; i < _count; ++i)
+		{	_outVisible[i] = (uint8_t)testSphere(_frustum, _spheres[i]); }
+	}
+}
+}
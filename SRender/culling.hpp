@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+#include <cstddef>
+#include "glm/vec3.hpp"
+#include "glm/vec4.hpp"
+#include "glm/mat4x4.hpp"
+
+#ifndef _NODISCARD
+#define _NODISCARD [[nodiscard]]
+#endif
+
+namespace srender
+{
+/** Bounding volumes and the frustum tests that skip anything the camera can not see. */
+namespace culling
+{
+	/** An axis aligned box and a sphere around the same points, in whatever space the points were in. */
+	struct bounds
+	{
+		glm::vec3 min = glm::vec3(0.0f);
+		glm::vec3 max = glm::vec3(0.0f);
+		glm::vec3 centre = glm::vec3(0.0f);
+		float radius = 0.0f;
+		bool empty = true;	// Nothing has been added yet, min and max mean nothing
+	};
+
+	/** The six planes of the view volume, pointing inwards with xyz normalised. */
+	struct frustum
+	{
+		glm::vec4 planes[6];
+	};
+
+	struct stats
+	{
+		uint32_t modelsVisible = 0U;
+		uint32_t modelsCulled = 0U;
+		uint32_t modelsOccluded = 0U;	// Inside the frustum but hidden behind occluders, also counted as culled
+		uint32_t meshesVisible = 0U;	// Only counts meshes of visible models
+		uint32_t meshesCulled = 0U;
+		uint32_t nodesTested = 0U;	// Scene tree nodes, each stands for every model below it
+		uint32_t modelsConditional = 0U;	// Hidden from the GPU last time, left to their new query to draw or not
+		uint32_t queries = 0U;	// GPU occlusion queries issued
+	};
+
+	/** Where a volume sits against the frustum. */
+	enum class containment : uint8_t
+	{
+		outside,
+		intersecting,
+		inside
+	};
+
+	/** Builds bounds around a set of points.
+	 * @param _stride Bytes from one point to the next, so positions can be read straight out of vertices.
+	 */
+	_NODISCARD bounds fromPoints(
+		const glm::vec3 *_points,
+		const size_t _count,
+		const size_t _stride = sizeof(glm::vec3)
+	) noexcept;
+	/** Bounds that hold both, either can be empty. */
+	_NODISCARD bounds merge(const bounds &_a, const bounds &_b) noexcept;
+	/** Moves bounds into another space, the box grows to stay axis aligned. */
+	_NODISCARD bounds transform(const bounds &_bounds, const glm::mat4 &_transform) noexcept;
+	/** Only the sphere of transform, packed as centre and radius.
+	 * @note The radius is scaled by the largest axis, so it stays conservative under non-uniform scale.
+	 */
+	_NODISCARD glm::vec4 transformSphere(const bounds &_bounds, const glm::mat4 &_transform) noexcept;
+
+	/** Pulls the planes out of a projection * view matrix, the result is in world space. */
+	_NODISCARD frustum extractFrustum(const glm::mat4 &_viewProjection) noexcept;
+	_NODISCARD bool testSphere(const frustum &_frustum, const glm::vec4 &_sphere) noexcept;
+	/** Tests the corner of the box furthest along each plane, so it may pass boxes just outside a corner. */
+	_NODISCARD bool testBox(const frustum &_frustum, const bounds &_bounds) noexcept;
+	/** Like testBox, but also says when the box is entirely inside, so nothing within it needs testing. */
+	_NODISCARD containment classifyBox(
+		const frustum &_frustum,
+		const glm::vec3 &_min,
+		const glm::vec3 &_max
+	) noexcept;
+	/** Tests many spheres at once, four to a SIMD register where available.
+	 * @param _spheres Centres and radii packed as in transformSphere.
+	 * @param _outVisible Set to 1 for each sphere at least partly inside, 0 otherwise.
+	 */
+	void testSpheres(
+		const frustum &_frustum,
+		const glm::vec4 *_spheres,
+		const uint32_t _count,
+		uint8_t *_outVisible
+	) noexcept;
+}
+}
@@ -4,97 +4,237 @@
 layout(location=0)in vec3 aPos;\
 layout(location=1)in vec3 aNormal;\
 layout(location=2)in vec2 aTexCoords;\
+layout(location=3)in mat4 aModel;\
+layout(location=7)in mat3 aTransposeInverseOfModel;\
 out vec3 FragPos;\
 out vec3 Normal;\
 out vec2 TexCoords;\
-uniform mat4 u_camera;\
-uniform mat4 u_model;\
-uniform mat3 u_transposeInverseOfModel;\
-void main(){\
-vec4 vertModel=u_model*vec4(aPos,1.0);\
+layout(std140)uniform Camera{mat4 u_camera;vec3 u_viewPos;};\
+invariant gl_Position;\
+void main(){\n\
+#if defined(DEFERRED_LIGHTING) || defined(CHECKERBOARD_RESOLVE)\n\
+vec2 corner=vec2((gl_VertexID<<1)&2,gl_VertexID&2);\
+gl_Position=vec4(corner*2.0-1.0,0.0,1.0);\n\
+#else\n\
+vec4 vertModel=aModel*vec4(aPos,1.0);\
 TexCoords=aTexCoords;\
-Normal=normalize(u_transposeInverseOfModel*aNormal);\
+Normal=normalize(aTransposeInverseOfModel*aNormal);\
 FragPos=vertModel.xyz;\
-gl_Position=u_camera*vertModel;}"
+gl_Position=u_camera*vertModel;\n\
+#endif\n\
+}"
 
 #define FRAGMENT_FALLBACK "#version 330 core\n\
 #define normalise normalize\n\
-const int NR_DIR_LIGHTS=3;\
-const int NR_POINT_LIGHTS=30;\
-const int NR_SPOT_LIGHTS=30;\
+#define MAX_DIR_LIGHTS 3\n\
+#define MAX_SHININESS 1024.0\n\
+#define SHADOW_CASCADES 4\n\
+#ifndef EXACT_LIGHT_COUNTS\n\
+#define NR_DIR_LIGHTS MAX_DIR_LIGHTS\n\
+#endif\n\
 const float near=0.1;\
 const float far=500.0;\
-out vec4 FragCol;\
+\n\
+#ifdef DEFERRED\n\
+layout(location=0)out vec4 FragCol;\
+layout(location=1)out vec4 FragMaterial;\n\
+#else\n\
+out vec4 FragCol;\n\
+#endif\n\
+#ifdef DEFERRED_LIGHTING\n\
+vec3 FragPos;\
+vec3 Normal;\
+uniform sampler2D u_gAlbedo;\
+uniform sampler2D u_gMaterial;\
+uniform sampler2D u_gDepth;\
+uniform mat4 u_inverseCamera;\n\
+#else\n\
 in vec3 FragPos;\
 in vec3 Normal;\
-in vec2 TexCoords;\
+in vec2 TexCoords;\n\
+#endif\n\
+#ifdef CHECKERBOARD_RESOLVE\n\
+uniform sampler2D u_cbCurrent;\
+uniform sampler2D u_cbDepth;\
+uniform sampler2D u_cbHistory;\
+uniform mat4 u_cbReproject;\
+uniform int u_cbParity;\
+uniform bool u_cbHistoryValid;\n\
+#endif\n\
 struct Material{float shininess;sampler2D texture_diffuse0;sampler2D texture_specular0;};\
 struct LightColour{vec3 ambient;vec3 diffuse;vec3 specular;};\
 struct LightDirectional{LightColour colour;vec4 direction;};\
-struct LightPoint{LightColour colour;vec4 position;float linear;float quadratic;};\
-struct LightSpot{LightColour colour;vec4 position;vec4 direction;float linear;float quadratic;float cutoff;float blur;};\
-uniform bool u_depthBuffer=false;\
-uniform bool u_useTextures=false;\
-uniform bool u_fullbright=false;\
-uniform vec3 u_viewPos;\
 uniform vec3 u_colour=vec3(1.0);\
 uniform Material u_material;\
-uniform LightDirectional[NR_DIR_LIGHTS] u_dirLights;\
-uniform LightPoint[NR_POINT_LIGHTS] u_pointLights;\
-uniform LightSpot[NR_SPOT_LIGHTS] u_spotLights;\
+layout(std140)uniform Camera{mat4 u_camera;vec3 u_viewPos;};\
+layout(std140)uniform DirLights{LightDirectional u_dirLights[MAX_DIR_LIGHTS];};\
+layout(std140)uniform Clusters{vec4 u_depthPlane;vec4 u_clusterScale;uvec4 u_clusterGrid;};\
+uniform samplerBuffer u_lights;\
+uniform usamplerBuffer u_clusters;\
+uniform usamplerBuffer u_clusterLights;\
+uniform samplerBuffer u_shadowViews;\
+uniform sampler2DShadow u_shadowAtlas;\
 vec3 m_viewDir;\
+vec3 m_diffuseTex=vec3(1.0);\
+vec3 m_specularTex=vec3(1.0);\
+float m_shininess;\
 vec3 PhongShading(LightColour _colour,vec3 _lightDir,float _intensity){\
-vec3 diffuseTex=vec3(1.0);\
-vec3 specularTex=vec3(1.0);\
-if(u_useTextures){\
-diffuseTex=texture(u_material.texture_diffuse0,TexCoords).rgb;\
-specularTex=texture(u_material.texture_specular0,TexCoords).rgb;}\
 float diff=max(dot(Normal,_lightDir),0.0);\
 vec3 reflectDir=reflect(-_lightDir,Normal);\
-float spec=pow(max(dot(m_viewDir,reflectDir),0.0),u_material.shininess);\
-vec3 ambient=_colour.ambient*diffuseTex;\
-vec3 diffuse=_colour.diffuse*diffuseTex*diff*_intensity;\
-vec3 specular=_colour.specular*specularTex*spec*_intensity;\
+float spec=pow(max(dot(m_viewDir,reflectDir),0.0),m_shininess);\
+vec3 ambient=_colour.ambient*m_diffuseTex;\
+vec3 diffuse=_colour.diffuse*m_diffuseTex*diff*_intensity;\
+vec3 specular=_colour.specular*m_specularTex*spec*_intensity;\
 return ambient+diffuse+specular;}\
 float CalculateAttentuation(float _dist,float _linear,float _quadratic){\
 return 1.0/(1.0+_linear*_dist+_quadratic*(_dist*_dist));}\
+vec3 ShadowCoord(int _view){\
+int base=_view*5;\
+mat4 toAtlas=mat4(texelFetch(u_shadowViews,base),texelFetch(u_shadowViews,base+1),texelFetch(u_shadowViews,base+2),texelFetch(u_shadowViews,base+3));\
+vec4 coord=toAtlas*vec4(FragPos,1.0);\
+return coord.xyz/coord.w;}\
+bool InsideTile(int _view,vec3 _coord){\
+vec4 tile=texelFetch(u_shadowViews,_view*5+4);\
+return all(greaterThanEqual(_coord.xy,tile.xy))&&all(lessThanEqual(_coord.xy,tile.zw));}\
+float SampleShadow(int _view,vec3 _coord){\
+if(_coord.z>=1.0)\
+return 1.0;\
+vec4 tile=texelFetch(u_shadowViews,_view*5+4);\
+return texture(u_shadowAtlas,vec3(clamp(_coord.xy,tile.xy,tile.zw),_coord.z));}\
+float DirectionalShadow(int _first){\
+if(_first<0)\
+return 1.0;\
+for(int i=0;i<SHADOW_CASCADES;++i){\
+vec3 coord=ShadowCoord(_first+i);\
+if(InsideTile(_first+i,coord))\
+return SampleShadow(_first+i,coord);}\
+return 1.0;}\
+int CubeFace(vec3 _dir){\
+vec3 size=abs(_dir);\
+if(size.x>=size.y&&size.x>=size.z)\
+return _dir.x>=0.0?0:1;\
+if(size.y>=size.z)\
+return _dir.y>=0.0?2:3;\
+return _dir.z>=0.0?4:5;}\
 vec3 CalculateDirectionalLighting(LightDirectional _light){\
 vec3 lightDir=normalise(_light.direction.xyz);\
-return PhongShading(_light.colour,lightDir,1);}\
-vec3 CalculatePointLight(LightPoint _light){\
-if(length(_light.linear)==0)return vec3(0);\
-vec3 lightDiff=_light.position.xyz-FragPos;\
+return PhongShading(_light.colour,lightDir,DirectionalShadow(int(_light.direction.w)));}\
+vec3 CalculateClusteredLight(int _index){\
+vec4 position=texelFetch(u_lights,_index*4);\
+vec4 colour=texelFetch(u_lights,_index*4+1);\
+vec4 direction=texelFetch(u_lights,_index*4+2);\
+vec4 cone=texelFetch(u_lights,_index*4+3);\
+vec3 lightDiff=position.xyz-FragPos;\
 vec3 lightDir=normalise(lightDiff);\
 float lightDist=length(lightDiff);\
-float attenuation=CalculateAttentuation(lightDist,_light.linear,_light.quadratic);\
-return PhongShading(_light.colour,lightDir,1)*attenuation;}\
-vec3 CalculateSpotLight(LightSpot _light){\
-if(length(_light.linear)==0)return vec3(0);\
-vec3 lightDiff=_light.position.xyz-FragPos;\
-vec3 lightDir=normalise(lightDiff);\
-float lightDist=length(lightDiff);\
-float attenuation=CalculateAttentuation(lightDist,_light.linear,_light.quadratic);\
+float attenuation=CalculateAttentuation(lightDist,colour.w,direction.w);\
 float intensity=1;\
-float theta=dot(lightDir,normalise(_light.direction.xyz));\
-float epsilon=(_light.blur*(1-_light.cutoff)+_light.cutoff)-_light.cutoff;\
-intensity=clamp((theta-_light.cutoff)/epsilon,0.0,1.0);\
-return PhongShading(_light.colour,lightDir,intensity)*attenuation;}\
+if(position.w>0.5){\
+float theta=dot(lightDir,normalise(direction.xyz));\
+float epsilon=(cone.y*(1-cone.x)+cone.x)-cone.x;\
+intensity=clamp((theta-cone.x)/epsilon,0.0,1.0);}\
+int shadowView=int(cone.z);\
+if(shadowView>=0){\
+if(position.w<0.5)\
+shadowView+=CubeFace(FragPos-position.xyz);\
+intensity*=SampleShadow(shadowView,ShadowCoord(shadowView));}\
+return PhongShading(LightColour(vec3(0.0),colour.rgb,colour.rgb),lightDir,intensity)*attenuation;}\
+uint ClusterIndex(){\
+float depth=max(dot(u_depthPlane,vec4(FragPos,1.0)),near);\
+vec3 cell=vec3(gl_FragCoord.xy*u_clusterScale.xy,log(depth)*u_clusterScale.z+u_clusterScale.w);\
+uvec3 clamped=uvec3(clamp(ivec3(cell),ivec3(0),ivec3(u_clusterGrid.xyz)-1));\
+return (clamped.z*u_clusterGrid.y+clamped.y)*u_clusterGrid.x+clamped.x;}\
+vec2 OctEncode(vec3 _normal){\
+_normal/=abs(_normal.x)+abs(_normal.y)+abs(_normal.z);\
+vec2 signs=vec2(_normal.x>=0.0?1.0:-1.0,_normal.y>=0.0?1.0:-1.0);\
+vec2 folded=_normal.z>=0.0?_normal.xy:(1.0-abs(_normal.yx))*signs;\
+return folded*0.5+0.5;}\
+vec3 OctDecode(vec2 _encoded){\
+_encoded=_encoded*2.0-1.0;\
+vec3 normal=vec3(_encoded,1.0-abs(_encoded.x)-abs(_encoded.y));\
+float fold=max(-normal.z,0.0);\
+normal.xy-=fold*vec2(normal.x>=0.0?1.0:-1.0,normal.y>=0.0?1.0:-1.0);\
+return normalise(normal);}\
 float LineariseDepth(float pDepth){\
 float z=pDepth*2.0-1.0;\
 return (2.0*near*far)/(far+near-z*(far-near));}\
-void main(){\
-if(u_depthBuffer){\
-FragCol=vec4(vec3(LineariseDepth(gl_FragCoord.z)/far),1.0);\
-}else if(u_fullbright){\
-FragCol=vec4(u_colour,1);\
-}else{\
-m_viewDir=normalise(u_viewPos-FragPos);\
-vec3 result;\
+void main(){\n\
+#if defined(CHECKERBOARD_RESOLVE)\n\
+ivec2 pixel=ivec2(gl_FragCoord.xy);\
+ivec2 drawnSize=textureSize(u_cbCurrent,0);\
+if((pixel.x&1)==u_cbParity){\
+FragCol=vec4(texelFetch(u_cbCurrent,ivec2(pixel.x>>1,pixel.y),0).rgb,1.0);\
+return;}\
+ivec2 left=ivec2(clamp((pixel.x-1)>>1,0,drawnSize.x-1),pixel.y);\
+ivec2 right=ivec2(clamp((pixel.x+1)>>1,0,drawnSize.x-1),pixel.y);\
+vec3 leftCol=texelFetch(u_cbCurrent,left,0).rgb;\
+vec3 rightCol=texelFetch(u_cbCurrent,right,0).rgb;\
+vec3 result=(leftCol+rightCol)*0.5;\
+if(u_cbHistoryValid){\
+float depth=min(texelFetch(u_cbDepth,left,0).r,texelFetch(u_cbDepth,right,0).r);\
+vec2 ndc=gl_FragCoord.xy/vec2(textureSize(u_cbHistory,0))*2.0-1.0;\
+vec4 last=u_cbReproject*vec4(ndc,depth*2.0-1.0,1.0);\
+vec2 uv=last.xy/last.w*0.5+0.5;\
+if(last.w>0.0&&all(greaterThanEqual(uv,vec2(0.0)))&&all(lessThanEqual(uv,vec2(1.0)))){\
+vec3 low=min(leftCol,rightCol);\
+vec3 high=max(leftCol,rightCol);\
+for(int row=-1;row<=1;row+=2){\
+int y=clamp(pixel.y+row,0,drawnSize.y-1);\
+vec3 leftRow=texelFetch(u_cbCurrent,ivec2(left.x,y),0).rgb;\
+vec3 rightRow=texelFetch(u_cbCurrent,ivec2(right.x,y),0).rgb;\
+low=min(low,min(leftRow,rightRow));\
+high=max(high,max(leftRow,rightRow));}\
+result=clamp(texture(u_cbHistory,uv).rgb,low,high);}}\
+FragCol=vec4(result,1.0);\n\
+#elif defined(BOUNDS_ONLY)\n\
+FragCol=vec4(1.0);\n\
+#elif defined(DEPTH_BUFFER)\n\
+FragCol=vec4(vec3(LineariseDepth(gl_FragCoord.z)/far),1.0);\n\
+#elif defined(FULLBRIGHT) && !defined(DEFERRED)\n\
+FragCol=vec4(u_colour,1);\n\
+#else\n\
+#ifdef DEFERRED_LIGHTING\n\
+ivec2 texel=ivec2(gl_FragCoord.xy);\
+float depth=texelFetch(u_gDepth,texel,0).r;\
+if(depth>=1.0)\
+discard;\
+vec4 albedo=texelFetch(u_gAlbedo,texel,0);\
+vec4 material=texelFetch(u_gMaterial,texel,0);\
+if(material.a<0.5){\
+FragCol=vec4(albedo.rgb,1);\
+return;}\
+vec2 ndc=gl_FragCoord.xy/vec2(textureSize(u_gDepth,0))*2.0-1.0;\
+vec4 world=u_inverseCamera*vec4(ndc,depth*2.0-1.0,1.0);\
+FragPos=world.xyz/world.w;\
+Normal=OctDecode(material.xy);\
+m_diffuseTex=albedo.rgb;\
+m_specularTex=vec3(albedo.a);\
+m_shininess=material.z*MAX_SHININESS;\n\
+#else\n\
+m_shininess=u_material.shininess;\n\
+#ifdef USE_TEXTURES\n\
+m_diffuseTex=texture(u_material.texture_diffuse0,TexCoords).rgb;\
+m_specularTex=texture(u_material.texture_specular0,TexCoords).rgb;\n\
+#endif\n\
+#endif\n\
+#if defined(DEFERRED)\n\
+#ifdef FULLBRIGHT\n\
+FragCol=vec4(u_colour,0.0);\
+FragMaterial=vec4(0.0);\n\
+#else\n\
+vec3 specular=m_specularTex*u_colour;\
+FragCol=vec4(m_diffuseTex*u_colour,(specular.r+specular.g+specular.b)/3.0);\
+FragMaterial=vec4(OctEncode(normalise(Normal)),m_shininess/MAX_SHININESS,1.0);\n\
+#endif\n\
+#else\n\
+m_viewDir=normalise(u_viewPos-FragPos);\n\
+vec3 result=vec3(0.0);\
 for(int i=0;i<NR_DIR_LIGHTS;++i)\
 result+=CalculateDirectionalLighting(u_dirLights[i]);\
-for(int i=0;i<NR_POINT_LIGHTS;++i)\
-result+=CalculatePointLight(u_pointLights[i]);\
-for(int i=0;i<NR_SPOT_LIGHTS;++i)\
-result+=CalculateSpotLight(u_spotLights[i]);\
-FragCol=vec4(result*u_colour,1);}\
+uvec2 range=texelFetch(u_clusters,int(ClusterIndex())).xy;\
+for(uint i=0u;i<range.y;++i)\
+result+=CalculateClusteredLight(int(texelFetch(u_clusterLights,int(range.x+i)).r));\
+FragCol=vec4(result*u_colour,1);\n\
+#endif\n\
+#endif\n\
 return;}"
@@ -0,0 +1,119 @@
+#include "deferred.hpp"
+#include "renderer.hpp"
+#include "debug.hpp"
+#include "glm/matrix.hpp"
+
+using glm::mat4;
+
+namespace srender
+{
+namespace deferred
+{
+	constexpr shader::uniformId l_uInverseCamera = shader::uniform("u_inverseCamera");
+	/** The sampler of each target in the lighting program, in the order of target. */
+	constexpr shader::uniformId l_uTargets[(uint8_t)target::count] = {
+		shader::uniform("u_gAlbedo"),
+		shader::uniform("u_gMaterial"),
+		shader::uniform("u_gDepth")
+	};
+
+	/** The textures of the G-buffer, in the order of target. */
+	uint32_t l_idTargets[(uint8_t)target::count] = {};
+	uint32_t l_idFBO = 0U;
+	uint32_t l_width = 0U, l_height = 0U;
+	/** The built in shader lighting every pixel, swapped when the light counts change. */
+	shader *l_lighting = nullptr;
+	uint64_t l_lightingKey = UINT64_MAX;
+
+	void deleteTargets() noexcept
+	{
+		if (l_idFBO)
+		{	renderer::deleteFramebuffer(l_idFBO); }
+		l_idFBO = 0U;
+		if (l_idTargets[0])
+		{	renderer::deleteTextures(l_idTargets, (uint32_t)target::count); }
+		for (uint32_t &idTex : l_idTargets)
+		{	idTex = 0U; }
+		l_width = l_height = 0U;
+	}
+
+	void resize(const uint32_t _width, const uint32_t _height) noexcept
+	{
+		deleteTargets();
+		l_width = _width;
+		l_height = _height;
+		l_idTargets[(uint8_t)target::albedo] = renderer::createTargetTexture(_width, _height, renderer::targetFormat::rgba8);
+		// 8 bits would band the normals, 16 keeps them under a hundredth of a degree apart
+		l_idTargets[(uint8_t)target::material] = renderer::createTargetTexture(_width, _height, renderer::targetFormat::rgba16);
+		// Matches the screen's format, so the depth can be blitted there once lighting is done
+		l_idTargets[(uint8_t)target::depth] = renderer::createDepthTexture(_width, _height);
+		l_idFBO = renderer::createFramebuffer(l_idTargets, 2U, l_idTargets[(uint8_t)target::depth]);
+		if (!l_idFBO)
+		{
+			debug::send(
+				"The driver cannot draw into the G-buffer, staying forward",
+				debug::type::note, debug::impact::large, debug::stage::mid
+			);
+		}
+	}
+
+	bool prepare(const shader::permutation &_scene)
+	{
+		uint32_t width, height;
+		renderer::getViewportSize(&width, &height);
+		// Minimised, there is nothing to draw into
+		if (width == 0U || height == 0U)
+		{	return false; }
+		if (width != l_width || height != l_height)
+		{	resize(width, height); }
+
+		// Only the light counts change how the lighting program is built
+		shader::permutation options = shader::permutation();
+		options.dirLights = _scene.dirLights;
+		if (options.key() != l_lightingKey)
+		{
+			l_lightingKey = options.key();
+			shader::release(l_lighting);
+			l_lighting = shader::acquire(nullptr, options.defines() + "#define DEFERRED_LIGHTING\n");
+		}
+		// Until it compiles the frame is drawn forward
+		return l_idFBO && l_lighting->isLoaded();
+	}
+
+	void beginGeometry() noexcept
+	{
+		renderer::bindFramebuffer(l_idFBO);
+		// A material alpha of 0 passes the albedo straight through, which is also what a shader
+		// that never writes the material target gets, on drivers that leave unwritten outputs alone
+		renderer::clearTargets(2U);
+	}
+
+	void light(const mat4 &_viewProjection) noexcept
+	{
+		renderer::bindFramebuffer(0U);
+		for (uint8_t i = 0; i < (uint8_t)target::count; ++i)
+		{
+			renderer::setActiveTexture(getTargetUnit((target)i));
+			renderer::bindTexture2D(l_idTargets[i]);
+			l_lighting->setInt(l_uTargets[i], getTargetUnit((target)i));
+		}
+		l_lighting->setMat4(l_uInverseCamera, glm::inverse(_viewProjection));
+		l_lighting->use();
+
+		// Pixels are written once each, their depth comes from the G-buffer instead
+		renderer::setDepthWrites(false);
+		renderer::drawFullscreenTriangle();
+		renderer::setDepthWrites(true);
+		renderer::blitDepthToScreen(l_idFBO, l_width, l_height);
+	}
+
+	void terminate() noexcept
+	{
+		deleteTargets();
+		shader::release(l_lighting);
+		l_lighting = nullptr;
+		l_lightingKey = UINT64_MAX;
+		renderer::releaseTargets();
+	}
+}
+}
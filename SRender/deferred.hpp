@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include "glm/mat4x4.hpp"
+#include "shader.hpp"
+
+#ifndef _NODISCARD
+#define _NODISCARD [[nodiscard]]
+#endif
+
+namespace srender
+{
+/** Deferred shading, geometry is drawn once into a G-buffer and every pixel is lit once afterwards.
+ * The G-buffer holds the surface, not its colour:
+ * albedo and specular in one RGBA8 target, an octahedral normal, shininess and a lit flag in one RGBA16 target,
+ * and depth, which the world position is rebuilt from.
+ * Lighting is one fullscreen pass of the built in shader, finding its lights through the same clusters as forward.
+ * @note Models must use shaders that write the G-buffer when DEFERRED is defined, as default.frag does.
+ */
+namespace deferred
+{
+	/** The textures of the G-buffer, in the order they are drawn into. */
+	enum class target: uint8_t
+	{
+		albedo,	// Albedo, and specular in alpha
+		material,	// Octahedral normal, shininess, and 0 in alpha for colour that is already final
+		depth,
+		count
+	};
+
+	/** Each target is bound here for the lighting pass, below the shared textures and clear of model textures. */
+	_NODISCARD constexpr uint8_t getTargetUnit(const target _target) { return 8U + (uint8_t)_target; }
+
+	/** Makes sure the G-buffer matches the screen and the lighting program matches the scene.
+	 * @param _scene The scene's options, only the light counts are used.
+	 * @return [bool] If a deferred frame can be drawn, false while the lighting program compiles or if the G-buffer failed.
+	 */
+	_NODISCARD bool prepare(const shader::permutation &_scene);
+	/** Draws into the G-buffer from here on, cleared for the new frame. */
+	void beginGeometry() noexcept;
+	/** Lights every covered pixel onto the screen, then copies the G-buffer's depth there for anything drawn after.
+	 * @param _viewProjection The camera's projection * view matrix, positions are rebuilt with its inverse.
+	 */
+	void light(const glm::mat4 &_viewProjection) noexcept;
+	void terminate() noexcept;
+}
+}
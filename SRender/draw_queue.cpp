@@ -0,0 +1,354 @@
+#include <vector>
+#include "draw_queue.hpp"
+#include "model.hpp"
+#include "renderer.hpp"
+#include "gpu_culling.hpp"
+
+using std::vector;
+
+namespace srender
+{
+namespace drawQueue
+{
+	/** What the radix sort moves around, much smaller than a packet. */
+	struct sortItem
+	{
+		uint64_t key;
+		uint32_t index;
+	};
+
+	/** Neighbouring packets drawn by one instanced draw, in sorted order. */
+	struct run
+	{
+		uint32_t first;
+		uint32_t count;
+	};
+
+	static_assert(sizeof(instance) == renderer::getInstanceSize(), "instance does not match the instance attributes");
+
+	vector<packet> l_packets = vector<packet>();
+	vector<sortItem> l_order = vector<sortItem>();
+	vector<sortItem> l_scratch = vector<sortItem>();
+	vector<run> l_runs = vector<run>();
+	/** Index of this frame's first instance in the stream buffer, run offsets are relative to it. */
+	uint32_t l_firstInstance = 0U;
+	vector<renderer::geometryRange> l_ranges = vector<renderer::geometryRange>();
+	stats l_stats;
+
+	/** Keeps the lowest bits of a value and moves them into place in the key. */
+	_NODISCARD constexpr uint64_t keyField(
+		const uint64_t _value,
+		const uint8_t _bits,
+		const uint8_t _shift
+	) noexcept
+	{	return (_value & ((1ULL << _bits) - 1ULL)) << _shift; }
+
+	uint64_t makeKey(
+		const pass _pass,
+		const uint32_t _program,
+		const uint32_t _material,
+		const uint32_t _mesh,
+		const float _depth
+	) noexcept
+	{
+		constexpr uint32_t depthMax = (1U << 20U) - 1U;
+		const float clamped = _depth < 0.0f ? 0.0f : (_depth > 1.0f ? 1.0f : _depth);
+		uint32_t depth = (uint32_t)(clamped * (float)depthMax);
+		// Transparent surfaces have to blend over what is behind them
+		if (_pass == pass::transparent)
+		{	depth = depthMax - depth; }
+
+		return keyField((uint64_t)_pass, 2U, 62U)
+			| keyField(_program, 14U, 48U)
+			| keyField(_material, 12U, 36U)
+			| keyField(_mesh, 16U, 20U)
+			| keyField(depth, 20U, 0U);
+	}
+
+	void clear() noexcept
+	{
+		l_packets.clear();
+		l_order.clear();
+	}
+
+	void push(const packet &_packet)
+	{
+		l_order.push_back({ _packet.key, (uint32_t)l_packets.size() });
+		l_packets.push_back(_packet);
+	}
+
+	void sort()
+	{
+		const size_t count = l_order.size();
+		if (count < 2U)
+		{	return; }
+		l_scratch.resize(count);
+
+		// Least significant byte first, each pass is stable so earlier passes are kept
+		for (uint8_t shift = 0; shift < 64U; shift += 8U)
+		{
+			uint32_t offsets[256] = {};
+			for (const sortItem &item : l_order)
+			{	++offsets[(item.key >> shift) & 0xFFU]; }
+
+			// Every key shares this byte, so the pass would not move anything
+			if (offsets[(l_order[0].key >> shift) & 0xFFU] == count)
+			{	continue; }
+
+			uint32_t total = 0U;
+			for (uint32_t &offset : offsets)
+			{
+				const uint32_t bucket = offset;
+				offset = total;
+				total += bucket;
+			}
+
+			for (const sortItem &item : l_order)
+			{	l_scratch[offsets[(item.key >> shift) & 0xFFU]++] = item; }
+			l_order.swap(l_scratch);
+		}
+	}
+
+	_NODISCARD inline const packet &packetAt(const size_t _sorted) noexcept
+	{	return l_packets[l_order[_sorted].index]; }
+
+	/** If a packet can be drawn with the program and uniforms set for another. */
+	_NODISCARD inline bool sameState(const packet &_first, const packet &_other) noexcept
+	{
+		return _first.program == _other.program
+			&& (_first.owner == _other.owner || _first.owner->sameMaterial(*_other.owner));
+	}
+
+	/** If two packets can be drawn by the same instanced draw. */
+	_NODISCARD inline bool canInstance(const packet &_first, const packet &_other) noexcept
+	{	return _first.geometry == _other.geometry && sameState(_first, _other); }
+
+	/** Draws runs without indirect support, one call each except for single instances of the same model.
+	 * @note Those share one glMultiDrawElementsBaseVertex, as every mesh reads the same matrices.
+	 */
+	void drawRuns(const size_t _first, const size_t _last) noexcept
+	{
+		for (size_t i = _first, end = _first; i < _last; i = end)
+		{
+			const packet &cur = packetAt(l_runs[i].first);
+			end = i + 1U;
+			if (l_runs[i].count == 1U)
+			{
+				while (end < _last && l_runs[end].count == 1U && packetAt(l_runs[end].first).owner == cur.owner)
+				{	++end; }
+			}
+
+			if (end - i == 1U)
+			{	cur.geometry->drawInstanced(l_runs[i].count, l_firstInstance + l_runs[i].first); }
+			else
+			{
+				l_ranges.clear();
+				for (size_t j = i; j < end; ++j)
+				{	l_ranges.push_back(packetAt(l_runs[j].first).geometry->getRange()); }
+				renderer::multiDrawGeometry(l_ranges.data(), (uint32_t)l_ranges.size(), l_firstInstance + l_runs[i].first);
+			}
+			++l_stats.drawCalls;
+		}
+	}
+
+	/** Draws a span of runs, changing the program, uniforms and vertex array only when they differ. */
+	void drawRunRange(const size_t _first, const size_t _last, const bool _indirect) noexcept
+	{
+		const shader *curProgram = nullptr;
+		const model *curOwner = nullptr;
+		uint32_t curVertexArray = 0U;
+		for (size_t first = _first, last = _first; first < _last; first = last)
+		{
+			const packet &cur = packetAt(l_runs[first].first);
+			// Runs that need no state change between them can go in one call
+			last = first + 1U;
+			while (last < _last)
+			{
+				const packet &next = packetAt(l_runs[last].first);
+				if (!sameState(cur, next) || next.geometry->getVAO() != cur.geometry->getVAO())
+				{	break; }
+				++last;
+			}
+
+			if (cur.program != curProgram)
+			{
+				cur.program->use();
+				curProgram = cur.program;
+				// The uniforms of the new program have not been set for this model
+				curOwner = nullptr;
+				++l_stats.programChanges;
+			}
+
+			if (!curOwner || (cur.owner != curOwner && !cur.owner->sameMaterial(*curOwner)))
+			{
+				cur.owner->applyUniforms(curProgram);
+				curOwner = cur.owner;
+				++l_stats.uniformChanges;
+			}
+
+			if (cur.geometry->getVAO() != curVertexArray)
+			{
+				curVertexArray = cur.geometry->getVAO();
+				++l_stats.vertexArrayChanges;
+			}
+
+			if (_indirect)
+			{
+				renderer::multiDrawIndirect(curVertexArray, (uint32_t)first, (uint32_t)(last - first));
+				++l_stats.drawCalls;
+			}
+			else
+			{	drawRuns(first, last); }
+		}
+	}
+
+	/** Draws the first runs with one program and no materials, so every run of a vertex array can share a call. */
+	void drawDepthOnly(const size_t _last, const shader *_program, const bool _indirect) noexcept
+	{
+		_program->use();
+		for (size_t first = 0, last = 0; first < _last; first = last)
+		{
+			const uint32_t idVAO = packetAt(l_runs[first].first).geometry->getVAO();
+			last = first + 1U;
+			while (last < _last && packetAt(l_runs[last].first).geometry->getVAO() == idVAO)
+			{	++last; }
+
+			if (_indirect)
+			{
+				renderer::multiDrawIndirect(idVAO, (uint32_t)first, (uint32_t)(last - first));
+				++l_stats.drawCalls;
+			}
+			else
+			{	drawRuns(first, last); }
+		}
+	}
+
+	/** Writes every packet's matrices and draw command to the stream, and groups the packets into runs.
+	 * @param _anyMaterial Runs only need the same mesh, for draws that push no material.
+	 * @param _gpuCull Lets the GPU decide how many instances of each run are drawn, if it can.
+	 * @return [bool] If the runs are drawn from the indirect commands.
+	 */
+	bool upload(const bool _anyMaterial, const bool _gpuCull) noexcept
+	{
+		// Written straight into the stream buffer, no copy is kept
+		instance *instances = (instance*)renderer::mapInstances((uint32_t)l_order.size(), &l_firstInstance);
+		for (size_t i = 0; i < l_order.size(); ++i)
+		{
+			const model *owner = packetAt(i).owner;
+			instances[i] = { owner->getTransform(), owner->getNormalMatrix() };
+		}
+
+		// Sorted order already puts packets that can share a draw next to each other
+		l_runs.clear();
+		for (uint32_t first = 0, last = 0; first < (uint32_t)l_order.size(); first = last)
+		{
+			const packet &cur = packetAt(first);
+			last = first + 1U;
+			while (last < (uint32_t)l_order.size()
+				&& (_anyMaterial ? cur.geometry == packetAt(last).geometry : canInstance(cur, packetAt(last))))
+			{	++last; }
+			l_runs.push_back({ first, last - first });
+		}
+		l_stats.commands = (uint32_t)l_runs.size();
+
+		// One command per run, so a run's index is also its command's index
+		const bool indirect = renderer::supportsIndirectDraw();
+		// The GPU fills in the instance counts, and the instances themselves go to a buffer of their own
+		const bool gpuCull = indirect && _gpuCull;
+		if (indirect)
+		{
+			renderer::drawCommand *commands = renderer::mapDrawCommands((uint32_t)l_runs.size());
+			for (size_t i = 0; i < l_runs.size(); ++i)
+			{
+				const renderer::geometryRange range = packetAt(l_runs[i].first).geometry->getRange();
+				renderer::drawCommand command;
+				command.count = range.indexCount;
+				command.instanceCount = gpuCull ? 0U : l_runs[i].count;
+				command.firstIndex = range.firstIndex;
+				command.baseVertex = (int32_t)range.firstVertex;
+				command.baseInstance = (gpuCull ? 0U : l_firstInstance) + l_runs[i].first;
+				commands[i] = command;
+			}
+		}
+		renderer::streamAllocation records;
+		if (gpuCull)
+		{
+			records = renderer::streamAllocate((uint32_t)(l_runs.size() * sizeof(gpuCulling::record)));
+			gpuCulling::record *out = (gpuCulling::record*)records.data;
+			for (size_t i = 0; i < l_runs.size(); ++i)
+			{
+				const culling::bounds &bounds = packetAt(l_runs[i].first).geometry->getBounds();
+				out[i].min = bounds.min;
+				out[i].firstInstance = l_runs[i].first;
+				out[i].max = bounds.max;
+				out[i].alwaysVisible = bounds.empty ? 1U : 0U;
+			}
+		}
+		renderer::flushStream();
+		if (gpuCull)
+		{
+			gpuCulling::cull(
+				l_firstInstance,
+				(uint32_t)l_order.size(),
+				(uint32_t)l_runs.size(),
+				records.idBuffer,
+				records.offset
+			);
+		}
+		return indirect;
+	}
+
+	void submit(const shader *_depthProgram) noexcept
+	{
+		l_stats = stats();
+		l_stats.packets = (uint32_t)l_packets.size();
+		if (l_order.empty())
+		{	return; }
+		const bool indirect = upload(false, gpuCulling::isActive());
+
+		// Only opaque runs are prepassed, transparent ones blend over what is behind them
+		size_t opaqueRuns = 0U;
+		while (opaqueRuns < l_runs.size() && (pass)(packetAt(l_runs[opaqueRuns].first).key >> 62U) == pass::opaque)
+		{	++opaqueRuns; }
+		if (!_depthProgram || opaqueRuns == 0U)
+		{
+			drawRunRange(0U, l_runs.size(), indirect);
+			return;
+		}
+
+		// Depth first, so the colour pass shades each pixel once however much overlaps it
+		renderer::setColourWrites(false);
+		renderer::setPositionOnly(true);
+		drawDepthOnly(opaqueRuns, _depthProgram, indirect);
+		renderer::setPositionOnly(false);
+		renderer::setColourWrites(true);
+		l_stats.prepassDrawCalls = l_stats.drawCalls;
+		l_stats.drawCalls = 0U;
+
+		// The depth is already final, anything not at it is hidden
+		renderer::setDepthWrites(false);
+		renderer::setDepthEqual(true);
+		drawRunRange(0U, opaqueRuns, indirect);
+		renderer::setDepthEqual(false);
+		renderer::setDepthWrites(true);
+		drawRunRange(opaqueRuns, l_runs.size(), indirect);
+	}
+
+	void submitDepthOnly(const shader *_program) noexcept
+	{
+		l_stats = stats();
+		l_stats.packets = (uint32_t)l_packets.size();
+		if (l_order.empty())
+		{	return; }
+
+		// Nothing but the matrices differs between models here, so every mesh is one run however its material differs
+		const bool indirect = upload(true, false);
+		renderer::setPositionOnly(true);
+		drawDepthOnly(l_runs.size(), _program, indirect);
+		renderer::setPositionOnly(false);
+	}
+
+	stats getStats() noexcept
+	{	return l_stats; }
+}
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+#include "glm/mat3x3.hpp"
+#include "glm/mat4x4.hpp"
+
+#ifndef _NODISCARD
+#define _NODISCARD [[nodiscard]]
+#endif
+
+namespace srender
+{
+struct shader;
+struct mesh;
+struct model;
+
+/** Collects every draw of a frame as a small packet, sorts them by the state they need,
+ * and submits them in that order so state only changes when it has to.
+ * Neighbouring packets of the same mesh, program and material are drawn as one instanced draw,
+ * and neighbouring draws that need no state change between them are issued as one multi draw.
+ */
+namespace drawQueue
+{
+	/** The most significant bits of every key, passes are drawn in this order. */
+	enum class pass: uint8_t
+	{
+		opaque,
+		transparent
+	};
+
+	/** What each instance of a mesh reads from the instance buffer, laid out as renderer::getInstanceSize. */
+	struct instance
+	{
+		glm::mat4 model;
+		glm::mat3 normalMatrix;
+	};
+
+	struct packet
+	{
+		uint64_t key = 0U;
+		const model *owner = nullptr;	// Supplies the matrices and the material
+		const shader *program = nullptr;
+		const mesh *geometry = nullptr;
+	};
+
+	struct stats
+	{
+		uint32_t packets = 0U;
+		uint32_t commands = 0U;	// One per run of instances
+		uint32_t drawCalls = 0U;	// Calls made to the renderer, each may hold several commands
+		uint32_t prepassDrawCalls = 0U;	// Calls made by the depth prepass, not counted in drawCalls
+		uint32_t programChanges = 0U;
+		uint32_t uniformChanges = 0U;	// Times a model pushed its material uniforms
+		uint32_t vertexArrayChanges = 0U;
+	};
+
+	/** Builds a sort key, the fields from most to least significant are
+	 * pass (2 bits), program (14), material (12), mesh (16) and depth (20).
+	 * @param _depth Distance from the camera scaled to 0-1, values outside are clamped.
+	 * @note Opaque draws sort front to back for early depth rejection, transparent ones back to front.
+	 */
+	_NODISCARD uint64_t makeKey(
+		const pass _pass,
+		const uint32_t _program,
+		const uint32_t _material,
+		const uint32_t _mesh,
+		const float _depth
+	) noexcept;
+
+	/** Empties the queue, the memory is kept for the next frame. */
+	void clear() noexcept;
+	void push(const packet &_packet);
+	/** Orders the packets by key with a radix sort. */
+	void sort();
+	/** Draws every packet in sorted order, skipping state that is already set.
+	 * @param _depthProgram If set, the opaque packets are first drawn with it into depth alone, reading only positions.
+	 * They are then drawn again in colour only where their depth is equal to it, so each pixel is shaded once.
+	 * @note Writes every packet's matrices to the stream buffer first, in the same order.
+	 * With indirect draw support every draw is also written there as a command up front,
+	 * and with GPU culling active the GPU then decides how many instances of each are drawn.
+	 * A depth prepass needs every program to compute gl_Position exactly as _depthProgram does, and declare it invariant.
+	 */
+	void submit(const shader *_depthProgram = nullptr) noexcept;
+	/** Draws every packet into depth alone with one program, reading only positions, as for a shadow map.
+	 * Packets of the same mesh are instanced together whatever their material, and never culled on the GPU.
+	 * @note The packets' programs are ignored and may be null.
+	 */
+	void submitDepthOnly(const shader *_program) noexcept;
+
+	/** Counts from the last submit. */
+	_NODISCARD stats getStats() noexcept;
+}
+}
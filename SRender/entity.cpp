@@ -42,14 +42,7 @@ void entity::updateModel() const noexcept
 	if (!m_model)
 	{	return; }
 
-	// TODO flesh out
-	string errorMsg;
-	m_model->getShaderRef()->setMat4("u_model", m_transform.getTransform(), errorMsg);
-	m_model->getShaderRef()->setMat3(
-		"u_transposeInverseOfModel",
-		(mat3)transpose(inverse(m_transform.getTransform())),
-		errorMsg
-	);
+	m_model->setTransform(m_transform.getTransform());
 }
 
 entity::entity()
@@ -75,7 +68,11 @@ void entity::setTransform(const mat4 *_value) noexcept
 void entity::setPosition(const vec3 _value) noexcept
 {
 	m_transform.setPosition(_value);
-	m_light->setPosition(m_transform.getPosition());
+	if (m_light)
+	{
+		m_light->setPosition(m_transform.getPosition());
+		graphics::markLightsDirty();
+	}
 	updateModel();
 }
 
@@ -83,7 +80,11 @@ void entity::setForward(const vec3 _value) noexcept
 {
 	m_transform.setForward(_value);
 	// Do this because the forward is not exactly _value
-	m_light->setForward(m_transform.getForward());
+	if (m_light)
+	{
+		m_light->setForward(m_transform.getForward());
+		graphics::markLightsDirty();
+	}
 	updateModel();
 }
 
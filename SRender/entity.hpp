@@ -24,7 +24,7 @@ class entity
 	/** Contains a list of all entities childed to this entity. */
 	std::vector<entity*> m_childrenRef = std::vector<entity*>();
 
-	/** Updates the shader information.
+	/** Passes the transform on to the model.
 	 * @todo Have this automatically called when anything in transform is changed.
 	 */
 	void updateModel() const noexcept;
@@ -0,0 +1,487 @@
+#include <assert.h>
+#include <algorithm>
+#include <vector>
+#include "frame_graph.hpp"
+#include "renderer.hpp"
+#include "debug.hpp"
+
+using std::string;
+using std::vector;
+
+namespace srender
+{
+namespace frameGraph
+{
+	struct resourceNode
+	{
+		const char *name = nullptr;
+		textureDesc desc = textureDesc();
+		uint32_t byteSize = 0U;	// Buffers only
+		uint32_t idObject = 0U;	// Set from the start if imported, transient ones get theirs in their first pass
+		uint32_t pooled = UINT32_MAX;	// Where in the pool a transient one's object came from
+		uint32_t readers = 0U;	// Passes reading it that are not culled, counted down while culling
+		uint32_t firstPass = UINT32_MAX, lastPass = 0U;
+		bool isBuffer = false;
+		bool imported = false;
+		bool screen = false;
+		bool computeWritten = false;	// Written by compute since the last barrier
+	};
+
+	struct passNode
+	{
+		const char *name = nullptr;
+		passFunc func = nullptr;
+		void *data = nullptr;
+		uint32_t writers = 0U;	// Resources it writes that something still needs, counted down while culling
+		bool compute = false;
+		bool kept = false;
+		bool culled = false;
+	};
+
+	/** One read or write of a resource by a pass, in the order they were declared. */
+	struct access
+	{
+		passId pass = 0U;
+		resourceId resource = 0U;
+		bool write = false;
+	};
+
+	struct pooledObject
+	{
+		uint32_t id = 0U;
+		textureDesc desc = textureDesc();
+		uint32_t byteSize = 0U;
+		uint64_t lastFrame = 0U;
+		bool isBuffer = false;
+		bool inUse = false;
+	};
+
+	struct framebuffer
+	{
+		uint32_t idColours[getMaxColourWrites()] = {};
+		uint32_t colourCount = 0U;
+		uint32_t idDepth = 0U;
+		uint32_t idFBO = 0U;
+		uint64_t lastFrame = 0U;
+	};
+
+	vector<resourceNode> l_resources = vector<resourceNode>();
+	vector<passNode> l_passes = vector<passNode>();
+	vector<access> l_accesses = vector<access>();
+	/** Resources whose readers reached 0 during culling, their writers lose a reason to run. */
+	vector<resourceId> l_unread = vector<resourceId>();
+	vector<pooledObject> l_pool = vector<pooledObject>();
+	vector<framebuffer> l_framebuffers = vector<framebuffer>();
+	uint64_t l_frame = 0U;
+	stats l_stats = stats();
+
+	/** Marks passes that nothing needs as culled, starting from the transient resources no pass reads. */
+	void cull() noexcept
+	{
+		for (const access &cur : l_accesses)
+		{
+			if (cur.write)
+			{	++l_passes[cur.pass].writers; }
+			else
+			{	++l_resources[cur.resource].readers; }
+		}
+		l_unread.clear();
+		for (resourceId i = 0; i < (resourceId)l_resources.size(); ++i)
+		{
+			if (!l_resources[i].imported && l_resources[i].readers == 0U)
+			{	l_unread.push_back(i); }
+		}
+		// Writing nothing at all has no effect the graph can see either
+		for (passId i = 0; i < (passId)l_passes.size(); ++i)
+		{
+			if (l_passes[i].writers == 0U && !l_passes[i].kept)
+			{	l_passes[i].culled = true; }
+		}
+		for (const access &cur : l_accesses)
+		{
+			if (!cur.write && l_passes[cur.pass].culled && --l_resources[cur.resource].readers == 0U
+				&& !l_resources[cur.resource].imported)
+			{	l_unread.push_back(cur.resource); }
+		}
+
+		while (!l_unread.empty())
+		{
+			const resourceId unread = l_unread.back();
+			l_unread.pop_back();
+			for (const access &writer : l_accesses)
+			{
+				passNode &pass = l_passes[writer.pass];
+				if (!writer.write || writer.resource != unread || pass.kept || pass.culled)
+				{	continue; }
+				if (--pass.writers > 0U)
+				{	continue; }
+				pass.culled = true;
+				// What it read is now needed by one pass fewer
+				for (const access &read : l_accesses)
+				{
+					if (read.pass == writer.pass && !read.write && --l_resources[read.resource].readers == 0U
+						&& !l_resources[read.resource].imported)
+					{	l_unread.push_back(read.resource); }
+				}
+			}
+		}
+	}
+
+	/** Finds a free pooled object matching the resource, or makes one. */
+	void acquire(resourceNode &_resource) noexcept
+	{
+		for (uint32_t i = 0; i < (uint32_t)l_pool.size(); ++i)
+		{
+			pooledObject &cur = l_pool[i];
+			if (cur.inUse || cur.isBuffer != _resource.isBuffer)
+			{	continue; }
+			const bool matches = _resource.isBuffer
+				? cur.byteSize == _resource.byteSize
+				: cur.desc.width == _resource.desc.width && cur.desc.height == _resource.desc.height
+					&& cur.desc.type == _resource.desc.type;
+			if (!matches)
+			{	continue; }
+			// Already used this frame, so this resource shares it with one that has finished
+			if (cur.lastFrame == l_frame)
+			{	++l_stats.resourcesAliased; }
+			cur.inUse = true;
+			cur.lastFrame = l_frame;
+			_resource.idObject = cur.id;
+			_resource.pooled = i;
+			return;
+		}
+
+		pooledObject created = pooledObject();
+		created.desc = _resource.desc;
+		created.byteSize = _resource.byteSize;
+		created.isBuffer = _resource.isBuffer;
+		if (_resource.isBuffer)
+		{	created.id = renderer::createStorageBuffer(_resource.byteSize); }
+		else if (_resource.desc.type == textureType::depth)
+		{	created.id = renderer::createDepthTexture(_resource.desc.width, _resource.desc.height); }
+		else
+		{
+			created.id = renderer::createTargetTexture(
+				_resource.desc.width,
+				_resource.desc.height,
+				_resource.desc.type == textureType::rgba16 ? renderer::targetFormat::rgba16 : renderer::targetFormat::rgba8
+			);
+		}
+		created.inUse = true;
+		created.lastFrame = l_frame;
+		_resource.idObject = created.id;
+		_resource.pooled = (uint32_t)l_pool.size();
+		l_pool.push_back(created);
+	}
+
+	/** Binds the framebuffer of every texture the pass writes, making it the first time that combination is seen. */
+	void bindTargets(const passId _pass) noexcept
+	{
+		framebuffer key = framebuffer();
+		[[maybe_unused]] bool screen = false;
+		uint32_t width = 0U, height = 0U;
+		for (const access &cur : l_accesses)
+		{
+			if (cur.pass != _pass || !cur.write)
+			{	continue; }
+			const resourceNode &target = l_resources[cur.resource];
+			if (target.screen)
+			{
+				screen = true;
+				continue;
+			}
+			if (target.isBuffer)
+			{	continue; }
+			if (target.desc.type == textureType::depth)
+			{	key.idDepth = target.idObject; }
+			else
+			{
+				assert(key.colourCount < getMaxColourWrites() && "GL only promises 8 draw buffers");
+				key.idColours[key.colourCount++] = target.idObject;
+			}
+			width = target.desc.width;
+			height = target.desc.height;
+		}
+		assert(!(screen && (key.colourCount || key.idDepth)) && "The screen cannot be written together with textures");
+
+		if (!key.colourCount && !key.idDepth)
+		{
+			// Buffers alone, or the screen, which is drawn to at its own size
+			renderer::bindFramebuffer(0U);
+			renderer::getViewportSize(&width, &height);
+			renderer::setViewportRect(0U, 0U, width, height);
+			return;
+		}
+
+		for (framebuffer &cur : l_framebuffers)
+		{
+			bool same = cur.colourCount == key.colourCount && cur.idDepth == key.idDepth;
+			for (uint32_t i = 0; same && i < key.colourCount; ++i)
+			{	same = cur.idColours[i] == key.idColours[i]; }
+			if (same)
+			{
+				cur.lastFrame = l_frame;
+				renderer::bindFramebuffer(cur.idFBO);
+				renderer::setViewportRect(0U, 0U, width, height);
+				return;
+			}
+		}
+		key.idFBO = renderer::createFramebuffer(key.idColours, key.colourCount, key.idDepth);
+		assert(key.idFBO && "The driver cannot draw into this combination of textures");
+		key.lastFrame = l_frame;
+		l_framebuffers.push_back(key);
+		renderer::bindFramebuffer(key.idFBO);
+		renderer::setViewportRect(0U, 0U, width, height);
+	}
+
+	/** Deletes pooled objects and framebuffers left unused for too long, and any framebuffer using a deleted texture. */
+	void trimPool() noexcept
+	{
+		for (size_t i = 0; i < l_pool.size();)
+		{
+			const pooledObject &cur = l_pool[i];
+			if (cur.lastFrame + getPoolFrames() >= l_frame)
+			{
+				++i;
+				continue;
+			}
+			if (cur.isBuffer)
+			{	renderer::deleteBuffer(cur.id); }
+			else
+			{
+				for (framebuffer &fbo : l_framebuffers)
+				{
+					bool uses = fbo.idDepth == cur.id;
+					for (uint32_t j = 0; j < fbo.colourCount; ++j)
+					{	uses = uses || fbo.idColours[j] == cur.id; }
+					// Marked as aged out, so the loop below deletes it along with the texture
+					if (uses)
+					{	fbo.lastFrame = 0U; }
+				}
+				renderer::deleteTextures(&cur.id);
+			}
+			l_pool[i] = l_pool.back();
+			l_pool.pop_back();
+		}
+		for (size_t i = 0; i < l_framebuffers.size();)
+		{
+			if (l_framebuffers[i].lastFrame + getPoolFrames() >= l_frame && l_framebuffers[i].lastFrame != 0U)
+			{
+				++i;
+				continue;
+			}
+			renderer::deleteFramebuffer(l_framebuffers[i].idFBO);
+			l_framebuffers[i] = l_framebuffers.back();
+			l_framebuffers.pop_back();
+		}
+	}
+
+	void begin() noexcept
+	{
+		l_resources.clear();
+		l_passes.clear();
+		l_accesses.clear();
+		++l_frame;
+		const uint32_t pooled = l_stats.texturesPooled, framebuffers = l_stats.framebuffers;
+		l_stats = stats();
+		l_stats.texturesPooled = pooled;
+		l_stats.framebuffers = framebuffers;
+
+		resourceNode screen = resourceNode();
+		screen.name = "screen";
+		screen.imported = true;
+		screen.screen = true;
+		l_resources.push_back(screen);
+	}
+
+	void execute() noexcept
+	{
+		cull();
+		// Lifetimes only count passes that run, so culled ones hold nothing back from being shared
+		for (const access &cur : l_accesses)
+		{
+			if (l_passes[cur.pass].culled)
+			{	continue; }
+			resourceNode &res = l_resources[cur.resource];
+			res.firstPass = std::min(res.firstPass, cur.pass);
+			res.lastPass = std::max(res.lastPass, cur.pass);
+		}
+
+		l_stats.passes = (uint32_t)l_passes.size();
+		for (passId i = 0; i < (passId)l_passes.size(); ++i)
+		{
+			const passNode &pass = l_passes[i];
+			if (pass.culled)
+			{
+				++l_stats.passesCulled;
+				continue;
+			}
+
+			bool barrier = false;
+			for (const access &cur : l_accesses)
+			{
+				if (cur.pass != i)
+				{	continue; }
+				resourceNode &res = l_resources[cur.resource];
+				if (!res.imported && res.firstPass == i && !res.idObject)
+				{
+					#ifdef _DEBUG
+						if (!cur.write)
+						{
+							debug::send(
+								string("Pass ") + pass.name + " reads " + res.name + " before anything writes it",
+								debug::type::note, debug::impact::small, debug::stage::mid
+							);
+						}
+					#endif
+					acquire(res);
+				}
+				barrier = barrier || res.computeWritten;
+			}
+			// One barrier makes every earlier compute write visible, not just the ones to these resources
+			if (barrier)
+			{
+				renderer::waitForComputeWrites();
+				++l_stats.barriers;
+				for (resourceNode &res : l_resources)
+				{	res.computeWritten = false; }
+			}
+
+			if (!pass.compute)
+			{	bindTargets(i); }
+			pass.func(pass.data);
+
+			for (const access &cur : l_accesses)
+			{
+				if (cur.pass != i)
+				{	continue; }
+				resourceNode &res = l_resources[cur.resource];
+				if (cur.write && pass.compute)
+				{	res.computeWritten = true; }
+				// Free for any later resource of the same size to take over
+				if (!res.imported && res.lastPass == i && res.pooled != UINT32_MAX)
+				{
+					l_pool[res.pooled].inUse = false;
+					res.pooled = UINT32_MAX;
+				}
+			}
+		}
+		// Whatever the passes left bound, the frame carries on drawing to the screen
+		renderer::bindFramebuffer(0U);
+
+		trimPool();
+		l_stats.texturesPooled = (uint32_t)l_pool.size();
+		l_stats.framebuffers = (uint32_t)l_framebuffers.size();
+	}
+
+	void terminate() noexcept
+	{
+		for (const pooledObject &cur : l_pool)
+		{
+			if (cur.isBuffer)
+			{	renderer::deleteBuffer(cur.id); }
+			else
+			{	renderer::deleteTextures(&cur.id); }
+		}
+		for (const framebuffer &cur : l_framebuffers)
+		{	renderer::deleteFramebuffer(cur.idFBO); }
+		l_pool.clear();
+		l_framebuffers.clear();
+		l_resources.clear();
+		l_passes.clear();
+		l_accesses.clear();
+	}
+
+	resourceId getScreen() noexcept
+	{	return 0U; }
+
+	resourceId createTexture(const char *_name, const textureDesc &_desc) noexcept
+	{
+		resourceNode created = resourceNode();
+		created.name = _name;
+		created.desc = _desc;
+		if (!created.desc.width || !created.desc.height)
+		{
+			uint32_t width, height;
+			renderer::getViewportSize(&width, &height);
+			created.desc.width = created.desc.width ? created.desc.width : width;
+			created.desc.height = created.desc.height ? created.desc.height : height;
+		}
+		l_resources.push_back(created);
+		return (resourceId)l_resources.size() - 1U;
+	}
+
+	resourceId createBuffer(const char *_name, const uint32_t _byteSize) noexcept
+	{
+		assert(renderer::supportsCompute() && "Storage buffers need compute support");
+		resourceNode created = resourceNode();
+		created.name = _name;
+		created.byteSize = _byteSize;
+		created.isBuffer = true;
+		l_resources.push_back(created);
+		return (resourceId)l_resources.size() - 1U;
+	}
+
+	resourceId importTexture(const char *_name, const uint32_t _idTex, const textureDesc &_desc) noexcept
+	{
+		resourceNode imported = resourceNode();
+		imported.name = _name;
+		imported.desc = _desc;
+		imported.idObject = _idTex;
+		imported.imported = true;
+		l_resources.push_back(imported);
+		return (resourceId)l_resources.size() - 1U;
+	}
+
+	resourceId importBuffer(const char *_name, const uint32_t _idBuffer) noexcept
+	{
+		resourceNode imported = resourceNode();
+		imported.name = _name;
+		imported.idObject = _idBuffer;
+		imported.isBuffer = true;
+		imported.imported = true;
+		l_resources.push_back(imported);
+		return (resourceId)l_resources.size() - 1U;
+	}
+
+	passId addPass(
+		const char *_name,
+		const passFunc _func,
+		void *_data,
+		const bool _compute
+	) noexcept
+	{
+		passNode created = passNode();
+		created.name = _name;
+		created.func = _func;
+		created.data = _data;
+		created.compute = _compute;
+		l_passes.push_back(created);
+		return (passId)l_passes.size() - 1U;
+	}
+
+	void read(const passId _pass, const resourceId _resource) noexcept
+	{
+		assert(_pass < l_passes.size() && _resource < l_resources.size());
+		l_accesses.push_back({ _pass, _resource, false });
+	}
+
+	void write(const passId _pass, const resourceId _resource) noexcept
+	{
+		assert(_pass < l_passes.size() && _resource < l_resources.size());
+		l_accesses.push_back({ _pass, _resource, true });
+	}
+
+	void keep(const passId _pass) noexcept
+	{	l_passes[_pass].kept = true; }
+
+	uint32_t getTexture(const resourceId _resource) noexcept
+	{	return l_resources[_resource].idObject; }
+
+	uint32_t getBuffer(const resourceId _resource) noexcept
+	{	return l_resources[_resource].idObject; }
+
+	stats getStats() noexcept
+	{	return l_stats; }
+}
+}
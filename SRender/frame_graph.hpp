@@ -0,0 +1,99 @@
+#pragma once
+#include <stdint.h>
+
+#ifndef _NODISCARD
+#define _NODISCARD [[nodiscard]]
+#endif
+
+namespace srender
+{
+/** Describes a frame as passes that read and write resources, rebuilt every frame and then run in the order passes were added.
+ * Passes whose writes nothing ends up reading are culled, unless they write the screen or something imported, or are kept.
+ * Transient textures and buffers come from a pool, and once the last pass using one has run
+ * the same texture is handed to the next transient resource of its size and format.
+ * Before each pass the framebuffer of the textures it writes is bound, from a cache, with the viewport set to them.
+ * A pass that follows compute writes to anything it touches waits for those writes first.
+ * @note A transient resource holds nothing when its first pass starts, that pass must clear or cover all of it.
+ */
+namespace frameGraph
+{
+	using resourceId = uint32_t;
+	using passId = uint32_t;
+	/** Runs a pass, with its framebuffer already bound.
+	 * @param _data As given to addPass.
+	 */
+	using passFunc = void(*)(void *_data);
+	/** Adds passes to the graph being built. */
+	using setupFunc = void(*)(void);
+
+	enum class textureType: uint8_t
+	{
+		rgba8,
+		rgba16,
+		depth	// As renderer::createDepthTexture, so it can be blitted to and from the screen
+	};
+
+	struct textureDesc
+	{
+		uint32_t width = 0U;	// 0 for the viewport's width when the texture is created
+		uint32_t height = 0U;	// 0 for the viewport's height
+		textureType type = textureType::rgba8;
+	};
+
+	struct stats
+	{
+		uint32_t passes = 0U;	// Added in the last frame
+		uint32_t passesCulled = 0U;	// Of those, skipped because nothing read what they wrote
+		uint32_t texturesPooled = 0U;	// Textures and buffers held by the pool, in use or not
+		uint32_t resourcesAliased = 0U;	// Transient resources that took over one another's texture or buffer in the last frame
+		uint32_t framebuffers = 0U;	// Cached combinations of textures
+		uint32_t barriers = 0U;	// Waits on compute writes in the last frame
+	};
+
+	/** Frames a pooled texture, buffer or cached framebuffer is kept without being used before it is deleted. */
+	_NODISCARD constexpr uint32_t getPoolFrames() { return 60U; }
+	/** GL only promises this many colour targets in one framebuffer. */
+	_NODISCARD constexpr uint32_t getMaxColourWrites() { return 8U; }
+
+	/** Forgets the last frame's passes and resources, the pool and framebuffers are kept. */
+	void begin() noexcept;
+	/** Runs every pass that was not culled, in the order they were added, then returns the transient resources to the pool. */
+	void execute() noexcept;
+	/** Deletes everything in the pool and every cached framebuffer. */
+	void terminate() noexcept;
+
+	/** Wherever the scene is drawn, the window or renderer's scene target, always imported. */
+	_NODISCARD resourceId getScreen() noexcept;
+	/** A texture that only lives for this frame, its size is fixed when this is called.
+	 * @param _name Kept as it is for messages, so it must outlive the frame.
+	 */
+	_NODISCARD resourceId createTexture(const char *_name, const textureDesc &_desc) noexcept;
+	/** A storage buffer that only lives for this frame, needs compute support. */
+	_NODISCARD resourceId createBuffer(const char *_name, const uint32_t _byteSize) noexcept;
+	/** A texture made and kept elsewhere, passes writing it are never culled. */
+	_NODISCARD resourceId importTexture(const char *_name, const uint32_t _idTex, const textureDesc &_desc) noexcept;
+	/** A buffer made and kept elsewhere, passes writing it are never culled. */
+	_NODISCARD resourceId importBuffer(const char *_name, const uint32_t _idBuffer) noexcept;
+
+	/** @param _compute True if the pass only dispatches compute, no framebuffer is bound for it. */
+	_NODISCARD passId addPass(
+		const char *_name,
+		const passFunc _func,
+		void *_data = nullptr,
+		const bool _compute = false
+	) noexcept;
+	void read(const passId _pass, const resourceId _resource) noexcept;
+	/** Textures written by a pass that is not compute are its colour targets in the order written, and depth.
+	 * @note The screen cannot be written together with textures.
+	 */
+	void write(const passId _pass, const resourceId _resource) noexcept;
+	/** Never culls the pass, for passes with effects the graph cannot see. */
+	void keep(const passId _pass) noexcept;
+
+	/** The texture behind a resource, only valid while a pass using it runs. */
+	_NODISCARD uint32_t getTexture(const resourceId _resource) noexcept;
+	/** The buffer behind a resource, only valid while a pass using it runs. */
+	_NODISCARD uint32_t getBuffer(const resourceId _resource) noexcept;
+	_NODISCARD stats getStats() noexcept;
+}
+}
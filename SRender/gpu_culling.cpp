@@ -0,0 +1,298 @@
+#include <algorithm>
+#include <string>
+#include "gpu_culling.hpp"
+#include "culling.hpp"
+#include "renderer.hpp"
+#include "cull_shader.hpp"
+#include "debug.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+using glm::mat4;
+using std::string;
+
+namespace srender
+{
+namespace gpuCulling
+{
+	/** Uniform locations of the cull program, looked up once. */
+	struct cullUniforms
+	{
+		int32_t instanceBase = -1;
+		int32_t commandBase = -1;
+		int32_t recordBase = -1;
+		int32_t instanceCount = -1;
+		int32_t commandCount = -1;
+		int32_t planes[6] = { -1, -1, -1, -1, -1, -1 };
+		int32_t useHiZ = -1;
+		int32_t lastViewProj = -1;
+		int32_t hiZ = -1;
+		int32_t depthSize = -1;
+		int32_t levels = -1;
+	};
+
+	uint32_t l_idCullProgram = 0U;
+	/** The first reduction reads the copied depth, every later one the level before it. */
+	uint32_t l_idDepthProgram = 0U;
+	uint32_t l_idLevelProgram = 0U;
+	cullUniforms l_uniforms;
+	int32_t l_depthSourceSize = -1, l_levelSourceSize = -1;
+	bool l_enabled = false;
+
+	/** Where the survivors are copied, grown to fit the most instances seen. */
+	uint32_t l_idCulled = 0U;
+	uint32_t l_culledSize = 0U;
+
+	mat4 l_viewProjection = mat4(1.0f);
+	/** The camera the pyramid was built from, boxes are projected with it to compare against the right depth. */
+	mat4 l_pyramidViewProjection = mat4(1.0f);
+	uint32_t l_idDepth = 0U;
+	uint32_t l_idPyramid = 0U;
+	uint32_t l_depthWidth = 0U, l_depthHeight = 0U;
+	uint32_t l_pyramidLevels = 0U;
+	/** Cleared when the pyramid no longer matches the screen, until it is rebuilt nothing is tested against it. */
+	bool l_pyramidValid = false;
+
+	/** Compiles and links a compute program, reporting any errors the same way as shader does.
+	 * @param _defines Inserted after the version line.
+	 * @return [uint32_t] The program, or 0 if it failed.
+	 */
+	uint32_t buildProgram(const char *_code, const char *_defines) noexcept
+	{
+		string code = _code;
+		code.insert(code.find('\n') + 1U, _defines);
+
+		int32_t success;
+		char infoLog[512];
+		const uint32_t idShader = renderer::createComputeShader();
+		renderer::loadShaderSource(idShader, code.c_str());
+		renderer::compileShader(idShader);
+		renderer::getShaderiv(idShader, &success);
+		if (!success)
+		{
+			renderer::getShaderInfoLog(idShader, infoLog, 512);
+			debug::send(
+				"ERROR::SHADER::COMPUTE::COMPILATION_FAILED:\n" + string(infoLog),
+				debug::type::note, debug::impact::large, debug::stage::mid, true, false
+			);
+			renderer::deleteShader(idShader);
+			return 0U;
+		}
+
+		const uint32_t idProgram = renderer::createComputeProgram(idShader);
+		renderer::deleteShader(idShader);
+		renderer::getProgramiv(idProgram, &success);
+		if (!success)
+		{
+			renderer::getProgramInfoLog(idProgram, infoLog, 512);
+			debug::send(
+				"ERROR::SHADER::PROGRAM::LINKING_FAILED:\n" + string(infoLog),
+				debug::type::note, debug::impact::large, debug::stage::mid, true, false
+			);
+			renderer::deleteShaderProgram(idProgram);
+			return 0U;
+		}
+		return idProgram;
+	}
+
+	/** Remakes the depth copy and the pyramid for a new screen size. */
+	void resizePyramid(const uint32_t _width, const uint32_t _height) noexcept
+	{
+		if (l_idDepth)
+		{
+			const uint32_t textures[2] = { l_idDepth, l_idPyramid };
+			renderer::deleteTextures(textures, 2U);
+		}
+
+		l_depthWidth = _width;
+		l_depthHeight = _height;
+		// The pyramid starts at half size, the first reduction already halves the depth
+		const uint32_t width = (_width + 1U) / 2U, height = (_height + 1U) / 2U;
+		l_pyramidLevels = 1U;
+		for (uint32_t w = width, h = height; w > 1U || h > 1U; ++l_pyramidLevels)
+		{
+			w = (w + 1U) / 2U;
+			h = (h + 1U) / 2U;
+		}
+
+		renderer::setActiveTexture(getPyramidUnit());
+		l_idDepth = renderer::createDepthTexture(_width, _height);
+		l_idPyramid = renderer::createFloatTexture(width, height, l_pyramidLevels);
+	}
+
+	bool init() noexcept
+	{
+		if (!renderer::supportsCompute())
+		{	return true; }
+
+		l_idCullProgram = buildProgram(CULL_COMPUTE, "");
+		l_idDepthProgram = buildProgram(HIZ_COMPUTE, "#define FROM_DEPTH\n");
+		l_idLevelProgram = buildProgram(HIZ_COMPUTE, "");
+		if (!l_idCullProgram || !l_idDepthProgram || !l_idLevelProgram)
+		{
+			terminate();
+			return false;
+		}
+
+		l_uniforms.instanceBase = renderer::getUniformLocation(l_idCullProgram, "u_instanceBase");
+		l_uniforms.commandBase = renderer::getUniformLocation(l_idCullProgram, "u_commandBase");
+		l_uniforms.recordBase = renderer::getUniformLocation(l_idCullProgram, "u_recordBase");
+		l_uniforms.instanceCount = renderer::getUniformLocation(l_idCullProgram, "u_instanceCount");
+		l_uniforms.commandCount = renderer::getUniformLocation(l_idCullProgram, "u_commandCount");
+		for (uint8_t i = 0; i < 6U; ++i)
+		{
+			const string name = "u_planes[" + std::to_string(i) + "]";
+			l_uniforms.planes[i] = renderer::getUniformLocation(l_idCullProgram, name.c_str());
+		}
+		l_uniforms.useHiZ = renderer::getUniformLocation(l_idCullProgram, "u_useHiZ");
+		l_uniforms.lastViewProj = renderer::getUniformLocation(l_idCullProgram, "u_lastViewProj");
+		l_uniforms.hiZ = renderer::getUniformLocation(l_idCullProgram, "u_hiZ");
+		l_uniforms.depthSize = renderer::getUniformLocation(l_idCullProgram, "u_depthSize");
+		l_uniforms.levels = renderer::getUniformLocation(l_idCullProgram, "u_levels");
+
+		// Samplers never move, so they are set once
+		renderer::setInt(l_idCullProgram, l_uniforms.hiZ, getPyramidUnit());
+		renderer::setInt(l_idDepthProgram, renderer::getUniformLocation(l_idDepthProgram, "u_source"), getPyramidUnit());
+		l_depthSourceSize = renderer::getUniformLocation(l_idDepthProgram, "u_sourceSize");
+		l_levelSourceSize = renderer::getUniformLocation(l_idLevelProgram, "u_sourceSize");
+		return true;
+	}
+
+	void terminate() noexcept
+	{
+		const uint32_t programs[3] = { l_idCullProgram, l_idDepthProgram, l_idLevelProgram };
+		for (const uint32_t idProgram : programs)
+		{
+			if (idProgram)
+			{	renderer::deleteShaderProgram(idProgram); }
+		}
+		l_idCullProgram = l_idDepthProgram = l_idLevelProgram = 0U;
+
+		if (l_idCulled)
+		{	renderer::deleteBuffer(l_idCulled); }
+		l_idCulled = 0U;
+		l_culledSize = 0U;
+
+		if (l_idDepth)
+		{
+			const uint32_t textures[2] = { l_idDepth, l_idPyramid };
+			renderer::deleteTextures(textures, 2U);
+		}
+		l_idDepth = l_idPyramid = 0U;
+		l_depthWidth = l_depthHeight = 0U;
+		l_pyramidValid = false;
+		renderer::releaseCompute();
+	}
+
+	void setEnabled(const bool _state) noexcept
+	{
+		l_enabled = _state;
+		// Depth from before it was turned off says nothing about the scene now
+		l_pyramidValid = false;
+	}
+
+	bool isActive() noexcept
+	{	return l_enabled && l_idCullProgram && renderer::supportsIndirectDraw(); }
+
+	void beginFrame(const mat4 &_viewProjection) noexcept
+	{	l_viewProjection = _viewProjection; }
+
+	void cull(
+		const uint32_t _firstInstance,
+		const uint32_t _instanceCount,
+		const uint32_t _commandCount,
+		const uint32_t _idRecords,
+		const uint32_t _recordOffset
+	) noexcept
+	{
+		if (_instanceCount == 0U)
+		{	return; }
+
+		const uint32_t needed = _instanceCount * renderer::getInstanceSize();
+		if (needed > l_culledSize)
+		{
+			if (l_idCulled)
+			{	renderer::deleteBuffer(l_idCulled); }
+			l_culledSize = std::max(needed, l_culledSize * 2U);
+			l_idCulled = renderer::createStorageBuffer(l_culledSize);
+		}
+
+		// Each buffer can differ if the stream grew part way through the frame
+		uint32_t idCommands, commandOffset;
+		renderer::getDrawCommandSource(&idCommands, &commandOffset);
+		renderer::bindStorageBuffer(0U, renderer::getInstanceSource());
+		renderer::bindStorageBuffer(1U, idCommands);
+		renderer::bindStorageBuffer(2U, _idRecords);
+		renderer::bindStorageBuffer(3U, l_idCulled);
+
+		// Offsets are in words, the instances start on a whole instance so this is exact
+		renderer::setUint(l_idCullProgram, l_uniforms.instanceBase, _firstInstance * (renderer::getInstanceSize() / 4U));
+		renderer::setUint(l_idCullProgram, l_uniforms.commandBase, commandOffset / 4U);
+		renderer::setUint(l_idCullProgram, l_uniforms.recordBase, _recordOffset / 4U);
+		renderer::setUint(l_idCullProgram, l_uniforms.instanceCount, _instanceCount);
+		renderer::setUint(l_idCullProgram, l_uniforms.commandCount, _commandCount);
+		const culling::frustum view = culling::extractFrustum(l_viewProjection);
+		for (uint8_t i = 0; i < 6U; ++i)
+		{	renderer::setFloat4(l_idCullProgram, l_uniforms.planes[i], glm::value_ptr(view.planes[i])); }
+
+		renderer::setBool(l_idCullProgram, l_uniforms.useHiZ, l_pyramidValid);
+		if (l_pyramidValid)
+		{
+			renderer::setMat4(l_idCullProgram, l_uniforms.lastViewProj, glm::value_ptr(l_pyramidViewProjection));
+			const int32_t size[2] = { (int32_t)l_depthWidth, (int32_t)l_depthHeight };
+			renderer::setInt2(l_idCullProgram, l_uniforms.depthSize, size);
+			renderer::setInt(l_idCullProgram, l_uniforms.levels, (int32_t)l_pyramidLevels);
+			renderer::setActiveTexture(getPyramidUnit());
+			renderer::bindTexture2D(l_idPyramid);
+		}
+
+		renderer::dispatchCompute((_instanceCount + 63U) / 64U);
+		renderer::waitForComputeWrites();
+		// Commands already hold base instances into the culled buffer
+		renderer::setInstanceSource(l_idCulled);
+	}
+
+	void buildPyramid() noexcept
+	{
+		if (!isActive())
+		{	return; }
+
+		uint32_t width, height;
+		renderer::getViewportSize(&width, &height);
+		if (width == 0U || height == 0U)
+		{
+			// Minimised, there is nothing to copy
+			l_pyramidValid = false;
+			return;
+		}
+		if (width != l_depthWidth || height != l_depthHeight)
+		{	resizePyramid(width, height); }
+
+		l_pyramidValid = renderer::copyDepthToTexture(l_idDepth, width, height);
+		if (!l_pyramidValid)
+		{	return; }
+		l_pyramidViewProjection = l_viewProjection;
+
+		renderer::setActiveTexture(getPyramidUnit());
+		renderer::bindTexture2D(l_idDepth);
+		uint32_t sourceWidth = width, sourceHeight = height;
+		for (uint32_t level = 0; level < l_pyramidLevels; ++level)
+		{
+			const int32_t sourceSize[2] = { (int32_t)sourceWidth, (int32_t)sourceHeight };
+			if (level == 0U)
+			{	renderer::setInt2(l_idDepthProgram, l_depthSourceSize, sourceSize); }
+			else
+			{
+				renderer::setInt2(l_idLevelProgram, l_levelSourceSize, sourceSize);
+				renderer::bindImageLevel(1U, l_idPyramid, level - 1U, false);
+			}
+			renderer::bindImageLevel(0U, l_idPyramid, level, true);
+
+			sourceWidth = (sourceWidth + 1U) / 2U;
+			sourceHeight = (sourceHeight + 1U) / 2U;
+			renderer::dispatchCompute((sourceWidth + 7U) / 8U, (sourceHeight + 7U) / 8U);
+			// Each level reads the one before it
+			renderer::waitForComputeWrites();
+		}
+	}
+}
+}
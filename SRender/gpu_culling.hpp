@@ -0,0 +1,65 @@
+#pragma once
+#include <stdint.h>
+#include "glm/vec3.hpp"
+#include "glm/mat4x4.hpp"
+
+#ifndef _NODISCARD
+#define _NODISCARD [[nodiscard]]
+#endif
+
+namespace srender
+{
+/** Culling done entirely by the GPU, between writing the draw commands and drawing them.
+ * A compute pass tests every instance against the frustum and a depth pyramid built from the last frame,
+ * and copies the survivors into a buffer of their own, counting them into their command as it goes.
+ * @note Needs compute shaders and indirect draw, without them the CPU culling is used.
+ */
+namespace gpuCulling
+{
+	/** Per draw command, what the compute pass needs to test its instances. */
+	struct record
+	{
+		glm::vec3 min = glm::vec3(0.0f);	// The mesh's box, in model space
+		uint32_t firstInstance = 0U;	// Both in the culled buffer and among the instances passed to cull
+		glm::vec3 max = glm::vec3(0.0f);
+		uint32_t alwaysVisible = 0U;	// Set for meshes without bounds, their instances are never tested
+	};
+
+	static_assert(sizeof(record) == 32, "record does not match the cull shader");
+
+	/** The texture unit the depth pyramid is bound to while culling, kept clear of model textures. */
+	_NODISCARD constexpr uint8_t getPyramidUnit() { return 7U; }
+
+	/** Builds the programs, does nothing without compute support.
+	 * @return [bool] False if compute is supported but a program failed to build.
+	 */
+	bool init() noexcept;
+	void terminate() noexcept;
+	void setEnabled(const bool _state) noexcept;
+	/** If the next cull will happen on the GPU, the CPU can then skip its own culling. */
+	_NODISCARD bool isActive() noexcept;
+
+	/** Sets the camera for this frame's cull.
+	 * @param _viewProjection The camera's projection * view matrix.
+	 */
+	void beginFrame(const glm::mat4 &_viewProjection) noexcept;
+	/** Culls the instances of the last mapped draw commands, then points drawing at the survivors.
+	 * @param _firstInstance The first of the instances, as mapInstances gave it.
+	 * @param _instanceCount Instances across every command.
+	 * @param _records One for each command, in order, already in the stream buffer.
+	 * @param _recordOffset Bytes from the start of _idRecords to the first record.
+	 * @note Every command must start with an instance count of 0, and a base instance of its record's firstInstance.
+	 */
+	void cull(
+		const uint32_t _firstInstance,
+		const uint32_t _instanceCount,
+		const uint32_t _commandCount,
+		const uint32_t _idRecords,
+		const uint32_t _recordOffset
+	) noexcept;
+	/** Copies the depth of everything drawn so far and reduces it for the next frame's cull.
+	 * @note Anything moving out from behind an occluder can be missing for the frame after.
+	 */
+	void buildPyramid() noexcept;
+}
+}
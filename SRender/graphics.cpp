@@ -1,5 +1,14 @@
+#include <algorithm>
 #include "graphics.hpp"
 #include "renderer.hpp"
+#include "draw_queue.hpp"
+#include "occlusion.hpp"
+#include "gpu_culling.hpp"
+#include "deferred.hpp"
+#include "shadows.hpp"
+#include "resolution.hpp"
+#include "checkerboard.hpp"
+#include "frame_graph.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "exception.hpp"
 #include "debug.hpp"
@@ -10,17 +19,554 @@ using glm::mat3;
 using glm::mat4;
 using std::string;
 using std::vector;
-using std::to_string;
 
 namespace srender
 {
 namespace graphics
 {
+	/** std140 mirrors of the glsl blocks, every vec3 is padded out to a vec4. */
+	struct cameraBlock
+	{
+		mat4 camera;
+		vec4 viewPos;
+	};
+
+	struct lightColourBlock
+	{
+		vec4 ambient;
+		vec4 diffuse;
+		vec4 specular;
+	};
+
+	struct dirLightBlock
+	{
+		lightColourBlock colour;
+		vec4 direction;	// w is the first of the light's shadow cascades, -1 without any
+	};
+
+	/** What a fragment needs to find its cluster. */
+	struct clusterBlock
+	{
+		vec4 depthPlane;	// Dotted with a world position gives its depth in front of the camera
+		vec4 scale;	// Pixels to tiles in xy, then the slice scale and bias of the log of the depth
+		glm::uvec4 grid;
+	};
+
+	/** One point or spot light in the light texture buffer, as four RGBA texels. */
+	struct clusterLight
+	{
+		vec4 position;	// w is 1 for a spot light
+		vec4 colour;	// w is the linear attenuation
+		vec4 direction;	// w is the quadratic attenuation
+		vec4 cone;	// Cutoff and blur, as the spot light block had them, then the first shadow view or -1
+	};
+
+	/** Where a light's first shadow view is written once the atlas is laid out. */
+	struct shadowTarget
+	{
+		bool directional;	// Into the directional light block, otherwise into l_clusterLights
+		uint32_t index;
+	};
+
+	static_assert(sizeof(cameraBlock) == 80, "cameraBlock does not match std140");
+	static_assert(sizeof(clusterBlock) == 48, "clusterBlock does not match std140");
+	static_assert(sizeof(dirLightBlock) == 64, "dirLightBlock does not match std140");
+	static_assert(sizeof(clusterLight) == 64, "clusterLight does not match the shader");
+
+	/** The size of each block in the order of shader::block. */
+	constexpr uint32_t l_blockSizes[(uint8_t)shader::block::count] = {
+		sizeof(cameraBlock),
+		sizeof(clusterBlock),
+		sizeof(dirLightBlock) * maxDirLights()
+	};
+
 	camera *l_camera = nullptr;
 	// Cannot be references for some weird vector reason
 	vector<model*> l_modelRefs = vector<model*>();
 	vector<light*> l_lightRefs = vector<light*>();
 
+	/** One buffer holds the light blocks, each at its own aligned offset. They only change with the lights. */
+	uint32_t l_idUBO = 0U;
+	uint32_t l_blockOffsets[(uint8_t)shader::block::count] = {};
+	/** CPU copy of the whole uniform buffer. */
+	vector<uint8_t> l_uboData = vector<uint8_t>();
+	/** The span of l_uboData changed since the last upload. */
+	uint32_t l_dirtyBegin = UINT32_MAX, l_dirtyEnd = 0U;
+	bool l_lightsDirty = true;
+	/** Point and spot lights as the shaders read them, and as the clusters are assigned from. */
+	vector<clusterLight> l_clusterLights = vector<clusterLight>();
+	vector<clusters::volume> l_lightVolumes = vector<clusters::volume>();
+	/** Every light that casts shadows, in the order they are laid out in the atlas. */
+	vector<shadows::request> l_shadowRequests = vector<shadows::request>();
+	vector<shadowTarget> l_shadowTargets = vector<shadowTarget>();
+	vector<int32_t> l_shadowViews = vector<int32_t>();
+	/** Texture buffers and the buffers behind them, in the order of shader::sharedTexture. */
+	uint32_t l_sharedTextures[(uint8_t)shader::sharedTexture::count] = {};
+	uint32_t l_sharedBuffers[(uint8_t)shader::sharedTexture::count] = {};
+	uint32_t l_maxAssignments = 0U;
+	/** Every model's world box, leaves hold the model's index in l_modelRefs. */
+	bvh l_sceneTree = bvh();
+	/** Models that moved since the last frame, their branches are refit before culling. */
+	vector<model*> l_movedModels = vector<model*>();
+	/** Kept between frames so culling does not allocate. */
+	vector<uint32_t> l_visibleModels = vector<uint32_t>();
+	vector<uint32_t> l_cullCandidates = vector<uint32_t>();
+	vector<vec4> l_cullSpheres = vector<vec4>();
+	vector<uint8_t> l_cullVisible = vector<uint8_t>();
+	culling::stats l_cullStats;
+	/** The models in a shadow view, kept between frames like the lists above. */
+	vector<uint32_t> l_shadowCasters = vector<uint32_t>();
+	/** What the GPU last said about a model, indexed like l_modelRefs. */
+	struct queryHistory
+	{
+		uint32_t idQuery = 0U;	// Made the first time the model is queried
+		bool pending = false;	// Issued, but the result has not been read
+		bool visible = true;	// The latest result, everything starts out visible
+	};
+
+	vector<queryHistory> l_queries = vector<queryHistory>();
+	/** Models held back from the queue by their last query, and the models queried this frame. */
+	vector<uint32_t> l_hiddenModels = vector<uint32_t>();
+	vector<uint32_t> l_queryModels = vector<uint32_t>();
+	bool l_occlusionQueries = false;
+	uint32_t l_queryBudget = 64U;
+	uint32_t l_frame = 0U;
+	bool l_fillMode = true;
+	mode l_renderMode = mode::fill;
+	/** Adds passes after the scene pass every frame. */
+	frameGraph::setupFunc l_graphSetup = nullptr;
+	pipeline l_pipeline = pipeline::forward;
+	bool l_depthPrepass = false;
+	/** A cube from 0 to 1, scaled over each box that is queried. */
+	mesh *l_boundsMesh = nullptr;
+	/** The built in shader with everything but the position cut out, for query boxes and the depth prepass. */
+	shader *l_boundsShader = nullptr;
+	/** Scene wide shader options, the light counts are kept up to date by writeLights. */
+	shader::permutation l_permutation = shader::permutation();
+
+	template<typename T>
+	_NODISCARD inline T *blockData(const shader::block _block, const uint8_t _index = 0U) noexcept
+	{	return (T*)&l_uboData[l_blockOffsets[(uint8_t)_block]] + _index; }
+
+	inline void markDirty(const uint32_t _offset, const uint32_t _byteSize) noexcept
+	{
+		l_dirtyBegin = std::min(l_dirtyBegin, _offset);
+		l_dirtyEnd = std::max(l_dirtyEnd, _offset + _byteSize);
+	}
+
+	void createUniformBuffer() noexcept
+	{
+		const uint32_t alignment = renderer::getUniformBufferOffsetAlignment();
+		uint32_t size = 0U;
+		// The camera and clusters are streamed every frame, so they have no space here
+		for (uint8_t i = (uint8_t)shader::block::dirLights; i < (uint8_t)shader::block::count; ++i)
+		{
+			l_blockOffsets[i] = size;
+			size += l_blockSizes[i];
+			// Round up so the next block starts on a legal offset
+			size = (size + alignment - 1U) / alignment * alignment;
+		}
+
+		l_uboData = vector<uint8_t>(size, 0U);
+		l_idUBO = renderer::createUniformBuffer(size);
+		// Bound once, the programs find them through their block bindings
+		for (uint8_t i = (uint8_t)shader::block::dirLights; i < (uint8_t)shader::block::count; ++i)
+		{	renderer::bindUniformBufferRange(i, l_idUBO, l_blockOffsets[i], l_blockSizes[i]); }
+		markDirty(0U, size);
+	}
+
+	/** Rewrites every light, directional ones into the CPU copy of their block and the rest into the light texture buffer. */
+	void writeLights() noexcept
+	{
+		const uint32_t begin = l_blockOffsets[(uint8_t)shader::block::dirLights];
+		// Zeroed slots are only read by the fallback shader, which loops over every slot
+		std::fill(l_uboData.begin() + begin, l_uboData.end(), (uint8_t)0U);
+
+		uint8_t numDirLights = 0;
+		l_clusterLights.clear();
+		l_lightVolumes.clear();
+		l_shadowRequests.clear();
+		l_shadowTargets.clear();
+		// Without a shadow map until one is given below, empty slots included
+		for (uint8_t i = 0; i < maxDirLights(); ++i)
+		{	blockData<dirLightBlock>(shader::block::dirLights, i)->direction.w = -1.0f; }
+		for (light *currentLight : l_lightRefs)
+		{
+			const vec4 col = vec4(currentLight->getColour().rgb(), 0.0f);
+			// The light travels away from forward, which points back at it
+			const vec3 forward = vec3(currentLight->getForward());
+			const bool hasDirection = glm::dot(forward, forward) > 0.0f;
+			switch (currentLight->getType())
+			{
+			case light::type::directional:
+			{
+				if (numDirLights >= maxDirLights()) break;
+				dirLightBlock *block = blockData<dirLightBlock>(shader::block::dirLights, numDirLights);
+				block->colour = { col * getAmbience(), col, col };
+				block->direction = vec4(forward, -1.0f);
+				if (currentLight->castsShadows() && hasDirection)
+				{
+					shadows::request request;
+					request.type = light::type::directional;
+					request.direction = -glm::normalize(forward);
+					l_shadowRequests.push_back(request);
+					l_shadowTargets.push_back({ true, numDirLights });
+				}
+				++numDirLights;
+				break;
+			}
+			case light::type::point:
+			case light::type::spot:
+			{
+				if (l_clusterLights.size() >= maxClusteredLights()) break;
+				const bool spot = currentLight->getType() == light::type::spot;
+				const vec3 position = vec3(currentLight->getPosition());
+				clusterLight data;
+				data.position = vec4(position, spot ? 1.0f : 0.0f);
+				data.colour = vec4(vec3(col), currentLight->getLinear());
+				data.direction = vec4(forward, currentLight->getQuadratic());
+				data.cone = spot ? vec4(currentLight->getAngle(), currentLight->getBlur(), -1.0f, 0.0f) : vec4(0.0f, 0.0f, -1.0f, 0.0f);
+				l_clusterLights.push_back(data);
+
+				clusters::volume volume;
+				volume.position = position;
+				volume.radius = clusters::getRadius(
+					currentLight->getLinear(),
+					currentLight->getQuadratic(),
+					std::max({ col.r, col.g, col.b })
+				);
+				// Lit where the way back to the light matches forward, so the cone opens the other way
+				if (spot && hasDirection)
+				{
+					volume.direction = -glm::normalize(forward);
+					volume.cosAngle = currentLight->getAngle();
+				}
+				l_lightVolumes.push_back(volume);
+
+				if (currentLight->castsShadows() && (!spot || hasDirection))
+				{
+					shadows::request request;
+					request.type = currentLight->getType();
+					request.position = position;
+					request.direction = volume.direction;
+					request.cosAngle = volume.cosAngle;
+					// A light that never fades still only shadows as far as anything is drawn
+					request.range = std::min(volume.radius, getFarPlane());
+					l_shadowRequests.push_back(request);
+					l_shadowTargets.push_back({ false, (uint32_t)l_clusterLights.size() - 1U });
+				}
+				break;
+			}
+			default:
+				assert(false && "You forgot to add the light type to writeLights");
+				return;
+			}
+		}
+
+		// Programs are selected for this count, so no fragment loops over empty slots
+		l_permutation.dirLights = numDirLights;
+
+		// Views only move if the lights before them changed, the rest keep their maps
+		l_shadowViews.resize(l_shadowRequests.size());
+		shadows::setLights(l_shadowRequests.data(), (uint32_t)l_shadowRequests.size(), l_shadowViews.data());
+		for (size_t i = 0; i < l_shadowTargets.size(); ++i)
+		{
+			const float firstView = (float)l_shadowViews[i];
+			if (l_shadowTargets[i].directional)
+			{	blockData<dirLightBlock>(shader::block::dirLights, (uint8_t)l_shadowTargets[i].index)->direction.w = firstView; }
+			else
+			{	l_clusterLights[l_shadowTargets[i].index].cone.z = firstView; }
+		}
+
+		markDirty(begin, (uint32_t)l_uboData.size() - begin);
+		renderer::updateTextureBuffer(
+			l_sharedBuffers[(uint8_t)shader::sharedTexture::lights],
+			(uint32_t)(l_clusterLights.size() * sizeof(clusterLight)),
+			l_clusterLights.data()
+		);
+		l_lightsDirty = false;
+	}
+
+	/** Sends everything that changed to the gpu in a single upload. */
+	void uploadUniformBuffer() noexcept
+	{
+		if (l_dirtyBegin >= l_dirtyEnd)
+		{	return; }
+
+		renderer::updateUniformBuffer(
+			l_idUBO,
+			l_dirtyBegin,
+			l_dirtyEnd - l_dirtyBegin,
+			&l_uboData[l_dirtyBegin]
+		);
+		l_dirtyBegin = UINT32_MAX;
+		l_dirtyEnd = 0U;
+	}
+
+	/** A cube from 0 to 1, only the positions matter. */
+	mesh *createBoundsMesh()
+	{
+		vector<mesh::vertex> *vertices = new vector<mesh::vertex>(8U, mesh::vertex());
+		for (uint8_t i = 0; i < 8U; ++i)
+		{	(*vertices)[i].position = vec3(i & 1U, (i >> 1U) & 1U, (i >> 2U) & 1U); }
+		vector<uint32_t> *indices = new vector<uint32_t>({
+			0, 2, 1, 1, 2, 3,	// -z
+			4, 5, 6, 5, 7, 6,	// +z
+			0, 1, 4, 1, 5, 4,	// -y
+			2, 6, 3, 3, 6, 7,	// +y
+			0, 4, 2, 2, 4, 6,	// -x
+			1, 3, 5, 3, 7, 5	// +x
+		});
+		return new mesh(vertices, indices, true);
+	}
+
+	/** The near plane would cut away the faces of a box around the camera, so those never go through a query. */
+	_NODISCARD inline bool containsCamera(const culling::bounds &_bounds, const vec3 &_position) noexcept
+	{
+		// Well past the near plane distance, a box just in front of the camera can lose its nearest face too
+		constexpr float margin = 0.5f;
+		return _position.x >= _bounds.min.x - margin && _position.x <= _bounds.max.x + margin
+			&& _position.y >= _bounds.min.y - margin && _position.y <= _bounds.max.y + margin
+			&& _position.z >= _bounds.min.z - margin && _position.z <= _bounds.max.z + margin;
+	}
+
+	/** Reads every query the GPU has finished, anything still in flight keeps its last answer. */
+	void readQueries() noexcept
+	{
+		for (queryHistory &cur : l_queries)
+		{
+			if (cur.pending && renderer::isQueryResultAvailable(cur.idQuery))
+			{
+				cur.visible = renderer::getQueryAnySamples(cur.idQuery);
+				cur.pending = false;
+			}
+		}
+	}
+
+	/** Draws the boxes of hidden models, and of visible ones due a recheck, as occlusion queries.
+	 * Hidden models are then drawn conditionally on their query, so they show up the frame they come into view.
+	 * @note Must follow the queue, the boxes are tested against everything it drew.
+	 */
+	void issueQueries(const vec3 &_viewPos)
+	{
+		// Hidden models first, a query is the only way they come back
+		l_queryModels.clear();
+		for (const uint32_t index : l_hiddenModels)
+		{
+			if (!l_queries[index].pending && l_queryModels.size() < l_queryBudget)
+			{	l_queryModels.push_back(index); }
+		}
+		// Visible models are spread over the interval by index, so they do not all come due together
+		for (const uint32_t index : l_visibleModels)
+		{
+			if (l_queryModels.size() >= l_queryBudget)
+			{	break; }
+			if (l_queries[index].pending || (l_frame + index) % getQueryInterval() != 0U
+				|| containsCamera(l_modelRefs[index]->getWorldBounds(), _viewPos))
+			{	continue; }
+			l_queryModels.push_back(index);
+		}
+
+		if (!l_queryModels.empty())
+		{
+			uint32_t first;
+			drawQueue::instance *boxes = (drawQueue::instance*)renderer::mapInstances((uint32_t)l_queryModels.size(), &first);
+			for (size_t i = 0; i < l_queryModels.size(); ++i)
+			{
+				const culling::bounds box = l_modelRefs[l_queryModels[i]]->getWorldBounds();
+				boxes[i] = {
+					glm::scale(glm::translate(mat4(1.0f), box.min), box.max - box.min),
+					mat3(1.0f)
+				};
+			}
+			renderer::flushStream();
+
+			// Only the depth test matters, the boxes must not show or hide anything themselves
+			renderer::setColourWrites(false);
+			renderer::setDepthWrites(false);
+			l_boundsShader->use();
+			for (size_t i = 0; i < l_queryModels.size(); ++i)
+			{
+				queryHistory &cur = l_queries[l_queryModels[i]];
+				if (!cur.idQuery)
+				{	cur.idQuery = renderer::createQuery(); }
+				renderer::beginOcclusionQuery(cur.idQuery);
+				l_boundsMesh->drawInstanced(1U, first + (uint32_t)i);
+				renderer::endOcclusionQuery();
+				cur.pending = true;
+			}
+			renderer::setDepthWrites(true);
+			renderer::setColourWrites(true);
+			l_cullStats.queries = (uint32_t)l_queryModels.size();
+		}
+
+		// Even a query still in flight from an earlier frame is fine, without a result the GPU just draws
+		for (const uint32_t index : l_hiddenModels)
+		{
+			model *cur = l_modelRefs[index];
+			cur->selectVariant(l_permutation);
+			cur->getActiveShader()->use();
+			renderer::beginConditionalRender(l_queries[index].idQuery);
+			cur->draw();
+			renderer::endConditionalRender();
+		}
+	}
+
+	/** Assigns the point and spot lights to the clusters of this frame's view, and streams what fragments need to find theirs. */
+	void updateClusters() noexcept
+	{
+		const mat4 view = l_camera->getView();
+		clusters::setProjection(l_camera->getProjection(), getNearPlane(), getFarPlane());
+		clusters::assign(view, l_lightVolumes.data(), (uint32_t)l_lightVolumes.size(), l_maxAssignments);
+		renderer::updateTextureBuffer(
+			l_sharedBuffers[(uint8_t)shader::sharedTexture::clusters],
+			clusters::getClusterCount() * 2U * sizeof(uint32_t),
+			clusters::getTable()
+		);
+		renderer::updateTextureBuffer(
+			l_sharedBuffers[(uint8_t)shader::sharedTexture::clusterLights],
+			clusters::getIndexCount() * sizeof(uint32_t),
+			clusters::getIndices()
+		);
+
+		uint32_t width, height;
+		renderer::getViewportSize(&width, &height);
+		const glm::vec2 sliceScale = clusters::getSliceScale();
+		const renderer::streamAllocation space = renderer::streamAllocate(
+			sizeof(clusterBlock),
+			renderer::getUniformBufferOffsetAlignment()
+		);
+		*(clusterBlock*)space.data = {
+			// The third row of the view matrix, negated as the camera looks down -z
+			-vec4(view[0][2], view[1][2], view[2][2], view[3][2]),
+			vec4(
+				(float)clusters::getGridX() / (float)std::max(width, 1U),
+				(float)clusters::getGridY() / (float)std::max(height, 1U),
+				sliceScale.x,
+				sliceScale.y
+			),
+			glm::uvec4(clusters::getGridX(), clusters::getGridY(), clusters::getGridZ(), 0U)
+		};
+		renderer::bindUniformBufferRange((uint32_t)shader::block::clusters, space.idBuffer, space.offset, sizeof(clusterBlock));
+	}
+
+	/** Draws one layer of the casters in a shadow view, see shadows::drawFunc. */
+	void drawShadowCasters(const mat4 &_viewProjection, const culling::frustum &_frustum, const bool _static)
+	{
+		const renderer::streamAllocation space = renderer::streamAllocate(
+			sizeof(cameraBlock),
+			renderer::getUniformBufferOffsetAlignment()
+		);
+		*(cameraBlock*)space.data = { _viewProjection, vec4(0.0f) };
+		renderer::bindUniformBufferRange((uint32_t)shader::block::camera, space.idBuffer, space.offset, sizeof(cameraBlock));
+
+		// Models crossing the edge are drawn as they are, testing them again costs more than a depth only draw
+		l_shadowCasters.clear();
+		l_sceneTree.cull(_frustum, &l_shadowCasters, &l_shadowCasters);
+		drawQueue::clear();
+		for (const uint32_t index : l_shadowCasters)
+		{
+			const model *cur = l_modelRefs[index];
+			if (cur->isShadowCaster() && cur->isStatic() == _static)
+			{	cur->queueShadow(); }
+		}
+		drawQueue::sort();
+		drawQueue::submitDepthOnly(l_boundsShader);
+	}
+
+	/** Brings the shadow maps up to date, only views whose matrix or casters changed are drawn.
+	 * @note Binds camera blocks of its own, the camera's has to be bound after.
+	 */
+	void renderShadows()
+	{
+		if (shadows::update(l_camera->getView(), l_camera->getProjection(), getNearPlane(), l_sceneTree.getBounds()))
+		{
+			uint32_t texelCount;
+			const vec4 *texels = shadows::getViewData(&texelCount);
+			renderer::updateTextureBuffer(
+				l_sharedBuffers[(uint8_t)shader::sharedTexture::shadowViews],
+				texelCount * (uint32_t)sizeof(vec4),
+				texels
+			);
+		}
+		// Bound every frame, creating a texture binds it to whichever unit is active
+		renderer::setActiveTexture(shader::getSharedTextureUnit(shader::sharedTexture::shadowAtlas));
+		renderer::bindTexture2D(shadows::getAtlas());
+
+		// The maps stay out of date until the casters' program is ready
+		if (!l_boundsShader->isLoaded())
+		{	return; }
+		// Lines and points would leave holes in the shadows
+		if (!l_fillMode)
+		{	renderer::setRenderMode((int)mode::fill); }
+		shadows::render(drawShadowCasters);
+		if (!l_fillMode)
+		{	renderer::setRenderMode((int)l_renderMode); }
+		uint32_t width, height;
+		renderer::getViewportSize(&width, &height);
+		renderer::setViewportRect(0U, 0U, width, height);
+	}
+
+	/** Fills l_visibleModels with every model that may be seen, and l_hiddenModels with those waiting on a query. */
+	void cullModels(const culling::frustum &_view, const vec3 &_viewPos, const bool _useQueries)
+	{
+		// Whole subtrees are skipped or accepted at once, only models in leaves crossing a plane need their own test
+		l_cullCandidates.clear();
+		l_cullStats.nodesTested = l_sceneTree.cull(_view, &l_visibleModels, &l_cullCandidates);
+
+		// Spheres fit rotated models closer than their boxes, the candidates are tested in one batch
+		l_cullSpheres.resize(l_cullCandidates.size());
+		l_cullVisible.resize(l_cullCandidates.size());
+		for (size_t i = 0; i < l_cullCandidates.size(); ++i)
+		{	l_cullSpheres[i] = l_modelRefs[l_cullCandidates[i]]->getWorldSphere(); }
+		culling::testSpheres(_view, l_cullSpheres.data(), (uint32_t)l_cullSpheres.size(), l_cullVisible.data());
+		for (size_t i = 0; i < l_cullCandidates.size(); ++i)
+		{
+			if (l_cullVisible[i])
+			{	l_visibleModels.push_back(l_cullCandidates[i]); }
+		}
+
+		// Visible occluders are drawn into the software depth buffer, then everything else is tested against it
+		occlusion::begin(l_camera->getWorldToCameraMatrix());
+		for (const uint32_t index : l_visibleModels)
+		{
+			if (l_modelRefs[index]->isOccluder())
+			{	l_modelRefs[index]->addOccluders(); }
+		}
+		if (occlusion::hasOccluders())
+		{
+			occlusion::rasterise();
+			size_t kept = 0U;
+			for (const uint32_t index : l_visibleModels)
+			{
+				const model *cur = l_modelRefs[index];
+				if (cur->isOccluder() || occlusion::testBox(cur->getWorldBounds()))
+				{	l_visibleModels[kept++] = index; }
+			}
+			l_cullStats.modelsOccluded = (uint32_t)(l_visibleModels.size() - kept);
+			l_visibleModels.resize(kept);
+		}
+
+		// Models the GPU saw nothing of last time wait for a new query, queued models go first to fill the depth
+		if (_useQueries)
+		{
+			readQueries();
+			size_t kept = 0U;
+			for (const uint32_t index : l_visibleModels)
+			{
+				queryHistory &history = l_queries[index];
+				if (!history.visible && containsCamera(l_modelRefs[index]->getWorldBounds(), _viewPos))
+				{	history.visible = true; }
+				if (history.visible)
+				{	l_visibleModels[kept++] = index; }
+				else
+				{	l_hiddenModels.push_back(index); }
+			}
+			l_visibleModels.resize(kept);
+			l_cullStats.modelsConditional = (uint32_t)l_hiddenModels.size();
+		}
+	}
+
 	bool init(const float _aspect) noexcept
 	{
 		// Default clear colour
@@ -31,169 +577,209 @@ namespace graphics
 		l_camera->setPosition(vec3(0.0f, 3.5f, 6.0f));
 
 		texture::init();
+		createUniformBuffer();
+		const renderer::bufferFormat formats[(uint8_t)shader::sharedTexture::shadowAtlas] = {
+			renderer::bufferFormat::rgba32f,
+			renderer::bufferFormat::rg32ui,
+			renderer::bufferFormat::r32ui,
+			renderer::bufferFormat::rgba32f
+		};
+		// The atlas is not a texture buffer, shadows owns it
+		for (uint8_t i = 0; i < (uint8_t)shader::sharedTexture::shadowAtlas; ++i)
+		{
+			l_sharedTextures[i] = renderer::createTextureBuffer(formats[i], &l_sharedBuffers[i]);
+			// Bound once, the programs find them through their fixed units
+			renderer::bindTextureBuffer(shader::getSharedTextureUnit((shader::sharedTexture)i), l_sharedTextures[i]);
+		}
+		l_maxAssignments = renderer::getMaxTextureBufferSize();
+		l_boundsMesh = createBoundsMesh();
+		l_boundsShader = shader::acquire(nullptr, "#define BOUNDS_ONLY\n");
+		// Lights asking for shadows then simply get none
+		if (!shadows::init())
+		{
+			debug::send(
+				"The driver cannot draw into the shadow atlas, lights cast no shadows",
+				debug::type::note, debug::impact::large, debug::stage::mid
+			);
+		}
+		// Without it culling stays on the CPU, nothing else depends on it
+		if (!gpuCulling::init())
+		{
+			debug::send(
+				"GPU culling programs failed to build, culling on the CPU",
+				debug::type::note, debug::impact::small, debug::stage::mid
+			);
+		}
 
 		return true;
 	}
 
 	void terminate() noexcept
 	{
+		renderer::deleteBuffer(l_idUBO);
+		renderer::deleteTextures(l_sharedTextures, (uint32_t)shader::sharedTexture::shadowAtlas);
+		for (uint8_t i = 0; i < (uint8_t)shader::sharedTexture::shadowAtlas; ++i)
+		{	renderer::deleteBuffer(l_sharedBuffers[i]); }
+		renderer::releaseStream();
+		for (const queryHistory &cur : l_queries)
+		{
+			if (cur.idQuery)
+			{	renderer::deleteQueries(&cur.idQuery); }
+		}
+		// Models deleted after this have nothing left to remove themselves from
+		l_queries.clear();
+		l_modelRefs.clear();
+		delete l_boundsMesh;
+		shader::release(l_boundsShader);
+		gpuCulling::terminate();
+		deferred::terminate();
+		shadows::terminate();
+		frameGraph::terminate();
+		checkerboard::terminate();
+		resolution::terminate();
+		shader::terminate();
 		texture::terminate();
 		delete l_camera;
 	}
 
-	void draw()
+	/** The scene pass of the frame graph, everything from the shadows to the last model. */
+	void drawScene(void *_data)
 	{
+		// Only half the columns are shaded, offset so the next frame shades the rest
+		const mat4 viewProjection = checkerboard::beginFrame(l_camera->getWorldToCameraMatrix(), l_fillMode);
 		// Clears to background colour
 		renderer::clearScreenBuffers();
+		++l_frame;
 
-		for (uint8_t i = 0; i < modelCount(); ++i)
-		{
-			model *cur = getModelAt(i);
-			cur->getShaderRef()->use();
-			// TODO flesh out
-			string errorMsg;
-			cur->getShaderRef()->setMat4("u_camera", l_camera->getWorldToCameraMatrix(), errorMsg);
-			cur->getShaderRef()->setFloat3("u_viewPos", (vec3)l_camera->getPosition(), errorMsg);
-			cur->draw();
-		}
-	}
+		renderer::beginStreamFrame();
 
-	void loadLightsIntoShader(const shader *_shader) noexcept
-	{
-		// TODO flesh out
-		string errorMsg;
-		uint8_t numDirLights = 0;
-		uint8_t numPointLights = 0;
-		uint8_t numSpotLights = 0;
-		string lightNum;
-		_shader->setFloat("u_material.shininess", 32.0f, errorMsg);
+		if (l_lightsDirty)
+		{	writeLights(); }
+
+		uploadUniformBuffer();
+		updateClusters();
 
-		for (uint8_t i = 0; i < lightCount(); ++i)
+		// Anything that finished compiling since last frame is swapped in from here on
+		shader::pollPending();
+
+		// Spread over frames so freeing meshes never causes a long copy
+		renderer::compactGeometry(getCompactionBudget());
+
+		// Moving a model only refits the nodes above it, the tree is rebuilt in the background once that wears it down
+		for (model *cur : l_movedModels)
 		{
-			light *currentLight = getLightAt(i);
-			switch (currentLight->getType())
+			const culling::bounds bounds = cur->getWorldBounds();
+			// Shadow maps the model left and the ones it entered are both out of date
+			if (cur->isShadowCaster())
 			{
-			case light::type::directional:
-				lightNum = to_string(numDirLights);
-				_shader->setFloat3(
-					"u_dirLights[" + lightNum + "].colour.ambient",
-					currentLight->getColour() * getAmbience(),
-					errorMsg
-				);
-				_shader->setFloat3(
-					"u_dirLights[" + lightNum + "].colour.diffuse",
-					currentLight->getColour(),
-					errorMsg
-				);
-				_shader->setFloat3(
-					"u_dirLights[" + lightNum + "].colour.specular",
-					currentLight->getColour(),
-					errorMsg
-				);
-				_shader->setFloat4(
-					"u_dirLights[" + lightNum + "].direction",
-					currentLight->getForward(),
-					errorMsg
-				);
-				++numDirLights; break;
-			case light::type::point:
-				lightNum = to_string(numPointLights);
-				_shader->setFloat3(
-					"u_pointLights[" + lightNum + "].colour.diffuse",
-					currentLight->getColour(),
-					errorMsg
-				);
-				_shader->setFloat3(
-					"u_pointLights[" + lightNum + "].colour.specular",
-					currentLight->getColour(),
-					errorMsg
-				);
-				_shader->setFloat4(
-					"u_pointLights[" + lightNum + "].position",
-					currentLight->getPosition(),
-					errorMsg
-				);
-				_shader->setFloat(
-					"u_pointLights[" + lightNum + "].linear",
-					currentLight->getLinear(),
-					errorMsg
-				);
-				_shader->setFloat(
-					"u_pointLights[" + lightNum + "].quadratic",
-					currentLight->getQuadratic(),
-					errorMsg
-				);
-				++numPointLights; break;
-			case light::type::spot:
-				lightNum = to_string(numSpotLights);
-				_shader->setFloat3(
-					"u_spotLights[" + lightNum + "].colour.diffuse",
-					currentLight->getColour(),
-					errorMsg
-				);
-				_shader->setFloat3(
-					"u_spotLights[" + lightNum + "].colour.specular",
-					currentLight->getColour(),
-					errorMsg
-				);
-				_shader->setFloat4(
-					"u_spotLights[" + lightNum + "].position",
-					currentLight->getPosition(),
-					errorMsg
-				);
-				_shader->setFloat4(
-					"u_spotLights[" + lightNum + "].direction",
-					currentLight->getForward(),
-					errorMsg
-				);
-				_shader->setFloat(
-					"u_spotLights[" + lightNum + "].linear",
-					currentLight->getLinear(),
-					errorMsg
-				);
-				_shader->setFloat(
-					"u_spotLights[" + lightNum + "].quadratic",
-					currentLight->getQuadratic(),
-					errorMsg
-				);
-				_shader->setFloat(
-					"u_spotLights[" + lightNum + "].cutoff",
-					currentLight->getAngle(),
-					errorMsg
-				);
-				_shader->setFloat(
-					"u_spotLights[" + lightNum + "].blur",
-					currentLight->getBlur(),
-					errorMsg
-				);
-				++numSpotLights; break;
-			default:
-				assert(false && "You forgot to add the light type to loadLightsIntoShader");
-				return;
+				shadows::casterMoved(l_sceneTree.getProxyBounds(cur->getSceneProxy()), cur->isStatic());
+				shadows::casterMoved(bounds, cur->isStatic());
 			}
+			l_sceneTree.move(cur->getSceneProxy(), bounds);
+		}
+		l_movedModels.clear();
+		l_sceneTree.maintain();
+		renderShadows();
+
+		// Shared by every program through the camera block, written straight into this frame's stream
+		const renderer::streamAllocation camSpace = renderer::streamAllocate(
+			sizeof(cameraBlock),
+			renderer::getUniformBufferOffsetAlignment()
+		);
+		*(cameraBlock*)camSpace.data = {
+			viewProjection,
+			l_camera->getPosition()
+		};
+		renderer::bindUniformBufferRange(
+			(uint32_t)shader::block::camera,
+			camSpace.idBuffer,
+			camSpace.offset,
+			sizeof(cameraBlock)
+		);
+
+		// Models only emit packets here, nothing is drawn until the queue is sorted
+		drawQueue::clear();
+		l_cullStats = culling::stats();
+		l_visibleModels.clear();
+		l_hiddenModels.clear();
+		const vec3 viewPos = l_camera->getPosition();
+		const culling::frustum view = culling::extractFrustum(viewProjection);
+		// The GPU tests every instance itself, so every model is sent and none are looked at here
+		const bool gpuCull = gpuCulling::isActive();
+		const bool useQueries = !gpuCull && l_occlusionQueries && l_fillMode && l_boundsShader->isLoaded();
+		if (gpuCull)
+		{
+			gpuCulling::beginFrame(viewProjection);
+			for (uint32_t i = 0; i < (uint32_t)l_modelRefs.size(); ++i)
+			{	l_visibleModels.push_back(i); }
+		}
+		else
+		{	cullModels(view, viewPos, useQueries); }
+
+		// Every variant is swapped to write the G-buffer, so it can only start once the lighting program is ready
+		l_permutation.deferred = l_pipeline == pipeline::deferred && l_fillMode && !l_permutation.depthBuffer
+			&& deferred::prepare(l_permutation);
+		if (l_permutation.deferred)
+		{	deferred::beginGeometry(); }
+
+		l_cullStats.modelsVisible = (uint32_t)(l_visibleModels.size() + l_hiddenModels.size());
+		l_cullStats.modelsCulled = (uint32_t)l_modelRefs.size() - l_cullStats.modelsVisible;
+		for (const uint32_t index : l_visibleModels)
+		{
+			model *cur = l_modelRefs[index];
+			// Only loads anything if the lights or the model's options changed
+			cur->selectVariant(l_permutation);
+			cur->queueDraw(glm::length(cur->getPosition() - viewPos) / getFarPlane(), gpuCull ? nullptr : &view, &l_cullStats);
 		}
+
+		drawQueue::sort();
+		drawQueue::submit(l_depthPrepass && l_boundsShader->isLoaded() ? l_boundsShader : nullptr);
+
+		// Queried boxes test against the G-buffer's depth, and anything they let through is drawn into it
+		if (useQueries)
+		{	issueQueries(viewPos); }
+		if (l_permutation.deferred)
+		{	deferred::light(viewProjection); }
+		// Everything opaque is drawn, so the depth is complete for the next frame's cull
+		if (gpuCull)
+		{	gpuCulling::buildPyramid(); }
+		checkerboard::endFrame();
+
+		renderer::endStreamFrame();
 	}
 
-	void updateAllShaders() noexcept
+	void draw()
 	{
-		// Need to add the light in each of the shaders
-		for (auto model : l_modelRefs)
-		{	loadLightsIntoShader(model->getShaderRef()); }
+		// Everything below draws into the scene target instead of the window while it is on
+		resolution::beginFrame();
+		frameGraph::begin();
+		// The scene is drawn first and whole, passes added after it can build on what it drew
+		const frameGraph::passId scene = frameGraph::addPass("scene", drawScene);
+		frameGraph::write(scene, frameGraph::getScreen());
+		if (l_graphSetup)
+		{	l_graphSetup(); }
+		frameGraph::execute();
+		resolution::endFrame();
 	}
 
+	void markLightsDirty() noexcept
+	{	l_lightsDirty = true; }
+
+	void markShadowsDirty() noexcept
+	{	shadows::invalidate(); }
+
 	void modifyAllSpotlights(
 		const bool _isAngle,
 		const float _value
 	)
 	{
-		for (uint8_t i = 0, count = 0; i < (uint8_t)lightCount(); ++i)
+		for (uint32_t i = 0; i < lightCount(); ++i)
 		{
 			light *currentlLight = getLightAt(i);
 
 			// We only want to modify the spotlights, ignore the others
 			if (currentlLight->getType() != light::type::spot) continue;
 
-			string numLights = to_string(count);
 			float limit = _isAngle ? 90.0f : 1.0f;
 			float newValue = _isAngle ? currentlLight->getAngleRaw() : currentlLight->getBlurRaw();
 			newValue += _value;
@@ -206,41 +792,56 @@ namespace graphics
 				else
 				{	currentlLight->setBlur(newValue); }
 
-				// Update the shaders on all the models
-				for (uint8_t j = 0; j < modelCount(); ++j)
-				{
-					// TODO flesh out
-					string errorMsg;
-					if (_isAngle)
-					{
-						getModelAt(j)->getShaderRef()->setFloat(
-							"u_spotLights[" + numLights + "].cutoff",
-							currentlLight->getAngle(),
-							errorMsg
-						);
-					}
-					else
-					{
-						getModelAt(j)->getShaderRef()->setFloat(
-							"u_spotLights[" + numLights + "].blur",
-							currentlLight->getBlur(),
-							errorMsg
-						);
-					}
-				}
+				// The cone decides which clusters the light reaches, so it is rewritten with the rest
+				markLightsDirty();
 			}
-			// Only incremented for a spotlight
-			++count;
 		}
 	}
 
 	void addNewModel(model *_model)
-	{	l_modelRefs.push_back(_model); }
+	{
+		_model->setSceneProxy(l_sceneTree.insert(_model->getWorldBounds(), (uint32_t)l_modelRefs.size()));
+		if (_model->isShadowCaster())
+		{	shadows::casterMoved(_model->getWorldBounds(), _model->isStatic()); }
+		l_modelRefs.push_back(_model);
+		l_queries.push_back(queryHistory());
+	}
+
+	void removeModel(model *_model) noexcept
+	{
+		const vector<model*>::iterator found = std::find(l_modelRefs.begin(), l_modelRefs.end(), _model);
+		if (found == l_modelRefs.end())
+		{	return; }
+		const uint32_t index = (uint32_t)(found - l_modelRefs.begin());
+
+		// The shadow maps it was drawn into are out of date without it
+		if (_model->isShadowCaster())
+		{	shadows::casterMoved(l_sceneTree.getProxyBounds(_model->getSceneProxy()), _model->isStatic()); }
+		l_sceneTree.remove(_model->getSceneProxy());
+		// Without a proxy it no longer reports moving, which releasing its meshes would do
+		_model->setSceneProxy(bvh::invalid());
+		l_movedModels.erase(std::remove(l_movedModels.begin(), l_movedModels.end(), _model), l_movedModels.end());
+
+		if (l_queries[index].idQuery)
+		{	renderer::deleteQueries(&l_queries[index].idQuery); }
+		l_modelRefs.erase(found);
+		l_queries.erase(l_queries.begin() + index);
+		// Every model after it moved down one, so the items the tree hands back follow
+		for (uint32_t i = index; i < (uint32_t)l_modelRefs.size(); ++i)
+		{	l_sceneTree.setItem(l_modelRefs[i]->getSceneProxy(), i); }
+	}
+
+	void markModelMoved(model *_model) noexcept
+	{
+		// The same model moved twice in a row only needs one refit
+		if (l_movedModels.empty() || l_movedModels.back() != _model)
+		{	l_movedModels.push_back(_model); }
+	}
 
 	void addNewLight(light *_light)
 	{
 		l_lightRefs.push_back(_light);
-		updateAllShaders();
+		markLightsDirty();
 	}
 
 	void setClearColour(const colour _colour) noexcept
@@ -250,38 +851,90 @@ namespace graphics
 	}
 
 	void setRenderMode(const mode _mode) noexcept
-	{	renderer::setRenderMode(int(_mode)); }
-
-	void setRenderDepthBuffer(const bool _state) noexcept
 	{
-		// TODO flesh out
-		string errorMsg;
-		for (auto model : l_modelRefs)
-		{	model->getShaderRef()->setBool("u_depthBuffer", _state, errorMsg); }
+		renderer::setRenderMode(int(_mode));
+		l_renderMode = _mode;
+		l_fillMode = _mode == mode::fill;
 	}
 
-	uint8_t modelCount() noexcept
-	{	return (uint8_t)l_modelRefs.size(); }
+	void setRenderDepthBuffer(const bool _state) noexcept
+	{	l_permutation.depthBuffer = _state; }
+
+	void setPipeline(const pipeline _pipeline) noexcept
+	{	l_pipeline = _pipeline; }
+
+	pipeline getPipeline() noexcept
+	{	return l_pipeline; }
+
+	void setDepthPrepass(const bool _state) noexcept
+	{	l_depthPrepass = _state; }
+
+	void setOcclusionQueries(const bool _state) noexcept
+	{	l_occlusionQueries = _state; }
+
+	void setGpuCulling(const bool _state) noexcept
+	{	gpuCulling::setEnabled(_state); }
 
-	uint8_t lightCount() noexcept
-	{	return (uint8_t)l_lightRefs.size(); }
+	void setQueryBudget(const uint32_t _budget) noexcept
+	{	l_queryBudget = _budget; }
 
-	model *getModelAt(const uint8_t _pos)
+	void setDynamicResolution(const bool _state) noexcept
+	{	resolution::setEnabled(_state); }
+
+	void setCheckerboard(const bool _state) noexcept
+	{	checkerboard::setEnabled(_state); }
+
+	void setGraphSetupCallback(const frameGraph::setupFunc _func) noexcept
+	{	l_graphSetup = _func; }
+
+	uint32_t modelCount() noexcept
+	{	return (uint32_t)l_modelRefs.size(); }
+
+	uint32_t lightCount() noexcept
+	{	return (uint32_t)l_lightRefs.size(); }
+
+	model *getModelAt(const uint32_t _pos)
 	{
-		if (_pos > modelCount() - 1)
+		if (_pos >= modelCount())
 		{	throw graphicsException("Attempting to access model outside array size"); }
 
 		return l_modelRefs[_pos];
 	}
 
-	light *getLightAt(const uint8_t _pos)
+	light *getLightAt(const uint32_t _pos)
 	{
-		if (_pos > lightCount() - 1)
+		if (_pos >= lightCount())
 		{	throw graphicsException("Attempting to access light outside array size"); }
 
 		return l_lightRefs[_pos];
 	}
 
+	const shader::permutation &getPermutation() noexcept
+	{
+		// Models created before the first draw still get the right light counts
+		if (l_lightsDirty && !l_uboData.empty())
+		{	writeLights(); }
+		return l_permutation;
+	}
+
+	culling::stats getCullStats() noexcept
+	{	return l_cullStats; }
+
+	clusters::stats getClusterStats() noexcept
+	{	return clusters::getStats(); }
+
+	shadows::stats getShadowStats() noexcept
+	{	return shadows::getStats(); }
+
+	resolution::stats getResolutionStats() noexcept
+	{	return resolution::getStats(); }
+
+	frameGraph::stats getFrameGraphStats() noexcept
+	{	return frameGraph::getStats(); }
+
+	bvh::stats getSceneTreeStats() noexcept
+	{	return l_sceneTree.getStats(); }
+
 	camera *getCamera() noexcept
 	{	return l_camera; }
 }
@@ -3,6 +3,11 @@
 #include "light.hpp"
 #include "model.hpp"
 #include "camera.hpp"
+#include "bvh.hpp"
+#include "clusters.hpp"
+#include "shadows.hpp"
+#include "resolution.hpp"
+#include "frame_graph.hpp"
 
 #ifndef _NODISCARD
 #define _NODISCARD [[nodiscard]]
@@ -20,13 +25,22 @@ namespace graphics
 		fill
 	};
 
+	/** How lights are applied to what is drawn. */
+	enum class pipeline: uint8_t
+	{
+		forward,	// Each model is lit as it is drawn
+		deferred	// Models are drawn into a G-buffer, then each pixel is lit once
+	};
+
 	bool init(const float _aspect) noexcept;
 	void draw();
 
 	void terminate() noexcept;
 
-	void loadLightsIntoShader(const shader *_shader) noexcept;
-	void updateAllShaders() noexcept;
+	/** Flags the light data for re-upload, call after moving or changing a light. */
+	void markLightsDirty() noexcept;
+	/** Draws every shadow map again, models call this themselves when they stop or start casting. */
+	void markShadowsDirty() noexcept;
 	/** Modifies either the angle or blur of all spotlights by a value.
 	 * @note Max value is 90 for angle and 1 for blur, min for both is 0.
 	 * @param _isAngle True to modify the angle, false to modify the blur of the spotlight.
@@ -37,19 +51,83 @@ namespace graphics
 		const float _value
 	);
 
+	/** Adds the model to the scene tree as well, where it is culled from. */
 	void addNewModel(model *_model);
 	void addNewLight(light *_light);
+	/** Takes the model out of the scene tree and everything drawing keeps about it, models call this themselves when deleted. */
+	void removeModel(model *_model) noexcept;
+
+	/** Queues the model's branch of the scene tree to be refit, models call this themselves when they move. */
+	void markModelMoved(model *_model) noexcept;
 
 	void setClearColour(const colour _colour) noexcept;
 	void setRenderMode(const mode _mode = mode::fill) noexcept;
 	void setRenderDepthBuffer(const bool _state) noexcept;
+	/** Switches between forward and deferred lighting from the next frame, both light the same scene the same way.
+	 * @note Point and line modes and the depth view are always drawn forward.
+	 */
+	void setPipeline(const pipeline _pipeline) noexcept;
+	/** Draws opaque models into depth alone first, so the lighting of each pixel only runs for what is in front.
+	 * @note Pays off when models overlap a lot on screen, every vertex is transformed twice.
+	 */
+	void setDepthPrepass(const bool _state) noexcept;
+	_NODISCARD pipeline getPipeline() noexcept;
+	/** Tests models against the depth buffer on the GPU as well, using the results of earlier frames.
+	 * Models the GPU saw nothing of are drawn conditionally on a fresh query, so nothing ever waits on a result.
+	 * @note Only used in fill mode, lines and points would make the queries miss.
+	 */
+	void setOcclusionQueries(const bool _state) noexcept;
+	/** Moves culling to the GPU when it has compute shaders, the CPU then sends every model as it is.
+	 * Instances are tested against the frustum and the depth of the last frame, and only the survivors are drawn.
+	 * @note Replaces the CPU culling and the occlusion queries, the cull stats then count every model as visible.
+	 */
+	void setGpuCulling(const bool _state) noexcept;
+	/** The most queries issued in a frame, hidden models are queried before visible ones are rechecked. */
+	void setQueryBudget(const uint32_t _budget) noexcept;
+	/** Draws the scene at a resolution that follows how long frames take, then stretches it over the window.
+	 * @note The target frame time, scale bounds and governor are set through resolution.
+	 */
+	void setDynamicResolution(const bool _state) noexcept;
+	/** Shades every other column of pixels each frame and fills in the rest from the frame before, for scenes bound by lighting.
+	 * @note Works in the fill render mode only, and looks best while little moves but the camera.
+	 */
+	void setCheckerboard(const bool _state) noexcept;
+	/** Called every frame once the scene pass is in the frame graph, to add passes after it.
+	 * @note frameGraph::getScreen holds the lit scene for anything reading it.
+	 */
+	void setGraphSetupCallback(const frameGraph::setupFunc _func) noexcept;
 
-	_NODISCARD uint8_t modelCount() noexcept;
-	_NODISCARD uint8_t lightCount() noexcept;
-	_NODISCARD model *getModelAt(const uint8_t _pos);
-	_NODISCARD light *getLightAt(const uint8_t _pos);
+	_NODISCARD uint32_t modelCount() noexcept;
+	_NODISCARD uint32_t lightCount() noexcept;
+	_NODISCARD model *getModelAt(const uint32_t _pos);
+	_NODISCARD light *getLightAt(const uint32_t _pos);
 	_NODISCARD camera *getCamera() noexcept;
+	/** The shader options for the current lights and render mode. */
+	_NODISCARD const shader::permutation &getPermutation() noexcept;
+	/** How many models and meshes were drawn or culled in the last frame. */
+	_NODISCARD culling::stats getCullStats() noexcept;
+	_NODISCARD bvh::stats getSceneTreeStats() noexcept;
+	/** How the point and spot lights were spread over the clusters in the last frame. */
+	_NODISCARD clusters::stats getClusterStats() noexcept;
+	/** How many shadow views there are and how many were drawn in the last frame. */
+	_NODISCARD shadows::stats getShadowStats() noexcept;
+	/** The scale the last frame was drawn at, and the times it was chosen from. */
+	_NODISCARD resolution::stats getResolutionStats() noexcept;
+	/** How many passes ran or were culled in the last frame, and what the pool holds. */
+	_NODISCARD frameGraph::stats getFrameGraphStats() noexcept;
 
 	_NODISCARD constexpr float getAmbience() { return 0.15f; }
+	/** Matches the far plane of the camera projection. */
+	_NODISCARD constexpr float getFarPlane() { return 500.0f; }
+	/** How many bytes of geometry may be moved each frame to close gaps left by freed meshes. */
+	_NODISCARD constexpr uint32_t getCompactionBudget() { return 256U * 1024U; }
+	/** Frames between queries of a model that keeps being visible, hidden models are queried every frame. */
+	_NODISCARD constexpr uint32_t getQueryInterval() { return 8U; }
+	/** Matches the near plane of the camera projection. */
+	_NODISCARD constexpr float getNearPlane() { return 0.1f; }
+	/** This must match the array size in the directional light block of the shaders. */
+	_NODISCARD constexpr uint8_t maxDirLights() { return 3U; }
+	/** Point and spot lights together, at four texels each this fills the smallest texture buffer GL allows. */
+	_NODISCARD constexpr uint32_t maxClusteredLights() { return 16384U; }
 }
 }
@@ -93,6 +93,15 @@ namespace input
 		// TODO
 	}
 
+	void sampleMouse() noexcept
+	{
+		double posX, posY;
+		glfwGetCursorPos(l_windowRef, &posX, &posY);
+		// Goes through the callback so anything following the mouse sees the movement as usual
+		if (posX != l_mouseX || posY != l_mouseY)
+		{	mouse_callback(l_windowRef, posX, posY); }
+	}
+
 	bool checkKeyState(const key _key, const state _state) noexcept
 	{	return (int)_state == glfwGetKey(l_windowRef, (int)_key); }
 
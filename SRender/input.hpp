@@ -187,6 +187,8 @@ namespace input
 	 */
 	bool init(GLFWwindow *_windowRef) noexcept;
 	void process() noexcept;
+	/** Reads the cursor right now instead of waiting for the next poll, calling the mouse callback if it moved. */
+	void sampleMouse() noexcept;
 	bool checkKeyState(const key _key, const state _state) noexcept;
 
 	void addMouseCallback(callbackFunc _callback) noexcept;
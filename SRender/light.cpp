@@ -43,6 +43,9 @@ void light::setPosition(vec4 _value) noexcept
 void light::setForward(vec4 _value) noexcept
 {	m_forward = _value; }
 
+void light::castShadows(bool _state) noexcept
+{	m_castShadows = _state; }
+
 float light::getAngle() const noexcept
 {	return cos(radians(m_angle)); }
 
@@ -72,4 +75,7 @@ vec4 light::getPosition() const noexcept
 
 vec4 light::getForward() const noexcept
 {	return m_forward; }
+
+bool light::castsShadows() const noexcept
+{	return m_castShadows; }
 }
@@ -31,6 +31,7 @@ private:
 	float m_blur = 0.23f;        // Only for spotlights
 	glm::vec4 m_position = glm::vec4(0);
 	glm::vec4 m_forward = glm::vec4(0);
+	bool m_castShadows = false;
 
 public:
 	light(
@@ -47,6 +48,8 @@ public:
 	void setBlur(float _value) noexcept;  // In degrees
 	void setPosition(glm::vec4 _value) noexcept;
 	void setForward(glm::vec4 _value) noexcept;
+	/** Gives the light a shadow map, see shadows. Call graphics::markLightsDirty after changing it. */
+	void castShadows(bool _state) noexcept;
 
 	_NODISCARD float getAngle() const noexcept;
 	_NODISCARD float getBlur() const noexcept;
@@ -58,5 +61,6 @@ public:
 	_NODISCARD float getBlurRaw() const noexcept;
 	glm::vec4 getPosition() const noexcept;
 	glm::vec4 getForward() const noexcept;
+	_NODISCARD bool castsShadows() const noexcept;
 };
 }
@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <string>
+#include <utility>
 #include "mesh.hpp"
 #include "renderer.hpp"
 
@@ -23,6 +24,11 @@ constexpr uint32_t l_indicesArr[6] = {
 	2U, 3U, 0U  // Tri two
 };
 
+static_assert(sizeof(glm::vec3) == renderer::getPositionSize(), "Positions do not match the position stream");
+
+/** The id given to the next mesh. */
+uint32_t l_nextId = 0U;
+
 //Static
 
 vector<mesh::vertex> mesh::generateVertices() noexcept
@@ -66,33 +72,43 @@ vector<uint32_t> mesh::generateIndices() noexcept
 mesh::mesh(
 	std::vector<vertex> *_vertices,
 	std::vector<uint32_t> *_indices,
-	bool _save
+	bool _save,
+	bool _occluder
 ) noexcept
 {
 	assert(_vertices && _indices);
-	renderer::setupMesh(
-		&m_idVAO,
-		&m_idVBO,
-		&m_idEBO,
+	// Depth only draws read these instead, 12 bytes a vertex rather than the whole vertex
+	vector<glm::vec3> positions = vector<glm::vec3>();
+	positions.reserve(_vertices->size());
+	for (const vertex &cur : *_vertices)
+	{	positions.push_back(cur.position); }
+	m_geometry = renderer::allocateGeometry(
 		&(*_vertices)[0].position[0],
+		&positions[0][0],
 		&(*_indices)[0],
-		(uint32_t)_vertices->size() * sizeof(vertex),
-		(uint32_t)_indices->size() * sizeof(uint32_t),
+		(uint32_t)_vertices->size(),
+		(uint32_t)_indices->size(),
 		sizeof(vertex),
 		offsetof(vertex, normal),
 		offsetof(vertex, texCoords)
 	);
+	m_id = l_nextId++;
+	m_bounds = culling::fromPoints(&(*_vertices)[0].position, _vertices->size(), sizeof(vertex));
+	if (_occluder)
+	{
+		m_occluderPositions = std::move(positions);
+		m_occluderIndices = *_indices;
+	}
 	if (_save)
 	{
 		m_vertices = _vertices;
 		m_indices = _indices;
 	}
-	m_count = (uint32_t)_indices->size();
 }
 
 mesh::~mesh()
 {
-	renderer::deleteMesh(m_idVAO, m_idVBO, m_idEBO);
+	renderer::freeGeometry(m_geometry);
 	if (m_vertices)
 	{	delete m_vertices; }
 	if (m_indices)
@@ -100,14 +116,29 @@ mesh::~mesh()
 }
 
 void mesh::draw() const noexcept
-{	renderer::drawElements(m_idVAO, m_count); }
+{	renderer::drawGeometry(getRange()); }
+
+void mesh::drawInstanced(const uint32_t _count, const uint32_t _first) const noexcept
+{	renderer::drawGeometryInstanced(getRange(), _count, _first); }
 
 uint32_t mesh::getVAO() const noexcept
-{	return m_idVAO; }
+{	return getRange().idVAO; }
+
+renderer::geometryRange mesh::getRange() const noexcept
+{	return renderer::getGeometryRange(m_geometry); }
+
+uint32_t mesh::getId() const noexcept
+{	return m_id; }
+
+const culling::bounds &mesh::getBounds() const noexcept
+{	return m_bounds; }
+
+bool mesh::isOccluder() const noexcept
+{	return !m_occluderIndices.empty(); }
 
-uint32_t mesh::getVBO() const noexcept
-{	return m_idVBO; }
+const std::vector<glm::vec3> &mesh::getOccluderPositions() const noexcept
+{	return m_occluderPositions; }
 
-uint32_t mesh::getEBO() const noexcept
-{	return m_idEBO; }
+const std::vector<uint32_t> &mesh::getOccluderIndices() const noexcept
+{	return m_occluderIndices; }
 }
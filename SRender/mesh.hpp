@@ -2,6 +2,8 @@
 #include <vector>
 #include "glm/vec2.hpp"
 #include "glm/vec3.hpp"
+#include "renderer.hpp"
+#include "culling.hpp"
 
 #ifndef _NODISCARD
 #define _NODISCARD [[nodiscard]]
@@ -19,13 +21,15 @@ struct mesh
 	};
 
 private:
-	uint32_t m_idVAO = 0U;	// The id for the vertex attribute object
-	uint32_t m_idVBO = 0U;	// The id for the vertex buffer object
-	uint32_t m_idEBO = 0U;	// The id for the element buffer object
+	uint32_t m_geometry = 0U;	// Handle to the vertices and indices in the shared buffers
+	uint32_t m_id;	// Unique per mesh, used to group draws of the same mesh
+	culling::bounds m_bounds;	// Around the vertices, in model space
 
 	std::vector<vertex> *m_vertices = nullptr;
 	std::vector<uint32_t> *m_indices = nullptr;
-	uint32_t m_count;
+	/** Positions only, kept for the software occlusion culler. Empty unless made as an occluder. */
+	std::vector<glm::vec3> m_occluderPositions = std::vector<glm::vec3>();
+	std::vector<uint32_t> m_occluderIndices = std::vector<uint32_t>();
 
 public:
 	/** Takes the vertices array and places it in a vector.
@@ -42,27 +46,34 @@ public:
 	 * @param _vertices Vertex data to be used, should be on the heap
 	 * @param _indices Index data to be used, should be on the heap
 	 * @param _save Whether the vertex and index data is saved to the Mesh object
+	 * @param _occluder Whether to keep a copy of the positions and indices to draw into the occlusion buffer
 	 */
 	mesh(
 		std::vector<vertex> *_vertices,
 		std::vector<uint32_t> *_indices,
-		bool _save = false
+		bool _save = false,
+		bool _occluder = false
 	) noexcept;
 	~mesh();
 
 	void draw() const noexcept;
+	/** Draws a run of instances from the instance buffer in one call.
+	 * @param _count The amount of instances.
+	 * @param _first Index of the first instance in the buffer.
+	 */
+	void drawInstanced(const uint32_t _count, const uint32_t _first) const noexcept;
 
-	/** Get the id for the vertex attribute object.
+	/** Get the id for the vertex attribute object, shared with every mesh of the same vertex format.
 	 * @return [uint32_t] The id of the vertex attribute object.
 	 */
 	_NODISCARD uint32_t getVAO() const noexcept;
-	/** Get the id for the vertex buffer object.
-	 * @return [uint32_t] The id of the vertex buffer object.
-	 */
-	_NODISCARD uint32_t getVBO() const noexcept;
-	/** Get the id for the element buffer object.
-	 * @return [uint32_t] The id of the element buffer object.
-	 */
-	_NODISCARD uint32_t getEBO() const noexcept;
+	/** Where the mesh currently is in the shared buffers, this can change between frames. */
+	_NODISCARD renderer::geometryRange getRange() const noexcept;
+	_NODISCARD uint32_t getId() const noexcept;
+	_NODISCARD const culling::bounds &getBounds() const noexcept;
+	/** If the mesh kept what it needs to hide others in the occlusion buffer. */
+	_NODISCARD bool isOccluder() const noexcept;
+	_NODISCARD const std::vector<glm::vec3> &getOccluderPositions() const noexcept;
+	_NODISCARD const std::vector<uint32_t> &getOccluderIndices() const noexcept;
 };
 }
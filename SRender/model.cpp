@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <unordered_map>
 #include "model.hpp"
 #include "assimp/Importer.hpp"
 #include "assimp/scene.h"
@@ -7,6 +9,9 @@
 #include "debug.hpp"
 #include "exception.hpp"
 #include "graphics.hpp"
+#include "draw_queue.hpp"
+#include "renderer.hpp"
+#include "occlusion.hpp"
 
 using glm::vec2;
 using glm::vec3;
@@ -15,6 +20,21 @@ using std::vector;
 
 namespace srender
 {
+constexpr shader::uniformId l_uColour = shader::uniform("u_colour");
+constexpr shader::uniformId l_uShininess = shader::uniform("u_material.shininess");
+
+/** Meshes loaded from a file, shared by every model using that file so they can be instanced. */
+struct sharedMeshes
+{
+	vector<mesh*> meshes;
+	vector<texture*> textures;
+	bool texturesLoaded = false;
+	uint32_t users = 0U;
+};
+
+/** Keyed by the absolute path of the file. */
+std::unordered_map<string, sharedMeshes> l_meshLibrary = std::unordered_map<string, sharedMeshes>();
+
 // Forward declaration
 class application { public: _NODISCARD static std::string getAppLocation() noexcept; };
 
@@ -33,19 +53,23 @@ void model::processNode(
 	const aiNode *_node,
 	const aiScene *_scene,
 	const string _directory,
-	const bool _loadTextures
+	const bool _loadTextures,
+	const bool _loadMeshes
 )
 {
 	// Process all the node's meshes (if any)
 	for (uint32_t i = 0; i < _node->mNumMeshes; ++i)
 	{
 		aiMesh *mesh = _scene->mMeshes[_node->mMeshes[i]];
-		m_meshes.push_back(processMesh(mesh, _scene, _directory, _loadTextures));
+		if (_loadMeshes)
+		{	m_meshes.push_back(processMesh(mesh, _scene, _directory, _loadTextures)); }
+		else
+		{	processMaterial(mesh, _scene, _directory, _loadTextures); }
 	}
 
 	// Then do the same for each of it's children
 	for (uint32_t i = 0; i < _node->mNumChildren; ++i)
-	{	processNode(_node->mChildren[i], _scene, _directory, _loadTextures); }
+	{	processNode(_node->mChildren[i], _scene, _directory, _loadTextures, _loadMeshes); }
 }
 
 mesh *model::processMesh(
@@ -93,7 +117,17 @@ mesh *model::processMesh(
 		{	indices->push_back(face.mIndices[j]); }
 	}
 
-	// Process material
+	processMaterial(_mesh, _scene, _directory, _loadTextures);
+	return new mesh(vertices, indices);
+}
+
+void model::processMaterial(
+	const aiMesh *_mesh,
+	const aiScene *_scene,
+	const string _directory,
+	const bool _loadTextures
+)
+{
 	if (_loadTextures && _mesh->mMaterialIndex >= 0U)
 	{
 		aiMaterial *material = _scene->mMaterials[_mesh->mMaterialIndex];
@@ -112,8 +146,6 @@ mesh *model::processMesh(
 		);
 		m_textures.insert(m_textures.end(), specularMaps.begin(), specularMaps.end());
 	}
-
-	return new mesh(vertices, indices);
 }
 
 vector<texture*> model::loadMaterialTextures(
@@ -202,9 +234,11 @@ vector<texture*> model::loadMaterialTextures(
 	return texturesOut;
 }
 
-void model::loadTexturesToShader() const
+void model::loadTexturesToShader()
 {
-	bool loaded = false;
+	m_samplers.clear();
+	m_textureSet = 0U;
+	uint32_t textureSet = 2166136261U;
 	uint8_t diffuseNr = 0;
 	uint8_t specularNr = 0;
 	for (size_t i = 0; i < m_textures.size(); ++i)
@@ -217,51 +251,38 @@ void model::loadTexturesToShader() const
 		case texture::type::diffuse:
 			name = "texture_diffuse";
 			number = std::to_string(diffuseNr++);
-			loaded = true;
 			break;
 		case texture::type::specular:
 			name = "texture_specular";
 			number = std::to_string(specularNr++);
-			loaded = true;
 			break;
 		default:
 			return;
 		}
 
 		string location = "u_material." + name + number;
-		string errorMsg;
-		if (m_shader->setInt(location.c_str(), (int32_t)m_textures[i]->getLocation(), errorMsg))
-		{
-			#ifdef _VERBOSE
-				string msg = {
-					"Setting "
-					+ location
-					+ " to "
-					+ std::to_string(m_textures[i]->getLocation())
-				};
-				debug::send(
-					msg,
-					debug::type::note,
-					debug::impact::small,
-					debug::stage::mid
-				);
-			#endif
-		}
-		else
-		{
-			#ifdef _VERBOSE
-				debug::send(
-					errorMsg,
-					debug::type::note,
-					debug::impact::large,
-					debug::stage::mid
-				);
-			#endif
-		}
+		m_samplers.push_back({
+			shader::uniform(location.c_str()),
+			(int32_t)m_textures[i]->getLocation()
+		});
+		// FNV-1a over the units, only has to tell sets apart for sorting
+		textureSet = (textureSet ^ (uint32_t)m_textures[i]->getLocation()) * 16777619U;
+
+		#ifdef _VERBOSE
+			debug::send(
+				"Setting " + location + " to " + std::to_string(m_textures[i]->getLocation()),
+				debug::type::note,
+				debug::impact::small,
+				debug::stage::mid
+			);
+		#endif
 	}
 
-	if (loaded)
-	{ useTextures(true); }
+	if (!m_samplers.empty())
+	{
+		m_textureSet = textureSet;
+		useTextures(true);
+	}
 }
 
 model::model()
@@ -276,10 +297,11 @@ model::model(
 	makePathAbsolute(&_modelPath);
 	makePathAbsolute(&_shaderPath);
 	loadFromFile(&_modelPath, _loadTextures);
-	addShader(new shader(&_shaderPath));
-	// Needs to be done after shader is loaded
+	// Before the shader, whether textures are used is part of the variant
 	if (_loadTextures)
 	{	loadTexturesToShader(); }
+	m_shaderPath = _shaderPath;
+	selectVariant(graphics::getPermutation());
 
 	#ifdef _VERBOSE
 		debug::send("Done!", debug::type::note, debug::impact::small, debug::stage::end);
@@ -288,10 +310,11 @@ model::model(
 
 model::~model()
 {
-	for (unsigned int i = 0; i < m_meshes.size(); ++i)
-	{	delete m_meshes[i]; }
-
-	delete m_shader;
+	// Before the meshes go, the scene must not hold on to a model that is being deleted
+	graphics::removeModel(this);
+	releaseMeshes();
+	shader::release(m_shader);
+	shader::release(m_previous);
 }
 
 void model::loadFromFile(const string *_path, const bool _loadTextures)
@@ -313,6 +336,26 @@ void model::loadFromFile(const string *_path, const bool _loadTextures)
 		}
 	#endif
 
+	// Another model already loaded this file, share its meshes so both can be instanced together
+	auto shared = l_meshLibrary.find(*_path);
+	const bool reuseMeshes = shared != l_meshLibrary.end();
+	if (reuseMeshes && (!_loadTextures || shared->second.texturesLoaded))
+	{
+		#ifdef _VERBOSE
+			debug::send(
+				"Sharing meshes already loaded from the file",
+				debug::type::note, debug::impact::small, debug::stage::mid
+			);
+		#endif
+		m_meshes = shared->second.meshes;
+		if (_loadTextures)
+		{	m_textures = shared->second.textures; }
+		m_meshSource = *_path;
+		++shared->second.users;
+		updateBounds();
+		return;
+	}
+
 	Assimp::Importer importer;
 	const aiScene *scene = importer.ReadFile(*_path, aiProcess_Triangulate | aiProcess_FlipUVs);
 
@@ -329,32 +372,192 @@ void model::loadFromFile(const string *_path, const bool _loadTextures)
 
 	size_t last_slash = (*_path).find_last_of("\\/");
 	string directory = (*_path).substr(0, last_slash);
-	processNode(scene->mRootNode, scene, directory, _loadTextures);
+	// The meshes may already be shared without their textures, in which case only those are loaded
+	processNode(scene->mRootNode, scene, directory, _loadTextures, !reuseMeshes);
+
+	sharedMeshes &entry = l_meshLibrary[*_path];
+	if (!reuseMeshes)
+	{	entry.meshes = m_meshes; }
+	m_meshes = entry.meshes;
+	if (_loadTextures)
+	{
+		entry.textures = m_textures;
+		entry.texturesLoaded = true;
+	}
+	m_meshSource = *_path;
+	++entry.users;
+	updateBounds();
+}
+
+void model::releaseMeshes() noexcept
+{
+	auto shared = l_meshLibrary.find(m_meshSource);
+	const bool isShared = !m_meshSource.empty() && shared != l_meshLibrary.end();
+	for (mesh *cur : m_meshes)
+	{
+		// Meshes added by hand are always owned by this model
+		if (!isShared || std::find(shared->second.meshes.begin(), shared->second.meshes.end(), cur)
+			== shared->second.meshes.end())
+		{	delete cur; }
+	}
+
+	if (isShared && --shared->second.users == 0U)
+	{
+		for (mesh *cur : shared->second.meshes)
+		{	delete cur; }
+		l_meshLibrary.erase(shared);
+	}
+
+	m_meshSource.clear();
+	m_meshes = vector<mesh*>();
+	updateBounds();
+}
+
+void model::updateBounds() noexcept
+{
+	m_bounds = culling::bounds();
+	for (const mesh *cur : m_meshes)
+	{	m_bounds = culling::merge(m_bounds, cur->getBounds()); }
+	markMoved();
+}
+
+void model::markMoved() noexcept
+{
+	if (m_sceneProxy != UINT32_MAX)
+	{	graphics::markModelMoved(this); }
 }
 
 void model::draw() const noexcept
 {
+	applyUniforms(getActiveShader());
+	uint32_t first;
+	*(drawQueue::instance*)renderer::mapInstances(1U, &first) = { m_transform, m_normalMatrix };
+	renderer::flushStream();
 	for (uint16_t i = 0; i < m_meshes.size(); ++i)
-	{	getMeshAt(i)->draw(); }
+	{	getMeshAt(i)->drawInstanced(1U, first); }
+}
+
+void model::applyUniforms(const shader *_shader) const noexcept
+{
+	// The shader is shared, unchanged values are filtered out by its uniform cache
+	_shader->setFloat3(l_uColour, m_tint);
+	// Lights come from the shared light blocks, only the material is per model
+	_shader->setFloat(l_uShininess, m_shininess);
+	for (auto &[sampler, unit] : m_samplers)
+	{	_shader->setInt(sampler, unit); }
+}
+
+void model::queueDraw(const float _depth, const culling::frustum *_view, culling::stats *_stats) const
+{
+	drawQueue::packet packet;
+	packet.owner = this;
+	packet.program = getActiveShader();
+	// A lone mesh has the same bounds as the model, which already passed
+	const bool testMeshes = _view && m_meshes.size() > 1U;
+	for (const mesh *cur : m_meshes)
+	{
+		if (testMeshes)
+		{
+			const culling::bounds world = culling::transform(cur->getBounds(), m_transform);
+			if (!culling::testBox(*_view, world) || (!m_occluder && !occlusion::testBox(world)))
+			{
+				++_stats->meshesCulled;
+				continue;
+			}
+		}
+		++_stats->meshesVisible;
+
+		packet.geometry = cur;
+		packet.key = drawQueue::makeKey(
+			drawQueue::pass::opaque,
+			packet.program->getProgramId(),
+			materialId(),
+			cur->getId(),
+			_depth
+		);
+		drawQueue::push(packet);
+	}
+}
+
+void model::queueShadow() const
+{
+	drawQueue::packet packet;
+	packet.owner = this;
+	for (const mesh *cur : m_meshes)
+	{
+		packet.geometry = cur;
+		packet.key = drawQueue::makeKey(drawQueue::pass::opaque, 0U, 0U, cur->getId(), 0.0f);
+		drawQueue::push(packet);
+	}
+}
+
+bool model::sameMaterial(const model &_other) const noexcept
+{
+	return m_tint == _other.m_tint
+		&& m_shininess == _other.m_shininess
+		&& m_samplers == _other.m_samplers;
+}
+
+uint32_t model::materialId() const noexcept
+{
+	// FNV-1a over everything sameMaterial compares, the samplers are already hashed into the texture set
+	const float values[4] = { m_tint.r, m_tint.g, m_tint.b, m_shininess };
+	const uint8_t *bytes = (const uint8_t*)values;
+	uint32_t hash = m_textureSet ? m_textureSet : 2166136261U;
+	for (size_t i = 0; i < sizeof(values); ++i)
+	{	hash = (hash ^ bytes[i]) * 16777619U; }
+	return hash;
 }
 
 void model::addShader(shader *_shader)
 {
-	if (m_shader)
-	{	delete m_shader; }
+	shader::release(m_shader);
+	shader::release(m_previous);
 	m_shader = _shader;
-	graphics::loadLightsIntoShader(m_shader);
+	m_previous = nullptr;
+	m_shaderPath = _shader->getPath();
+	// Unknown defines, so the next selectVariant always replaces it
+	m_variantKey = UINT64_MAX;
 }
 
-void model::clearMeshes()
+void model::selectVariant(const shader::permutation &_scene)
 {
-	for (auto mesh : m_meshes)
-	{	delete mesh; }
-	m_meshes = vector<mesh*>();
+	shader::permutation options = _scene;
+	options.useTextures = m_useTextures;
+	options.fullbright = m_fullbright;
+
+	const uint64_t key = options.key();
+	if (key != m_variantKey)
+	{
+		m_variantKey = key;
+		shader *next = shader::acquire(&m_shaderPath, options.defines());
+		if (m_shader && m_shader->isLoaded())
+		{
+			// Keep drawing with the old variant until the new one has compiled
+			shader::release(m_previous);
+			m_previous = m_shader;
+		}
+		else
+		{	shader::release(m_shader); }
+		m_shader = next;
+	}
+
+	if (m_previous && m_shader->isLoaded())
+	{
+		shader::release(m_previous);
+		m_previous = nullptr;
+	}
 }
 
+void model::clearMeshes()
+{	releaseMeshes(); }
+
 void model::addMesh(mesh *_mesh)
-{	m_meshes.push_back(_mesh); }
+{
+	m_meshes.push_back(_mesh);
+	m_bounds = culling::merge(m_bounds, _mesh->getBounds());
+	markMoved();
+}
 
 void model::setMesh(mesh *_mesh)
 {
@@ -362,33 +565,99 @@ void model::setMesh(mesh *_mesh)
 	addMesh(_mesh);
 }
 
-void model::useTextures(const bool _state) const
+void model::setTransform(const glm::mat4 &_transform) noexcept
 {
-	//> Throw exception if no shader
-	string errorMsg;
-	m_shader->setBool("u_useTextures", _state, errorMsg);
+	m_transform = _transform;
+	m_normalMatrix = (glm::mat3)glm::transpose(glm::inverse(_transform));
+	markMoved();
 }
 
-void model::fullbright(const bool _state) const
+void model::useTextures(const bool _state) noexcept
+{	m_useTextures = _state; }
+
+void model::fullbright(const bool _state) noexcept
+{	m_fullbright = _state; }
+
+void model::sentTint(const colour _colour) noexcept
+{	m_tint = _colour.rgb(); }
+
+void model::setOccluder(const bool _state) noexcept
+{	m_occluder = _state; }
+
+void model::castShadows(const bool _state) noexcept
 {
-	//> Throw exception if no shader
-	string errorMsg;
-	m_shader->setBool("u_fullbright", _state, errorMsg);
+	m_castShadows = _state;
+	graphics::markShadowsDirty();
 }
 
-void model::sentTint(const colour _colour) const
+void model::setStatic(const bool _state) noexcept
 {
-	//> Throw exception if no shader
-	string errorMsg;
-	m_shader->setFloat3("u_colour", _colour.rgb(), errorMsg);
+	m_static = _state;
+	// The model has to move to the other layer
+	graphics::markShadowsDirty();
 }
 
+void model::setSceneProxy(const uint32_t _proxy) noexcept
+{	m_sceneProxy = _proxy; }
+
 shader *model::getShaderRef() const noexcept
 {
 	//> Throw exception if no shader
 	return m_shader;
 }
 
+glm::vec3 model::getPosition() const noexcept
+{	return (glm::vec3)m_transform[3]; }
+
+const glm::mat4 &model::getTransform() const noexcept
+{	return m_transform; }
+
+const glm::mat3 &model::getNormalMatrix() const noexcept
+{	return m_normalMatrix; }
+
+const culling::bounds &model::getBounds() const noexcept
+{	return m_bounds; }
+
+glm::vec4 model::getWorldSphere() const noexcept
+{	return culling::transformSphere(m_bounds, m_transform); }
+
+culling::bounds model::getWorldBounds() const noexcept
+{	return culling::transform(m_bounds, m_transform); }
+
+uint32_t model::getSceneProxy() const noexcept
+{	return m_sceneProxy; }
+
+bool model::isOccluder() const noexcept
+{	return m_occluder; }
+
+bool model::isShadowCaster() const noexcept
+{	return m_castShadows; }
+
+bool model::isStatic() const noexcept
+{	return m_static; }
+
+void model::addOccluders() const
+{
+	for (const mesh *cur : m_meshes)
+	{
+		if (!cur->isOccluder())
+		{	continue; }
+		occlusion::addOccluder(
+			cur->getOccluderPositions().data(),
+			cur->getOccluderIndices().data(),
+			(uint32_t)cur->getOccluderIndices().size(),
+			m_transform
+		);
+	}
+}
+
+const shader *model::getActiveShader() const
+{
+	if (m_shader->isLoaded())
+	{	return m_shader; }
+	return m_previous ? m_previous : shader::fallback();
+}
+
 mesh *model::getMeshAt(const uint16_t _pos) const  noexcept
 {
 	if (_pos > m_meshes.size() - 1)
@@ -14,6 +14,8 @@
 namespace srender
 {
 /** A model is a collection of meshes, textures, and a shader.
+ * The shader is shared with other models, so everything specific to this model is kept
+ * here and pushed to the shader right before drawing.
  * @todo Arbitrary mesh loading.
  */
 struct model
@@ -21,13 +23,44 @@ struct model
 private:
 	std::vector<mesh*> m_meshes = std::vector<mesh*>();
 	std::vector<texture*> m_textures = std::vector<texture*>();
+	/** The file the meshes are shared from, empty if this model owns its meshes. */
+	std::string m_meshSource = "";
+	/** The variant for the current options, may still be compiling. */
 	shader *m_shader = nullptr;
+	/** The last variant that finished compiling, drawn with until m_shader is ready. */
+	shader *m_previous = nullptr;
+	std::string m_shaderPath = "";	// Shared by every variant
+	uint64_t m_variantKey = UINT64_MAX;	// The permutation m_shader was loaded with
+	/** Around every mesh, in model space. */
+	culling::bounds m_bounds = culling::bounds();
+	/** Where graphics keeps this model in the scene tree, UINT32_MAX until it is added. */
+	uint32_t m_sceneProxy = UINT32_MAX;
 
+	// Per-draw state
+	glm::mat4 m_transform = glm::mat4(1.0f);
+	glm::mat3 m_normalMatrix = glm::mat3(1.0f);
+	glm::vec3 m_tint = glm::vec3(1.0f);
+	float m_shininess = 32.0f;
+	bool m_useTextures = false;
+	bool m_fullbright = false;
+	/** Drawn into the occlusion buffer to hide other models, only meshes made as occluders are. */
+	bool m_occluder = false;
+	bool m_castShadows = true;
+	/** Never moves, so it is drawn into the static layer of shadow maps and left there. */
+	bool m_static = false;
+	/** Identifies the combination of samplers, models sharing one sort next to each other. */
+	uint32_t m_textureSet = 0U;
+	/** Which texture unit each material sampler reads from. */
+	std::vector<std::pair<shader::uniformId, int32_t>> m_samplers =
+		std::vector<std::pair<shader::uniformId, int32_t>>();
+
+	/** @param _loadMeshes False to only collect the textures, for meshes that are already shared. */
 	void processNode(
 		const aiNode *_node,
 		const aiScene *_scene,
 		const std::string _directory,
-		const bool _loadTextures
+		const bool _loadTextures,
+		const bool _loadMeshes = true
 	);
 
 	_NODISCARD mesh *processMesh(
@@ -36,6 +69,12 @@ private:
 		const std::string _directory,
 		const bool _loadTextures
 	);
+	void processMaterial(
+		const aiMesh *_mesh,
+		const aiScene *_scene,
+		const std::string _directory,
+		const bool _loadTextures
+	);
 
 	_NODISCARD std::vector<texture*> loadMaterialTextures(
 		const aiMaterial *_material,
@@ -44,7 +83,16 @@ private:
 		const bool _loadTextures
 	) const;
 
-	void loadTexturesToShader() const;
+	/** Works out which texture unit each material sampler uses. */
+	void loadTexturesToShader();
+	/** Deletes the meshes, or gives up the reference to them if they are shared. */
+	void releaseMeshes() noexcept;
+	/** Rebuilds the model bounds from the meshes, needed whenever they change. */
+	void updateBounds() noexcept;
+	/** Lets graphics refit the scene tree, only once the model has been added to it. */
+	void markMoved() noexcept;
+	/** Hashes the material for the sort key, only has to tell materials apart most of the time. */
+	_NODISCARD uint32_t materialId() const noexcept;
 
 public:
 	model();
@@ -60,19 +108,76 @@ public:
 		const bool _loadTextures
 	);
 
+	/** Pushes the material to the shader and draws every mesh as a single instance.
+	 * @note The shader from getActiveShader must already be in use.
+	 * @note Overwrites the instance buffer, so this can not be mixed with a draw queue submit.
+	 */
 	void draw() const noexcept;
+	/** Pushes the material uniforms, without drawing anything.
+	 * @param _shader The shader in use, normally the one from getActiveShader.
+	 * @note The matrices are instance attributes and are not part of this.
+	 */
+	void applyUniforms(const shader *_shader) const noexcept;
+	/** Adds a packet for every visible mesh to the draw queue instead of drawing right away.
+	 * @param _depth Distance of the model from the camera, scaled to 0-1.
+	 * @param _view Meshes outside it, or hidden in the occlusion buffer, are skipped. The model as a whole should already have passed.
+	 * Null queues every mesh, for when the GPU does the culling.
+	 * @param _stats Mesh counts are added to this.
+	 */
+	void queueDraw(const float _depth, const culling::frustum *_view, culling::stats *_stats) const;
+	/** Adds a packet for every mesh to the draw queue for drawQueue::submitDepthOnly, sorted by mesh alone so they instance together. */
+	void queueShadow() const;
+	/** If both models set the same material uniforms, which lets them be drawn as instances of each other. */
+	_NODISCARD bool sameMaterial(const model &_other) const noexcept;
 
+	/** Takes a reference to the shader, releasing any previous one.
+	 * @param _shader Ideally from shader::acquire, a shader made with new is owned from here on.
+	 * @note Only the path is kept once a variant is selected, the defines come from the permutation.
+	 */
 	void addShader(shader *_shader);
+	/** Switches to the variant of the shader for these options, only loading anything if they changed.
+	 * @param _scene The options set by graphics, the model fills in its own texture and fullbright flags.
+	 */
+	void selectVariant(const shader::permutation &_scene);
 
 	void clearMeshes();
 	void addMesh(mesh *_mesh);
 	void setMesh(mesh *_mesh);
 
-	void useTextures(const bool _state) const;
-	void fullbright(const bool _state) const;
-	void sentTint(const colour _colour) const;
+	/** Sets the model matrix, the normal matrix is derived from it. */
+	void setTransform(const glm::mat4 &_transform) noexcept;
+	void useTextures(const bool _state) noexcept;
+	void fullbright(const bool _state) noexcept;
+	void sentTint(const colour _colour) noexcept;
+	/** Makes the model hide whatever is behind it from the occlusion culler, best for large, simple models.
+	 * @note Only meshes created as occluders are drawn, see the mesh constructor.
+	 */
+	void setOccluder(const bool _state) noexcept;
+	/** Leaves the model out of every shadow map when false, models cast shadows by default. */
+	void castShadows(const bool _state) noexcept;
+	/** Promises the model will not move, so shadow maps only draw it again when it does anyway.
+	 * @note Moving a static model still works, but every shadow map it was in is drawn in full again.
+	 */
+	void setStatic(const bool _state) noexcept;
+	/** Set by graphics when the model is added to the scene. */
+	void setSceneProxy(const uint32_t _proxy) noexcept;
 
 	_NODISCARD shader *getShaderRef() const noexcept;
+	_NODISCARD glm::vec3 getPosition() const noexcept;
+	_NODISCARD const glm::mat4 &getTransform() const noexcept;
+	_NODISCARD const glm::mat3 &getNormalMatrix() const noexcept;
+	_NODISCARD const culling::bounds &getBounds() const noexcept;
+	/** The bounding sphere in world space, packed as centre and radius. */
+	_NODISCARD glm::vec4 getWorldSphere() const noexcept;
+	_NODISCARD culling::bounds getWorldBounds() const noexcept;
+	_NODISCARD uint32_t getSceneProxy() const noexcept;
+	_NODISCARD bool isOccluder() const noexcept;
+	_NODISCARD bool isShadowCaster() const noexcept;
+	_NODISCARD bool isStatic() const noexcept;
+	/** Draws every occluder mesh into the occlusion buffer, with the model transform. */
+	void addOccluders() const;
+	/** The shader to draw with, the previous variant or the fallback while the current one compiles. */
+	_NODISCARD const shader *getActiveShader() const;
 	_NODISCARD mesh *getMeshAt(const uint16_t _pos) const noexcept;
 	_NODISCARD texture *getTextureAt(const uint16_t _pos) const noexcept;
 };
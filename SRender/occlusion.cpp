@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <future>
+#include <thread>
+#include <vector>
+#include "occlusion.hpp"
+
+// Every x64 target has SSE, elsewhere the compiler says when it is enabled
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#include <xmmintrin.h>
+	#define OCCLUSION_SSE
+#endif
+
+using glm::vec3;
+using glm::vec4;
+using glm::mat4;
+using std::vector;
+
+namespace srender
+{
+namespace occlusion
+{
+	/** A triangle ready to draw, wound so every edge function is positive inside. */
+	struct screenTriangle
+	{
+		vec3 points[3];	// Pixels in x and y, depth in z
+		int32_t minX, maxX, minY, maxY;	// Covered pixels, already clamped to the buffer
+	};
+
+	/** The edge through two points as a * x + b * y + c. */
+	struct edge
+	{
+		float a, b, c;
+	};
+
+	constexpr uint32_t l_tilesX = getWidth() / getTileSize();
+	constexpr uint32_t l_tilesY = getHeight() / getTileSize();
+	static_assert(getWidth() % 4U == 0U && getWidth() % getTileSize() == 0U, "The width must be whole tiles and SIMD lanes");
+	static_assert(getHeight() % getTileSize() == 0U, "The height must be whole tiles");
+
+	mat4 l_viewProjection = mat4(1.0f);
+	vector<screenTriangle> l_triangles = vector<screenTriangle>();
+	vector<float> l_depth = vector<float>(getWidth() * getHeight(), 1.0f);
+	/** The furthest depth in each tile, anything behind it is hidden across the whole tile. */
+	vector<float> l_tileMax = vector<float>(l_tilesX * l_tilesY, 1.0f);
+	vector<std::future<void>> l_jobs = vector<std::future<void>>();
+
+	_NODISCARD inline vec3 toScreen(const vec4 &_clip) noexcept
+	{
+		const vec3 ndc = vec3(_clip) / _clip.w;
+		return vec3(
+			(ndc.x * 0.5f + 0.5f) * (float)getWidth(),
+			(ndc.y * 0.5f + 0.5f) * (float)getHeight(),
+			ndc.z * 0.5f + 0.5f
+		);
+	}
+
+	_NODISCARD inline edge makeEdge(const vec3 &_from, const vec3 &_to) noexcept
+	{
+		const float a = _from.y - _to.y;
+		const float b = _to.x - _from.x;
+		return { a, b, -(a * _from.x + b * _from.y) };
+	}
+
+	void addTriangle(vec3 _a, vec3 _b, vec3 _c)
+	{
+		const float area = (_b.x - _a.x) * (_c.y - _a.y) - (_b.y - _a.y) * (_c.x - _a.x);
+		if (std::abs(area) < 1e-6f)
+		{	return; }
+		// Drawn from both sides, a flat occluder hides just as much from behind
+		if (area < 0.0f)
+		{	std::swap(_b, _c); }
+
+		screenTriangle tri;
+		tri.points[0] = _a;
+		tri.points[1] = _b;
+		tri.points[2] = _c;
+		tri.minX = std::max(0, (int32_t)std::floor(std::min({ _a.x, _b.x, _c.x })));
+		tri.maxX = std::min((int32_t)getWidth() - 1, (int32_t)std::floor(std::max({ _a.x, _b.x, _c.x })));
+		tri.minY = std::max(0, (int32_t)std::floor(std::min({ _a.y, _b.y, _c.y })));
+		tri.maxY = std::min((int32_t)getHeight() - 1, (int32_t)std::floor(std::max({ _a.y, _b.y, _c.y })));
+		if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+		{	return; }
+		l_triangles.push_back(tri);
+	}
+
+	/** Fills the pixels of a triangle that are closer than what is there, within a range of rows. */
+	void drawTriangle(const screenTriangle &_tri, const int32_t _firstRow, const int32_t _lastRow) noexcept
+	{
+		const int32_t top = std::max(_tri.minY, _firstRow);
+		const int32_t bottom = std::min(_tri.maxY, _lastRow);
+		if (top > bottom)
+		{	return; }
+
+		const vec3 &a = _tri.points[0];
+		const vec3 &b = _tri.points[1];
+		const vec3 &c = _tri.points[2];
+		// Each edge is zero along its side and reaches the area at the opposite corner
+		const edge e0 = makeEdge(b, c);
+		const edge e1 = makeEdge(c, a);
+		const edge e2 = makeEdge(a, b);
+		const float invArea = 1.0f / (e0.a * a.x + e0.b * a.y + e0.c);
+		// Depth is linear in screen space once divided by w, so it is a plane too
+		const edge depth = {
+			(a.z * e0.a + b.z * e1.a + c.z * e2.a) * invArea,
+			(a.z * e0.b + b.z * e1.b + c.z * e2.b) * invArea,
+			(a.z * e0.c + b.z * e1.c + c.z * e2.c) * invArea
+		};
+
+		// Starts on a multiple of four so whole SIMD lanes stay inside the row
+		const int32_t left = _tri.minX & ~3;
+		for (int32_t y = top; y <= bottom; ++y)
+		{
+			const float py = (float)y + 0.5f;
+			float *row = &l_depth[(size_t)y * getWidth()];
+			int32_t x = left;
+			#ifdef OCCLUSION_SSE
+				const __m128 zero = _mm_setzero_ps();
+				const __m128 row0 = _mm_set1_ps(e0.b * py + e0.c);
+				const __m128 row1 = _mm_set1_ps(e1.b * py + e1.c);
+				const __m128 row2 = _mm_set1_ps(e2.b * py + e2.c);
+				const __m128 rowDepth = _mm_set1_ps(depth.b * py + depth.c);
+				for (; x <= _tri.maxX; x += 4)
+				{
+					const __m128 px = _mm_add_ps(_mm_set1_ps((float)x), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+					const __m128 inside = _mm_and_ps(
+						_mm_and_ps(
+							_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(e0.a)), row0), zero),
+							_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(e1.a)), row1), zero)
+						),
+						_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(e2.a)), row2), zero)
+					);
+					if (_mm_movemask_ps(inside) == 0)
+					{	continue; }
+
+					const __m128 current = _mm_loadu_ps(row + x);
+					const __m128 closer = _mm_min_ps(current, _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(depth.a)), rowDepth));
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, current)));
+				}
+			#endif
+			// Everything without SSE
+			for (; x <= _tri.maxX; ++x)
+			{
+				const float px = (float)x + 0.5f;
+				if (e0.a * px + e0.b * py + e0.c < 0.0f
+					|| e1.a * px + e1.b * py + e1.c < 0.0f
+					|| e2.a * px + e2.b * py + e2.c < 0.0f)
+				{	continue; }
+				row[x] = std::min(row[x], depth.a * px + depth.b * py + depth.c);
+			}
+		}
+	}
+
+	/** One worker's share, whole rows of tiles so it can build their depths without waiting on anyone. */
+	void drawBand(const uint32_t _firstTileRow, const uint32_t _endTileRow) noexcept
+	{
+		const uint32_t firstRow = _firstTileRow * getTileSize();
+		const uint32_t endRow = _endTileRow * getTileSize();
+		std::fill(l_depth.begin() + firstRow * getWidth(), l_depth.begin() + endRow * getWidth(), 1.0f);
+
+		for (const screenTriangle &tri : l_triangles)
+		{	drawTriangle(tri, (int32_t)firstRow, (int32_t)endRow - 1); }
+
+		for (uint32_t ty = _firstTileRow; ty < _endTileRow; ++ty)
+		{
+			for (uint32_t tx = 0; tx < l_tilesX; ++tx)
+			{
+				float furthest = 0.0f;
+				for (uint32_t y = ty * getTileSize(); y < (ty + 1U) * getTileSize(); ++y)
+				{
+					const float *row = &l_depth[(size_t)y * getWidth() + tx * getTileSize()];
+					furthest = std::max(furthest, *std::max_element(row, row + getTileSize()));
+				}
+				l_tileMax[ty * l_tilesX + tx] = furthest;
+			}
+		}
+	}
+
+	void begin(const mat4 &_viewProjection) noexcept
+	{
+		l_viewProjection = _viewProjection;
+		l_triangles.clear();
+	}
+
+	void addOccluder(
+		const vec3 *_positions,
+		const uint32_t *_indices,
+		const uint32_t _indexCount,
+		const mat4 &_transform
+	)
+	{
+		const mat4 toClip = l_viewProjection * _transform;
+		for (uint32_t i = 0; i + 2U < _indexCount; i += 3U)
+		{
+			vec4 clip[3];
+			for (uint8_t j = 0; j < 3U; ++j)
+			{	clip[j] = toClip * vec4(_positions[_indices[i + j]], 1.0f); }
+
+			// Clipped to the near plane, cutting a corner off leaves four points
+			vec4 polygon[4];
+			uint8_t count = 0U;
+			for (uint8_t j = 0; j < 3U; ++j)
+			{
+				const vec4 &cur = clip[j];
+				const vec4 &next = clip[(j + 1U) % 3U];
+				const float curDistance = cur.z + cur.w;
+				const float nextDistance = next.z + next.w;
+				if (curDistance >= 0.0f)
+				{	polygon[count++] = cur; }
+				if ((curDistance >= 0.0f) != (nextDistance >= 0.0f))
+				{	polygon[count++] = cur + (next - cur) * (curDistance / (curDistance - nextDistance)); }
+			}
+			if (count < 3U)
+			{	continue; }
+
+			vec3 screen[4];
+			for (uint8_t j = 0; j < count; ++j)
+			{	screen[j] = toScreen(polygon[j]); }
+			addTriangle(screen[0], screen[1], screen[2]);
+			if (count == 4U)
+			{	addTriangle(screen[0], screen[2], screen[3]); }
+		}
+	}
+
+	void rasterise()
+	{
+		const uint32_t workers = std::clamp(std::thread::hardware_concurrency(), 1U, getMaxWorkers());
+		// Split by tile rows, the first band is left for this thread
+		l_jobs.clear();
+		for (uint32_t i = 1; i < workers; ++i)
+		{
+			l_jobs.push_back(std::async(
+				std::launch::async,
+				drawBand,
+				l_tilesY * i / workers,
+				l_tilesY * (i + 1U) / workers
+			));
+		}
+		drawBand(0U, l_tilesY / workers);
+		for (std::future<void> &job : l_jobs)
+		{	job.wait(); }
+	}
+
+	bool hasOccluders() noexcept
+	{	return !l_triangles.empty(); }
+
+	bool testBox(const culling::bounds &_bounds) noexcept
+	{
+		if (_bounds.empty || l_triangles.empty())
+		{	return true; }
+
+		vec3 min = vec3(FLT_MAX);
+		vec3 max = vec3(-FLT_MAX);
+		for (uint8_t i = 0; i < 8U; ++i)
+		{
+			const vec4 clip = l_viewProjection * vec4(
+				i & 1U ? _bounds.max.x : _bounds.min.x,
+				i & 2U ? _bounds.max.y : _bounds.min.y,
+				i & 4U ? _bounds.max.z : _bounds.min.z,
+				1.0f
+			);
+			// Crossing the near plane, the camera is inside or right next to it
+			if (clip.z < -clip.w)
+			{	return true; }
+
+			const vec3 screen = toScreen(clip);
+			min = glm::min(min, screen);
+			max = glm::max(max, screen);
+		}
+
+		const int32_t left = std::max(0, (int32_t)std::floor(min.x));
+		const int32_t right = std::min((int32_t)getWidth() - 1, (int32_t)std::floor(max.x));
+		const int32_t bottom = std::max(0, (int32_t)std::floor(min.y));
+		const int32_t top = std::min((int32_t)getHeight() - 1, (int32_t)std::floor(max.y));
+		// Off screen is for the frustum test to decide
+		if (left > right || bottom > top)
+		{	return true; }
+
+		const int32_t tileSize = (int32_t)getTileSize();
+		for (int32_t ty = bottom / tileSize; ty <= top / tileSize; ++ty)
+		{
+			for (int32_t tx = left / tileSize; tx <= right / tileSize; ++tx)
+			{
+				// The whole tile is closer than the nearest point of the box
+				if (l_tileMax[ty * l_tilesX + tx] < min.z)
+				{	continue; }
+
+				const int32_t rowEnd = std::min(top, (ty + 1) * tileSize - 1);
+				const int32_t columnEnd = std::min(right, (tx + 1) * tileSize - 1);
+				for (int32_t y = std::max(bottom, ty * tileSize); y <= rowEnd; ++y)
+				{
+					for (int32_t x = std::max(left, tx * tileSize); x <= columnEnd; ++x)
+					{
+						if (l_depth[(size_t)y * getWidth() + x] >= min.z)
+						{	return true; }
+					}
+				}
+			}
+		}
+		return false;
+	}
+
+	const float *getDepth() noexcept
+	{	return l_depth.data(); }
+}
+}
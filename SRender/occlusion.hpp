@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+#include "glm/vec3.hpp"
+#include "glm/mat4x4.hpp"
+#include "culling.hpp"
+
+#ifndef _NODISCARD
+#define _NODISCARD [[nodiscard]]
+#endif
+
+namespace srender
+{
+/** Software occlusion culling, entirely on the CPU.
+ * Occluders are drawn into a small depth buffer by worker threads, each filling a band of rows,
+ * and the furthest depth of every tile is kept on top of it. Boxes are then tested tile first,
+ * only reading single pixels in tiles that do not settle it.
+ * @note Needs nothing from the GPU, so it can be run and timed without a window.
+ */
+namespace occlusion
+{
+	/** The depth buffer size, both are whole tiles and the width is a multiple of the SIMD width. */
+	_NODISCARD constexpr uint32_t getWidth() { return 256U; }
+	_NODISCARD constexpr uint32_t getHeight() { return 128U; }
+	/** Pixels along each side of a tile, the coarse level of the hierarchy. */
+	_NODISCARD constexpr uint32_t getTileSize() { return 8U; }
+	/** Threads the rows are split over, including the one calling rasterise. */
+	_NODISCARD constexpr uint32_t getMaxWorkers() { return 4U; }
+
+	/** Starts a new frame, forgetting the occluders of the last one.
+	 * @param _viewProjection The camera's projection * view matrix.
+	 */
+	void begin(const glm::mat4 &_viewProjection) noexcept;
+	/** Adds the triangles of a mesh, they are only set up here and drawn by rasterise.
+	 * @param _transform Model to world space.
+	 * @note Triangles are clipped to the near plane and drawn from both sides.
+	 */
+	void addOccluder(
+		const glm::vec3 *_positions,
+		const uint32_t *_indices,
+		const uint32_t _indexCount,
+		const glm::mat4 &_transform
+	);
+	/** Draws every occluder added since begin, then builds the tile depths. */
+	void rasterise();
+
+	/** If anything was added this frame, with nothing added every test passes. */
+	_NODISCARD bool hasOccluders() noexcept;
+	/** If any part of the box may be in front of the occluders.
+	 * @param _bounds In world space.
+	 * @return [bool] False only if the box is certainly hidden.
+	 */
+	_NODISCARD bool testBox(const culling::bounds &_bounds) noexcept;
+	/** The depth buffer, rows from the bottom of the screen up, 0 at the near plane and 1 at the far. */
+	_NODISCARD const float *getDepth() noexcept;
+}
+}
@@ -0,0 +1,237 @@
+#include <assert.h>
+#include <bit>
+#include "range_allocator.hpp"
+
+namespace srender
+{
+//Static
+
+void rangeAllocator::mapping(const uint32_t _size, uint32_t *_outFirst, uint32_t *_outSecond) noexcept
+{
+	// Small sizes get a class each, above that each power of two is split evenly
+	if (_size < secondLevelCount)
+	{
+		*_outFirst = 0U;
+		*_outSecond = _size;
+		return;
+	}
+	const uint32_t top = (uint32_t)std::bit_width(_size) - 1U;
+	*_outFirst = top - secondLevelBits + 1U;
+	*_outSecond = (_size >> (top - secondLevelBits)) ^ secondLevelCount;
+}
+
+//Member
+
+rangeAllocator::rangeAllocator(const uint32_t _capacity) noexcept
+{
+	for (uint32_t (&heads)[secondLevelCount] : m_freeHeads)
+	{
+		for (uint32_t &head : heads)
+		{	head = invalid(); }
+	}
+	grow(_capacity);
+}
+
+uint32_t rangeAllocator::createBlock(const uint32_t _offset, const uint32_t _size) noexcept
+{
+	block fresh;
+	fresh.offset = _offset;
+	fresh.size = _size;
+	if (!m_unusedBlocks.empty())
+	{
+		const uint32_t index = m_unusedBlocks.back();
+		m_unusedBlocks.pop_back();
+		m_blocks[index] = fresh;
+		return index;
+	}
+	m_blocks.push_back(fresh);
+	return (uint32_t)m_blocks.size() - 1U;
+}
+
+void rangeAllocator::insertFree(const uint32_t _block) noexcept
+{
+	uint32_t first, second;
+	block &cur = m_blocks[_block];
+	mapping(cur.size, &first, &second);
+
+	cur.isFree = true;
+	cur.prevFree = invalid();
+	cur.nextFree = m_freeHeads[first][second];
+	if (cur.nextFree != invalid())
+	{	m_blocks[cur.nextFree].prevFree = _block; }
+	m_freeHeads[first][second] = _block;
+
+	m_firstLevelMap |= 1U << first;
+	m_secondLevelMaps[first] |= 1U << second;
+	++m_freeCount;
+}
+
+void rangeAllocator::removeFree(const uint32_t _block) noexcept
+{
+	uint32_t first, second;
+	block &cur = m_blocks[_block];
+	mapping(cur.size, &first, &second);
+
+	if (cur.prevFree != invalid())
+	{	m_blocks[cur.prevFree].nextFree = cur.nextFree; }
+	else
+	{	m_freeHeads[first][second] = cur.nextFree; }
+	if (cur.nextFree != invalid())
+	{	m_blocks[cur.nextFree].prevFree = cur.prevFree; }
+
+	if (m_freeHeads[first][second] == invalid())
+	{
+		m_secondLevelMaps[first] &= ~(1U << second);
+		if (!m_secondLevelMaps[first])
+		{	m_firstLevelMap &= ~(1U << first); }
+	}
+
+	cur.isFree = false;
+	cur.prevFree = invalid();
+	cur.nextFree = invalid();
+	--m_freeCount;
+}
+
+void rangeAllocator::absorbNext(const uint32_t _block) noexcept
+{
+	const uint32_t next = m_blocks[_block].nextPhysical;
+	m_blocks[_block].size += m_blocks[next].size;
+	m_blocks[_block].nextPhysical = m_blocks[next].nextPhysical;
+	if (m_blocks[next].nextPhysical != invalid())
+	{	m_blocks[m_blocks[next].nextPhysical].prevPhysical = _block; }
+	else
+	{	m_last = _block; }
+	m_unusedBlocks.push_back(next);
+}
+
+uint32_t rangeAllocator::findFree(const uint32_t _size) const noexcept
+{
+	uint32_t size = _size;
+	if (size >= secondLevelCount)
+	{
+		// Rounded up to the next class, so the head of any list searched is big enough
+		const uint32_t round = (1U << (std::bit_width(size) - 1U - secondLevelBits)) - 1U;
+		if (size > UINT32_MAX - round)
+		{	return invalid(); }
+		size += round;
+	}
+
+	uint32_t first, second;
+	mapping(size, &first, &second);
+	uint32_t secondMap = m_secondLevelMaps[first] & (UINT32_MAX << second);
+	if (!secondMap)
+	{
+		// Nothing in this power of two, take the smallest class of a bigger one
+		const uint32_t firstMap = first + 1U < firstLevelCount ? m_firstLevelMap & (UINT32_MAX << (first + 1U)) : 0U;
+		if (!firstMap)
+		{	return invalid(); }
+		first = (uint32_t)std::countr_zero(firstMap);
+		secondMap = m_secondLevelMaps[first];
+	}
+	second = (uint32_t)std::countr_zero(secondMap);
+	return m_freeHeads[first][second];
+}
+
+uint32_t rangeAllocator::allocate(const uint32_t _size) noexcept
+{
+	if (_size == 0U)
+	{	return invalid(); }
+	const uint32_t found = findFree(_size);
+	if (found == invalid())
+	{	return invalid(); }
+
+	removeFree(found);
+	if (m_blocks[found].size > _size)
+	{
+		// The rest goes back as its own free block
+		const uint32_t rest = createBlock(m_blocks[found].offset + _size, m_blocks[found].size - _size);
+		block &cur = m_blocks[found];
+		cur.size = _size;
+		m_blocks[rest].prevPhysical = found;
+		m_blocks[rest].nextPhysical = cur.nextPhysical;
+		if (cur.nextPhysical != invalid())
+		{	m_blocks[cur.nextPhysical].prevPhysical = rest; }
+		else
+		{	m_last = rest; }
+		cur.nextPhysical = rest;
+		insertFree(rest);
+	}
+	m_used += _size;
+	return found;
+}
+
+void rangeAllocator::free(const uint32_t _block) noexcept
+{
+	assert(_block < m_blocks.size() && !m_blocks[_block].isFree && "Block is not allocated");
+	m_used -= m_blocks[_block].size;
+
+	const uint32_t next = m_blocks[_block].nextPhysical;
+	if (next != invalid() && m_blocks[next].isFree)
+	{
+		removeFree(next);
+		absorbNext(_block);
+	}
+
+	uint32_t merged = _block;
+	const uint32_t prev = m_blocks[_block].prevPhysical;
+	if (prev != invalid() && m_blocks[prev].isFree)
+	{
+		removeFree(prev);
+		absorbNext(prev);
+		merged = prev;
+	}
+	insertFree(merged);
+}
+
+void rangeAllocator::grow(const uint32_t _newCapacity) noexcept
+{
+	if (_newCapacity <= m_capacity)
+	{	return; }
+	const uint32_t added = _newCapacity - m_capacity;
+
+	if (m_last != invalid() && m_blocks[m_last].isFree)
+	{
+		// The size class changes, so it has to move lists
+		removeFree(m_last);
+		m_blocks[m_last].size += added;
+		insertFree(m_last);
+	}
+	else
+	{
+		const uint32_t tail = createBlock(m_capacity, added);
+		m_blocks[tail].prevPhysical = m_last;
+		if (m_last != invalid())
+		{	m_blocks[m_last].nextPhysical = tail; }
+		m_last = tail;
+		insertFree(tail);
+	}
+	m_capacity = _newCapacity;
+}
+
+uint32_t rangeAllocator::lastUsed() const noexcept
+{
+	if (m_last == invalid() || !m_blocks[m_last].isFree)
+	{	return m_last; }
+	// Free neighbours are always merged, so the block before a free one is in use
+	return m_blocks[m_last].prevPhysical;
+}
+
+rangeAllocator::stats rangeAllocator::getStats() const noexcept
+{
+	stats out;
+	out.capacity = m_capacity;
+	out.used = m_used;
+	out.freeRanges = m_freeCount;
+	if (m_firstLevelMap)
+	{
+		const uint32_t first = 31U - (uint32_t)std::countl_zero(m_firstLevelMap);
+		const uint32_t second = 31U - (uint32_t)std::countl_zero(m_secondLevelMaps[first]);
+		for (uint32_t cur = m_freeHeads[first][second]; cur != invalid(); cur = m_blocks[cur].nextFree)
+		{
+			if (m_blocks[cur].size > out.largestFree)
+			{	out.largestFree = m_blocks[cur].size; }
+		}
+	}
+	return out;
+}
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+#ifndef _NODISCARD
+#define _NODISCARD [[nodiscard]]
+#endif
+
+namespace srender
+{
+/** Hands out ranges of a space that lives elsewhere, such as a GL buffer, using a two level segregated fit.
+ * Free ranges are kept in lists by size class so allocating and freeing both take constant time.
+ * @note Offsets and sizes are in whatever unit the owner chooses, vertices or indices for geometry.
+ */
+struct rangeAllocator
+{
+	/** Returned by allocate when nothing fits. */
+	_NODISCARD static constexpr uint32_t invalid() { return UINT32_MAX; }
+
+	struct stats
+	{
+		uint32_t capacity = 0U;
+		uint32_t used = 0U;
+		uint32_t freeRanges = 0U;
+		uint32_t largestFree = 0U;
+	};
+
+private:
+	/** Each level splits a power of two into this many size classes. */
+	static constexpr uint32_t secondLevelBits = 4U;
+	static constexpr uint32_t secondLevelCount = 1U << secondLevelBits;
+	static constexpr uint32_t firstLevelCount = 32U;
+
+	struct block
+	{
+		uint32_t offset = 0U;
+		uint32_t size = 0U;
+		uint32_t prevPhysical = invalid();	// Neighbours by offset, used to merge on free
+		uint32_t nextPhysical = invalid();
+		uint32_t prevFree = invalid();	// Neighbours in the free list of the same size class
+		uint32_t nextFree = invalid();
+		bool isFree = false;
+	};
+
+	std::vector<block> m_blocks;
+	std::vector<uint32_t> m_unusedBlocks;	// Records in m_blocks that can be reused
+	uint32_t m_freeHeads[firstLevelCount][secondLevelCount];
+	uint32_t m_firstLevelMap = 0U;	// A bit per first level with any free block
+	uint32_t m_secondLevelMaps[firstLevelCount] = {};
+	uint32_t m_last = invalid();	// The block with the highest offset
+	uint32_t m_capacity = 0U;
+	uint32_t m_used = 0U;
+	uint32_t m_freeCount = 0U;
+
+	static void mapping(const uint32_t _size, uint32_t *_outFirst, uint32_t *_outSecond) noexcept;
+	_NODISCARD uint32_t createBlock(const uint32_t _offset, const uint32_t _size) noexcept;
+	void insertFree(const uint32_t _block) noexcept;
+	void removeFree(const uint32_t _block) noexcept;
+	/** Joins a block with the one after it, the one after is released. */
+	void absorbNext(const uint32_t _block) noexcept;
+	_NODISCARD uint32_t findFree(const uint32_t _size) const noexcept;
+
+public:
+	rangeAllocator(const uint32_t _capacity = 0U) noexcept;
+
+	/** Reserves a range.
+	 * @return [uint32_t] A block handle, or invalid() if no free range is big enough.
+	 */
+	_NODISCARD uint32_t allocate(const uint32_t _size) noexcept;
+	/** Releases a block from allocate, merging it with free neighbours. */
+	void free(const uint32_t _block) noexcept;
+	/** Adds space to the end, the offsets of existing blocks do not change. */
+	void grow(const uint32_t _newCapacity) noexcept;
+
+	/** The allocated block with the highest offset, what compaction moves first.
+	 * @return [uint32_t] The block, or invalid() if nothing is allocated.
+	 */
+	_NODISCARD uint32_t lastUsed() const noexcept;
+
+	_NODISCARD uint32_t getOffset(const uint32_t _block) const noexcept
+	{	return m_blocks[_block].offset; }
+	_NODISCARD uint32_t getSize(const uint32_t _block) const noexcept
+	{	return m_blocks[_block].size; }
+	_NODISCARD uint32_t getCapacity() const noexcept
+	{	return m_capacity; }
+	/** Counts over every block.
+	 * @note Walks the largest size class to find the biggest free range.
+	 */
+	_NODISCARD stats getStats() const noexcept;
+};
+}
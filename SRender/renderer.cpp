@@ -1,137 +1,1695 @@
+#include <algorithm>
+#include <cstring>
+#include <utility>
 #include "renderer.hpp"
+#include "range_allocator.hpp"
 #include "glad/glad.h"
 #include "GLFW/glfw3.h"
 #include "assert.h"
 
+// Enums from versions beyond the 3.3 core that glad was generated for
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+	#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+	#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+	#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+	#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+	#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+	#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+	#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_COMPUTE_SHADER
+	#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+	#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+	#define GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT 0x90DF
+#endif
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+	#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#endif
+#ifndef GL_TEXTURE_FETCH_BARRIER_BIT
+	#define GL_TEXTURE_FETCH_BARRIER_BIT 0x00000008
+#endif
+#ifndef GL_SHADER_IMAGE_ACCESS_BARRIER_BIT
+	#define GL_SHADER_IMAGE_ACCESS_BARRIER_BIT 0x00000020
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+	#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+#ifndef GL_SHADER_STORAGE_BARRIER_BIT
+	#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+
 namespace srender
 {
 namespace renderer
 {
 	bool l_gladLoaded = false;
 
-	bool loadGlad() noexcept
+	// Extensions, glad only loads core 3.3 so anything newer is fetched by hand
+
+	typedef void (APIENTRYP getProgramBinaryProc)(GLuint, GLsizei, GLsizei*, GLenum*, void*);
+	typedef void (APIENTRYP programBinaryProc)(GLuint, GLenum, const void*, GLsizei);
+	typedef void (APIENTRYP programParameteriProc)(GLuint, GLenum, GLint);
+	typedef void (APIENTRYP maxShaderCompilerThreadsProc)(GLuint);
+	typedef void (APIENTRYP drawElementsInstancedBaseVertexBaseInstanceProc)(GLenum, GLsizei, GLenum, const void*, GLsizei, GLint, GLuint);
+	typedef void (APIENTRYP multiDrawElementsIndirectProc)(GLenum, GLenum, const void*, GLsizei, GLsizei);
+	typedef void (APIENTRYP bufferStorageProc)(GLenum, GLsizeiptr, const void*, GLbitfield);
+	typedef void (APIENTRYP dispatchComputeProc)(GLuint, GLuint, GLuint);
+	typedef void (APIENTRYP memoryBarrierProc)(GLbitfield);
+	typedef void (APIENTRYP bindImageTextureProc)(GLuint, GLuint, GLint, GLboolean, GLint, GLenum, GLenum);
+
+	getProgramBinaryProc l_glGetProgramBinary = nullptr;
+	programBinaryProc l_glProgramBinary = nullptr;
+	programParameteriProc l_glProgramParameteri = nullptr;
+	bool l_programBinarySupported = false;
+	maxShaderCompilerThreadsProc l_glMaxShaderCompilerThreads = nullptr;
+	bool l_parallelCompileSupported = false;
+	drawElementsInstancedBaseVertexBaseInstanceProc l_glDrawElementsInstancedBaseVertexBaseInstance = nullptr;
+	multiDrawElementsIndirectProc l_glMultiDrawElementsIndirect = nullptr;
+	bufferStorageProc l_glBufferStorage = nullptr;
+	dispatchComputeProc l_glDispatchCompute = nullptr;
+	memoryBarrierProc l_glMemoryBarrier = nullptr;
+	bindImageTextureProc l_glBindImageTexture = nullptr;
+
+	_NODISCARD inline bool hasVersion(const int _major, const int _minor) noexcept
+	{	return GLVersion.major > _major || (GLVersion.major == _major && GLVersion.minor >= _minor); }
+
+	_NODISCARD bool hasExtension(const char *_name) noexcept
+	{
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; ++i)
+		{
+			if (std::strcmp((const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i), _name) == 0)
+			{	return true; }
+		}
+		return false;
+	}
+
+	void loadExtensions() noexcept
+	{
+		if (hasVersion(4, 1) || hasExtension("GL_ARB_get_program_binary"))
+		{
+			l_glGetProgramBinary = (getProgramBinaryProc)glfwGetProcAddress("glGetProgramBinary");
+			l_glProgramBinary = (programBinaryProc)glfwGetProcAddress("glProgramBinary");
+			l_glProgramParameteri = (programParameteriProc)glfwGetProcAddress("glProgramParameteri");
+			// The extension can be exposed with no formats, which makes it useless
+			GLint formats = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+			l_programBinarySupported = l_glGetProgramBinary
+				&& l_glProgramBinary
+				&& l_glProgramParameteri
+				&& formats > 0;
+		}
+
+		// The KHR and ARB versions share the completion status enum
+		if (hasExtension("GL_KHR_parallel_shader_compile"))
+		{	l_glMaxShaderCompilerThreads = (maxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR"); }
+		else if (hasExtension("GL_ARB_parallel_shader_compile"))
+		{	l_glMaxShaderCompilerThreads = (maxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB"); }
+		if (l_glMaxShaderCompilerThreads)
+		{
+			// 0xFFFFFFFF lets the driver decide how many threads to compile on
+			l_glMaxShaderCompilerThreads(0xFFFFFFFFU);
+			l_parallelCompileSupported = true;
+		}
+
+		// Without it the instance attributes are re-pointed for every draw instead
+		if (hasVersion(4, 2) || hasExtension("GL_ARB_base_instance"))
+		{
+			l_glDrawElementsInstancedBaseVertexBaseInstance = (drawElementsInstancedBaseVertexBaseInstanceProc)
+				glfwGetProcAddress("glDrawElementsInstancedBaseVertexBaseInstance");
+		}
+
+		// Indirect draws pick their instances with the base instance, so both are needed
+		if (l_glDrawElementsInstancedBaseVertexBaseInstance
+			&& (hasVersion(4, 3) || hasExtension("GL_ARB_multi_draw_indirect")))
+		{
+			l_glMultiDrawElementsIndirect = (multiDrawElementsIndirectProc)
+				glfwGetProcAddress("glMultiDrawElementsIndirect");
+		}
+
+		// Lets per frame data be written straight into a buffer that stays mapped
+		if (hasVersion(4, 4) || hasExtension("GL_ARB_buffer_storage"))
+		{	l_glBufferStorage = (bufferStorageProc)glfwGetProcAddress("glBufferStorage"); }
+
+		// Compute on its own is no use without storage buffers to read and write, or images for the depth pyramid
+		if (hasVersion(4, 3) || (hasExtension("GL_ARB_compute_shader")
+			&& hasExtension("GL_ARB_shader_storage_buffer_object")
+			&& hasExtension("GL_ARB_shader_image_load_store")))
+		{
+			l_glDispatchCompute = (dispatchComputeProc)glfwGetProcAddress("glDispatchCompute");
+			l_glMemoryBarrier = (memoryBarrierProc)glfwGetProcAddress("glMemoryBarrier");
+			l_glBindImageTexture = (bindImageTextureProc)glfwGetProcAddress("glBindImageTexture");
+		}
+	}
+
+	/** Shadow copy of the GL state the renderer is responsible for. */
+	struct glState
+	{
+		uint32_t program = 0U;
+		uint32_t vertexArray = 0U;
+		uint32_t arrayBuffer = 0U;
+		uint32_t elementBuffer = 0U;	// Part of the vertex array state
+		uint32_t uniformBuffer = 0U;	// The generic binding, not the indexed ones
+		uint32_t indirectBuffer = 0U;
+		uint8_t activeTexture = 0U;
+		uint32_t textures[32] = {};	// The 2D texture bound to each unit
+	};
+
+	glState l_state;
+	stateStats l_stats;
+
+	/** Used to mark a piece of state as unknown, no object will ever have this id. */
+	constexpr uint32_t unknownState() { return UINT32_MAX; }
+
+	/** Updates the shadow state and tallies whether the call is needed.
+	 * @param _current The tracked value.
+	 * @param _value The value being requested.
+	 * @return [bool] True if the GL call must be issued.
+	 */
+	inline bool trackState(uint32_t &_current, const uint32_t _value) noexcept
+	{
+		if (_current == _value)
+		{
+			++l_stats.skipped;
+			return false;
+		}
+		_current = _value;
+		++l_stats.issued;
+		return true;
+	}
+
+	inline void bindVertexArray(const uint32_t _idVAO) noexcept
+	{
+		if (trackState(l_state.vertexArray, _idVAO))
+		{
+			glBindVertexArray(_idVAO);
+			// Each vertex array carries its own element buffer binding
+			l_state.elementBuffer = unknownState();
+		}
+	}
+
+	inline void bindArrayBuffer(const uint32_t _idVBO) noexcept
+	{
+		if (trackState(l_state.arrayBuffer, _idVBO))
+		{	glBindBuffer(GL_ARRAY_BUFFER, _idVBO); }
+	}
+
+	inline void bindElementBuffer(const uint32_t _idEBO) noexcept
+	{
+		if (trackState(l_state.elementBuffer, _idEBO))
+		{	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _idEBO); }
+	}
+
+	inline void bindUniformBuffer(const uint32_t _idUBO) noexcept
+	{
+		if (trackState(l_state.uniformBuffer, _idUBO))
+		{	glBindBuffer(GL_UNIFORM_BUFFER, _idUBO); }
+	}
+
+	inline void bindIndirectBuffer(const uint32_t _idBuffer) noexcept
+	{
+		if (trackState(l_state.indirectBuffer, _idBuffer))
+		{	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _idBuffer); }
+	}
+
+	// Instancing
+
+	/** The per-instance attributes start after the three vertex attributes. */
+	constexpr GLuint instanceModelLocation() { return 3U; }
+	constexpr GLuint instanceNormalLocation() { return 7U; }
+
+	/** The buffer the instance attributes of every arena read from, the stream or the one gpuCulling wrote culled instances to. */
+	uint32_t l_idInstanceSource = 0U;
+	/** Where mapDrawCommands put this frame's draw commands. */
+	uint32_t l_idCommandSource = 0U;
+	uint32_t l_commandOffset = 0U;
+
+	/** Points the instance attributes of the bound vertex array at an offset into the instance buffer. */
+	void pointInstanceAttributes(const uint64_t _offset) noexcept
+	{
+		bindArrayBuffer(l_idInstanceSource);
+		const GLsizei stride = (GLsizei)getInstanceSize();
+		// A mat4 takes four locations, one per column, a mat3 takes three
+		for (GLuint i = 0; i < 4U; ++i)
+		{
+			glVertexAttribPointer(
+				instanceModelLocation() + i, 4, GL_FLOAT, GL_FALSE, stride,
+				(void*)(_offset + i * 4U * sizeof(float))
+			);
+		}
+		for (GLuint i = 0; i < 3U; ++i)
+		{
+			glVertexAttribPointer(
+				instanceNormalLocation() + i, 3, GL_FLOAT, GL_FALSE, stride,
+				(void*)(_offset + (16U + i * 3U) * sizeof(float))
+			);
+		}
+	}
+
+	/** Deleting a bound object reverts that binding to zero. */
+	inline void forgetDeleted(uint32_t &_current, const uint32_t _id) noexcept
+	{
+		if (_current == _id)
+		{	_current = 0U; }
+	}
+
+	bool loadGlad() noexcept
+	{
+		// Glad: load all OpenGL function pointers
+		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+		{	return false; }
+		l_gladLoaded = true;
+		loadExtensions();
+		// A fresh context has everything bound to zero
+		l_state = glState();
+		glEnable(GL_DEPTH_TEST);
+		return true;
+	}
+
+	bool getGladLoaded() noexcept
+	{	return l_gladLoaded; }
+
+	std::string getDriverString() noexcept
+	{
+		std::string driver;
+		for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+		{
+			const GLubyte *str = glGetString(name);
+			driver += str ? (const char*)str : "";
+			driver += '\n';
+		}
+		return driver;
+	}
+
+	void clearScreenBuffers() noexcept
+	{
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	void setClearColour(
+		const float _r,
+		const float _g,
+		const float _b,
+		const float _a
+	) noexcept
+	{	glClearColor((GLfloat)_r, (GLfloat)_g, (GLfloat)_b, (GLfloat)_a); }
+
+	void setRenderMode(const int _mode) noexcept
+	{
+		assert(_mode < 3);
+		glPolygonMode(GL_FRONT_AND_BACK, GL_POINT + _mode);
+	}
+
+	/** The window size and the viewport size, both read from GL the first time either is asked for. */
+	uint32_t l_windowWidth = 0U, l_windowHeight = 0U;
+	uint32_t l_viewportWidth = 0U, l_viewportHeight = 0U;
+	/** Drawn into in place of the window while set, framebuffer 0 means this everywhere. */
+	uint32_t l_idSceneFBO = 0U;
+
+	void setResolution(const size_t _width, const size_t _height) noexcept
+	{
+		l_windowWidth = (uint32_t)_width;
+		l_windowHeight = (uint32_t)_height;
+		// The scene target keeps its own viewport, the window's is only used when presenting it
+		if (l_idSceneFBO)
+		{	return; }
+		l_viewportWidth = l_windowWidth;
+		l_viewportHeight = l_windowHeight;
+		glViewport(0, 0, (GLsizei)_width, (GLsizei)_height);
+	}
+
+	/** The window sets the first viewport itself, before any resize reaches setResolution. */
+	inline void readFirstViewport() noexcept
+	{
+		if (l_windowWidth || l_windowHeight)
+		{	return; }
+		GLint viewport[4] = {};
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		l_windowWidth = (uint32_t)viewport[2];
+		l_windowHeight = (uint32_t)viewport[3];
+		if (!l_idSceneFBO)
+		{
+			l_viewportWidth = l_windowWidth;
+			l_viewportHeight = l_windowHeight;
+		}
+	}
+
+	void getViewportSize(uint32_t *_outWidth, uint32_t *_outHeight) noexcept
+	{
+		readFirstViewport();
+		*_outWidth = l_viewportWidth;
+		*_outHeight = l_viewportHeight;
+	}
+
+	void getWindowSize(uint32_t *_outWidth, uint32_t *_outHeight) noexcept
+	{
+		readFirstViewport();
+		*_outWidth = l_windowWidth;
+		*_outHeight = l_windowHeight;
+	}
+
+	void setColourWrites(const bool _state) noexcept
+	{	glColorMask(_state, _state, _state, _state); }
+
+	void setDepthWrites(const bool _state) noexcept
+	{	glDepthMask(_state); }
+
+	void setDepthEqual(const bool _state) noexcept
+	{	glDepthFunc(_state ? GL_EQUAL : GL_LESS); }
+
+	void setViewportRect(const uint32_t _x, const uint32_t _y, const uint32_t _width, const uint32_t _height) noexcept
+	{	glViewport((GLint)_x, (GLint)_y, (GLsizei)_width, (GLsizei)_height); }
+
+	void setDepthBias(const float _slope, const float _constant) noexcept
+	{
+		if (_slope == 0.0f && _constant == 0.0f)
+		{
+			glDisable(GL_POLYGON_OFFSET_FILL);
+			return;
+		}
+		glEnable(GL_POLYGON_OFFSET_FILL);
+		glPolygonOffset((GLfloat)_slope, (GLfloat)_constant);
+	}
+
+	// State
+
+	stateStats getStateStats() noexcept
+	{	return l_stats; }
+
+	void resetStateStats() noexcept
+	{	l_stats = stateStats(); }
+
+	void invalidateStateCache() noexcept
+	{
+		l_state.program = unknownState();
+		l_state.vertexArray = unknownState();
+		l_state.arrayBuffer = unknownState();
+		l_state.elementBuffer = unknownState();
+		l_state.uniformBuffer = unknownState();
+		l_state.indirectBuffer = unknownState();
+		// Out of range so the next setActiveTexture is always issued
+		l_state.activeTexture = UINT8_MAX;
+		for (uint32_t &tex : l_state.textures)
+		{	tex = unknownState(); }
+	}
+
+	// Stream
+
+	/** Segment size a new stream buffer starts with, doubled whenever a frame needs more. */
+	constexpr uint32_t streamSegmentSize() { return 1U << 20U; }
+
+	/** A stream buffer replaced by a bigger one, kept until the frames using it are done. */
+	struct retiredBuffer
+	{
+		uint32_t idBuffer = 0U;
+		GLsync fence = nullptr;	// Null until the frame that retired it has been submitted
+		/** Without persistent mapping, the staging earlier allocations of the frame still point into, freed when it ends. */
+		std::vector<uint8_t> staging = std::vector<uint8_t>();
+		uint32_t written = 0U;	// Bytes of staging in use when it was retired
+	};
+
+	uint32_t l_idStream = 0U;
+	/** Persistent mapping of the whole buffer, null when falling back to orphaning. */
+	uint8_t *l_streamMapped = nullptr;
+	/** Written instead of the mapping when orphaning, uploaded by flushStream. */
+	std::vector<uint8_t> l_streamStaging = std::vector<uint8_t>();
+	uint32_t l_streamSize = 0U;	// Bytes per segment, one segment per frame in flight
+	uint32_t l_streamSegment = 0U;	// The segment this frame writes to
+	uint32_t l_streamHead = 0U;	// Offset of the next allocation within the segment
+	uint32_t l_streamFlushed = 0U;	// How much of the segment has been uploaded when orphaning
+	GLsync l_streamFences[maxFramesInFlight()] = {};
+	std::vector<retiredBuffer> l_retiredStreams = std::vector<retiredBuffer>();
+
+	/** Blocks until the GPU has passed a fence, then deletes it. */
+	void waitFence(GLsync _fence) noexcept
+	{
+		if (!_fence)
+		{	return; }
+		// The first wait flushes so the fence is sure to reach the GPU
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while (glClientWaitSync(_fence, flags, 1000000U) == GL_TIMEOUT_EXPIRED)
+		{	flags = 0; }
+		glDeleteSync(_fence);
+	}
+
+	void createStream(const uint32_t _segmentSize) noexcept
+	{
+		l_streamSize = _segmentSize;
+		glGenBuffers(1, &l_idStream);
+		bindArrayBuffer(l_idStream);
+		if (l_glBufferStorage)
+		{
+			// Mapped once for its whole life, coherent so writes need no explicit flush
+			const GLsizeiptr size = (GLsizeiptr)_segmentSize * maxFramesInFlight();
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			l_glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+			l_streamMapped = (uint8_t*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+			if (l_streamMapped)
+			{	return; }
+
+			// Storage is immutable, so orphaning needs a new buffer
+			l_glBufferStorage = nullptr;
+			glDeleteBuffers(1, &l_idStream);
+			forgetDeleted(l_state.arrayBuffer, l_idStream);
+			glGenBuffers(1, &l_idStream);
+			bindArrayBuffer(l_idStream);
+		}
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)_segmentSize, NULL, GL_STREAM_DRAW);
+		l_streamStaging.resize(_segmentSize);
+	}
+
+	/** Replaces the stream with one that fits at least _needed bytes per frame.
+	 * @note Allocations already made this frame stay valid, the old buffer lives until the GPU is done with it.
+	 * Without persistent mapping its staging is kept until the frame ends, so their data can still be written.
+	 */
+	void growStream(const uint32_t _needed) noexcept
+	{
+		flushStream();
+		retiredBuffer retired;
+		retired.idBuffer = l_idStream;
+		retired.staging = std::move(l_streamStaging);
+		retired.written = l_streamHead;
+		l_retiredStreams.push_back(std::move(retired));
+		// The retired buffer's own fence comes after these, so they are no longer needed
+		for (GLsync &fence : l_streamFences)
+		{
+			if (fence)
+			{
+				glDeleteSync(fence);
+				fence = nullptr;
+			}
+		}
+
+		uint32_t size = l_streamSize * 2U;
+		while (size < _needed)
+		{	size *= 2U; }
+		l_idStream = 0U;
+		l_streamMapped = nullptr;
+		createStream(size);
+		l_streamSegment = 0U;
+		l_streamHead = 0U;
+		l_streamFlushed = 0U;
+	}
+
+	void beginStreamFrame() noexcept
+	{
+		if (!l_idStream)
+		{	createStream(streamSegmentSize()); }
+
+		// Buffers replaced in earlier frames can go once the GPU is past them
+		for (size_t i = 0; i < l_retiredStreams.size();)
+		{
+			const retiredBuffer &retired = l_retiredStreams[i];
+			if (!retired.fence || glClientWaitSync(retired.fence, 0, 0U) == GL_TIMEOUT_EXPIRED)
+			{
+				++i;
+				continue;
+			}
+			glDeleteSync(retired.fence);
+			deleteBuffer(retired.idBuffer);
+			l_retiredStreams[i] = l_retiredStreams.back();
+			l_retiredStreams.pop_back();
+		}
+
+		if (l_streamMapped)
+		{
+			// The GPU may still be reading this segment from maxFramesInFlight frames ago
+			l_streamSegment = (l_streamSegment + 1U) % maxFramesInFlight();
+			waitFence(l_streamFences[l_streamSegment]);
+			l_streamFences[l_streamSegment] = nullptr;
+		}
+		else
+		{
+			// The driver hands over fresh memory while the old contents are still in use
+			bindArrayBuffer(l_idStream);
+			glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)l_streamSize, NULL, GL_STREAM_DRAW);
+		}
+		l_streamHead = 0U;
+		l_streamFlushed = 0U;
+	}
+
+	streamAllocation streamAllocate(const uint32_t _byteSize, const uint32_t _alignment) noexcept
+	{
+		assert(l_idStream && "beginStreamFrame has not been called");
+		// Aligned as an offset into the whole buffer, alignments like the instance size are not powers of two
+		uint32_t base = l_streamMapped ? l_streamSegment * l_streamSize : 0U;
+		uint32_t offset = (base + l_streamHead + _alignment - 1U) / _alignment * _alignment - base;
+		if (offset + _byteSize > l_streamSize)
+		{
+			growStream(_byteSize);
+			// The new buffer starts over at its first segment
+			base = 0U;
+			offset = 0U;
+		}
+
+		streamAllocation out;
+		out.idBuffer = l_idStream;
+		out.offset = base + offset;
+		out.data = (l_streamMapped ? l_streamMapped + out.offset : l_streamStaging.data() + offset);
+		l_streamHead = offset + _byteSize;
+		return out;
+	}
+
+	void flushStream() noexcept
+	{
+		// Allocations made before the stream grew may have been written since, so their buffers are sent again
+		for (const retiredBuffer &retired : l_retiredStreams)
+		{
+			if (retired.staging.empty())
+			{	continue; }
+			bindArrayBuffer(retired.idBuffer);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)retired.written, retired.staging.data());
+		}
+		if (l_streamMapped || l_streamHead <= l_streamFlushed)
+		{	return; }
+		bindArrayBuffer(l_idStream);
+		glBufferSubData(
+			GL_ARRAY_BUFFER,
+			(GLintptr)l_streamFlushed,
+			(GLsizeiptr)(l_streamHead - l_streamFlushed),
+			l_streamStaging.data() + l_streamFlushed
+		);
+		l_streamFlushed = l_streamHead;
+	}
+
+	void endStreamFrame() noexcept
+	{
+		flushStream();
+		if (l_streamMapped)
+		{	l_streamFences[l_streamSegment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0); }
+		for (retiredBuffer &retired : l_retiredStreams)
+		{
+			if (!retired.fence)
+			{	retired.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0); }
+			// Nothing from this frame can be written any more
+			retired.staging = std::vector<uint8_t>();
+		}
+	}
+
+	bool supportsPersistentMapping() noexcept
+	{	return l_streamMapped != nullptr; }
+
+	void releaseStream() noexcept
+	{
+		if (!l_gladLoaded)
+		{	return; }
+		for (GLsync &fence : l_streamFences)
+		{
+			if (fence)
+			{
+				glDeleteSync(fence);
+				fence = nullptr;
+			}
+		}
+		for (const retiredBuffer &retired : l_retiredStreams)
+		{
+			if (retired.fence)
+			{	glDeleteSync(retired.fence); }
+			deleteBuffer(retired.idBuffer);
+		}
+		l_retiredStreams.clear();
+		// Deleting a mapped buffer unmaps it
+		deleteBuffer(l_idStream);
+		l_idStream = 0U;
+		l_streamMapped = nullptr;
+		l_streamStaging = std::vector<uint8_t>();
+	}
+
+	// Frame pacing
+
+	/** One fence per recent frame, indexed by frame number. */
+	GLsync l_frameFences[maxFramesInFlight()] = {};
+	uint64_t l_framesFenced = 0U;
+
+	void waitForFramesInFlight(const uint32_t _limit) noexcept
+	{
+		assert(_limit > 0U && _limit <= maxFramesInFlight() && "Frames in flight out of range");
+		if (l_framesFenced < _limit)
+		{	return; }
+		// Starting frame N needs frame N - _limit to be done
+		GLsync &fence = l_frameFences[(l_framesFenced - _limit) % maxFramesInFlight()];
+		waitFence(fence);
+		fence = nullptr;
+	}
+
+	void fenceFrame() noexcept
+	{
+		GLsync &fence = l_frameFences[l_framesFenced % maxFramesInFlight()];
+		// Never waited on when the limit is below the maximum
+		if (fence)
+		{	glDeleteSync(fence); }
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		++l_framesFenced;
+	}
+
+	void releaseFrameFences() noexcept
+	{
+		if (!l_gladLoaded)
+		{	return; }
+		for (GLsync &fence : l_frameFences)
+		{
+			if (fence)
+			{
+				glDeleteSync(fence);
+				fence = nullptr;
+			}
+		}
+	}
+
+	// Mesh
+
+	/** Every mesh of one vertex format lives in these buffers, so drawing any of them needs no vertex array switch. */
+	struct geometryArena
+	{
+		uint32_t idVAO = 0U;
+		uint32_t idVBO = 0U;
+		uint32_t idEBO = 0U;
+		/** The same vertices as positions only, at the same indices as idVBO, drawn through their own vertex array. */
+		uint32_t idPositionVAO = 0U;
+		uint32_t idPositionVBO = 0U;
+		uint32_t vertexSize = 0U;
+		uint64_t normalOffset = 0U;
+		uint64_t texCoordOffset = 0U;
+		rangeAllocator vertices;	// In vertices
+		rangeAllocator indices;	// In indices
+		// The handle using each block, so compaction knows who to tell when a block moves
+		std::vector<uint32_t> vertexOwners;
+		std::vector<uint32_t> indexOwners;
+	};
+
+	/** What a geometry handle refers to, the blocks change when compaction moves the mesh. */
+	struct geometryEntry
+	{
+		uint32_t arena = 0U;
+		uint32_t vertexBlock = rangeAllocator::invalid();
+		uint32_t indexBlock = rangeAllocator::invalid();
+	};
+
+	std::vector<geometryArena> l_arenas = std::vector<geometryArena>();
+	std::vector<geometryEntry> l_geometry = std::vector<geometryEntry>();
+	std::vector<uint32_t> l_freeHandles = std::vector<uint32_t>();
+
+	/** Set while drawing depth only, draws then bind each arena's position vertex array instead. */
+	bool l_positionOnly = false;
+
+	/** The starting size of an arena, grown by doubling when a mesh does not fit. */
+	constexpr uint32_t arenaVertices() { return 1U << 16U; }
+	constexpr uint32_t arenaIndices() { return 1U << 18U; }
+
+	/** Handles start at 1 so 0 can mean no geometry, like GL ids. */
+	_NODISCARD inline geometryEntry &entryAt(const uint32_t _handle) noexcept
+	{	return l_geometry[_handle - 1U]; }
+
+	inline void setOwner(std::vector<uint32_t> *_owners, const uint32_t _block, const uint32_t _handle)
+	{
+		if (_block >= _owners->size())
+		{	_owners->resize(_block + 1U, 0U); }
+		(*_owners)[_block] = _handle;
+	}
+
+	/** Moves a buffer to a bigger one, keeping the contents.
+	 * @note The old buffer is deleted, so anything pointing at it must be updated.
+	 */
+	void growBuffer(uint32_t *_idBuffer, const uint32_t _oldByteSize, const uint32_t _newByteSize) noexcept
+	{
+		uint32_t idNew;
+		glGenBuffers(1, &idNew);
+		// The copy bindings are not used for anything else, so they are not tracked
+		glBindBuffer(GL_COPY_WRITE_BUFFER, idNew);
+		glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)_newByteSize, NULL, GL_STATIC_DRAW);
+		if (*_idBuffer)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, *_idBuffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)_oldByteSize);
+			glDeleteBuffers(1, _idBuffer);
+			forgetDeleted(l_state.arrayBuffer, *_idBuffer);
+			forgetDeleted(l_state.elementBuffer, *_idBuffer);
+		}
+		*_idBuffer = idNew;
+	}
+
+	/** Points the vertex array of an arena at its current buffers. */
+	void setupArenaAttributes(const geometryArena &_arena) noexcept
+	{
+		bindVertexArray(_arena.idVAO);
+		// GL_ARRAY_BUFFER effectively works like a pointer, using the id provided to point to the buffer
+		bindArrayBuffer(_arena.idVBO);
+		// The element buffer binding is recorded within the vertex array
+		bindElementBuffer(_arena.idEBO);
+
+		/*Tells the shader how to use the vertex data provided
+		* p1: Which vertex attribute we want to configure in the vertex shader (location = 0)
+		* p2: Vertex size (vec3)
+		* p3: The type of data (vec is using floats)
+		* p4: Whether we want to normalise the data
+		* p5: Stride, how big each chunk of data is
+		* p6: Offset, for some reason a void*
+		*/
+		// Position attribute
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, _arena.vertexSize, (void*)0);
+		// Normal attribute
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, _arena.vertexSize, (void*)_arena.normalOffset);
+		// Texcoord attribute
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, _arena.vertexSize, (void*)_arena.texCoordOffset);
+
+		// Model and normal matrix attributes, these advance once per instance rather than per vertex
+		if (!l_idInstanceSource)
+		{
+			if (!l_idStream)
+			{	createStream(streamSegmentSize()); }
+			l_idInstanceSource = l_idStream;
+		}
+		pointInstanceAttributes(0U);
+		for (GLuint i = instanceModelLocation(); i < instanceNormalLocation() + 3U; ++i)
+		{
+			glEnableVertexAttribArray(i);
+			glVertexAttribDivisor(i, 1);
+		}
+
+		// Shares the element buffer and instances, only the vertices come from elsewhere
+		bindVertexArray(_arena.idPositionVAO);
+		bindArrayBuffer(_arena.idPositionVBO);
+		bindElementBuffer(_arena.idEBO);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, getPositionSize(), (void*)0);
+		pointInstanceAttributes(0U);
+		for (GLuint i = instanceModelLocation(); i < instanceNormalLocation() + 3U; ++i)
+		{
+			glEnableVertexAttribArray(i);
+			glVertexAttribDivisor(i, 1);
+		}
+	}
+
+	/** Takes a block from one of an arena's allocators, growing the buffer behind it if nothing fits.
+	 * @param _outGrown Set to true if the buffer was replaced.
+	 */
+	_NODISCARD uint32_t allocateBlock(
+		rangeAllocator *_allocator,
+		uint32_t *_idBuffer,
+		const uint32_t _elementSize,
+		const uint32_t _count,
+		const uint32_t _initialCapacity,
+		bool *_outGrown
+	) noexcept
+	{
+		uint32_t block = _allocator->allocate(_count);
+		if (block != rangeAllocator::invalid())
+		{	return block; }
+
+		const uint32_t oldCapacity = _allocator->getCapacity();
+		uint32_t capacity = oldCapacity ? oldCapacity * 2U : _initialCapacity;
+		// Twice the size leaves room for the allocator rounding the request up to its size class
+		while (capacity - oldCapacity < _count * 2U)
+		{	capacity *= 2U; }
+
+		// Offsets stay the same, so the ranges already handed out are still valid
+		growBuffer(_idBuffer, oldCapacity * _elementSize, capacity * _elementSize);
+		_allocator->grow(capacity);
+		*_outGrown = true;
+
+		block = _allocator->allocate(_count);
+		assert(block != rangeAllocator::invalid() && "Grown buffer should fit the range");
+		return block;
+	}
+
+	/** Finds the arena for a vertex format, creating it on first use. */
+	_NODISCARD uint32_t findArena(
+		const uint32_t _vertexSize,
+		const uint64_t _normalOffset,
+		const uint64_t _texCoordOffset
+	) noexcept
+	{
+		for (uint32_t i = 0; i < l_arenas.size(); ++i)
+		{
+			if (l_arenas[i].vertexSize == _vertexSize
+				&& l_arenas[i].normalOffset == _normalOffset
+				&& l_arenas[i].texCoordOffset == _texCoordOffset)
+			{	return i; }
+		}
+
+		geometryArena arena;
+		arena.vertexSize = _vertexSize;
+		arena.normalOffset = _normalOffset;
+		arena.texCoordOffset = _texCoordOffset;
+		glGenVertexArrays(1, &arena.idVAO);
+		glGenVertexArrays(1, &arena.idPositionVAO);
+		l_arenas.push_back(arena);
+		return (uint32_t)l_arenas.size() - 1U;
+	}
+
+	uint32_t allocateGeometry(
+		const float *_vertices,
+		const float *_positions,
+		const uint32_t *_indices,
+		const uint32_t _vertexCount,
+		const uint32_t _indexCount,
+		const uint32_t _vertexSize,
+		uint64_t _normalOffset,
+		uint64_t _texCoordOffset
+	) noexcept
+	{
+		geometryEntry entry;
+		entry.arena = findArena(_vertexSize, _normalOffset, _texCoordOffset);
+		geometryArena &arena = l_arenas[entry.arena];
+
+		bool grown = false;
+		const uint32_t oldVertexCapacity = arena.vertices.getCapacity();
+		entry.vertexBlock = allocateBlock(
+			&arena.vertices,
+			&arena.idVBO,
+			arena.vertexSize,
+			_vertexCount,
+			arenaVertices(),
+			&grown
+		);
+		// The position stream grows with the vertices, so one offset finds a vertex in both
+		if (arena.vertices.getCapacity() != oldVertexCapacity)
+		{
+			growBuffer(
+				&arena.idPositionVBO,
+				oldVertexCapacity * getPositionSize(),
+				arena.vertices.getCapacity() * getPositionSize()
+			);
+		}
+		entry.indexBlock = allocateBlock(
+			&arena.indices,
+			&arena.idEBO,
+			(uint32_t)sizeof(uint32_t),
+			_indexCount,
+			arenaIndices(),
+			&grown
+		);
+		if (grown)
+		{	setupArenaAttributes(arena); }
+
+		// The indices stay relative to the mesh, the base vertex moves them at draw time
+		bindArrayBuffer(arena.idVBO);
+		glBufferSubData(
+			GL_ARRAY_BUFFER,
+			(GLintptr)arena.vertices.getOffset(entry.vertexBlock) * arena.vertexSize,
+			(GLsizeiptr)_vertexCount * arena.vertexSize,
+			_vertices
+		);
+		bindArrayBuffer(arena.idPositionVBO);
+		glBufferSubData(
+			GL_ARRAY_BUFFER,
+			(GLintptr)arena.vertices.getOffset(entry.vertexBlock) * getPositionSize(),
+			(GLsizeiptr)_vertexCount * getPositionSize(),
+			_positions
+		);
+		bindVertexArray(arena.idVAO);
+		glBufferSubData(
+			GL_ELEMENT_ARRAY_BUFFER,
+			(GLintptr)arena.indices.getOffset(entry.indexBlock) * sizeof(uint32_t),
+			(GLsizeiptr)_indexCount * sizeof(uint32_t),
+			_indices
+		);
+
+		uint32_t handle;
+		if (!l_freeHandles.empty())
+		{
+			handle = l_freeHandles.back();
+			l_freeHandles.pop_back();
+			entryAt(handle) = entry;
+		}
+		else
+		{
+			l_geometry.push_back(entry);
+			handle = (uint32_t)l_geometry.size();
+		}
+		setOwner(&arena.vertexOwners, entry.vertexBlock, handle);
+		setOwner(&arena.indexOwners, entry.indexBlock, handle);
+		return handle;
+	}
+
+	void freeGeometry(const uint32_t _handle) noexcept
+	{
+		if (!l_gladLoaded || !_handle)
+		{	return; }
+
+		geometryEntry &entry = entryAt(_handle);
+		geometryArena &arena = l_arenas[entry.arena];
+		arena.vertices.free(entry.vertexBlock);
+		arena.indices.free(entry.indexBlock);
+		entry = geometryEntry();
+		l_freeHandles.push_back(_handle);
+	}
+
+	geometryRange getGeometryRange(const uint32_t _handle) noexcept
+	{
+		const geometryEntry &entry = entryAt(_handle);
+		const geometryArena &arena = l_arenas[entry.arena];
+		geometryRange range;
+		range.idVAO = arena.idVAO;
+		range.firstVertex = arena.vertices.getOffset(entry.vertexBlock);
+		range.vertexCount = arena.vertices.getSize(entry.vertexBlock);
+		range.firstIndex = arena.indices.getOffset(entry.indexBlock);
+		range.indexCount = arena.indices.getSize(entry.indexBlock);
+		return range;
+	}
+
+	/** Moves the block with the highest offset into a free range lower down, if there is one.
+	 * @param _idMirror A second buffer indexed by the same allocator, moved along with the first. 0 if there is none.
+	 * @param _isIndex Which block of the owning entry to update.
+	 * @return [uint32_t] Bytes copied, 0 if the block could not move.
+	 */
+	uint32_t compactStep(
+		rangeAllocator *_allocator,
+		std::vector<uint32_t> *_owners,
+		const uint32_t _idBuffer,
+		const uint32_t _elementSize,
+		const uint32_t _idMirror,
+		const uint32_t _mirrorElementSize,
+		const bool _isIndex
+	) noexcept
+	{
+		const uint32_t last = _allocator->lastUsed();
+		if (last == rangeAllocator::invalid())
+		{	return 0U; }
+
+		const uint32_t size = _allocator->getSize(last);
+		const uint32_t moved = _allocator->allocate(size);
+		if (moved == rangeAllocator::invalid())
+		{	return 0U; }
+		// Only space after the block was free, so it is already as low as it goes
+		if (_allocator->getOffset(moved) > _allocator->getOffset(last))
+		{
+			_allocator->free(moved);
+			return 0U;
+		}
+
+		// Both blocks are allocated at once so the ranges never overlap, as a copy within one buffer requires
+		glBindBuffer(GL_COPY_READ_BUFFER, _idBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, _idBuffer);
+		glCopyBufferSubData(
+			GL_COPY_READ_BUFFER,
+			GL_COPY_WRITE_BUFFER,
+			(GLintptr)_allocator->getOffset(last) * _elementSize,
+			(GLintptr)_allocator->getOffset(moved) * _elementSize,
+			(GLsizeiptr)size * _elementSize
+		);
+		if (_idMirror)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, _idMirror);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, _idMirror);
+			glCopyBufferSubData(
+				GL_COPY_READ_BUFFER,
+				GL_COPY_WRITE_BUFFER,
+				(GLintptr)_allocator->getOffset(last) * _mirrorElementSize,
+				(GLintptr)_allocator->getOffset(moved) * _mirrorElementSize,
+				(GLsizeiptr)size * _mirrorElementSize
+			);
+		}
+
+		const uint32_t handle = (*_owners)[last];
+		if (_isIndex)
+		{	entryAt(handle).indexBlock = moved; }
+		else
+		{	entryAt(handle).vertexBlock = moved; }
+		setOwner(_owners, moved, handle);
+		_allocator->free(last);
+		return size * (_elementSize + _mirrorElementSize);
+	}
+
+	uint32_t compactGeometry(const uint32_t _byteBudget) noexcept
+	{
+		uint32_t copied = 0U;
+		for (geometryArena &arena : l_arenas)
+		{
+			// One free range means everything is already packed at the start
+			while (copied < _byteBudget && arena.vertices.getStats().freeRanges > 1U)
+			{
+				const uint32_t step = compactStep(
+					&arena.vertices,
+					&arena.vertexOwners,
+					arena.idVBO,
+					arena.vertexSize,
+					arena.idPositionVBO,
+					getPositionSize(),
+					false
+				);
+				if (!step)
+				{	break; }
+				copied += step;
+			}
+			while (copied < _byteBudget && arena.indices.getStats().freeRanges > 1U)
+			{
+				const uint32_t step = compactStep(&arena.indices, &arena.indexOwners, arena.idEBO, (uint32_t)sizeof(uint32_t), 0U, 0U, true);
+				if (!step)
+				{	break; }
+				copied += step;
+			}
+		}
+		return copied;
+	}
+
+	geometryStats getGeometryStats() noexcept
+	{
+		geometryStats out;
+		out.ranges = (uint32_t)(l_geometry.size() - l_freeHandles.size());
+		uint64_t freeBytes = 0U;
+		uint64_t largestFreeBytes = 0U;
+		for (const geometryArena &arena : l_arenas)
+		{
+			const rangeAllocator::stats vertices = arena.vertices.getStats();
+			const rangeAllocator::stats indices = arena.indices.getStats();
+			// Every vertex is stored twice, once whole and once in the position stream
+			const uint32_t vertexBytes = arena.vertexSize + getPositionSize();
+			out.bytesInUse += vertices.used * vertexBytes + indices.used * (uint32_t)sizeof(uint32_t);
+			out.bytesReserved += vertices.capacity * vertexBytes + indices.capacity * (uint32_t)sizeof(uint32_t);
+			freeBytes += (uint64_t)(vertices.capacity - vertices.used) * vertexBytes
+				+ (uint64_t)(indices.capacity - indices.used) * sizeof(uint32_t);
+			largestFreeBytes += (uint64_t)vertices.largestFree * vertexBytes
+				+ (uint64_t)indices.largestFree * sizeof(uint32_t);
+		}
+		// The share of free space outside the biggest free range of each buffer
+		out.fragmentation = freeBytes ? 1.0f - (float)largestFreeBytes / (float)freeBytes : 0.0f;
+		return out;
+	}
+
+	void *mapInstances(const uint32_t _count, uint32_t *_outFirstInstance) noexcept
+	{
+		const streamAllocation space = streamAllocate(_count * getInstanceSize(), getInstanceSize());
+		// The stream grew or culled instances were drawn, attribute pointers keep the buffer they were set up with
+		setInstanceSource(space.idBuffer);
+		*_outFirstInstance = space.offset / getInstanceSize();
+		return space.data;
+	}
+
+	void setInstanceSource(const uint32_t _idBuffer) noexcept
+	{
+		if (_idBuffer == l_idInstanceSource)
+		{	return; }
+		l_idInstanceSource = _idBuffer;
+		for (const geometryArena &arena : l_arenas)
+		{
+			bindVertexArray(arena.idVAO);
+			pointInstanceAttributes(0U);
+			bindVertexArray(arena.idPositionVAO);
+			pointInstanceAttributes(0U);
+		}
+	}
+
+	uint32_t getInstanceSource() noexcept
+	{	return l_idInstanceSource; }
+
+	/** The vertex array a draw of an arena binds, its position only one while setPositionOnly is on. */
+	_NODISCARD inline uint32_t drawVertexArray(const uint32_t _idVAO) noexcept
+	{
+		if (!l_positionOnly)
+		{	return _idVAO; }
+		for (const geometryArena &arena : l_arenas)
+		{
+			if (arena.idVAO == _idVAO)
+			{	return arena.idPositionVAO; }
+		}
+		return _idVAO;
+	}
+
+	void setPositionOnly(const bool _state) noexcept
+	{	l_positionOnly = _state; }
+
+	/** The byte offset of an index as the pointer GL expects. */
+	_NODISCARD inline const void *indexOffset(const uint32_t _firstIndex) noexcept
+	{	return (const void*)((uintptr_t)_firstIndex * sizeof(uint32_t)); }
+
+	void drawGeometry(const geometryRange &_range) noexcept
+	{
+		bindVertexArray(drawVertexArray(_range.idVAO));
+		glDrawElementsBaseVertex(
+			GL_TRIANGLES,
+			(GLsizei)_range.indexCount,
+			GL_UNSIGNED_INT,
+			indexOffset(_range.firstIndex),
+			(GLint)_range.firstVertex
+		);
+	}
+
+	void drawGeometryInstanced(
+		const geometryRange &_range,
+		const uint32_t _instanceCount,
+		const uint32_t _firstInstance
+	) noexcept
+	{
+		bindVertexArray(drawVertexArray(_range.idVAO));
+		if (l_glDrawElementsInstancedBaseVertexBaseInstance)
+		{
+			l_glDrawElementsInstancedBaseVertexBaseInstance(
+				GL_TRIANGLES,
+				(GLsizei)_range.indexCount,
+				GL_UNSIGNED_INT,
+				indexOffset(_range.firstIndex),
+				(GLsizei)_instanceCount,
+				(GLint)_range.firstVertex,
+				_firstInstance
+			);
+			return;
+		}
+
+		// GL 3.3 has no base instance, so the attributes are moved to the first one instead
+		pointInstanceAttributes((uint64_t)_firstInstance * getInstanceSize());
+		glDrawElementsInstancedBaseVertex(
+			GL_TRIANGLES,
+			(GLsizei)_range.indexCount,
+			GL_UNSIGNED_INT,
+			indexOffset(_range.firstIndex),
+			(GLsizei)_instanceCount,
+			(GLint)_range.firstVertex
+		);
+	}
+
+	void multiDrawGeometry(
+		const geometryRange *_ranges,
+		const uint32_t _drawCount,
+		const uint32_t _instance
+	) noexcept
 	{
-		// Glad: load all OpenGL function pointers
-		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-		{	return false; }
-		l_gladLoaded = true;
-		glEnable(GL_DEPTH_TEST);
-		return true;
+		if (_drawCount == 0U)
+		{	return; }
+
+		// Kept between calls so drawing does not allocate
+		static std::vector<GLsizei> counts;
+		static std::vector<const void*> offsets;
+		static std::vector<GLint> baseVertices;
+		counts.resize(_drawCount);
+		offsets.resize(_drawCount);
+		baseVertices.resize(_drawCount);
+		for (uint32_t i = 0; i < _drawCount; ++i)
+		{
+			assert(_ranges[i].idVAO == _ranges[0].idVAO && "Multi draws must share an arena");
+			counts[i] = (GLsizei)_ranges[i].indexCount;
+			offsets[i] = indexOffset(_ranges[i].firstIndex);
+			baseVertices[i] = (GLint)_ranges[i].firstVertex;
+		}
+
+		bindVertexArray(drawVertexArray(_ranges[0].idVAO));
+		// Every draw reads the same single instance
+		pointInstanceAttributes((uint64_t)_instance * getInstanceSize());
+		glMultiDrawElementsBaseVertex(
+			GL_TRIANGLES,
+			counts.data(),
+			GL_UNSIGNED_INT,
+			offsets.data(),
+			(GLsizei)_drawCount,
+			baseVertices.data()
+		);
+		// Draws with a base instance count from the start of the buffer
+		pointInstanceAttributes(0U);
 	}
 
-	bool getGladLoaded() noexcept
-	{	return l_gladLoaded; }
+	bool supportsIndirectDraw() noexcept
+	{	return l_glMultiDrawElementsIndirect != nullptr; }
 
-	void clearScreenBuffers() noexcept
+	drawCommand *mapDrawCommands(const uint32_t _count) noexcept
 	{
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		const streamAllocation space = streamAllocate(_count * (uint32_t)sizeof(drawCommand), 4U);
+		l_idCommandSource = space.idBuffer;
+		l_commandOffset = space.offset;
+		return (drawCommand*)space.data;
 	}
 
-	void setClearColour(
-		const float _r,
-		const float _g,
-		const float _b,
-		const float _a
+	void getDrawCommandSource(uint32_t *_outIdBuffer, uint32_t *_outOffset) noexcept
+	{
+		*_outIdBuffer = l_idCommandSource;
+		*_outOffset = l_commandOffset;
+	}
+
+	void multiDrawIndirect(
+		const uint32_t _idVAO,
+		const uint32_t _firstCommand,
+		const uint32_t _commandCount
 	) noexcept
-	{	glClearColor((GLfloat)_r, (GLfloat)_g, (GLfloat)_b, (GLfloat)_a); }
+	{
+		assert(l_glMultiDrawElementsIndirect && "Check supportsIndirectDraw first");
+		bindVertexArray(drawVertexArray(_idVAO));
+		bindIndirectBuffer(l_idCommandSource);
+		l_glMultiDrawElementsIndirect(
+			GL_TRIANGLES,
+			GL_UNSIGNED_INT,
+			(const void*)((uintptr_t)l_commandOffset + _firstCommand * sizeof(drawCommand)),
+			(GLsizei)_commandCount,
+			0
+		);
+	}
 
-	void setRenderMode(const int _mode) noexcept
+	// Occlusion query
+
+	uint32_t createQuery() noexcept
 	{
-		assert(_mode < 3);
-		glPolygonMode(GL_FRONT_AND_BACK, GL_POINT + _mode);
+		uint32_t id;
+		glGenQueries(1, &id);
+		return id;
 	}
 
-	void setResolution(const size_t _width, const size_t _height) noexcept
-	{	glViewport(0, 0, (GLsizei)_width, (GLsizei)_height); }
+	void deleteQueries(const uint32_t *_idQueries, const uint32_t _count) noexcept
+	{	glDeleteQueries(_count, _idQueries); }
 
-	// Mesh
+	void beginOcclusionQuery(const uint32_t _idQuery) noexcept
+	{	glBeginQuery(GL_ANY_SAMPLES_PASSED, _idQuery); }
 
-	void setupMesh(
-		uint32_t *_outIdVAO,
-		uint32_t *_outIdVBO,
-		uint32_t *_outIdEBO,
-		const float *_vertices,
-		const uint32_t *_indices,
-		const uint32_t _verticesByteSize,
-		const uint32_t _indicesByteSize,
-		const uint32_t _vertexSize,
-		uint64_t _normalOffset,
-		uint64_t _texCoordOffset
-	) noexcept
+	void endOcclusionQuery() noexcept
+	{	glEndQuery(GL_ANY_SAMPLES_PASSED); }
+
+	bool isQueryResultAvailable(const uint32_t _idQuery) noexcept
 	{
-		// Creates and assigns to an id the Vertex Array Object, Vertex Buffer Object, and Element Buffer Object
-		// Arguments are number of objects to generate, and an array of uints to have the ids stored in
-		glGenVertexArrays(1, _outIdVAO);
-		glGenBuffers(1, _outIdVBO);
-		glGenBuffers(1, _outIdEBO);
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(_idQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+		return available == GL_TRUE;
+	}
 
-		// Binds the vertex array so that the VBO and EBO are neatly stored within
-		glBindVertexArray(*_outIdVAO);
+	bool getQueryAnySamples(const uint32_t _idQuery) noexcept
+	{
+		GLuint result = GL_FALSE;
+		glGetQueryObjectuiv(_idQuery, GL_QUERY_RESULT, &result);
+		return result != GL_FALSE;
+	}
 
-		// GL_ARRAY_BUFFER effectively works like a pointer, using the id provided to point to the buffer
-		glBindBuffer(GL_ARRAY_BUFFER, *_outIdVBO);
-		// Loads the vertices to the VBO
-		glBufferData(GL_ARRAY_BUFFER, (GLsizei)_verticesByteSize, _vertices, GL_STATIC_DRAW);
+	void beginConditionalRender(const uint32_t _idQuery) noexcept
+	{	glBeginConditionalRender(_idQuery, GL_QUERY_NO_WAIT); }
 
-		/*GL_STREAM_DRAW: the data is set only once and used by the GPU at most a few times.
-		* GL_STATIC_DRAW: the data is set only once and used many times.
-		*GL_DYNAMIC_DRAW: the data is changed a lot and used many times.
-		*/
+	void endConditionalRender() noexcept
+	{	glEndConditionalRender(); }
 
-		// This buffer stores the indices that reference the elements of the VBO
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, *_outIdEBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizei)_indicesByteSize, _indices, GL_STATIC_DRAW);
+	// Timer query
 
-		/*Tells the shader how to use the vertex data provided
-		* p1: Which vertex attribute we want to configure in the vertex shader (location = 0)
-		* p2: Vertex size (vec3)
-		* p3: The type of data (vec is using floats)
-		* p4: Whether we want to normalise the data
-		* p5: Stride, how big each chunk of data is
-		* p6: Offset, for some reason a void*
-		*/
-		// Position attribute
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, _vertexSize, (void*)0);
-		// Normal attribute
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, _vertexSize, (void*)_normalOffset);
-		// Texcoord attribute
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, _vertexSize, (void*)_texCoordOffset);
+	void beginTimerQuery(const uint32_t _idQuery) noexcept
+	{	glBeginQuery(GL_TIME_ELAPSED, _idQuery); }
+
+	void endTimerQuery() noexcept
+	{	glEndQuery(GL_TIME_ELAPSED); }
 
-		// Unbinds the vertex array
-		glBindVertexArray(0);
-		// Unbinds the GL_ARRAY_BUFFER
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		// Unbinds the GL_ELEMENT_ARRAY_BUFFER
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	uint64_t getQueryNanoseconds(const uint32_t _idQuery) noexcept
+	{
+		GLuint64 result = 0U;
+		glGetQueryObjectui64v(_idQuery, GL_QUERY_RESULT, &result);
+		return (uint64_t)result;
 	}
 
-	void deleteMesh(
-		const uint32_t _idVAO,
-		const uint32_t _idVBO,
-		const uint32_t _idEBO
+	// Compute
+
+	/** The depth of the default framebuffer is copied through this, made the first time it is needed. */
+	uint32_t l_idCopyFBO = 0U;
+
+	bool supportsCompute() noexcept
+	{	return l_glDispatchCompute && l_glMemoryBarrier && l_glBindImageTexture; }
+
+	uint32_t createComputeShader() noexcept
+	{	return glCreateShader(GL_COMPUTE_SHADER); }
+
+	uint32_t createComputeProgram(uint32_t _idCompute) noexcept
+	{
+		const uint32_t idProgram = glCreateProgram();
+		glAttachShader(idProgram, _idCompute);
+		glLinkProgram(idProgram);
+		return idProgram;
+	}
+
+	void dispatchCompute(const uint32_t _groupsX, const uint32_t _groupsY) noexcept
+	{
+		assert(l_glDispatchCompute && "Check supportsCompute first");
+		l_glDispatchCompute(_groupsX, _groupsY, 1U);
+	}
+
+	void waitForComputeWrites() noexcept
+	{
+		l_glMemoryBarrier(
+			GL_COMMAND_BARRIER_BIT
+			| GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+			| GL_SHADER_STORAGE_BARRIER_BIT
+			| GL_TEXTURE_FETCH_BARRIER_BIT
+			| GL_SHADER_IMAGE_ACCESS_BARRIER_BIT
+		);
+	}
+
+	uint32_t createStorageBuffer(const uint32_t _byteSize) noexcept
+	{
+		uint32_t idBuffer;
+		glGenBuffers(1, &idBuffer);
+		bindArrayBuffer(idBuffer);
+		// Written and read by the GPU only
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)_byteSize, NULL, GL_DYNAMIC_COPY);
+		return idBuffer;
+	}
+
+	void bindStorageBuffer(const uint32_t _binding, const uint32_t _idBuffer) noexcept
+	{	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, _binding, _idBuffer); }
+
+	void bindImageLevel(
+		const uint32_t _unit,
+		const uint32_t _idTex,
+		const uint32_t _level,
+		const bool _write
 	) noexcept
+	{	l_glBindImageTexture(_unit, _idTex, (GLint)_level, GL_FALSE, 0, _write ? GL_WRITE_ONLY : GL_READ_ONLY, GL_R32F); }
+
+	uint32_t createFloatTexture(const uint32_t _width, const uint32_t _height, const uint32_t _levels) noexcept
 	{
-		if (l_gladLoaded)
+		uint32_t idTex;
+		glGenTextures(1, &idTex);
+		bindTexture2D(idTex);
+		// Every level is defined, so the texture is complete whichever one is read
+		for (uint32_t level = 0, width = _width, height = _height; level < _levels; ++level)
 		{
-			glDeleteVertexArrays(1, &_idVAO);
-			glDeleteBuffers(1, &_idVBO);
-			glDeleteBuffers(1, &_idEBO);
+			glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_R32F, (GLsizei)width, (GLsizei)height, 0, GL_RED, GL_FLOAT, NULL);
+			width = std::max(1U, (width + 1U) / 2U);
+			height = std::max(1U, (height + 1U) / 2U);
 		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)_levels - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		return idTex;
 	}
 
-	void drawElements(const uint32_t _idVAO, const uint32_t _size) noexcept
+	uint32_t createDepthTexture(const uint32_t _width, const uint32_t _height) noexcept
 	{
-		glBindVertexArray(_idVAO);
-		glDrawElements(
-			GL_TRIANGLES,
-			(GLsizei)_size,
-			GL_UNSIGNED_INT,
+		// A depth blit needs the same format on both sides, so match the default framebuffer
+		GLint depthBits = 24, stencilBits = 0;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_DEPTH, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthBits);
+		glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_STENCIL, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencilBits);
+		glBindFramebuffer(GL_FRAMEBUFFER, l_idSceneFBO);
+		GLenum format = GL_DEPTH_COMPONENT24, type = GL_UNSIGNED_INT;
+		GLenum dataFormat = GL_DEPTH_COMPONENT;
+		if (stencilBits > 0)
+		{
+			format = depthBits == 32 ? GL_DEPTH32F_STENCIL8 : GL_DEPTH24_STENCIL8;
+			type = depthBits == 32 ? GL_FLOAT_32_UNSIGNED_INT_24_8_REV : GL_UNSIGNED_INT_24_8;
+			dataFormat = GL_DEPTH_STENCIL;
+		}
+		else if (depthBits == 32)
+		{
+			format = GL_DEPTH_COMPONENT32F;
+			type = GL_FLOAT;
+		}
+		else if (depthBits == 16)
+		{	format = GL_DEPTH_COMPONENT16; }
+
+		uint32_t idTex;
+		glGenTextures(1, &idTex);
+		bindTexture2D(idTex);
+		glTexImage2D(GL_TEXTURE_2D, 0, format, (GLsizei)_width, (GLsizei)_height, 0, dataFormat, type, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		return idTex;
+	}
+
+	bool copyDepthToTexture(const uint32_t _idTex, const uint32_t _width, const uint32_t _height) noexcept
+	{
+		if (!l_idCopyFBO)
+		{	glGenFramebuffers(1, &l_idCopyFBO); }
+		// Clears any earlier error, so the check below only sees the blit
+		while (glGetError() != GL_NO_ERROR) {}
+
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, l_idCopyFBO);
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, _idTex, 0);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, l_idSceneFBO);
+		glBlitFramebuffer(
+			0, 0, (GLint)_width, (GLint)_height,
+			0, 0, (GLint)_width, (GLint)_height,
+			GL_DEPTH_BUFFER_BIT, GL_NEAREST
+		);
+		glBindFramebuffer(GL_FRAMEBUFFER, l_idSceneFBO);
+		return glGetError() == GL_NO_ERROR;
+	}
+
+	void releaseCompute() noexcept
+	{
+		if (l_idCopyFBO)
+		{
+			glDeleteFramebuffers(1, &l_idCopyFBO);
+			l_idCopyFBO = 0U;
+		}
+	}
+
+	// Render target
+
+	/** Core profile draws need a vertex array bound, even one without any attributes. */
+	uint32_t l_idEmptyVAO = 0U;
+
+	uint32_t createTargetTexture(const uint32_t _width, const uint32_t _height, const targetFormat _format) noexcept
+	{
+		uint32_t idTex;
+		glGenTextures(1, &idTex);
+		bindTexture2D(idTex);
+		const GLenum format = _format == targetFormat::rgba16 ? GL_RGBA16 : GL_RGBA8;
+		const GLenum type = _format == targetFormat::rgba16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+		glTexImage2D(GL_TEXTURE_2D, 0, format, (GLsizei)_width, (GLsizei)_height, 0, GL_RGBA, type, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		return idTex;
+	}
+
+	uint32_t createShadowTexture(const uint32_t _size) noexcept
+	{
+		uint32_t idTex;
+		glGenTextures(1, &idTex);
+		bindTexture2D(idTex);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, (GLsizei)_size, (GLsizei)_size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		// Linear filtering on a compared texture blends the results of four comparisons, not four depths
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		return idTex;
+	}
+
+	uint32_t createFramebuffer(
+		const uint32_t *_idColours,
+		const uint32_t _colourCount,
+		const uint32_t _idDepth
+	) noexcept
+	{
+		assert(_colourCount <= 8U && "GL only promises 8 draw buffers");
+
+		// A depth texture with stencil has to be attached as both
+		GLint stencilBits = 0;
+		bindTexture2D(_idDepth);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_STENCIL_SIZE, &stencilBits);
+
+		uint32_t idFBO;
+		glGenFramebuffers(1, &idFBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, idFBO);
+		GLenum drawBuffers[8];
+		for (uint32_t i = 0; i < _colourCount; ++i)
+		{
+			drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+			glFramebufferTexture2D(GL_FRAMEBUFFER, drawBuffers[i], GL_TEXTURE_2D, _idColours[i], 0);
+		}
+		glFramebufferTexture2D(
+			GL_FRAMEBUFFER,
+			stencilBits > 0 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT,
+			GL_TEXTURE_2D,
+			_idDepth,
 			0
 		);
-		//glBindVertexArray(0);
+		if (_colourCount > 0U)
+		{	glDrawBuffers((GLsizei)_colourCount, drawBuffers); }
+		else
+		{
+			// Without these a framebuffer with no colour is incomplete on some drivers
+			glDrawBuffer(GL_NONE);
+			glReadBuffer(GL_NONE);
+		}
+
+		const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		glBindFramebuffer(GL_FRAMEBUFFER, l_idSceneFBO);
+		if (!complete)
+		{
+			glDeleteFramebuffers(1, &idFBO);
+			return 0U;
+		}
+		return idFBO;
+	}
+
+	void deleteFramebuffer(const uint32_t _idFBO) noexcept
+	{	glDeleteFramebuffers(1, &_idFBO); }
+
+	void bindFramebuffer(const uint32_t _idFBO) noexcept
+	{	glBindFramebuffer(GL_FRAMEBUFFER, _idFBO ? _idFBO : l_idSceneFBO); }
+
+	void setSceneTarget(const uint32_t _idFBO, const uint32_t _width, const uint32_t _height) noexcept
+	{
+		readFirstViewport();
+		l_idSceneFBO = _idFBO;
+		l_viewportWidth = _idFBO ? _width : l_windowWidth;
+		l_viewportHeight = _idFBO ? _height : l_windowHeight;
+		glBindFramebuffer(GL_FRAMEBUFFER, l_idSceneFBO);
+		glViewport(0, 0, (GLsizei)l_viewportWidth, (GLsizei)l_viewportHeight);
+	}
+
+	uint32_t getSceneTarget() noexcept
+	{	return l_idSceneFBO; }
+
+	void presentSceneTarget() noexcept
+	{
+		if (!l_idSceneFBO)
+		{	return; }
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, l_idSceneFBO);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glBlitFramebuffer(
+			0, 0, (GLint)l_viewportWidth, (GLint)l_viewportHeight,
+			0, 0, (GLint)l_windowWidth, (GLint)l_windowHeight,
+			GL_COLOR_BUFFER_BIT, GL_LINEAR
+		);
+		glBindFramebuffer(GL_FRAMEBUFFER, l_idSceneFBO);
+	}
+
+	void clearTargets(const uint32_t _colourCount) noexcept
+	{
+		const GLfloat zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		const GLfloat far = 1.0f;
+		for (uint32_t i = 0; i < _colourCount; ++i)
+		{	glClearBufferfv(GL_COLOR, (GLint)i, zero); }
+		glClearBufferfv(GL_DEPTH, 0, &far);
+	}
+
+	void clearDepthRect(const uint32_t _x, const uint32_t _y, const uint32_t _width, const uint32_t _height) noexcept
+	{
+		// Clears ignore the viewport, only the scissor keeps them in the rectangle
+		const GLfloat far = 1.0f;
+		glEnable(GL_SCISSOR_TEST);
+		glScissor((GLint)_x, (GLint)_y, (GLsizei)_width, (GLsizei)_height);
+		glClearBufferfv(GL_DEPTH, 0, &far);
+		glDisable(GL_SCISSOR_TEST);
+	}
+
+	void copyDepthRect(
+		const uint32_t _idFrom,
+		const uint32_t _idTo,
+		const uint32_t _x,
+		const uint32_t _y,
+		const uint32_t _width,
+		const uint32_t _height
+	) noexcept
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, _idFrom ? _idFrom : l_idSceneFBO);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _idTo ? _idTo : l_idSceneFBO);
+		glBlitFramebuffer(
+			(GLint)_x, (GLint)_y, (GLint)(_x + _width), (GLint)(_y + _height),
+			(GLint)_x, (GLint)_y, (GLint)(_x + _width), (GLint)(_y + _height),
+			GL_DEPTH_BUFFER_BIT, GL_NEAREST
+		);
+		glBindFramebuffer(GL_FRAMEBUFFER, l_idSceneFBO);
+	}
+
+	void copyColourRect(
+		const uint32_t _idFrom,
+		const uint32_t _idTo,
+		const uint32_t _x,
+		const uint32_t _y,
+		const uint32_t _width,
+		const uint32_t _height
+	) noexcept
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, _idFrom ? _idFrom : l_idSceneFBO);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _idTo ? _idTo : l_idSceneFBO);
+		glBlitFramebuffer(
+			(GLint)_x, (GLint)_y, (GLint)(_x + _width), (GLint)(_y + _height),
+			(GLint)_x, (GLint)_y, (GLint)(_x + _width), (GLint)(_y + _height),
+			GL_COLOR_BUFFER_BIT, GL_NEAREST
+		);
+		glBindFramebuffer(GL_FRAMEBUFFER, l_idSceneFBO);
+	}
+
+	void blitDepthToScreen(const uint32_t _idFBO, const uint32_t _width, const uint32_t _height) noexcept
+	{	copyDepthRect(_idFBO, 0U, 0U, 0U, _width, _height); }
+
+	void drawFullscreenTriangle() noexcept
+	{
+		if (!l_idEmptyVAO)
+		{	glGenVertexArrays(1, &l_idEmptyVAO); }
+		bindVertexArray(l_idEmptyVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+
+	void releaseTargets() noexcept
+	{
+		if (l_idEmptyVAO)
+		{
+			bindVertexArray(0U);
+			glDeleteVertexArrays(1, &l_idEmptyVAO);
+			l_idEmptyVAO = 0U;
+		}
+	}
+
+	// Uniform buffer
+
+	uint32_t createUniformBuffer(const uint32_t _byteSize) noexcept
+	{
+		uint32_t idUBO;
+		glGenBuffers(1, &idUBO);
+		bindUniformBuffer(idUBO);
+		// Contents change often but are read by every draw
+		glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)_byteSize, NULL, GL_DYNAMIC_DRAW);
+		return idUBO;
+	}
+
+	void updateUniformBuffer(
+		const uint32_t _idUBO,
+		const uint32_t _offset,
+		const uint32_t _byteSize,
+		const void *_data
+	) noexcept
+	{
+		bindUniformBuffer(_idUBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, (GLintptr)_offset, (GLsizeiptr)_byteSize, _data);
+	}
+
+	void bindUniformBufferRange(
+		const uint32_t _binding,
+		const uint32_t _idUBO,
+		const uint32_t _offset,
+		const uint32_t _byteSize
+	) noexcept
+	{
+		glBindBufferRange(GL_UNIFORM_BUFFER, _binding, _idUBO, (GLintptr)_offset, (GLsizeiptr)_byteSize);
+		// Binding to an indexed point also sets the generic binding
+		l_state.uniformBuffer = _idUBO;
+	}
+
+	void deleteBuffer(const uint32_t _idBuffer) noexcept
+	{
+		if (l_gladLoaded)
+		{
+			glDeleteBuffers(1, &_idBuffer);
+			forgetDeleted(l_state.arrayBuffer, _idBuffer);
+			forgetDeleted(l_state.elementBuffer, _idBuffer);
+			forgetDeleted(l_state.uniformBuffer, _idBuffer);
+			forgetDeleted(l_state.indirectBuffer, _idBuffer);
+		}
+	}
+
+	uint32_t getUniformBufferOffsetAlignment() noexcept
+	{
+		GLint alignment = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		// The spec caps the value at 256
+		return alignment > 0 ? (uint32_t)alignment : 256U;
 	}
 
 	// Texture
@@ -141,6 +1699,13 @@ namespace renderer
 		if (_num > 31)
 		{	return; }
 
+		if (l_state.activeTexture == _num)
+		{
+			++l_stats.skipped;
+			return;
+		}
+		l_state.activeTexture = _num;
+		++l_stats.issued;
 		glActiveTexture(GL_TEXTURE0 + _num);
 	}
 
@@ -148,7 +1713,18 @@ namespace renderer
 	{	glGenTextures(1, _outIdTex); }
 
 	void bindTexture2D(uint32_t _idTex) noexcept
-	{	glBindTexture(GL_TEXTURE_2D, _idTex); }
+	{
+		// Unknown unit, can't be tracked
+		if (l_state.activeTexture > 31)
+		{
+			++l_stats.issued;
+			glBindTexture(GL_TEXTURE_2D, _idTex);
+			return;
+		}
+
+		if (trackState(l_state.textures[l_state.activeTexture], _idTex))
+		{	glBindTexture(GL_TEXTURE_2D, _idTex); }
+	}
 
 	void setBorderColour(float *_arr) noexcept
 	{	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, _arr); }
@@ -200,7 +1776,54 @@ namespace renderer
 	void deleteTextures(const uint32_t *_textureIds, const uint32_t _textureCount) noexcept
 	{
 		if (l_gladLoaded)
-		{	glDeleteTextures(_textureCount, _textureIds); }
+		{
+			glDeleteTextures(_textureCount, _textureIds);
+			for (uint32_t i = 0; i < _textureCount; ++i)
+			{
+				for (uint32_t &tex : l_state.textures)
+				{	forgetDeleted(tex, _textureIds[i]); }
+			}
+		}
+	}
+
+	// Texture buffer
+
+	uint32_t createTextureBuffer(const bufferFormat _format, uint32_t *_outIdBuffer) noexcept
+	{
+		glGenBuffers(1, _outIdBuffer);
+		bindArrayBuffer(*_outIdBuffer);
+		// Never left without storage, a texture buffer over nothing is incomplete
+		glBufferData(GL_ARRAY_BUFFER, 16, NULL, GL_STREAM_DRAW);
+
+		uint32_t idTex;
+		glGenTextures(1, &idTex);
+		glBindTexture(GL_TEXTURE_BUFFER, idTex);
+		const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[(uint8_t)_format], *_outIdBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		return idTex;
+	}
+
+	void updateTextureBuffer(const uint32_t _idBuffer, const uint32_t _byteSize, const void *_data) noexcept
+	{
+		bindArrayBuffer(_idBuffer);
+		const GLsizeiptr size = (GLsizeiptr)std::max(_byteSize, 16U);
+		glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+		if (_byteSize)
+		{	glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)_byteSize, _data); }
+	}
+
+	void bindTextureBuffer(const uint8_t _unit, const uint32_t _idTex) noexcept
+	{
+		setActiveTexture(_unit);
+		glBindTexture(GL_TEXTURE_BUFFER, _idTex);
+	}
+
+	uint32_t getMaxTextureBufferSize() noexcept
+	{
+		GLint size = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &size);
+		return size > 0 ? (uint32_t)size : 65536U;
 	}
 
 	// Shader
@@ -211,6 +1834,9 @@ namespace renderer
 		// Link the vertex and fragment shaders
 		glAttachShader(idProgram, _idVertex);
 		glAttachShader(idProgram, _idFragment);
+		// Must be set before linking for the binary to be retrievable afterwards
+		if (l_programBinarySupported)
+		{	l_glProgramParameteri(idProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE); }
 		glLinkProgram(idProgram);
 		return idProgram;
 	}
@@ -222,7 +1848,10 @@ namespace renderer
 	{	return glCreateShader(GL_FRAGMENT_SHADER); }
 
 	void useShaderProgram(uint32_t _idProgram) noexcept
-	{	glUseProgram(_idProgram); }
+	{
+		if (trackState(l_state.program, _idProgram))
+		{	glUseProgram(_idProgram); }
+	}
 
 	void loadShaderSource(uint32_t _idShader, const char *_code) noexcept
 	{	glShaderSource(_idShader, 1, &_code, NULL); }
@@ -253,15 +1882,108 @@ namespace renderer
 	void deleteShaderProgram(const uint32_t _idProgram) noexcept
 	{
 		if (l_gladLoaded)
-		{	glDeleteProgram(_idProgram); }
+		{
+			glDeleteProgram(_idProgram);
+			// A program in use is only flagged for deletion and stays bound
+			if (l_state.program == _idProgram)
+			{	l_state.program = unknownState(); }
+		}
 	}
 
 	void deleteShader(const uint32_t _idShader) noexcept
 	{	glDeleteShader(_idShader); }
 
+	bool supportsParallelCompile() noexcept
+	{	return l_parallelCompileSupported; }
+
+	bool isProgramComplete(const uint32_t _idProgram) noexcept
+	{
+		// Without the extension any status query waits for the driver, so it counts as done
+		if (!l_parallelCompileSupported)
+		{	return true; }
+
+		GLint complete = GL_FALSE;
+		glGetProgramiv(_idProgram, GL_COMPLETION_STATUS_KHR, &complete);
+		return complete == GL_TRUE;
+	}
+
+	bool supportsProgramBinary() noexcept
+	{	return l_programBinarySupported; }
+
+	bool getProgramBinary(
+		const uint32_t _idProgram,
+		std::vector<uint8_t> *_outData,
+		uint32_t *_outFormat
+	) noexcept
+	{
+		if (!l_programBinarySupported)
+		{	return false; }
+
+		GLint length = 0;
+		glGetProgramiv(_idProgram, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+		{	return false; }
+
+		_outData->resize((size_t)length);
+		GLenum format = 0;
+		l_glGetProgramBinary(_idProgram, length, &length, &format, _outData->data());
+		_outData->resize((size_t)length);
+		*_outFormat = (uint32_t)format;
+		return length > 0;
+	}
+
+	uint32_t createShaderProgramFromBinary(
+		const uint32_t _format,
+		const void *_data,
+		const uint32_t _byteSize
+	) noexcept
+	{
+		if (!l_programBinarySupported)
+		{	return 0U; }
+
+		uint32_t idProgram = glCreateProgram();
+		l_glProgramBinary(idProgram, (GLenum)_format, _data, (GLsizei)_byteSize);
+		// A driver update or different gpu makes old binaries fail to "link"
+		GLint success = 0;
+		glGetProgramiv(idProgram, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glDeleteProgram(idProgram);
+			return 0U;
+		}
+		return idProgram;
+	}
+
+	void setUniformBlockBinding(uint32_t _idProgram, const char *_blockName, uint32_t _binding) noexcept
+	{
+		GLuint index = glGetUniformBlockIndex(_idProgram, _blockName);
+		if (index == GL_INVALID_INDEX)
+		{	return; }
+		glUniformBlockBinding(_idProgram, index, _binding);
+	}
+
 	int32_t getUniformLocation(uint32_t _idProgram, const char *_name) noexcept
 	{	return glGetUniformLocation(_idProgram, _name); }
 
+	uint32_t getActiveUniformCount(uint32_t _idProgram) noexcept
+	{
+		GLint count = 0;
+		glGetProgramiv(_idProgram, GL_ACTIVE_UNIFORMS, &count);
+		return (uint32_t)count;
+	}
+
+	void getActiveUniform(
+		uint32_t _idProgram,
+		uint32_t _index,
+		char *_outName,
+		uint16_t _nameSize,
+		int32_t *_outArraySize
+	) noexcept
+	{
+		GLenum type;
+		glGetActiveUniform(_idProgram, _index, _nameSize, NULL, _outArraySize, &type, _outName);
+	}
+
 	void setBool(uint32_t _idProgram, int32_t _location, bool _value) noexcept
 	{
 		useShaderProgram(_idProgram);
@@ -274,6 +1996,12 @@ namespace renderer
 		glUniform1i(_location, (int32_t)_value);
 	}
 
+	void setInt2(uint32_t _idProgram, int32_t _location, const int32_t *_value) noexcept
+	{
+		useShaderProgram(_idProgram);
+		glUniform2iv(_location, 1, _value);
+	}
+
 	void setUint(uint32_t _idProgram, int32_t _location, uint32_t _value) noexcept
 	{
 		useShaderProgram(_idProgram);
@@ -286,31 +2014,31 @@ namespace renderer
 		glUniform1f(_location, _value);
 	}
 
-	void setFloat2(uint32_t _idProgram, int32_t _location, float *_value) noexcept
+	void setFloat2(uint32_t _idProgram, int32_t _location, const float *_value) noexcept
 	{
 		useShaderProgram(_idProgram);
 		glUniform2fv(_location, 1, _value);
 	}
 
-	void setFloat3(uint32_t _idProgram, int32_t _location, float *_value) noexcept
+	void setFloat3(uint32_t _idProgram, int32_t _location, const float *_value) noexcept
 	{
 		useShaderProgram(_idProgram);
 		glUniform3fv(_location, 1, _value);
 	}
 
-	void setFloat4(uint32_t _idProgram, int32_t _location, float *_value) noexcept
+	void setFloat4(uint32_t _idProgram, int32_t _location, const float *_value) noexcept
 	{
 		useShaderProgram(_idProgram);
 		glUniform4fv(_location, 1, _value);
 	}
 
-	void setMat3(uint32_t _idProgram, int32_t _location, float *_value) noexcept
+	void setMat3(uint32_t _idProgram, int32_t _location, const float *_value) noexcept
 	{
 		useShaderProgram(_idProgram);
 		glUniformMatrix3fv(_location, 1, GL_FALSE, _value);
 	}
 
-	void setMat4(uint32_t _idProgram, int32_t _location, float *_value) noexcept
+	void setMat4(uint32_t _idProgram, int32_t _location, const float *_value) noexcept
 	{
 		useShaderProgram(_idProgram);
 		glUniformMatrix4fv(_location, 1, GL_FALSE, _value);
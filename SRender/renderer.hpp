@@ -1,6 +1,9 @@
 /** Designed to be the one stop shop for swapping renderer libraries */
+#pragma once
 #include <cstdint>
 #include <cstddef>
+#include <string>
+#include <vector>
 
 #ifndef _NODISCARD
 #define _NODISCARD [[nodiscard]]
@@ -11,8 +14,11 @@ namespace srender
 /** Interface for the rendering backend */
 namespace renderer
 {
+	/** Loads all core functions, as well as any optional extensions the driver offers. */
 	_NODISCARD bool loadGlad() noexcept;
 	_NODISCARD bool getGladLoaded() noexcept;
+	/** Vendor, renderer and version of the driver, anything built by the driver is only valid for this. */
+	_NODISCARD std::string getDriverString() noexcept;
 	void clearScreenBuffers() noexcept;
 	void setClearColour(
 		const float _r,
@@ -21,28 +27,353 @@ namespace renderer
 		const float _a = 1.0f
 	) noexcept;
 	void setRenderMode(const int _mode) noexcept;
+	/** Sets the size of the window, which is also the viewport unless a scene target is set. */
 	void setResolution(const size_t _width, const size_t _height) noexcept;
+	/** The size of the area being drawn to, as last set by setResolution, setSceneTarget or the window. */
+	void getViewportSize(uint32_t *_outWidth, uint32_t *_outHeight) noexcept;
+	/** The size of the window, as last set by setResolution or the window itself. */
+	void getWindowSize(uint32_t *_outWidth, uint32_t *_outHeight) noexcept;
+	/** Turns writing to every colour channel on or off, depth testing still happens. */
+	void setColourWrites(const bool _state) noexcept;
+	void setDepthWrites(const bool _state) noexcept;
+	/** Only lets fragments through at exactly the depth already stored, for drawing over a depth prepass. */
+	void setDepthEqual(const bool _state) noexcept;
+	/** Draws into part of the bound framebuffer only, in pixels from its bottom left.
+	 * @note Unlike setResolution this is not remembered, set the full size back afterwards.
+	 */
+	void setViewportRect(const uint32_t _x, const uint32_t _y, const uint32_t _width, const uint32_t _height) noexcept;
+	/** Pushes the depth of filled triangles away from the viewer, by _slope times how steep each one is plus _constant depth steps.
+	 * @note 0 for both turns it off.
+	 */
+	void setDepthBias(const float _slope, const float _constant) noexcept;
+
+	// State
+
+	/** Counters for the shadow-state layer, any bind that would not change the GL state is skipped. */
+	struct stateStats
+	{
+		uint64_t issued = 0U;	// Calls that reached the driver
+		uint64_t skipped = 0U;	// Calls that were redundant and never made
+	};
+
+	_NODISCARD stateStats getStateStats() noexcept;
+	void resetStateStats() noexcept;
+	/** Forgets all tracked state so the next bind of anything is issued.
+	 * @note Must be called if the GL state is modified outside of the renderer.
+	 */
+	void invalidateStateCache() noexcept;
+
+	// Stream
+
+	/** How many frames of streamed data can exist at once, each gets its own part of the stream buffer. */
+	_NODISCARD constexpr uint32_t maxFramesInFlight() { return 3U; }
+
+	/** Space in the stream buffer, only valid for the frame it was made in. */
+	struct streamAllocation
+	{
+		void *data = nullptr;	// Write only, reading it back can be very slow
+		uint32_t idBuffer = 0U;	// Can change between allocations if the stream grows
+		uint32_t offset = 0U;	// Bytes from the start of idBuffer
+	};
+
+	/** Starts a frame of streamed data, waiting if the GPU still reads the space it will reuse. */
+	void beginStreamFrame() noexcept;
+	/** Makes room for data that only lives for this frame, growing the buffer if the frame needs more.
+	 * @param _alignment Offset from the start of the buffer is a multiple of this, need not be a power of two.
+	 * @note Data stays valid for the whole frame, even if the stream grows, but only reaches the GPU by the next flushStream.
+	 */
+	_NODISCARD streamAllocation streamAllocate(const uint32_t _byteSize, const uint32_t _alignment = 16U) noexcept;
+	/** Sends what has been written so far to the GPU, only does anything without persistent mapping.
+	 * @note Call after writing and before the draws that read it.
+	 */
+	void flushStream() noexcept;
+	/** Fences the frame so its space is not reused before the GPU is done with it. */
+	void endStreamFrame() noexcept;
+	/** True if GL_ARB_buffer_storage is usable, core since GL 4.4, otherwise the stream is orphaned each frame. */
+	_NODISCARD bool supportsPersistentMapping() noexcept;
+	void releaseStream() noexcept;
+
+	// Frame pacing
+
+	/** Waits until no more than _limit - 1 frames are still queued on the GPU, so the next one can start.
+	 * @param _limit From 1 to maxFramesInFlight, 1 waits for the GPU to finish the last frame.
+	 */
+	void waitForFramesInFlight(const uint32_t _limit) noexcept;
+	/** Marks the end of a frame, call right after swapping buffers. */
+	void fenceFrame() noexcept;
+	void releaseFrameFences() noexcept;
 
 	// Mesh
 
-	void setupMesh(
-		uint32_t *_outIdVAO,
-		uint32_t *_outIdVBO,
-		uint32_t *_outIdEBO,
+	/** Where a mesh lives in the shared geometry buffers of its vertex format. */
+	struct geometryRange
+	{
+		uint32_t idVAO = 0U;	// Shared by every mesh of the same vertex format
+		uint32_t firstVertex = 0U;	// Added to every index when drawing
+		uint32_t vertexCount = 0U;
+		uint32_t firstIndex = 0U;
+		uint32_t indexCount = 0U;
+	};
+
+	struct geometryStats
+	{
+		uint32_t ranges = 0U;	// Meshes currently allocated
+		uint32_t bytesInUse = 0U;
+		uint32_t bytesReserved = 0U;	// Size of every geometry buffer together
+		float fragmentation = 0.0f;	// 0 when the free space of each buffer is one range, towards 1 as it splinters
+	};
+
+	/** Bytes per vertex of the position stream, an xyz position and nothing else. */
+	_NODISCARD constexpr uint32_t getPositionSize() { return 3U * sizeof(float); }
+	/** Copies a mesh into the shared buffers for its vertex format, growing them if needed.
+	 * @param _positions The positions of _vertices again, tightly packed as getPositionSize, for depth only draws.
+	 * @param _indices Relative to the first of _vertices.
+	 * @return [uint32_t] A handle for the mesh, its range can move so look it up with getGeometryRange.
+	 * @note The position has to be the first attribute of the vertex.
+	 */
+	_NODISCARD uint32_t allocateGeometry(
 		const float *_vertices,
+		const float *_positions,
 		const uint32_t *_indices,
-		const uint32_t _verticesByteSize,
-		const uint32_t _indicesByteSize,
+		const uint32_t _vertexCount,
+		const uint32_t _indexCount,
 		const uint32_t _vertexSize,
 		uint64_t _normalOffset,
 		uint64_t _texCoordOffset
 	) noexcept;
-	void deleteMesh(
+	/** Hands a mesh's space back to its buffers, merging it with any free space either side. */
+	void freeGeometry(const uint32_t _handle) noexcept;
+	/** Where a mesh is right now, only valid until the next compactGeometry. */
+	_NODISCARD geometryRange getGeometryRange(const uint32_t _handle) noexcept;
+	/** Moves meshes from the end of each buffer into free space nearer the start, a little at a time.
+	 * @param _byteBudget Stops once this much has been copied.
+	 * @return [uint32_t] Bytes copied.
+	 */
+	uint32_t compactGeometry(const uint32_t _byteBudget) noexcept;
+	_NODISCARD geometryStats getGeometryStats() noexcept;
+	void drawGeometry(const geometryRange &_range) noexcept;
+	/** Makes every draw from here on read only the position stream, a third of the bytes of a whole vertex.
+	 * @note For depth only passes, the normals and texture coordinates read nothing while it is on.
+	 */
+	void setPositionOnly(const bool _state) noexcept;
+
+	// Instancing
+
+	/** Bytes per instance, a column major mat4 model matrix followed by a mat3 normal matrix.
+	 * @note Read by the vertex shader at locations 3-6 and 7-9.
+	 */
+	_NODISCARD constexpr uint32_t getInstanceSize() { return 25U * sizeof(float); }
+	/** Makes room for this frame's instances in the stream buffer, to be written directly.
+	 * @param _outFirstInstance Set to the index of the first instance, as the draw functions take it.
+	 * @return [void*] Where to write _count instances, call flushStream before drawing them.
+	 */
+	_NODISCARD void *mapInstances(const uint32_t _count, uint32_t *_outFirstInstance) noexcept;
+	/** Points every vertex array's instance attributes at the start of a buffer, mapInstances points them back.
+	 * @note For instances written by the GPU, the draw functions then index into this buffer.
+	 */
+	void setInstanceSource(const uint32_t _idBuffer) noexcept;
+	_NODISCARD uint32_t getInstanceSource() noexcept;
+	/** Draws a mesh once for each of a run of instances in the stream buffer.
+	 * @param _firstInstance Index of the first instance to read.
+	 */
+	void drawGeometryInstanced(
+		const geometryRange &_range,
+		const uint32_t _instanceCount,
+		const uint32_t _firstInstance
+	) noexcept;
+	/** Draws several meshes of the same vertex format with one call, all reading the same instance.
+	 * @param _ranges Array of _drawCount meshes.
+	 */
+	void multiDrawGeometry(
+		const geometryRange *_ranges,
+		const uint32_t _drawCount,
+		const uint32_t _instance
+	) noexcept;
+
+	// Indirect draw
+
+	/** One draw of an indirect buffer, laid out as GL reads it. */
+	struct drawCommand
+	{
+		uint32_t count = 0U;
+		uint32_t instanceCount = 0U;
+		uint32_t firstIndex = 0U;
+		int32_t baseVertex = 0;
+		uint32_t baseInstance = 0U;	// Where in the instance buffer this draw's instances start
+	};
+
+	/** True if glMultiDrawElementsIndirect with base instances is usable, core since GL 4.3. */
+	_NODISCARD bool supportsIndirectDraw() noexcept;
+	/** Makes room for this frame's draw commands in the stream buffer, to be written directly.
+	 * @return [drawCommand*] Where to write _count commands, call flushStream before drawing them.
+	 * @note Only the most recent commands can be drawn.
+	 */
+	_NODISCARD drawCommand *mapDrawCommands(const uint32_t _count) noexcept;
+	/** Where the last mapped commands are, so the GPU can write to them before they are drawn.
+	 * @param _outOffset Bytes from the start of the buffer to the first command.
+	 */
+	void getDrawCommandSource(uint32_t *_outIdBuffer, uint32_t *_outOffset) noexcept;
+	/** Issues a run of mapped commands as a single call, all must use the vertex array given. */
+	void multiDrawIndirect(
 		const uint32_t _idVAO,
-		const uint32_t _idVBO,
-		const uint32_t _idEBO
+		const uint32_t _firstCommand,
+		const uint32_t _commandCount
 	) noexcept;
-	void drawElements(const uint32_t _idVAO, const uint32_t _size) noexcept;
+
+	// Occlusion query
+
+	_NODISCARD uint32_t createQuery() noexcept;
+	void deleteQueries(const uint32_t *_idQueries, const uint32_t _count = 1U) noexcept;
+	/** Counts whether any sample of the draws until endOcclusionQuery passes the depth test. */
+	void beginOcclusionQuery(const uint32_t _idQuery) noexcept;
+	void endOcclusionQuery() noexcept;
+	/** Checks if the GPU has the answer yet, never waits. */
+	_NODISCARD bool isQueryResultAvailable(const uint32_t _idQuery) noexcept;
+	/** If any sample passed, waits for the GPU unless isQueryResultAvailable was true. */
+	_NODISCARD bool getQueryAnySamples(const uint32_t _idQuery) noexcept;
+	/** Draws until endConditionalRender are skipped by the GPU if the query saw no samples.
+	 * @note Never waits, a query without a result yet lets everything draw.
+	 */
+	void beginConditionalRender(const uint32_t _idQuery) noexcept;
+	void endConditionalRender() noexcept;
+
+	// Timer query
+
+	/** Measures how long the GPU spends on the commands until endTimerQuery, only one can run at a time.
+	 * @note Uses the same query objects as createQuery, a query is for one kind only.
+	 */
+	void beginTimerQuery(const uint32_t _idQuery) noexcept;
+	void endTimerQuery() noexcept;
+	/** The nanoseconds the GPU took, waits for the GPU unless isQueryResultAvailable was true. */
+	_NODISCARD uint64_t getQueryNanoseconds(const uint32_t _idQuery) noexcept;
+
+	// Compute
+
+	/** True if compute shaders, storage buffers and image stores are usable, core since GL 4.3. */
+	_NODISCARD bool supportsCompute() noexcept;
+	_NODISCARD uint32_t createComputeShader() noexcept;
+	_NODISCARD uint32_t createComputeProgram(uint32_t _idCompute) noexcept;
+	/** Runs the program in use over a grid of work groups. */
+	void dispatchCompute(const uint32_t _groupsX, const uint32_t _groupsY = 1U) noexcept;
+	/** Makes everything compute wrote visible to draws, indirect commands, texture reads and later dispatches. */
+	void waitForComputeWrites() noexcept;
+	/** Creates a buffer only the GPU writes and reads, with undefined contents. */
+	_NODISCARD uint32_t createStorageBuffer(const uint32_t _byteSize) noexcept;
+	/** Attaches a whole buffer to an indexed storage block binding point. */
+	void bindStorageBuffer(const uint32_t _binding, const uint32_t _idBuffer) noexcept;
+	/** Attaches one level of an R32F texture to an image unit.
+	 * @param _write Write only if true, otherwise read only.
+	 */
+	void bindImageLevel(
+		const uint32_t _unit,
+		const uint32_t _idTex,
+		const uint32_t _level,
+		const bool _write
+	) noexcept;
+	/** Creates a single channel float texture with every level defined, each half the size of the last rounded up. */
+	_NODISCARD uint32_t createFloatTexture(const uint32_t _width, const uint32_t _height, const uint32_t _levels) noexcept;
+	/** Creates a texture that the default framebuffer's depth can be copied into. */
+	_NODISCARD uint32_t createDepthTexture(const uint32_t _width, const uint32_t _height) noexcept;
+	/** Copies the depth of the screen into a texture from createDepthTexture.
+	 * @return [bool] False if the driver refused the copy, the texture is then undefined.
+	 */
+	_NODISCARD bool copyDepthToTexture(const uint32_t _idTex, const uint32_t _width, const uint32_t _height) noexcept;
+	/** Deletes the framebuffer copyDepthToTexture made. */
+	void releaseCompute() noexcept;
+
+	// Render target
+
+	/** Formats a colour target can be created in, both normalised to 0-1 when read. */
+	enum class targetFormat: uint8_t
+	{
+		rgba8,
+		rgba16
+	};
+
+	/** Creates a single level texture to be drawn into, read back with texelFetch. */
+	_NODISCARD uint32_t createTargetTexture(const uint32_t _width, const uint32_t _height, const targetFormat _format) noexcept;
+	/** Creates a square depth texture that shaders compare against through a sampler2DShadow, filtered over four texels. */
+	_NODISCARD uint32_t createShadowTexture(const uint32_t _size) noexcept;
+	/** Creates a framebuffer drawing into every colour texture at once, in order, and testing against the depth texture.
+	 * @param _colourCount 0 for a framebuffer that only has depth.
+	 * @param _idDepth From createDepthTexture, so its depth can be blitted to the screen, or 0 for no depth at all.
+	 * @return [uint32_t] 0 if the driver cannot draw into this combination.
+	 */
+	_NODISCARD uint32_t createFramebuffer(
+		const uint32_t *_idColours,
+		const uint32_t _colourCount,
+		const uint32_t _idDepth
+	) noexcept;
+	void deleteFramebuffer(const uint32_t _idFBO) noexcept;
+	/** Draws into the framebuffer from here on, 0 for the screen, which is the scene target while one is set. */
+	void bindFramebuffer(const uint32_t _idFBO) noexcept;
+	/** Draws the scene into a framebuffer instead of the window, anything asking for the screen gets it instead.
+	 * @param _idFBO From createFramebuffer with a depth texture from createDepthTexture, or 0 to draw to the window again.
+	 * @param _width The part of it drawn into from its bottom left, which getViewportSize returns from now on.
+	 * @note Binds it and sets the viewport.
+	 */
+	void setSceneTarget(const uint32_t _idFBO, const uint32_t _width, const uint32_t _height) noexcept;
+	/** The framebuffer the scene is drawn into, 0 while it is the window. */
+	_NODISCARD uint32_t getSceneTarget() noexcept;
+	/** Stretches the colour of the scene target over the whole window with linear filtering, if one is set. */
+	void presentSceneTarget() noexcept;
+	/** Clears the bound framebuffer's first colour targets to 0 and its depth to the far plane, the clear colour is untouched. */
+	void clearTargets(const uint32_t _colourCount) noexcept;
+	/** Clears the depth of part of the bound framebuffer to the far plane, in pixels from its bottom left. */
+	void clearDepthRect(const uint32_t _x, const uint32_t _y, const uint32_t _width, const uint32_t _height) noexcept;
+	/** Copies the depth of part of one framebuffer to the same place in another, both need the same depth format.
+	 * @note 0 is the screen, and it is left bound.
+	 */
+	void copyDepthRect(
+		const uint32_t _idFrom,
+		const uint32_t _idTo,
+		const uint32_t _x,
+		const uint32_t _y,
+		const uint32_t _width,
+		const uint32_t _height
+	) noexcept;
+	/** Copies the first colour target of part of one framebuffer to the same place in another.
+	 * @note 0 is the screen, and it is left bound.
+	 */
+	void copyColourRect(
+		const uint32_t _idFrom,
+		const uint32_t _idTo,
+		const uint32_t _x,
+		const uint32_t _y,
+		const uint32_t _width,
+		const uint32_t _height
+	) noexcept;
+	/** Copies a framebuffer's depth onto the screen's, so later draws test against it. */
+	void blitDepthToScreen(const uint32_t _idFBO, const uint32_t _width, const uint32_t _height) noexcept;
+	/** Covers the viewport with one triangle, the vertex shader makes the corners from gl_VertexID. */
+	void drawFullscreenTriangle() noexcept;
+	/** Deletes the empty vertex array drawFullscreenTriangle made. */
+	void releaseTargets() noexcept;
+
+	// Uniform buffer
+
+	/** Creates a buffer for uniform blocks with undefined contents.
+	 * @param _byteSize The total size of the buffer.
+	 * @return [uint32_t] The id of the buffer.
+	 */
+	_NODISCARD uint32_t createUniformBuffer(const uint32_t _byteSize) noexcept;
+	/** Overwrites part of a uniform buffer with a single upload. */
+	void updateUniformBuffer(
+		const uint32_t _idUBO,
+		const uint32_t _offset,
+		const uint32_t _byteSize,
+		const void *_data
+	) noexcept;
+	/** Attaches part of a buffer to an indexed uniform binding point, it stays until something else is bound there. */
+	void bindUniformBufferRange(
+		const uint32_t _binding,
+		const uint32_t _idUBO,
+		const uint32_t _offset,
+		const uint32_t _byteSize
+	) noexcept;
+	void deleteBuffer(const uint32_t _idBuffer) noexcept;
+	/** Ranges bound with bindUniformBufferRange must start on a multiple of this. */
+	_NODISCARD uint32_t getUniformBufferOffsetAlignment() noexcept;
 
 	// Texture
 
@@ -70,6 +401,28 @@ namespace renderer
 	 */
 	void deleteTextures(const uint32_t *_textureIds, const uint32_t _textureCount = 1U) noexcept;
 
+	// Texture buffer
+
+	/** How each texel of a texture buffer is read. */
+	enum class bufferFormat: uint8_t
+	{
+		rgba32f,
+		rg32ui,
+		r32ui
+	};
+
+	/** Creates a buffer that shaders read through a samplerBuffer, and the texture they read it by.
+	 * @param _outIdBuffer Set to the buffer, fill it with updateTextureBuffer.
+	 * @return [uint32_t] The texture.
+	 */
+	_NODISCARD uint32_t createTextureBuffer(const bufferFormat _format, uint32_t *_outIdBuffer) noexcept;
+	/** Replaces the whole contents, the old storage is orphaned so draws still reading it never stall. */
+	void updateTextureBuffer(const uint32_t _idBuffer, const uint32_t _byteSize, const void *_data) noexcept;
+	/** Binds a texture buffer to a unit, it stays there until something else is bound. */
+	void bindTextureBuffer(const uint8_t _unit, const uint32_t _idTex) noexcept;
+	/** The most texels a texture buffer can be read up to, at least 65536. */
+	_NODISCARD uint32_t getMaxTextureBufferSize() noexcept;
+
 	// Shader
 
 	_NODISCARD uint32_t createShaderProgram(uint32_t _idVertex, uint32_t _idFragment) noexcept;
@@ -85,15 +438,56 @@ namespace renderer
 	void deleteShaderProgram(const uint32_t _idProgram) noexcept;
 	void deleteShader(const uint32_t _idShader) noexcept;
 
+	/** True if GL_KHR_parallel_shader_compile (or the ARB version) is available. */
+	_NODISCARD bool supportsParallelCompile() noexcept;
+	/** Checks if the driver has finished linking a program, without waiting on it.
+	 * @return [bool] Always true without parallel compile support, as querying the status would block.
+	 * @note Only once this is true can the link status be read for free.
+	 */
+	_NODISCARD bool isProgramComplete(const uint32_t _idProgram) noexcept;
+
+	/** True if GL_ARB_get_program_binary is usable, core since GL 4.1. */
+	_NODISCARD bool supportsProgramBinary() noexcept;
+	/** Retrieves the driver specific binary of a linked program.
+	 * @return [bool] False if the driver could not provide one.
+	 */
+	_NODISCARD bool getProgramBinary(
+		const uint32_t _idProgram,
+		std::vector<uint8_t> *_outData,
+		uint32_t *_outFormat
+	) noexcept;
+	/** Creates a program from a binary made by getProgramBinary.
+	 * @return [uint32_t] The program id, or 0 if the driver rejected the binary.
+	 */
+	_NODISCARD uint32_t createShaderProgramFromBinary(
+		const uint32_t _format,
+		const void *_data,
+		const uint32_t _byteSize
+	) noexcept;
+
+	/** Points a named uniform block of a program at a binding point, does nothing if the block is unused. */
+	void setUniformBlockBinding(uint32_t _idProgram, const char *_blockName, uint32_t _binding) noexcept;
 	_NODISCARD int32_t getUniformLocation(uint32_t _idProgram, const char *_name) noexcept;
+	_NODISCARD uint32_t getActiveUniformCount(uint32_t _idProgram) noexcept;
+	/** Retrieves the name of an active uniform by index.
+	 * @param _outArraySize Set to the element count, 1 if the uniform is not an array.
+	 */
+	void getActiveUniform(
+		uint32_t _idProgram,
+		uint32_t _index,
+		char *_outName,
+		uint16_t _nameSize,
+		int32_t *_outArraySize
+	) noexcept;
 	void setBool(uint32_t _idProgram, int32_t _location, bool _value) noexcept;
 	void setInt(uint32_t _idProgram, int32_t _location, int32_t _value) noexcept;
+	void setInt2(uint32_t _idProgram, int32_t _location, const int32_t *_value) noexcept;
 	void setUint(uint32_t _idProgram, int32_t _location, uint32_t _value) noexcept;
 	void setFloat(uint32_t _idProgram, int32_t _location, float _value) noexcept;
-	void setFloat2(uint32_t _idProgram, int32_t _location, float *_value) noexcept;
-	void setFloat3(uint32_t _idProgram, int32_t _location, float *_value) noexcept;
-	void setFloat4(uint32_t _idProgram, int32_t _location, float *_value) noexcept;
-	void setMat3(uint32_t _idProgram, int32_t _location, float *_value) noexcept;
-	void setMat4(uint32_t _idProgram, int32_t _location, float *_value) noexcept;
+	void setFloat2(uint32_t _idProgram, int32_t _location, const float *_value) noexcept;
+	void setFloat3(uint32_t _idProgram, int32_t _location, const float *_value) noexcept;
+	void setFloat4(uint32_t _idProgram, int32_t _location, const float *_value) noexcept;
+	void setMat3(uint32_t _idProgram, int32_t _location, const float *_value) noexcept;
+	void setMat4(uint32_t _idProgram, int32_t _location, const float *_value) noexcept;
 }
 }
@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <cmath>
+#include "resolution.hpp"
+#include "renderer.hpp"
+#include "debug.hpp"
+
+namespace srender
+{
+namespace resolution
+{
+	bool l_enabled = false;
+	double l_targetTime = 1.0 / 60.0;
+	float l_minScale = 0.5f, l_maxScale = 1.0f;
+	float l_proportional = 0.1f, l_integral = 0.5f, l_derivative = 0.005f;
+
+	/** The governor's output before it is rounded to a step, and the scale actually drawn at. */
+	float l_scale = 1.0f, l_drawnScale = 1.0f;
+	/** Holds the scale the error settles at, kept within the bounds so it never winds up past them. */
+	float l_sum = 1.0f;
+	float l_lastError = 0.0f;
+	/** The frame time the error is taken from, smoothed so one slow frame does not shake the scale. */
+	double l_smoothTime = 0.0;
+	double l_cpuTime = 0.0, l_gpuTime = 0.0;
+
+	/** Sized for the upper bound of the window, smaller scales draw into its bottom left. */
+	uint32_t l_idColour = 0U, l_idDepth = 0U, l_idFBO = 0U;
+	uint32_t l_targetWidth = 0U, l_targetHeight = 0U;
+
+	/** Used in turn, a query is only begun again once its result was read. */
+	uint32_t l_idQueries[getQueryCount()] = {};
+	bool l_queryPending[getQueryCount()] = {};
+	uint8_t l_nextQuery = 0U;
+	bool l_timing = false;
+
+	void deleteTarget() noexcept
+	{
+		// Nothing may keep drawing into it once it is gone
+		renderer::setSceneTarget(0U, 0U, 0U);
+		if (l_idFBO)
+		{	renderer::deleteFramebuffer(l_idFBO); }
+		if (l_idColour)
+		{
+			const uint32_t textures[2] = { l_idColour, l_idDepth };
+			renderer::deleteTextures(textures, 2U);
+		}
+		l_idFBO = l_idColour = l_idDepth = 0U;
+		l_targetWidth = l_targetHeight = 0U;
+	}
+
+	/** Makes the scene target big enough for the upper bound at this window size.
+	 * @return [bool] False if the driver cannot draw into it.
+	 */
+	bool resizeTarget(const uint32_t _windowWidth, const uint32_t _windowHeight) noexcept
+	{
+		const uint32_t width = std::max(1U, (uint32_t)std::ceil(_windowWidth * l_maxScale));
+		const uint32_t height = std::max(1U, (uint32_t)std::ceil(_windowHeight * l_maxScale));
+		if (l_idFBO && width == l_targetWidth && height == l_targetHeight)
+		{	return true; }
+
+		deleteTarget();
+		l_idColour = renderer::createTargetTexture(width, height, renderer::targetFormat::rgba8);
+		// Matches the window's depth, so the G-buffer's depth can still be blitted into it
+		l_idDepth = renderer::createDepthTexture(width, height);
+		l_idFBO = renderer::createFramebuffer(&l_idColour, 1U, l_idDepth);
+		if (!l_idFBO)
+		{
+			deleteTarget();
+			return false;
+		}
+		l_targetWidth = width;
+		l_targetHeight = height;
+		return true;
+	}
+
+	/** Reads every query that has finished without waiting, oldest first so the newest result is kept. */
+	void readQueries() noexcept
+	{
+		for (uint8_t i = 0; i < getQueryCount(); ++i)
+		{
+			const uint8_t slot = (uint8_t)((l_nextQuery + i) % getQueryCount());
+			if (l_queryPending[slot] && renderer::isQueryResultAvailable(l_idQueries[slot]))
+			{
+				l_gpuTime = (double)renderer::getQueryNanoseconds(l_idQueries[slot]) * 1e-9;
+				l_queryPending[slot] = false;
+			}
+		}
+	}
+
+	/** Moves the scale towards holding the target frame time, then rounds it to a step if it moved far enough. */
+	void govern() noexcept
+	{
+		// Without any GPU time the whole frame is all there is, which includes waiting on the GPU
+		const double measured = l_gpuTime > 0.0 ? l_gpuTime : l_cpuTime;
+		if (measured <= 0.0 || l_targetTime <= 0.0)
+		{	return; }
+		l_smoothTime = l_smoothTime > 0.0 ? l_smoothTime + (measured - l_smoothTime) * 0.2 : measured;
+		// A hitch would otherwise count as a long stretch of error
+		const float deltaTime = (float)std::min(std::max(l_cpuTime, 0.001), 0.1);
+
+		const float error = (float)((l_targetTime - l_smoothTime) / l_targetTime);
+		l_sum = std::clamp(l_sum + l_integral * error * deltaTime, l_minScale, l_maxScale);
+		const float change = (error - l_lastError) / deltaTime;
+		l_lastError = error;
+		l_scale = std::clamp(l_sum + l_proportional * error + l_derivative * change, l_minScale, l_maxScale);
+
+		// A whole step away before it changes, so noise around a step does not resize every frame
+		if (std::fabs(l_scale - l_drawnScale) >= getScaleStep())
+		{
+			l_drawnScale = std::clamp(
+				std::round(l_scale / getScaleStep()) * getScaleStep(),
+				l_minScale,
+				l_maxScale
+			);
+		}
+	}
+
+	void terminate() noexcept
+	{
+		deleteTarget();
+		if (l_idQueries[0])
+		{	renderer::deleteQueries(l_idQueries, getQueryCount()); }
+		for (uint8_t i = 0; i < getQueryCount(); ++i)
+		{
+			l_idQueries[i] = 0U;
+			l_queryPending[i] = false;
+		}
+		l_timing = false;
+	}
+
+	void setEnabled(const bool _state) noexcept
+	{
+		l_enabled = _state;
+		l_scale = l_drawnScale = l_sum = l_maxScale;
+		l_lastError = 0.0f;
+		l_smoothTime = 0.0;
+	}
+
+	bool getEnabled() noexcept
+	{	return l_enabled; }
+
+	void setTargetFrameTime(const double _seconds) noexcept
+	{	l_targetTime = _seconds; }
+
+	void setScaleBounds(const float _min, const float _max) noexcept
+	{
+		l_maxScale = std::clamp(_max, getLowestScale(), getHighestScale());
+		l_minScale = std::clamp(_min, getLowestScale(), l_maxScale);
+		l_scale = std::clamp(l_scale, l_minScale, l_maxScale);
+		l_drawnScale = std::clamp(l_drawnScale, l_minScale, l_maxScale);
+		l_sum = std::clamp(l_sum, l_minScale, l_maxScale);
+	}
+
+	void setGains(const float _proportional, const float _integral, const float _derivative) noexcept
+	{
+		l_proportional = _proportional;
+		l_integral = _integral;
+		l_derivative = _derivative;
+	}
+
+	void setFrameTime(const double _seconds) noexcept
+	{	l_cpuTime = _seconds; }
+
+	void beginFrame() noexcept
+	{
+		uint32_t windowWidth, windowHeight;
+		renderer::getWindowSize(&windowWidth, &windowHeight);
+		if (!l_enabled || windowWidth == 0U || windowHeight == 0U)
+		{
+			if (l_idFBO)
+			{	deleteTarget(); }
+			return;
+		}
+		if (!resizeTarget(windowWidth, windowHeight))
+		{
+			debug::send(
+				"The driver cannot draw into the scene target, drawing at the window's resolution",
+				debug::type::note, debug::impact::large, debug::stage::mid
+			);
+			l_enabled = false;
+			return;
+		}
+		if (!l_idQueries[0])
+		{
+			for (uint32_t &idQuery : l_idQueries)
+			{	idQuery = renderer::createQuery(); }
+		}
+
+		readQueries();
+		govern();
+		const uint32_t width = std::min(l_targetWidth, std::max(1U, (uint32_t)std::lround(windowWidth * l_drawnScale)));
+		const uint32_t height = std::min(l_targetHeight, std::max(1U, (uint32_t)std::lround(windowHeight * l_drawnScale)));
+		renderer::setSceneTarget(l_idFBO, width, height);
+
+		// Skipped while the GPU is so far behind that every query is still waiting
+		if (!l_queryPending[l_nextQuery])
+		{
+			renderer::beginTimerQuery(l_idQueries[l_nextQuery]);
+			l_timing = true;
+		}
+	}
+
+	void endFrame() noexcept
+	{
+		if (l_timing)
+		{
+			renderer::endTimerQuery();
+			l_queryPending[l_nextQuery] = true;
+			l_nextQuery = (uint8_t)((l_nextQuery + 1U) % getQueryCount());
+			l_timing = false;
+		}
+		renderer::presentSceneTarget();
+	}
+
+	float getScale() noexcept
+	{	return l_idFBO ? l_drawnScale : 1.0f; }
+
+	stats getStats() noexcept
+	{
+		stats result = stats();
+		result.scale = getScale();
+		renderer::getViewportSize(&result.width, &result.height);
+		result.gpuTime = l_gpuTime;
+		result.cpuTime = l_cpuTime;
+		return result;
+	}
+}
+}
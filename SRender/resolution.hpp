@@ -0,0 +1,58 @@
+#pragma once
+#include <stdint.h>
+
+#ifndef _NODISCARD
+#define _NODISCARD [[nodiscard]]
+#endif
+
+namespace srender
+{
+/** Dynamic resolution, the scene is drawn into a target of its own at a fraction of the window's size,
+ * then stretched over the window, so a slow frame costs fewer pixels instead of a dropped frame.
+ * The fraction is steered by a PID governor towards a target frame time.
+ * It reads how long the GPU took from timer queries a few frames old.
+ * Until those arrive, or where they never do, it uses the CPU time of the whole frame, which includes waiting on the GPU.
+ * @note The scale applies to both axes, so the pixels drawn go with its square.
+ */
+namespace resolution
+{
+	struct stats
+	{
+		float scale = 1.0f;	// Of both axes, as drawn in the last frame
+		uint32_t width = 0U, height = 0U;	// Pixels drawn in the last frame
+		double gpuTime = 0.0;	// Seconds, from the newest timer query that finished, 0 without any
+		double cpuTime = 0.0;	// Seconds, the last whole frame as the application measured it
+	};
+
+	/** The bounds setScaleBounds is clamped to, above 1 draws more pixels than the window has. */
+	_NODISCARD constexpr float getLowestScale() { return 0.25f; }
+	_NODISCARD constexpr float getHighestScale() { return 2.0f; }
+	/** The scale only changes in these steps, so the targets sized by the viewport are not made again every frame. */
+	_NODISCARD constexpr float getScaleStep() { return 0.05f; }
+	/** Timer queries in flight, enough for the GPU to be this many frames behind before a result is missed. */
+	_NODISCARD constexpr uint8_t getQueryCount() { return 4U; }
+
+	void terminate() noexcept;
+	/** Starts drawing into the scene target from the next frame, or the window again, the scale starts at its upper bound. */
+	void setEnabled(const bool _state) noexcept;
+	_NODISCARD bool getEnabled() noexcept;
+	/** The frame time to hold, in seconds. */
+	void setTargetFrameTime(const double _seconds) noexcept;
+	/** How far the scale may move, each clamped to getLowestScale and getHighestScale. */
+	void setScaleBounds(const float _min, const float _max) noexcept;
+	/** How strongly the governor follows the error, its sum over time and its change.
+	 * @note The error is the share of the target frame time left over, negative when over it.
+	 */
+	void setGains(const float _proportional, const float _integral, const float _derivative) noexcept;
+	/** The CPU time of the last whole frame, called by the application before drawing. */
+	void setFrameTime(const double _seconds) noexcept;
+
+	/** Runs the governor, resizes the scene target if needed and draws into it from here on. */
+	void beginFrame() noexcept;
+	/** Stretches what was drawn over the window, ready to be swapped. */
+	void endFrame() noexcept;
+
+	_NODISCARD float getScale() noexcept;
+	_NODISCARD stats getStats() noexcept;
+}
+}
@@ -1,47 +1,176 @@
 #include <fstream>
 #include <sstream>
+#include <cstring>
+#include <unordered_map>
+#include <algorithm>
 #include "shader.hpp"
 #include "default_shader.hpp"
 #include "renderer.hpp"
+#include "shader_cache.hpp"
 #include "glm/gtc/type_ptr.hpp"
 #include "debug.hpp"
 
 using std::string;
+using std::vector;
 using std::stringstream;
 using std::ifstream;
 
 namespace srender
 {
-shader::shader(const string *_shaderPath)
-{	load(_shaderPath); }
+/** The glsl block names, in the order of shader::block. */
+constexpr const char *l_blockNames[(uint8_t)shader::block::count] = {
+	"Camera",
+	"Clusters",
+	"DirLights"
+};
+
+/** The glsl sampler names, in the order of shader::sharedTexture. */
+constexpr const char *l_sharedTextureNames[(uint8_t)shader::sharedTexture::count] = {
+	"u_lights",
+	"u_clusters",
+	"u_clusterLights",
+	"u_shadowViews",
+	"u_shadowAtlas"
+};
+
+/** Every shared shader, keyed by path and defines. */
+std::unordered_map<string, shader*> l_library = std::unordered_map<string, shader*>();
+
+/** Shaders submitted to the driver that have not been checked yet. */
+vector<shader*> l_pending = vector<shader*>();
+shader *l_fallback = nullptr;
+
+_NODISCARD inline string libraryKey(const string *_shaderPath, const string &_defines)
+{	return (_shaderPath ? *_shaderPath : string()) + '\n' + _defines; }
+
+// Permutation
+
+string shader::permutation::defines() const
+{
+	// Always in the same order, the string is part of the library key
+	string out = "#define EXACT_LIGHT_COUNTS\n";
+	out += "#define NR_DIR_LIGHTS " + std::to_string(dirLights) + '\n';
+	if (useTextures)
+	{	out += "#define USE_TEXTURES\n"; }
+	if (fullbright)
+	{	out += "#define FULLBRIGHT\n"; }
+	if (depthBuffer)
+	{	out += "#define DEPTH_BUFFER\n"; }
+	if (deferred)
+	{	out += "#define DEFERRED\n"; }
+	return out;
+}
+
+// Static
+
+shader *shader::acquire(const string *_shaderPath, const string &_defines)
+{
+	const string key = libraryKey(_shaderPath, _defines);
+	auto it = l_library.find(key);
+	if (it != l_library.end())
+	{
+		#ifdef _VERBOSE
+			debug::send(
+				"Reusing shader \"" + it->second->m_shaderPath + "\"",
+				debug::type::note, debug::impact::small, debug::stage::mid
+			);
+		#endif
+		++it->second->m_refCount;
+		return it->second;
+	}
+
+	shader *newShader = new shader(_shaderPath, _defines);
+	l_library[key] = newShader;
+	return newShader;
+}
+
+void shader::release(shader *_shader) noexcept
+{
+	if (!_shader || --_shader->m_refCount > 0U)
+	{	return; }
+
+	// Only remove the entry if it is this shader, one made with new is not in the library
+	auto it = l_library.find(libraryKey(&_shader->m_shaderPath, _shader->m_defines));
+	if (it != l_library.end() && it->second == _shader)
+	{	l_library.erase(it); }
+	delete _shader;
+}
+
+size_t shader::libraryCount() noexcept
+{	return l_library.size(); }
+
+shader *shader::fallback()
+{
+	if (!l_fallback)
+	{
+		l_fallback = acquire();
+		// Everything else waits on this one, so it is the only shader worth blocking for
+		l_fallback->finish();
+	}
+	return l_fallback;
+}
+
+void shader::pollPending() noexcept
+{
+	// Completing a shader removes it from the list, so go backwards
+	for (size_t i = l_pending.size(); i > 0U; --i)
+	{	l_pending[i - 1U]->poll(); }
+}
+
+size_t shader::pendingCount() noexcept
+{	return l_pending.size(); }
+
+void shader::terminate() noexcept
+{
+	release(l_fallback);
+	l_fallback = nullptr;
+}
+
+// Member
+
+shader::shader(const string *_shaderPath, const string &_defines)
+{	load(_shaderPath, _defines); }
 
 shader::~shader()
 {	destroy(); }
 
 void shader::destroy() noexcept
 {
+	if (m_pending)
+	{
+		l_pending.erase(std::find(l_pending.begin(), l_pending.end(), this));
+		renderer::deleteShader(m_idVertex);
+		renderer::deleteShader(m_idFragment);
+		renderer::deleteShaderProgram(m_idProgram);
+		m_pending = false;
+	}
+
 	if (m_shaderLoaded)
 	{
 		renderer::deleteShaderProgram(m_idProgram);
+		m_uniforms.clear();
 		m_shaderLoaded = false;
 	}
 }
 
-void shader::load(const std::string *_shaderPath)
+void shader::load(const std::string *_shaderPath, const std::string &_defines)
 {
-	if (m_shaderLoaded)
+	if (m_shaderLoaded || m_pending)
 	{
 		debug::send("SHADER::OVERWRITING_SHADER");
 		destroy();
 	}
 
+	m_defines = _defines;
+
 	// If no path is given, will use fallback shader
+	string vertexCode, fragmentCode;
 	m_shaderPath = _shaderPath ? *_shaderPath : "";
 	if (m_shaderPath != "")
 	{
-		m_shaderPath = *_shaderPath;
-		loadShader(shaderType::vertex);
-		loadShader(shaderType::fragment);
+		// Files that can't be read are left empty and use the fallback code
+		readFile(shaderType::vertex, &vertexCode);
+		readFile(shaderType::fragment, &fragmentCode);
 	}
 	else
 	{
@@ -49,20 +178,46 @@ void shader::load(const std::string *_shaderPath)
 			"SHADER::NO_PATH_PROVIDED::USING_FALLBACK_CODE",
 			debug::type::note, debug::impact::large, debug::stage::mid
 		);
-		loadShader(shaderType::vertex, true);
-		loadShader(shaderType::fragment, true);
 	}
 
-	createShaderProgram();
+	vertexCode = injectDefines(vertexCode.empty() ? VERTEX_FALLBACK : vertexCode.c_str());
+	fragmentCode = injectDefines(fragmentCode.empty() ? FRAGMENT_FALLBACK : fragmentCode.c_str());
+
+	// A program binary from an earlier run skips compiling entirely
+	m_cacheKey = shaderCache::makeKey(vertexCode, fragmentCode);
+	m_idProgram = shaderCache::load(m_cacheKey);
+	if (m_idProgram)
+	{
+		setupProgram();
+		return;
+	}
+
+	loadShader(shaderType::vertex, vertexCode);
+	loadShader(shaderType::fragment, fragmentCode);
+	// Linking is queued straight away, the driver works through it while other shaders are submitted
+	m_idProgram = renderer::createShaderProgram(m_idVertex, m_idFragment);
+	m_pending = true;
+	l_pending.push_back(this);
+}
+
+bool shader::poll() noexcept
+{
+	if (m_pending && renderer::isProgramComplete(m_idProgram))
+	{	completeProgram(); }
+	return m_shaderLoaded;
+}
+
+void shader::finish() noexcept
+{
+	// Reading the status of an incomplete program simply waits for it
+	if (m_pending)
+	{	completeProgram(); }
 }
 
 void shader::use() const noexcept
 {	renderer::useShaderProgram(m_idProgram); }
 
-constexpr bool shader::isLoaded() const noexcept
-{	return m_shaderLoaded; }
-
-void shader::loadShader(const shaderType _type, bool _useFallback)
+void shader::loadShader(const shaderType _type, const string &_code)
 {
 	if (_type == shaderType::program)
 	{
@@ -73,34 +228,24 @@ void shader::loadShader(const shaderType _type, bool _useFallback)
 		return;
 	}
 
-	if (!_useFallback)
-	{	_useFallback = !readFile(_type); }
-
-	if (_useFallback)
-	{	loadFallback(_type); }
-
-	#ifdef _VERBOSE
-		debug::send("Success!");
-	#endif
-}
-
-bool shader::readFile(const shaderType _type)
-{
-	bool success = true;
-	string codeString;
-	string path = m_shaderPath + byType(_type, string(".vert"), string(".frag"));
-
 	#ifdef _VERBOSE
 		debug::send(
-			"Compiling "
+			"Submitting "
 			+ byType(_type, string("vertex"), string("fragment"))
 			+ " shader \""
-			+ path
-			+ "\"...",
-			debug::type::process, debug::impact::small, debug::stage::mid, false, false
+			+ m_shaderPath
+			+ "\"",
+			debug::type::process, debug::impact::small, debug::stage::mid
 		);
 	#endif
 
+	submitShader(byType(_type, &m_idVertex, &m_idFragment), _type, _code.c_str());
+}
+
+bool shader::readFile(const shaderType _type, string *_outCode)
+{
+	string path = m_shaderPath + byType(_type, string(".vert"), string(".frag"));
+
 	// Try to retrieve the vertex/fragment source code from filePath
 	try
 	{
@@ -114,7 +259,7 @@ bool shader::readFile(const shaderType _type)
 		fileStream.close();
 
 		// Convert stream into string
-		codeString = codeStream.str();
+		*_outCode = codeStream.str();
 	}
 	catch (ifstream::failure &e)
 	{
@@ -128,19 +273,11 @@ bool shader::readFile(const shaderType _type)
 			debug::type::note, debug::impact::small, debug::stage::mid
 		);
 
-		success = false;
-	}
-
-	if (success)
-	{
-		success = compileShader(
-			byType(_type, &m_idVertex, &m_idFragment),
-			_type,
-			codeString.c_str()
-		);
+		_outCode->clear();
+		return false;
 	}
 
-	return success;
+	return true;
 }
 
 void shader::loadFallback(const shaderType _type)
@@ -158,11 +295,12 @@ void shader::loadFallback(const shaderType _type)
 	{
 		const char *vertexFallback = VERTEX_FALLBACK;
 		const char *fragmentFallback = FRAGMENT_FALLBACK;
+		const string code = injectDefines(byType<const char*&>(_type, vertexFallback, fragmentFallback));
 
 		result = compileShader(
 			byType(_type, &m_idVertex, &m_idFragment),
 			_type,
-			byType<const char*&>(_type, vertexFallback, fragmentFallback)
+			code.c_str()
 		);
 	}
 
@@ -178,7 +316,24 @@ void shader::loadFallback(const shaderType _type)
 	}
 }
 
-bool shader::compileShader(
+string shader::injectDefines(const char *_code) const
+{
+	string code = _code;
+	if (m_defines.empty())
+	{	return code; }
+
+	// Anything but comments before #version is an error, so go after it
+	size_t pos = code.find("#version");
+	pos = pos == string::npos ? 0U : code.find('\n', pos);
+	pos = pos == string::npos ? code.size() : pos + 1U;
+	string defines = m_defines;
+	if (defines.back() != '\n')
+	{	defines += '\n'; }
+	code.insert(pos, defines);
+	return code;
+}
+
+void shader::submitShader(
 	uint32_t *_id,
 	shaderType _type,
 	const char *_code
@@ -200,35 +355,201 @@ bool shader::compileShader(
 			"ERROR::SHADER::ATTEMPTING_TO_COMPILE_UNKNOWN_SHADER_TYPE",
 			debug::type::note, debug::impact::large, debug::stage::mid, true
 		);
-		return false;
+		*_id = 0U;
+		return;
 	}
 
 	// Loads the shader code into the shader object
 	renderer::loadShaderSource(*_id, _code);
 	// Compiles the shader at run-time
 	renderer::compileShader(*_id);
+}
+
+bool shader::compileShader(
+	uint32_t *_id,
+	shaderType _type,
+	const char *_code
+) noexcept
+{
+	submitShader(_id, _type, _code);
 	// Performs error checking on the shader
-	return checkForErrors(*_id, _type);
+	return *_id && checkForErrors(*_id, _type);
 }
 
-void shader::createShaderProgram() noexcept
+void shader::completeProgram() noexcept
 {
-	// Creates a shader program object assigned to id, this sets it as the active shader
-	m_idProgram = renderer::createShaderProgram(m_idVertex, m_idFragment);
-	// Performs error checking on the shader program
-	if (!checkForErrors(m_idProgram, shaderType::program))
+	l_pending.erase(std::find(l_pending.begin(), l_pending.end(), this));
+	m_pending = false;
+
+	// The stages are finished along with the link, so their status no longer stalls
+	bool relink = false;
+	for (shaderType type : { shaderType::vertex, shaderType::fragment })
+	{
+		uint32_t *id = byType(type, &m_idVertex, &m_idFragment);
+		if (checkForErrors(*id, type))
+		{	continue; }
+
+		renderer::deleteShader(*id);
+		loadFallback(type);
+		relink = true;
+	}
+
+	if (relink)
 	{
 		renderer::deleteShaderProgram(m_idProgram);
-		return;
+		m_idProgram = renderer::createShaderProgram(m_idVertex, m_idFragment);
 	}
+
+	verifyProgram();
+	// A fallback stage would be loaded for the broken source next launch, hiding its errors
+	if (m_shaderLoaded && !relink)
+	{	shaderCache::store(m_cacheKey, m_idProgram); }
+
+	#ifdef _VERBOSE
+		if (m_shaderLoaded)
+		{
+			debug::send(
+				"Compiled shader \"" + m_shaderPath + "\"",
+				debug::type::note, debug::impact::small, debug::stage::mid
+			);
+		}
+	#endif
+}
+
+void shader::verifyProgram() noexcept
+{
 	// We no longer need the vertex and fragment shaders
 	renderer::deleteShader(m_idVertex);
 	renderer::deleteShader(m_idFragment);
+	// Performs error checking on the shader program
+	if (!checkForErrors(m_idProgram, shaderType::program))
+	{
+		renderer::deleteShaderProgram(m_idProgram);
+		return;
+	}
+	setupProgram();
+}
+
+void shader::setupProgram() noexcept
+{
 	// Sets the shader as the active one
 	renderer::useShaderProgram(m_idProgram);
+	// Block bindings are not kept in program binaries, so this is always redone
+	for (uint8_t i = 0; i < (uint8_t)block::count; ++i)
+	{	renderer::setUniformBlockBinding(m_idProgram, l_blockNames[i], i); }
+	// Like the blocks, the shared samplers always read the same unit
+	for (uint8_t i = 0; i < (uint8_t)sharedTexture::count; ++i)
+	{
+		const int32_t location = renderer::getUniformLocation(m_idProgram, l_sharedTextureNames[i]);
+		if (location != -1)
+		{	renderer::setInt(m_idProgram, location, getSharedTextureUnit((sharedTexture)i)); }
+	}
+	reflectUniforms();
 	m_shaderLoaded = true;
 }
 
+void shader::reflectUniforms() noexcept
+{
+	// Each array element has its own location, so they are expanded into separate entries
+	vector<std::pair<string, int32_t>> found;
+	const uint32_t count = renderer::getActiveUniformCount(m_idProgram);
+	char name[256];
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		int32_t arraySize = 1;
+		renderer::getActiveUniform(m_idProgram, i, name, 256, &arraySize);
+		string fullName = name;
+		// Uniforms inside a block have no location and are skipped
+		int32_t location = renderer::getUniformLocation(m_idProgram, fullName.c_str());
+		if (location < 0)
+		{	continue; }
+
+		found.push_back({ fullName, location });
+
+		// Arrays of basic types report as "name[0]"
+		if (arraySize > 1 && fullName.ends_with("[0]"))
+		{
+			string base = fullName.substr(0, fullName.size() - 3);
+			// The bare name refers to the first element
+			found.push_back({ base, location });
+			for (int32_t j = 1; j < arraySize; ++j)
+			{
+				string element = base + '[' + std::to_string(j) + ']';
+				found.push_back({
+					element,
+					renderer::getUniformLocation(m_idProgram, element.c_str())
+				});
+			}
+		}
+	}
+
+	// Keep the load factor at or below one half so probes stay short
+	size_t tableSize = 16U;
+	while (tableSize < found.size() * 2U)
+	{	tableSize <<= 1U; }
+	m_uniforms = vector<uniformEntry>(tableSize);
+
+	for (auto &[uniformName, location] : found)
+	{	insertUniform(uniformName, location); }
+}
+
+void shader::insertUniform(const string &_name, const int32_t _location) noexcept
+{
+	if (_location < 0)
+	{	return; }
+
+	const uniformId id = uniform(_name.c_str());
+	const size_t mask = m_uniforms.size() - 1U;
+	size_t i = id & mask;
+	while (m_uniforms[i].location >= 0)
+	{
+		if (m_uniforms[i].id == id)
+		{
+			debug::send(
+				"SHADER::UNIFORM_HASH_COLLISION::\"" + _name + "\"",
+				debug::type::note, debug::impact::large, debug::stage::mid
+			);
+			return;
+		}
+		i = (i + 1U) & mask;
+	}
+
+	m_uniforms[i].id = id;
+	m_uniforms[i].location = _location;
+}
+
+shader::uniformEntry *shader::findUniform(const uniformId _id) const noexcept
+{
+	if (m_uniforms.empty())
+	{	return nullptr; }
+
+	const size_t mask = m_uniforms.size() - 1U;
+	size_t i = _id & mask;
+	// The table is never full, so an empty slot always ends the probe
+	while (m_uniforms[i].location >= 0)
+	{
+		if (m_uniforms[i].id == _id)
+		{	return &m_uniforms[i]; }
+		i = (i + 1U) & mask;
+	}
+	return nullptr;
+}
+
+bool shader::cacheValue(
+	uniformEntry *_entry,
+	const void *_value,
+	const uint8_t _size
+) noexcept
+{
+	assert(_size <= sizeof(_entry->value));
+	if (_entry->hasValue && std::memcmp(_entry->value, _value, _size) == 0)
+	{	return false; }
+
+	std::memcpy(_entry->value, _value, _size);
+	_entry->hasValue = true;
+	return true;
+}
+
 bool shader::checkForErrors(
 	const uint32_t _shaderID,
 	const shaderType _type
@@ -283,121 +604,195 @@ inline T shader::byType(
 	return (_type == shaderType::vertex ? _vertex : _fragment);
 }
 
-bool shader::setBool(string _name, bool _value, string &_msg) const noexcept
+bool shader::setBool(const string &_name, bool _value, string &_msg) const noexcept
 {
-	int32_t location = renderer::getUniformLocation(m_idProgram, _name.c_str());
-	if (location < 0)
+	if (!setBool(uniform(_name.c_str()), _value))
 	{
 		_msg = "Attempting to set unknown uniform \"" + _name + "\"";
 		return false;
 	}
-	renderer::setBool(m_idProgram, location, _value);
 	return true;
 }
 
-bool shader::setInt(string _name, int32_t _value, string &_msg) const noexcept
+bool shader::setInt(const string &_name, int32_t _value, string &_msg) const noexcept
 {
-	int32_t location = renderer::getUniformLocation(m_idProgram, _name.c_str());
-	if (location < 0)
+	if (!setInt(uniform(_name.c_str()), _value))
 	{
 		_msg = "Attempting to set unknown uniform \"" + _name + "\"";
 		return false;
 	}
-	renderer::setInt(m_idProgram, location, _value);
 	return true;
 }
 
-bool shader::setUint(string _name, uint32_t _value, string &_msg) const noexcept
+bool shader::setUint(const string &_name, uint32_t _value, string &_msg) const noexcept
 {
-	int32_t location = renderer::getUniformLocation(m_idProgram, _name.c_str());
-	if (location < 0)
+	if (!setUint(uniform(_name.c_str()), _value))
 	{
 		_msg = "Attempting to set unknown uniform \"" + _name + "\"";
 		return false;
 	}
-	renderer::setUint(m_idProgram, location, _value);
 	return true;
 }
 
-bool shader::setFloat(string _name, float _value, string &_msg) const noexcept
+bool shader::setFloat(const string &_name, float _value, string &_msg) const noexcept
 {
-	int32_t location = renderer::getUniformLocation(m_idProgram, _name.c_str());
-	if (location < 0)
+	if (!setFloat(uniform(_name.c_str()), _value))
 	{
 		_msg = "Attempting to set unknown uniform \"" + _name + "\"";
 		return false;
 	}
-	renderer::setFloat(m_idProgram, location, _value);
 	return true;
 }
 
-bool shader::setFloat2(string _name, glm::vec2 *_value, string &_msg) const noexcept
+bool shader::setFloat2(const string &_name, glm::vec2 *_value, string &_msg) const noexcept
 {
-	int32_t location = renderer::getUniformLocation(m_idProgram, _name.c_str());
-	if (location < 0)
+	if (!setFloat2(uniform(_name.c_str()), *_value))
 	{
 		_msg = "Attempting to set unknown uniform \"" + _name + "\"";
 		return false;
 	}
-	renderer::setFloat2(m_idProgram, location, &(*_value)[0]);
 	return true;
 }
-bool shader::setFloat2(string _name, glm::vec2 _value, string &_msg) const noexcept
+bool shader::setFloat2(const string &_name, glm::vec2 _value, string &_msg) const noexcept
 {	return setFloat2(_name, &_value, _msg); }
 
-bool shader::setFloat3(string _name, glm::vec3 *_value, string &_msg) const noexcept
+bool shader::setFloat3(const string &_name, glm::vec3 *_value, string &_msg) const noexcept
 {
-	int32_t location = renderer::getUniformLocation(m_idProgram, _name.c_str());
-	if (location < 0)
+	if (!setFloat3(uniform(_name.c_str()), *_value))
 	{
 		_msg = "Attempting to set unknown uniform \"" + _name + "\"";
 		return false;
 	}
-	renderer::setFloat3(m_idProgram, location, &(*_value)[0]);
 	return true;
 }
-bool shader::setFloat3(string _name, glm::vec3 _value, string &_msg) const noexcept
+bool shader::setFloat3(const string &_name, glm::vec3 _value, string &_msg) const noexcept
 {	return setFloat3(_name, &_value, _msg); }
 
-bool shader::setFloat4(string _name, glm::vec4 *_value, string &_msg) const noexcept
+bool shader::setFloat4(const string &_name, glm::vec4 *_value, string &_msg) const noexcept
 {
-	int32_t location = renderer::getUniformLocation(m_idProgram, _name.c_str());
-	if (location < 0)
+	if (!setFloat4(uniform(_name.c_str()), *_value))
 	{
 		_msg = "Attempting to set unknown uniform \"" + _name + "\"";
 		return false;
 	}
-	renderer::setFloat4(m_idProgram, location, &(*_value)[0]);
 	return true;
 }
-bool shader::setFloat4(string _name, glm::vec4 _value, string &_msg) const noexcept
+bool shader::setFloat4(const string &_name, glm::vec4 _value, string &_msg) const noexcept
 {	return setFloat4(_name, &_value, _msg); }
 
-bool shader::setMat3(string _name, glm::mat3 *_value, string &_msg) const noexcept
+bool shader::setMat3(const string &_name, glm::mat3 *_value, string &_msg) const noexcept
 {
-	int32_t location = renderer::getUniformLocation(m_idProgram, _name.c_str());
-	if (location < 0)
+	if (!setMat3(uniform(_name.c_str()), *_value))
 	{
 		_msg = "Attempting to set unknown uniform \"" + _name + "\"";
 		return false;
 	}
-	renderer::setMat3(m_idProgram, location, &(*_value)[0][0]);
 	return true;
 }
-bool shader::setMat3(string _name, glm::mat3 _value, string &_msg) const noexcept
+bool shader::setMat3(const string &_name, glm::mat3 _value, string &_msg) const noexcept
 {	return setMat3(_name, &_value, _msg); }
 
-bool shader::setMat4(string _name, glm::mat4 *_value, string &_msg) const noexcept
+bool shader::setMat4(const string &_name, glm::mat4 *_value, string &_msg) const noexcept
 {
-	int32_t location = renderer::getUniformLocation(m_idProgram, _name.c_str());
-	if (location < 0)
+	if (!setMat4(uniform(_name.c_str()), *_value))
 	{
 		_msg = "Attempting to set unknown uniform \"" + _name + "\"";
 		return false;
 	}
-	renderer::setMat4(m_idProgram, location, &(*_value)[0][0]);
 	return true;
 }
-bool shader::setMat4(string _name, glm::mat4 _value, string &_msg) const noexcept
+bool shader::setMat4(const string &_name, glm::mat4 _value, string &_msg) const noexcept
 {	return setMat4(_name, &_value, _msg); }
+
+bool shader::setBool(const uniformId _id, const bool _value) const noexcept
+{
+	uniformEntry *entry = findUniform(_id);
+	if (!entry)
+	{	return false; }
+	// Cached as an int to match how glsl stores it
+	const int32_t asInt = (int32_t)_value;
+	if (cacheValue(entry, &asInt, sizeof(asInt)))
+	{	renderer::setBool(m_idProgram, entry->location, _value); }
+	return true;
+}
+
+bool shader::setInt(const uniformId _id, const int32_t _value) const noexcept
+{
+	uniformEntry *entry = findUniform(_id);
+	if (!entry)
+	{	return false; }
+	if (cacheValue(entry, &_value, sizeof(_value)))
+	{	renderer::setInt(m_idProgram, entry->location, _value); }
+	return true;
+}
+
+bool shader::setUint(const uniformId _id, const uint32_t _value) const noexcept
+{
+	uniformEntry *entry = findUniform(_id);
+	if (!entry)
+	{	return false; }
+	if (cacheValue(entry, &_value, sizeof(_value)))
+	{	renderer::setUint(m_idProgram, entry->location, _value); }
+	return true;
+}
+
+bool shader::setFloat(const uniformId _id, const float _value) const noexcept
+{
+	uniformEntry *entry = findUniform(_id);
+	if (!entry)
+	{	return false; }
+	if (cacheValue(entry, &_value, sizeof(_value)))
+	{	renderer::setFloat(m_idProgram, entry->location, _value); }
+	return true;
+}
+
+bool shader::setFloat2(const uniformId _id, const glm::vec2 &_value) const noexcept
+{
+	uniformEntry *entry = findUniform(_id);
+	if (!entry)
+	{	return false; }
+	if (cacheValue(entry, &_value, sizeof(_value)))
+	{	renderer::setFloat2(m_idProgram, entry->location, &_value[0]); }
+	return true;
+}
+
+bool shader::setFloat3(const uniformId _id, const glm::vec3 &_value) const noexcept
+{
+	uniformEntry *entry = findUniform(_id);
+	if (!entry)
+	{	return false; }
+	if (cacheValue(entry, &_value, sizeof(_value)))
+	{	renderer::setFloat3(m_idProgram, entry->location, &_value[0]); }
+	return true;
+}
+
+bool shader::setFloat4(const uniformId _id, const glm::vec4 &_value) const noexcept
+{
+	uniformEntry *entry = findUniform(_id);
+	if (!entry)
+	{	return false; }
+	if (cacheValue(entry, &_value, sizeof(_value)))
+	{	renderer::setFloat4(m_idProgram, entry->location, &_value[0]); }
+	return true;
+}
+
+bool shader::setMat3(const uniformId _id, const glm::mat3 &_value) const noexcept
+{
+	uniformEntry *entry = findUniform(_id);
+	if (!entry)
+	{	return false; }
+	if (cacheValue(entry, &_value, sizeof(_value)))
+	{	renderer::setMat3(m_idProgram, entry->location, &_value[0][0]); }
+	return true;
+}
+
+bool shader::setMat4(const uniformId _id, const glm::mat4 &_value) const noexcept
+{
+	uniformEntry *entry = findUniform(_id);
+	if (!entry)
+	{	return false; }
+	if (cacheValue(entry, &_value, sizeof(_value)))
+	{	renderer::setMat4(m_idProgram, entry->location, &_value[0][0]); }
+	return true;
+}
 }
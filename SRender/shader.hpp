@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <vector>
 #include "glm/vec2.hpp"
 #include "glm/vec3.hpp"
 #include "glm/vec4.hpp"
@@ -15,7 +16,85 @@ namespace srender
 /** A shader is used to render the given vertex and texture information to the screen. */
 struct shader
 {
+	/** Uniform blocks shared by every program, the value is the fixed binding point. */
+	enum class block: uint8_t
+	{
+		camera,
+		clusters,
+		dirLights,
+		count
+	};
+
+	/** Textures shared by every program, each always bound to the unit getSharedTextureUnit gives.
+	 * @note All are texture buffers but the shadow atlas, which comes last.
+	 */
+	enum class sharedTexture: uint8_t
+	{
+		lights,	// Every point and spot light
+		clusters,	// Where each cluster's list of lights is
+		clusterLights,	// The lists themselves
+		shadowViews,	// Every shadow map's matrix and tile, see shadows
+		shadowAtlas,	// The shadow maps themselves, read through a sampler2DShadow
+		count
+	};
+
+	/** Kept clear of the units textures of models are bound to, the last of the 16 GL promises. */
+	_NODISCARD static constexpr uint8_t getSharedTextureUnit(const sharedTexture _texture) noexcept
+	{	return 11U + (uint8_t)_texture; }
+
+	/** Options compiled into a program as constants rather than branched on per fragment.
+	 * Each distinct combination is its own program in the library.
+	 */
+	struct permutation
+	{
+		bool useTextures = false;
+		bool fullbright = false;
+		bool depthBuffer = false;
+		/** Writes the surface into the G-buffer instead of lighting it, see deferred. */
+		bool deferred = false;
+		/** The exact amount of directional lights, the loop stops at this instead of the block size.
+		 * @note Point and spot lights are looked up per cluster, so their counts are not compiled in.
+		 */
+		uint8_t dirLights = 0U;
+
+		/** Packs every option into one value so variants can be compared without building strings. */
+		_NODISCARD constexpr uint64_t key() const noexcept
+		{
+			return (uint64_t)useTextures
+				| (uint64_t)fullbright << 1U
+				| (uint64_t)depthBuffer << 2U
+				| (uint64_t)deferred << 3U
+				| (uint64_t)dirLights << 8U;
+		}
+		/** The lines of "#define NAME VALUE" to load the variant with. */
+		_NODISCARD std::string defines() const;
+	};
+
+	/** A precomputed handle to a uniform, create these with shader::uniform("u_name") at compile time. */
+	using uniformId = uint32_t;
+
+	/** Hashes the name of a uniform (FNV-1a), constexpr so hot paths never hash at runtime.
+	 * @param _name The name exactly as it appears in glsl, e.g. "u_dirLights[0].direction".
+	 * @return [uniformId] The handle used to look the uniform up.
+	 */
+	_NODISCARD static constexpr uniformId uniform(const char *_name) noexcept
+	{
+		uint32_t hash = 2166136261U;
+		for (; *_name; ++_name)
+		{	hash = (hash ^ (uint8_t)*_name) * 16777619U; }
+		return hash;
+	}
+
 private:
+	/** Everything known about an active uniform, filled in once after linking. */
+	struct uniformEntry
+	{
+		uniformId id = 0U;
+		int32_t location = -1;	// -1 marks an empty slot
+		bool hasValue = false;	// Nothing is cached until the first write
+		uint8_t value[64];	// The last value written, big enough for a mat4
+	};
+
 	/** Used for selecting which part of the shader to use for functions. */
 	enum class shaderType: uint8_t
 	{
@@ -25,24 +104,63 @@ private:
 	};
 
 	bool m_shaderLoaded = false;
+	/** Submitted to the driver but not yet checked, isLoaded stays false until it is. */
+	bool m_pending = false;
 	uint32_t m_idProgram, m_idVertex, m_idFragment;
 	std::string m_shaderPath = "";	// The file path of the shaders
+	std::string m_defines = "";	// Injected after the #version line of both stages
+	uint64_t m_cacheKey = 0U;	// Where the program binary is stored once linked
+	/** Owners sharing this shader, it is deleted when the last one releases it. */
+	uint32_t m_refCount = 1U;
+	/** Flat open addressing table of uniforms, the size is always a power of two. */
+	mutable std::vector<uniformEntry> m_uniforms = std::vector<uniformEntry>();
 
-	void loadShader(const shaderType _type, bool _useFallback = false);
-	/** Attempts to read a shader from a file, and if successful, attempts to compile it.
+	/** Hands one stage to the driver to compile, errors are only checked once the program is linked.
+	 * @param _type The type of shader being compiled.
+	 * @param _code The source with defines already injected.
+	 */
+	void loadShader(const shaderType _type, const std::string &_code);
+	/** Attempts to read a shader from a file.
 	 * @param _type The type of shader being read in.
-	 * @return [bool] If reading and compiling was a success.
+	 * @param _outCode Receives the source, cleared if reading failed.
+	 * @return [bool] If reading was a success.
 	 */
-	bool readFile(const shaderType _type);
+	bool readFile(const shaderType _type, std::string *_outCode);
 	void loadFallback(const shaderType _type);
 
+	/** Places the defines on the line after #version, where glsl requires them to be. */
+	_NODISCARD std::string injectDefines(const char *_code) const;
+
+	/** Creates and compiles a shader object without waiting for the result. */
+	void submitShader(
+		uint32_t *_id,
+		shaderType _type,
+		const char *_code
+	) noexcept;
 	_NODISCARD bool compileShader(
 		uint32_t *_id,
 		shaderType _type,
 		const char *_code
 	) noexcept;
 
-	void createShaderProgram() noexcept;
+	/** Checks the finished stages and link, swapping in the fallback for any stage that failed. */
+	void completeProgram() noexcept;
+	/** Checks the link of the program, setting it up if it succeeded. */
+	void verifyProgram() noexcept;
+	/** Everything a freshly linked or binary loaded program needs before use. */
+	void setupProgram() noexcept;
+	/** Enumerates the active uniforms of the linked program into the uniform table. */
+	void reflectUniforms() noexcept;
+	void insertUniform(const std::string &_name, const int32_t _location) noexcept;
+	_NODISCARD uniformEntry *findUniform(const uniformId _id) const noexcept;
+	/** Compares a value against the last one written and stores it.
+	 * @return [bool] True if the value differs and has to be sent to the gpu.
+	 */
+	_NODISCARD static bool cacheValue(
+		uniformEntry *_entry,
+		const void *_value,
+		const uint8_t _size
+	) noexcept;
 
 	_NODISCARD bool checkForErrors(
 		const uint32_t _shaderID,
@@ -65,37 +183,92 @@ private:
 	) const noexcept;
 
 public:
+	/** Gets a shared shader, only compiling it if no identical one is loaded already.
+	 * @param _shaderPath The path of the vertex and fragment shader, nullptr or empty for the fallback.
+	 * @param _defines Lines of "#define NAME VALUE" prepended to both stages.
+	 * @return [shader*] The shader, must be handed back with release().
+	 */
+	_NODISCARD static shader *acquire(
+		const std::string *_shaderPath = nullptr,
+		const std::string &_defines = ""
+	);
+	/** Gives up a reference to a shader, deleting it once nothing uses it.
+	 * @note Also accepts shaders created with new, which start with a single reference.
+	 */
+	static void release(shader *_shader) noexcept;
+	/** The amount of distinct programs held by the library. */
+	_NODISCARD static size_t libraryCount() noexcept;
+	/** The built in shader, always compiled and ready to draw with.
+	 * @note Used in place of any shader that is still compiling.
+	 */
+	_NODISCARD static shader *fallback();
+	/** Completes every shader the driver has finished with, call once per frame. */
+	static void pollPending() noexcept;
+	/** The amount of shaders still waiting on the driver. */
+	_NODISCARD static size_t pendingCount() noexcept;
+	/** Releases the fallback shader, call before the context is destroyed. */
+	static void terminate() noexcept;
+
 	/** Just calls load.
 	 * @param _shaderPath The relative path of the vertex and fragment shader and their name.
+	 * @param _defines Lines of "#define NAME VALUE" prepended to both stages.
 	 */
-	shader(const std::string *_shaderPath = nullptr);
+	shader(const std::string *_shaderPath = nullptr, const std::string &_defines = "");
 	~shader();
 
 	/** Deletes the currently used shader program. */
 	void destroy() noexcept;
-	/** Given a path, will load and compile a shader.
+	/** Given a path, will load and submit a shader for compiling.
 	 * @param _shaderPath The relative path of the vertex and fragment shader and their name.
 	 * @note The vertex and fragment shaders must have the same name, the path does not require the extension.
+	 * @note Compiling happens in the background, the shader is not usable until isLoaded is true.
 	 */
-	void load(const std::string *_shaderPath = nullptr);
+	void load(const std::string *_shaderPath = nullptr, const std::string &_defines = "");
+	/** Completes the shader if the driver has finished with it, never blocks.
+	 * @return [bool] If the shader is loaded.
+	 */
+	bool poll() noexcept;
+	/** Waits for the driver and completes the shader. */
+	void finish() noexcept;
 	/** Makes this shader the active shader. */
 	void use() const noexcept;
 
-	_NODISCARD constexpr bool isLoaded() const noexcept;
-
-	bool setBool   (const std::string _name, bool       _value, std::string &_msg) const noexcept;
-	bool setInt    (const std::string _name, int32_t    _value, std::string &_msg) const noexcept;
-	bool setUint   (const std::string _name, uint32_t   _value, std::string &_msg) const noexcept;
-	bool setFloat  (const std::string _name, float      _value, std::string &_msg) const noexcept;
-	bool setFloat2 (const std::string _name, glm::vec2 *_value, std::string &_msg) const noexcept;
-	bool setFloat2 (const std::string _name, glm::vec2  _value, std::string &_msg) const noexcept;
-	bool setFloat3 (const std::string _name, glm::vec3 *_value, std::string &_msg) const noexcept;
-	bool setFloat3 (const std::string _name, glm::vec3  _value, std::string &_msg) const noexcept;
-	bool setFloat4 (const std::string _name, glm::vec4 *_value, std::string &_msg) const noexcept;
-	bool setFloat4 (const std::string _name, glm::vec4  _value, std::string &_msg) const noexcept;
-	bool setMat3   (const std::string _name, glm::mat3 *_value, std::string &_msg) const noexcept;
-	bool setMat3   (const std::string _name, glm::mat3  _value, std::string &_msg) const noexcept;
-	bool setMat4   (const std::string _name, glm::mat4 *_value, std::string &_msg) const noexcept;
-	bool setMat4   (const std::string _name, glm::mat4  _value, std::string &_msg) const noexcept;
+	_NODISCARD bool isLoaded() const noexcept
+	{	return m_shaderLoaded; }
+	_NODISCARD const std::string &getPath() const noexcept
+	{	return m_shaderPath; }
+	_NODISCARD uint32_t getProgramId() const noexcept
+	{	return m_idProgram; }
+	_NODISCARD bool isPending() const noexcept
+	{	return m_pending; }
+
+	/** The string setters hash the name at runtime, prefer the uniformId overloads for anything per frame. */
+	bool setBool   (const std::string &_name, bool       _value, std::string &_msg) const noexcept;
+	bool setInt    (const std::string &_name, int32_t    _value, std::string &_msg) const noexcept;
+	bool setUint   (const std::string &_name, uint32_t   _value, std::string &_msg) const noexcept;
+	bool setFloat  (const std::string &_name, float      _value, std::string &_msg) const noexcept;
+	bool setFloat2 (const std::string &_name, glm::vec2 *_value, std::string &_msg) const noexcept;
+	bool setFloat2 (const std::string &_name, glm::vec2  _value, std::string &_msg) const noexcept;
+	bool setFloat3 (const std::string &_name, glm::vec3 *_value, std::string &_msg) const noexcept;
+	bool setFloat3 (const std::string &_name, glm::vec3  _value, std::string &_msg) const noexcept;
+	bool setFloat4 (const std::string &_name, glm::vec4 *_value, std::string &_msg) const noexcept;
+	bool setFloat4 (const std::string &_name, glm::vec4  _value, std::string &_msg) const noexcept;
+	bool setMat3   (const std::string &_name, glm::mat3 *_value, std::string &_msg) const noexcept;
+	bool setMat3   (const std::string &_name, glm::mat3  _value, std::string &_msg) const noexcept;
+	bool setMat4   (const std::string &_name, glm::mat4 *_value, std::string &_msg) const noexcept;
+	bool setMat4   (const std::string &_name, glm::mat4  _value, std::string &_msg) const noexcept;
+
+	/** Writes are skipped when the value matches the last one written.
+	 * @return [bool] False if the shader has no such active uniform.
+	 */
+	bool setBool   (const uniformId _id, const bool       _value) const noexcept;
+	bool setInt    (const uniformId _id, const int32_t    _value) const noexcept;
+	bool setUint   (const uniformId _id, const uint32_t   _value) const noexcept;
+	bool setFloat  (const uniformId _id, const float      _value) const noexcept;
+	bool setFloat2 (const uniformId _id, const glm::vec2 &_value) const noexcept;
+	bool setFloat3 (const uniformId _id, const glm::vec3 &_value) const noexcept;
+	bool setFloat4 (const uniformId _id, const glm::vec4 &_value) const noexcept;
+	bool setMat3   (const uniformId _id, const glm::mat3 &_value) const noexcept;
+	bool setMat4   (const uniformId _id, const glm::mat4 &_value) const noexcept;
 };
 }
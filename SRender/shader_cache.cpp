@@ -0,0 +1,171 @@
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include "shader_cache.hpp"
+#include "renderer.hpp"
+#include "debug.hpp"
+
+using std::string;
+using std::vector;
+using std::ifstream;
+using std::ofstream;
+
+namespace srender
+{
+namespace shaderCache
+{
+	/** Written at the start of every file to catch stale or foreign files. */
+	struct fileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		uint32_t format;
+		uint32_t byteSize;
+	};
+
+	constexpr uint32_t fileMagic() { return 0x42505253U; }	// "SRPB"
+	constexpr uint32_t fileVersion() { return 1U; }
+
+	bool l_enabled = false;
+	string l_directory = "";
+	/** Hashed once, it is part of every key. */
+	uint64_t l_driverHash = 0U;
+	stats l_stats;
+
+	_NODISCARD inline uint64_t hashBytes(
+		const void *_data,
+		const size_t _size,
+		uint64_t _hash = 14695981039346656037ULL
+	) noexcept
+	{
+		// FNV-1a
+		const uint8_t *bytes = (const uint8_t*)_data;
+		for (size_t i = 0; i < _size; ++i)
+		{	_hash = (_hash ^ bytes[i]) * 1099511628211ULL; }
+		return _hash;
+	}
+
+	_NODISCARD inline string filePath(const uint64_t _key)
+	{
+		char name[17];
+		std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)_key);
+		return l_directory + name + ".bin";
+	}
+
+	void init(const string &_directory) noexcept
+	{
+		if (!renderer::supportsProgramBinary())
+		{
+			#ifdef _VERBOSE
+				debug::send(
+					"Program binaries unsupported, shader cache disabled",
+					debug::type::note, debug::impact::small, debug::stage::mid
+				);
+			#endif
+			return;
+		}
+
+		std::error_code error;
+		std::filesystem::create_directories(_directory, error);
+		if (error)
+		{
+			debug::send(
+				"SHADER_CACHE::FAILED_TO_CREATE_DIRECTORY::\"" + _directory + "\"",
+				debug::type::note, debug::impact::large, debug::stage::mid
+			);
+			return;
+		}
+
+		const string driver = renderer::getDriverString();
+		l_driverHash = hashBytes(driver.data(), driver.size());
+		l_directory = _directory;
+		l_enabled = true;
+	}
+
+	uint64_t makeKey(const string &_vertexCode, const string &_fragmentCode) noexcept
+	{
+		uint64_t key = hashBytes(&l_driverHash, sizeof(l_driverHash));
+		key = hashBytes(_vertexCode.data(), _vertexCode.size(), key);
+		// Separator so moving text between the stages changes the key
+		key = hashBytes("\0", 1U, key);
+		return hashBytes(_fragmentCode.data(), _fragmentCode.size(), key);
+	}
+
+	uint32_t load(const uint64_t _key) noexcept
+	{
+		if (!l_enabled)
+		{	return 0U; }
+
+		const string path = filePath(_key);
+		ifstream file(path, std::ios::binary);
+		fileHeader header = {};
+		vector<uint8_t> data;
+		if (file && file.read((char*)&header, sizeof(header))
+			&& header.magic == fileMagic()
+			&& header.version == fileVersion()
+			&& header.key == _key)
+		{
+			data.resize(header.byteSize);
+			if (!file.read((char*)data.data(), header.byteSize))
+			{	data.clear(); }
+		}
+		file.close();
+
+		if (data.empty())
+		{
+			++l_stats.misses;
+			return 0U;
+		}
+
+		uint32_t idProgram = renderer::createShaderProgramFromBinary(
+			header.format,
+			data.data(),
+			(uint32_t)data.size()
+		);
+
+		if (!idProgram)
+		{
+			// Usually a driver update, the program gets compiled and the file replaced
+			++l_stats.rejected;
+			++l_stats.misses;
+			std::error_code error;
+			std::filesystem::remove(path, error);
+			return 0U;
+		}
+
+		++l_stats.hits;
+		return idProgram;
+	}
+
+	void store(const uint64_t _key, const uint32_t _idProgram) noexcept
+	{
+		if (!l_enabled)
+		{	return; }
+
+		vector<uint8_t> data;
+		fileHeader header = { fileMagic(), fileVersion(), _key, 0U, 0U };
+		if (!renderer::getProgramBinary(_idProgram, &data, &header.format))
+		{	return; }
+		header.byteSize = (uint32_t)data.size();
+
+		ofstream file(filePath(_key), std::ios::binary | std::ios::trunc);
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)data.data(), data.size());
+
+		if (!file)
+		{
+			debug::send(
+				"SHADER_CACHE::FAILED_TO_WRITE::\"" + filePath(_key) + "\"",
+				debug::type::note, debug::impact::large, debug::stage::mid
+			);
+		}
+	}
+
+	bool getEnabled() noexcept
+	{	return l_enabled; }
+
+	stats getStats() noexcept
+	{	return l_stats; }
+}
+}
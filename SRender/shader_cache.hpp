@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <stdint.h>
+
+#ifndef _NODISCARD
+#define _NODISCARD [[nodiscard]]
+#endif
+
+namespace srender
+{
+/** Keeps linked program binaries on disk so later launches can skip compiling glsl.
+ * Binaries are keyed by a hash of both sources, which include any defines, and the driver.
+ * Does nothing if the driver does not support GL_ARB_get_program_binary.
+ */
+namespace shaderCache
+{
+	struct stats
+	{
+		uint32_t hits = 0U;	// Programs loaded from a binary
+		uint32_t misses = 0U;	// Programs that had to be compiled
+		uint32_t rejected = 0U;	// Binaries the driver refused, counted as misses too
+	};
+
+	/** Enables the cache, creating the directory if needed.
+	 * @param _directory Where the binaries are stored, should end with a slash.
+	 * @note Must be called after the renderer is loaded.
+	 */
+	void init(const std::string &_directory) noexcept;
+
+	/** Hashes the final shader sources together with the driver.
+	 * @return [uint64_t] The key for load and store.
+	 */
+	_NODISCARD uint64_t makeKey(
+		const std::string &_vertexCode,
+		const std::string &_fragmentCode
+	) noexcept;
+	/** Tries to create a program from a stored binary.
+	 * @return [uint32_t] The linked program, or 0 if there is no usable binary.
+	 */
+	_NODISCARD uint32_t load(const uint64_t _key) noexcept;
+	/** Writes the binary of a freshly linked program to disk. */
+	void store(const uint64_t _key, const uint32_t _idProgram) noexcept;
+
+	_NODISCARD bool getEnabled() noexcept;
+	_NODISCARD stats getStats() noexcept;
+}
+}
@@ -0,0 +1,404 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+#include "shadows.hpp"
+#include "renderer.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+using glm::vec2;
+using glm::vec3;
+using glm::vec4;
+using glm::mat4;
+using std::vector;
+
+namespace srender
+{
+namespace shadows
+{
+	/** One tile of the atlas and what is drawn into it. */
+	struct view
+	{
+		mat4 viewProjection = mat4(0.0f);	// As last drawn, zero until the first update
+		culling::frustum frustum = culling::frustum();
+		uint32_t x = 0U, y = 0U, size = 0U;	// The tile, in texels from the atlas' bottom left
+		uint32_t light = 0U;	// Index into l_requests
+		uint8_t part = 0U;	// The cascade or cube face
+		bool staticDirty = true;
+		bool dynamicDirty = true;	// Always set along with staticDirty, the dynamic layer is a copy of it
+	};
+
+	/** The sizes of tile a page can be split into, in the order of l_tileSizes. */
+	enum class tileClass: uint8_t
+	{
+		cascade,
+		spot,
+		face,
+		count
+	};
+
+	constexpr uint32_t l_tileSizes[(uint8_t)tileClass::count] = { getCascadeSize(), getSpotSize(), getFaceSize() };
+	constexpr uint32_t l_pagesPerRow = getAtlasSize() / getCascadeSize();
+	/** Close enough for a light inside a small caster to still be outside it. */
+	constexpr float l_nearPlane = 0.05f;
+	/** The depth of cascades is rounded out to this, so a caster moving a little leaves them alone. */
+	constexpr float l_depthStep = 16.0f;
+	/** How far drawn depth is pushed back, enough that surfaces do not shadow themselves. */
+	constexpr float l_slopeBias = 2.0f;
+	constexpr float l_constantBias = 4.0f;
+
+	/** Hands out tiles a page at a time, each page only holds tiles of one size. */
+	struct allocator
+	{
+		uint32_t nextPage = 0U;
+		uint32_t page[(uint8_t)tileClass::count] = {};
+		/** Tiles taken from each class' page, full to begin with so the first tile opens one. */
+		uint32_t used[(uint8_t)tileClass::count] = { UINT32_MAX, UINT32_MAX, UINT32_MAX };
+	};
+
+	/** The way each cube face looks, in the order of the views of a point light. */
+	const vec3 l_faceDirections[6] = {
+		vec3( 1.0f,  0.0f,  0.0f),
+		vec3(-1.0f,  0.0f,  0.0f),
+		vec3( 0.0f,  1.0f,  0.0f),
+		vec3( 0.0f, -1.0f,  0.0f),
+		vec3( 0.0f,  0.0f,  1.0f),
+		vec3( 0.0f,  0.0f, -1.0f)
+	};
+
+	/** Every view is drawn into the static atlas, then copied into the live one and drawn over with the dynamic casters. */
+	uint32_t l_idStaticAtlas = 0U, l_idLiveAtlas = 0U;
+	uint32_t l_idStaticFBO = 0U, l_idLiveFBO = 0U;
+	vector<request> l_requests = vector<request>();
+	vector<view> l_views = vector<view>();
+	/** What the shaders read, getViewTexels per view. */
+	vector<vec4> l_texels = vector<vec4>();
+	bool l_layoutChanged = false;
+	stats l_stats;
+
+	_NODISCARD bool allocate(allocator *_pages, const tileClass _class, uint32_t *_outX, uint32_t *_outY) noexcept
+	{
+		const uint8_t index = (uint8_t)_class;
+		const uint32_t size = l_tileSizes[index];
+		const uint32_t perRow = getCascadeSize() / size;
+		if (_pages->used[index] >= perRow * perRow)
+		{
+			if (_pages->nextPage >= l_pagesPerRow * l_pagesPerRow)
+			{	return false; }
+			_pages->page[index] = _pages->nextPage++;
+			_pages->used[index] = 0U;
+		}
+
+		const uint32_t page = _pages->page[index];
+		const uint32_t slot = _pages->used[index]++;
+		*_outX = (page % l_pagesPerRow) * getCascadeSize() + (slot % perRow) * size;
+		*_outY = (page / l_pagesPerRow) * getCascadeSize() + (slot / perRow) * size;
+		return true;
+	}
+
+	/** Any up that is not along the direction, lookAt needs one. */
+	_NODISCARD inline vec3 upFor(const vec3 &_direction) noexcept
+	{	return std::abs(_direction.y) > 0.99f ? vec3(0.0f, 0.0f, 1.0f) : vec3(0.0f, 1.0f, 0.0f); }
+
+	/** An orthographic view around one slice of the camera's frustum, that only moves in whole texels.
+	 * @param _spread The half size of the camera's view a distance of 1 in front of it, corner to corner.
+	 */
+	_NODISCARD mat4 cascadeMatrix(
+		const request &_light,
+		const float _near,
+		const float _far,
+		const vec3 &_eye,
+		const vec3 &_forward,
+		const float _spread,
+		const culling::bounds &_scene
+	) noexcept
+	{
+		// A sphere around the slice only depends on the projection, so turning the camera never resizes it
+		const float halfDepth = (_far - _near) * 0.5f;
+		const float radius = std::sqrt(_far * _far * _spread * _spread + halfDepth * halfDepth);
+		// The margin lets the centre snap a quarter of the way across without the slice leaving
+		const float half = radius * 1.25f;
+		const float step = half * 0.25f;
+		const mat4 lightView = glm::lookAt(vec3(0.0f), _light.direction, upFor(_light.direction));
+		const vec3 centre = vec3(lightView * vec4(_eye + _forward * (_near + halfDepth), 1.0f));
+		const float x = std::round(centre.x / step) * step;
+		const float y = std::round(centre.y / step) * step;
+
+		// Deep enough for every caster on the way to the slice, as the light looks down the direction
+		float closest = -1.0f, furthest = 1.0f;
+		if (!_scene.empty)
+		{
+			closest = FLT_MAX;
+			furthest = -FLT_MAX;
+			for (uint8_t i = 0; i < 8U; ++i)
+			{
+				const vec3 corner = vec3(
+					i & 1U ? _scene.max.x : _scene.min.x,
+					i & 2U ? _scene.max.y : _scene.min.y,
+					i & 4U ? _scene.max.z : _scene.min.z
+				);
+				const float distance = glm::dot(corner, _light.direction);
+				closest = std::min(closest, distance);
+				furthest = std::max(furthest, distance);
+			}
+			closest = std::floor(closest / l_depthStep) * l_depthStep - l_depthStep;
+			furthest = std::ceil(furthest / l_depthStep) * l_depthStep + l_depthStep;
+		}
+		return glm::ortho(x - half, x + half, y - half, y + half, closest, furthest) * lightView;
+	}
+
+	_NODISCARD mat4 perspectiveMatrix(const request &_light, const vec3 &_direction, const float _fov) noexcept
+	{
+		return glm::perspective(_fov, 1.0f, l_nearPlane, std::max(_light.range, l_nearPlane * 2.0f))
+			* glm::lookAt(_light.position, _light.position + _direction, upFor(_direction));
+	}
+
+	_NODISCARD mat4 spotMatrix(const request &_light) noexcept
+	{
+		const float angle = std::acos(std::clamp(_light.cosAngle, -1.0f, 1.0f));
+		// A perspective projection can not reach 180 degrees, wider cones lose the edge of their shadow
+		return perspectiveMatrix(_light, _light.direction, std::min(angle * 2.0f, glm::radians(160.0f)));
+	}
+
+	/** What the shaders need of a view, its matrix into the atlas and the part of the atlas it may sample. */
+	void writeTexels(const view &_view, vec4 *_out) noexcept
+	{
+		// Clip space onto the tile, and depth from -1 to 1 onto 0 to 1
+		const float texel = 1.0f / (float)getAtlasSize();
+		const float scale = (float)_view.size * texel * 0.5f;
+		const vec2 centre = (vec2((float)_view.x, (float)_view.y) + (float)_view.size * 0.5f) * texel;
+		const mat4 toTile = glm::scale(glm::translate(mat4(1.0f), vec3(centre, 0.5f)), vec3(scale, scale, 0.5f));
+		const mat4 toAtlas = toTile * _view.viewProjection;
+		for (uint8_t i = 0; i < 4U; ++i)
+		{	_out[i] = toAtlas[i]; }
+		// Half a texel in, so filtering never reaches into the next tile
+		const vec2 low = vec2((float)_view.x, (float)_view.y) * texel;
+		const vec2 high = low + (float)_view.size * texel;
+		_out[4] = vec4(low + texel * 0.5f, high - texel * 0.5f);
+	}
+
+	bool init() noexcept
+	{
+		l_idStaticAtlas = renderer::createShadowTexture(getAtlasSize());
+		l_idLiveAtlas = renderer::createShadowTexture(getAtlasSize());
+		l_idStaticFBO = renderer::createFramebuffer(nullptr, 0U, l_idStaticAtlas);
+		l_idLiveFBO = renderer::createFramebuffer(nullptr, 0U, l_idLiveAtlas);
+		if (!l_idStaticFBO || !l_idLiveFBO)
+		{
+			terminate();
+			return false;
+		}
+		return true;
+	}
+
+	void terminate() noexcept
+	{
+		if (l_idStaticFBO)
+		{	renderer::deleteFramebuffer(l_idStaticFBO); }
+		if (l_idLiveFBO)
+		{	renderer::deleteFramebuffer(l_idLiveFBO); }
+		if (l_idStaticAtlas)
+		{	renderer::deleteTextures(&l_idStaticAtlas); }
+		if (l_idLiveAtlas)
+		{	renderer::deleteTextures(&l_idLiveAtlas); }
+		l_idStaticFBO = l_idLiveFBO = 0U;
+		l_idStaticAtlas = l_idLiveAtlas = 0U;
+		l_views.clear();
+		l_texels.clear();
+	}
+
+	void setLights(const request *_requests, const uint32_t _count, int32_t *_outFirstViews) noexcept
+	{
+		vector<view> previous = vector<view>();
+		previous.swap(l_views);
+		l_requests.assign(_requests, _requests + _count);
+		l_stats.lightsSkipped = 0U;
+
+		allocator pages;
+		for (uint32_t i = 0; i < _count; ++i)
+		{
+			_outFirstViews[i] = -1;
+			uint8_t parts = 1U;
+			tileClass size = tileClass::spot;
+			if (_requests[i].type == light::type::directional)
+			{
+				parts = getCascadeCount();
+				size = tileClass::cascade;
+			}
+			else if (_requests[i].type == light::type::point)
+			{
+				parts = 6U;
+				size = tileClass::face;
+			}
+
+			// A light gets every one of its tiles or none of them
+			const allocator before = pages;
+			const size_t first = l_views.size();
+			for (uint8_t part = 0; l_idLiveFBO && part < parts; ++part)
+			{
+				view cur;
+				cur.light = i;
+				cur.part = part;
+				cur.size = l_tileSizes[(uint8_t)size];
+				if (!allocate(&pages, size, &cur.x, &cur.y))
+				{	break; }
+				l_views.push_back(cur);
+			}
+			if (l_views.size() - first < parts)
+			{
+				pages = before;
+				l_views.resize(first);
+				++l_stats.lightsSkipped;
+				continue;
+			}
+			_outFirstViews[i] = (int32_t)first;
+		}
+
+		// A view on the same tile keeps what was drawn there, update then checks its matrix still matches
+		for (size_t i = 0; i < l_views.size() && i < previous.size(); ++i)
+		{
+			view &cur = l_views[i];
+			const view &old = previous[i];
+			if (cur.x == old.x && cur.y == old.y && cur.size == old.size)
+			{
+				cur.viewProjection = old.viewProjection;
+				cur.frustum = old.frustum;
+				cur.staticDirty = old.staticDirty;
+				cur.dynamicDirty = old.dynamicDirty;
+			}
+		}
+		l_stats.views = (uint32_t)l_views.size();
+		l_layoutChanged = true;
+	}
+
+	void casterMoved(const culling::bounds &_bounds, const bool _static) noexcept
+	{
+		for (view &cur : l_views)
+		{
+			if (!culling::testBox(cur.frustum, _bounds))
+			{	continue; }
+			cur.dynamicDirty = true;
+			if (_static)
+			{	cur.staticDirty = true; }
+		}
+	}
+
+	void invalidate() noexcept
+	{
+		for (view &cur : l_views)
+		{	cur.staticDirty = cur.dynamicDirty = true; }
+	}
+
+	bool update(
+		const mat4 &_view,
+		const mat4 &_projection,
+		const float _nearPlane,
+		const culling::bounds &_scene
+	) noexcept
+	{
+		bool changed = l_layoutChanged;
+		l_layoutChanged = false;
+		l_texels.resize(l_views.size() * getViewTexels());
+		if (l_views.empty())
+		{	return changed; }
+
+		const mat4 toWorld = glm::inverse(_view);
+		const vec3 eye = vec3(toWorld[3]);
+		const vec3 forward = -glm::normalize(vec3(toWorld[2]));
+		const float spread = std::sqrt(1.0f / (_projection[0][0] * _projection[0][0]) + 1.0f / (_projection[1][1] * _projection[1][1]));
+		// Practical splits, mostly logarithmic so the near cascades stay sharp
+		float splits[getCascadeCount() + 1U];
+		splits[0] = _nearPlane;
+		for (uint8_t i = 1; i <= getCascadeCount(); ++i)
+		{
+			const float t = (float)i / (float)getCascadeCount();
+			splits[i] = 0.75f * _nearPlane * std::pow(getShadowDistance() / _nearPlane, t)
+				+ 0.25f * (_nearPlane + (getShadowDistance() - _nearPlane) * t);
+		}
+
+		for (size_t i = 0; i < l_views.size(); ++i)
+		{
+			view &cur = l_views[i];
+			const request &source = l_requests[cur.light];
+			mat4 viewProjection;
+			switch (source.type)
+			{
+			case light::type::directional:
+				viewProjection = cascadeMatrix(source, splits[cur.part], splits[cur.part + 1U], eye, forward, spread, _scene);
+				break;
+			case light::type::spot:
+				viewProjection = spotMatrix(source);
+				break;
+			default:
+				viewProjection = perspectiveMatrix(source, l_faceDirections[cur.part], glm::radians(90.0f));
+				break;
+			}
+
+			// Cascades only change when they snap to a new place, so most frames nothing needs drawing
+			if (viewProjection != cur.viewProjection)
+			{
+				cur.viewProjection = viewProjection;
+				cur.frustum = culling::extractFrustum(viewProjection);
+				cur.staticDirty = cur.dynamicDirty = true;
+				changed = true;
+			}
+			writeTexels(cur, &l_texels[i * getViewTexels()]);
+		}
+		return changed;
+	}
+
+	void render(const drawFunc _draw) noexcept
+	{
+		l_stats.staticDrawn = l_stats.dynamicDrawn = 0U;
+		bool outdated = false;
+		for (const view &cur : l_views)
+		{	outdated |= cur.dynamicDirty; }
+		if (!outdated)
+		{	return; }
+
+		renderer::setDepthBias(l_slopeBias, l_constantBias);
+		renderer::bindFramebuffer(l_idStaticFBO);
+		for (view &cur : l_views)
+		{
+			if (!cur.staticDirty)
+			{	continue; }
+			renderer::setViewportRect(cur.x, cur.y, cur.size, cur.size);
+			renderer::clearDepthRect(cur.x, cur.y, cur.size, cur.size);
+			_draw(cur.viewProjection, cur.frustum, true);
+			cur.staticDirty = false;
+			++l_stats.staticDrawn;
+		}
+
+		// Each dynamic layer starts over from its static one, so casters that left it leave nothing behind
+		for (const view &cur : l_views)
+		{
+			if (cur.dynamicDirty)
+			{	renderer::copyDepthRect(l_idStaticFBO, l_idLiveFBO, cur.x, cur.y, cur.size, cur.size); }
+		}
+		renderer::bindFramebuffer(l_idLiveFBO);
+		for (view &cur : l_views)
+		{
+			if (!cur.dynamicDirty)
+			{	continue; }
+			renderer::setViewportRect(cur.x, cur.y, cur.size, cur.size);
+			_draw(cur.viewProjection, cur.frustum, false);
+			cur.dynamicDirty = false;
+			++l_stats.dynamicDrawn;
+		}
+		renderer::setDepthBias(0.0f, 0.0f);
+		renderer::bindFramebuffer(0U);
+	}
+
+	const vec4 *getViewData(uint32_t *_outTexelCount) noexcept
+	{
+		*_outTexelCount = (uint32_t)l_texels.size();
+		return l_texels.data();
+	}
+
+	uint32_t getAtlas() noexcept
+	{	return l_idLiveAtlas; }
+
+	stats getStats() noexcept
+	{	return l_stats; }
+}
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <stdint.h>
+#include "glm/vec3.hpp"
+#include "glm/mat4x4.hpp"
+#include "light.hpp"
+#include "culling.hpp"
+
+#ifndef _NODISCARD
+#define _NODISCARD [[nodiscard]]
+#endif
+
+namespace srender
+{
+/** Shadow maps for every light that casts them, all kept as tiles of one depth atlas and only drawn when they change.
+ * Directional lights get cascades around the camera, spot lights one tile and point lights one tile per cube face.
+ * Each tile is kept twice: once with only the static casters, and once with the dynamic casters drawn over a copy of that.
+ * A tile is drawn again when its matrix changes or a caster inside it moves, and only the dynamic layer
+ * when the caster was dynamic, so a still scene draws no shadows at all.
+ * @note Shaders read every view from the shadowViews texture buffer, as the matrix into the atlas and the tile it may sample.
+ */
+namespace shadows
+{
+	/** One light to make maps for, filled in by graphics. */
+	struct request
+	{
+		light::type type = light::type::directional;
+		glm::vec3 position = glm::vec3(0.0f);
+		glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);	// The way the light travels, normalised
+		float cosAngle = 0.0f;	// Spot lights only, the cosine of the cutoff
+		float range = 0.0f;	// Point and spot lights only, how far the light reaches
+	};
+
+	struct stats
+	{
+		uint32_t views = 0U;	// Cascades, spot tiles and cube faces in the atlas
+		uint32_t staticDrawn = 0U;	// Views whose static layer was drawn again in the last frame
+		uint32_t dynamicDrawn = 0U;	// Views whose dynamic layer was drawn again, this includes the above
+		uint32_t lightsSkipped = 0U;	// Lights that found no room in the atlas and cast no shadow
+	};
+
+	/** Draws one layer of casters into a view, the viewport and framebuffer are already set.
+	 * @param _static True for the static casters, false for the dynamic ones.
+	 */
+	using drawFunc = void(*)(const glm::mat4 &_viewProjection, const culling::frustum &_frustum, const bool _static);
+
+	/** The atlas is split into pages, cascades take a whole page and the other tiles share one. */
+	_NODISCARD constexpr uint32_t getAtlasSize() { return 4096U; }
+	_NODISCARD constexpr uint32_t getCascadeSize() { return 1024U; }
+	_NODISCARD constexpr uint32_t getSpotSize() { return 512U; }
+	_NODISCARD constexpr uint32_t getFaceSize() { return 256U; }
+	/** This must match SHADOW_CASCADES in the shaders. */
+	_NODISCARD constexpr uint8_t getCascadeCount() { return 4U; }
+	/** How far from the camera directional lights still cast shadows, the last cascade ends here. */
+	_NODISCARD constexpr float getShadowDistance() { return 80.0f; }
+	/** Texels a view takes in the shadowViews texture buffer, the matrix into the atlas and then the tile. */
+	_NODISCARD constexpr uint32_t getViewTexels() { return 5U; }
+
+	/** Makes the atlas, without it every light is skipped.
+	 * @return [bool] False if the driver cannot draw into it.
+	 */
+	bool init() noexcept;
+	void terminate() noexcept;
+
+	/** Lays the lights out in the atlas, views that keep their tile keep what was drawn in them.
+	 * @param _outFirstViews Set to each light's first view, in the order of _requests, or -1 if it did not fit.
+	 * Cascades and cube faces follow the first view in order, the faces as +x, -x, +y, -y, +z and -z.
+	 */
+	void setLights(const request *_requests, const uint32_t _count, int32_t *_outFirstViews) noexcept;
+	/** Marks the views a caster's box is in to be drawn again, call with both the old and new box when one moves.
+	 * @param _static Which layer the caster is in, a dynamic caster leaves the static layer alone.
+	 */
+	void casterMoved(const culling::bounds &_bounds, const bool _static) noexcept;
+	/** Every view is drawn again, for changes no box can describe. */
+	void invalidate() noexcept;
+	/** Fits the cascades to the camera and rebuilds every matrix, only views whose matrix changed need drawing.
+	 * @param _view World to view space of the camera.
+	 * @param _scene Around every caster, the cascades are deep enough to reach all of them.
+	 * @return [bool] If the view texels changed and have to be uploaded again.
+	 */
+	bool update(
+		const glm::mat4 &_view,
+		const glm::mat4 &_projection,
+		const float _nearPlane,
+		const culling::bounds &_scene
+	) noexcept;
+	/** Draws every view that is out of date, leaving the screen bound with the viewport unset. */
+	void render(const drawFunc _draw) noexcept;
+
+	/** What update laid out, getViewTexels for each view. */
+	_NODISCARD const glm::vec4 *getViewData(uint32_t *_outTexelCount) noexcept;
+	/** The atlas to sample, with the dynamic casters in it. */
+	_NODISCARD uint32_t getAtlas() noexcept;
+	_NODISCARD stats getStats() noexcept;
+}
+}